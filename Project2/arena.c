@@ -0,0 +1,188 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+// Helpers just used by the arena, static so they can't get linked into other files
+
+static ArenaBlock *arena_grow(Arena *arena, size_t size, size_t align);
+static unsigned int arena_hash(const char *name);
+static int arena_rehash(Arena *arena);
+
+/**
+ * Initializes an empty `Arena`.
+ *
+ * Nothing is allocated until the first `arena_alloc`, so an arena that is never used costs nothing.
+ *
+ * @param[out] arena  Pointer to the `Arena` to initialize.
+ */
+void arena_init(Arena *arena) {
+    arena->blocks = NULL;
+    arena->next_size = ARENA_BLOCK_SIZE;
+    arena->reserved = 0;
+    arena->names = NULL;
+    arena->name_buckets = 0;
+    arena->name_count = 0;
+}
+
+/**
+ * Releases every block of an `Arena` at once, and with them everything allocated from it.
+ *
+ * The arena is left empty and can be used again.
+ *
+ * @param[in,out] arena  Pointer to the `Arena` to release.
+ */
+void arena_release(Arena *arena) {
+    ArenaBlock *block = arena->blocks;
+
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena_init(arena);
+}
+
+/**
+ * Allocates memory that lives until the `Arena` is released.
+ *
+ * Allocations are bumped off the current block, a new block is added when it is full. Blocks
+ * start at `ARENA_BLOCK_SIZE` and double up to `ARENA_BLOCK_MAX`, larger allocations get a block
+ * of their own. The memory is not zeroed and is never freed on its own.
+ *
+ * @param[in,out] arena  Pointer to the `Arena`.
+ * @param[in]     size   Number of bytes.
+ * @param[in]     align  Alignment of the memory, a power of two.
+ * @return               Pointer to the memory, or NULL if memory ran out.
+ */
+void *arena_alloc(Arena *arena, size_t size, size_t align) {
+    ArenaBlock *block = arena->blocks;
+    uintptr_t start;
+
+    if (block != NULL) {
+        start = ((uintptr_t)(block + 1) + block->used + (align - 1)) & ~(uintptr_t)(align - 1);
+        if (start + size <= (uintptr_t)(block + 1) + block->size) {
+            block->used = start + size - (uintptr_t)(block + 1);
+            return (void *)start;
+        }
+    }
+    block = arena_grow(arena, size, align);
+    if (block == NULL) {
+        return NULL;
+    }
+    start = ((uintptr_t)(block + 1) + (align - 1)) & ~(uintptr_t)(align - 1);
+    block->used = start + size - (uintptr_t)(block + 1);
+    return (void *)start;
+}
+
+/**
+ * Copies a name into an `Arena` once, however many objects are given that name.
+ *
+ * @param[in,out] arena  Pointer to the `Arena`.
+ * @param[in]     name   Name to intern.
+ * @return               The arena's copy of the name, which must not be changed, or NULL if memory ran out.
+ */
+char *arena_intern(Arena *arena, const char *name) {
+    unsigned int hash = arena_hash(name);
+    size_t length = strlen(name);
+    ArenaName *entry;
+
+    if (arena->name_count >= arena->name_buckets && !arena_rehash(arena) && arena->names == NULL) {
+        return NULL;
+    }
+    for (entry = arena->names[hash & (arena->name_buckets - 1)]; entry != NULL; entry = entry->next) {
+        if (entry->hash == hash && strcmp(entry->text, name) == 0) {
+            return entry->text;
+        }
+    }
+
+    entry = (ArenaName *)arena_alloc(arena, sizeof(ArenaName) + length + 1, _Alignof(ArenaName));
+    if (entry == NULL) {
+        return NULL;
+    }
+    entry->hash = hash;
+    memcpy(entry->text, name, length + 1);
+    entry->next = arena->names[hash & (arena->name_buckets - 1)];
+    arena->names[hash & (arena->name_buckets - 1)] = entry;
+    arena->name_count++;
+    return entry->text;
+}
+
+/**
+ * Adds a block to an `Arena` big enough for an allocation that did not fit the current one.
+ *
+ * The unused end of the current block is given up, since blocks are only ever bumped forward.
+ *
+ * @param[in,out] arena  Pointer to the `Arena`.
+ * @param[in]     size   Bytes of the allocation.
+ * @param[in]     align  Alignment of the allocation.
+ * @return               The new block, now the arena's first, or NULL if memory ran out.
+ */
+static ArenaBlock *arena_grow(Arena *arena, size_t size, size_t align) {
+    size_t block_size = arena->next_size;
+    ArenaBlock *block;
+
+    if (size + align > block_size) {
+        block_size = size + align;
+    }
+    else if (arena->next_size < ARENA_BLOCK_MAX) {
+        arena->next_size *= 2;
+    }
+    block = (ArenaBlock *)malloc(sizeof(ArenaBlock) + block_size);
+    if (block == NULL) {
+        perror("Failed to allocate memory for the arena");
+        return NULL;
+    }
+    block->size = block_size;
+    block->used = 0;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->reserved += block_size;
+    return block;
+}
+
+/**
+ * Hashes a name for the arena's name table (FNV-1a).
+ *
+ * @param[in] name  Name to hash.
+ * @return          Hash of the name.
+ */
+static unsigned int arena_hash(const char *name) {
+    unsigned int hash = 2166136261u;
+
+    for (const unsigned char *c = (const unsigned char *)name; *c != '\0'; c++) {
+        hash = (hash ^ *c) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Doubles the buckets of the arena's name table, starting at `ARENA_NAME_BUCKETS`.
+ *
+ * The new buckets come from the arena as well, the old ones are simply left behind.
+ *
+ * @param[in,out] arena  Pointer to the `Arena`.
+ * @return               Non-zero on success; zero if memory ran out (the table keeps its buckets).
+ */
+static int arena_rehash(Arena *arena) {
+    int buckets = (arena->name_buckets > 0) ? arena->name_buckets * 2 : ARENA_NAME_BUCKETS;
+    ArenaName **names = (ArenaName **)arena_alloc(arena, (size_t)buckets * sizeof(ArenaName *), _Alignof(ArenaName *));
+
+    if (names == NULL) {
+        return 0;
+    }
+    memset(names, 0, (size_t)buckets * sizeof(ArenaName *));
+    for (int i = 0; i < arena->name_buckets; i++) {
+        ArenaName *entry = arena->names[i];
+        while (entry != NULL) {
+            ArenaName *next = entry->next;
+            entry->next = names[entry->hash & (buckets - 1)];
+            names[entry->hash & (buckets - 1)] = entry;
+            entry = next;
+        }
+    }
+    arena->names = names;
+    arena->name_buckets = buckets;
+    return 1;
+}
@@ -0,0 +1,1273 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Micro and macro benchmarks of the simulator's hot paths, run by `make bench`.
+//
+//     p2bench            every benchmark, results as JSON on stdout
+//     p2bench --quick    a tenth of the work, for a quick look
+//
+// Each result is one object of the "results" array with the benchmark's "name", its
+// parameters and its measurements. Times are nanoseconds of wall clock time.
+
+#define BENCH_MAX_PRODUCERS 8       // Most producer threads of the contended queue benchmark
+#define BENCH_QUEUE_EVENTS 200000   // Events pushed by every producer, in total
+#define BENCH_QUEUE_ROUND 1000      // Events pushed then popped per round of the uncontended benchmark
+#define BENCH_RESOURCE_OPS 1000000  // Consume and store pairs per thread
+#define BENCH_RECIPE_INPUTS 8       // Most inputs of a recipe in the recipe benchmark
+#define BENCH_RECIPE_OPS 200000     // Recipe transactions per thread
+#define BENCH_HOT_THREADS 4         // Most threads storing into one resource
+#define BENCH_HOT_OPS 1000000       // Stores per thread into the hot resource
+#define BENCH_RUN_VIRTUAL_MS 10000  // Simulated milliseconds of each virtual end-to-end run
+#define BENCH_RUN_POOL_MS 1000      // Wall clock milliseconds of each end-to-end run on the pool
+#define BENCH_MAX_PARTITIONS 8      // Most partitions of the partitioned end-to-end runs
+#define BENCH_RUN_CONTROL_MS 60000  // Simulated milliseconds of each run of the controller benchmark
+#define BENCH_CHECKPOINT_MS 1000    // Simulated milliseconds run before each checkpoint
+#define BENCH_BRANCHES 8            // Managers restored from each checkpoint
+#define BENCH_TRACE_MS 2000         // Simulated milliseconds of each recorded run of the replay benchmark
+#define BENCH_LIFETIME_SYSTEMS 100000  // Systems set up and torn down by each lifetime benchmark, across all its runs
+
+// Where results are written and whether one has been written yet
+typedef struct BenchOutput {
+    FILE *stream;
+    int results;
+} BenchOutput;
+
+// Shared by the producer threads of the contended queue benchmark
+typedef struct BenchQueue {
+    EventQueue *queue;
+    int events;             // Events each producer pushes
+    System systems[BENCH_MAX_PRODUCERS];  // One reporting system per producer, only their addresses are used
+    Resource resource;
+    atomic_int started;     // Producers ready to push
+    atomic_int go;          // Set once every producer is ready
+    atomic_int finished;    // Producers done pushing
+} BenchQueue;
+
+// Argument of one producer thread
+typedef struct BenchProducer {
+    BenchQueue *bench;
+    int index;
+    pthread_t thread;
+} BenchProducer;
+
+// Shared by the threads of the resource contention benchmark
+typedef struct BenchResource {
+    Resource *resource;
+    long ops;
+    atomic_int started;
+    atomic_int go;
+} BenchResource;
+
+// Shared by the threads of the recipe benchmark, each thread has its own inputs unless they are shared
+typedef struct BenchRecipe {
+    Resource *resources[2][BENCH_RECIPE_INPUTS];
+    ResourceAmount inputs[2][BENCH_RECIPE_INPUTS];
+    int input_count;
+    int shared;
+    long ops;
+    atomic_int started;
+    atomic_int go;
+} BenchRecipe;
+
+// Argument of one recipe thread
+typedef struct BenchRecipeWorker {
+    BenchRecipe *bench;
+    int index;
+    pthread_t thread;
+} BenchRecipeWorker;
+
+// Shared by the threads of the hot resource benchmark
+typedef struct BenchHot {
+    Resource *resource;
+    long ops;
+    atomic_int started;
+    atomic_int go;
+} BenchHot;
+
+// Shared by the threads of the neighbouring resources benchmark, each thread has a resource of its own
+typedef struct BenchNeighbours {
+    Resource *resources[BENCH_HOT_THREADS];
+    long ops;
+    atomic_int started;
+    atomic_int go;
+} BenchNeighbours;
+
+// Argument of one neighbouring resources thread
+typedef struct BenchNeighbour {
+    BenchNeighbours *bench;
+    int index;
+    pthread_t thread;
+} BenchNeighbour;
+
+static void bench_begin(BenchOutput *out, const char *name);
+static void bench_end(BenchOutput *out);
+static void bench_queue_uncontended(BenchOutput *out, int backend, int rounds);
+static void bench_queue_contended(BenchOutput *out, int backend, int policy, int producers, int events);
+static void *bench_producer_thread(void *args);
+static void bench_resource(BenchOutput *out, int threads, long ops);
+static void *bench_resource_thread(void *args);
+static void bench_recipe(BenchOutput *out, int inputs, int threads, int shared, long ops);
+static void *bench_recipe_thread(void *args);
+static void bench_hot_resource(BenchOutput *out, int threads, int quota, long ops);
+static void *bench_hot_thread(void *args);
+static void bench_neighbours(BenchOutput *out, int threads, long ops);
+static void *bench_neighbour_thread(void *args);
+static void bench_array_growth(BenchOutput *out, int count);
+static void bench_load_copies(Manager *manager, int systems);
+static void bench_run_virtual(BenchOutput *out, int systems, long long limit_ms);
+static void bench_load_fleet(Manager *manager, int systems);
+static void bench_run_fleet(BenchOutput *out, int systems, long long limit_ms, int tick);
+static void bench_run_pool(BenchOutput *out, int systems, int workers, long long duration_ms);
+static void bench_run_partitioned(BenchOutput *out, int systems, int partitions, int workers, long long duration_ms);
+static void bench_load_pipeline(Manager *manager);
+static void bench_run_control(BenchOutput *out, int policy, long long limit_ms);
+static void bench_checkpoint(BenchOutput *out, int systems, long long limit_ms);
+static void bench_replay(BenchOutput *out, int systems, int policy, long long limit_ms);
+static void bench_lifetime(BenchOutput *out, int systems, int runs);
+static long bench_rss_kb(void);
+static const char *bench_backend_name(int backend);
+static const char *bench_control_name(int policy);
+
+int main(int argc, char *argv[]) {
+    BenchOutput out = {stdout, 0};
+    int scale = 1;
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    static const int scenario_sizes[] = {4, 100, 1000, 10000};
+
+    if (argc == 2 && strcmp(argv[1], "--quick") == 0) {
+        scale = 10;
+    }
+    else if (argc != 1) {
+        fprintf(stderr, "Usage: %s [--quick]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (cores < 1) {
+        cores = 1;
+    }
+
+    // Tested machine first so results from different hosts are not compared by mistake
+    fprintf(out.stream, "{\n  \"benchmark\": \"p2bench\",\n  \"cores\": %d,\n  \"quick\": %s,\n  \"results\": [",
+            cores, scale > 1 ? "true" : "false");
+
+    // First, while the heap is untouched, so the resident set shows what a Manager keeps
+    for (size_t i = 0; i < sizeof(scenario_sizes) / sizeof(scenario_sizes[0]); i++) {
+        int runs = BENCH_LIFETIME_SYSTEMS / scenario_sizes[i] / scale;
+        bench_lifetime(&out, scenario_sizes[i], runs > 0 ? runs : 1);
+    }
+    for (int backend = EVENT_QUEUE_LOCKED; backend <= EVENT_QUEUE_LOCKFREE; backend++) {
+        bench_queue_uncontended(&out, backend, BENCH_QUEUE_EVENTS * 5 / BENCH_QUEUE_ROUND / scale);
+    }
+    for (int producers = 1; producers <= BENCH_MAX_PRODUCERS; producers *= 2) {
+        bench_queue_contended(&out, EVENT_QUEUE_LOCKED, EVENT_QUEUE_DROP, producers, BENCH_QUEUE_EVENTS / producers / scale);
+        bench_queue_contended(&out, EVENT_QUEUE_LOCKED, EVENT_QUEUE_COALESCE, producers, BENCH_QUEUE_EVENTS / producers / scale);
+        bench_queue_contended(&out, EVENT_QUEUE_LOCKFREE, EVENT_QUEUE_DROP, producers, BENCH_QUEUE_EVENTS / producers / scale);
+    }
+
+    bench_resource(&out, 1, BENCH_RESOURCE_OPS / scale);
+    bench_resource(&out, 2, BENCH_RESOURCE_OPS / scale);
+
+    for (int inputs = 1; inputs <= BENCH_RECIPE_INPUTS; inputs *= 2) {
+        bench_recipe(&out, inputs, 1, 0, BENCH_RECIPE_OPS / scale);
+        bench_recipe(&out, inputs, 2, 0, BENCH_RECIPE_OPS / scale);
+        bench_recipe(&out, inputs, 2, 1, BENCH_RECIPE_OPS / scale);
+    }
+
+    for (int threads = 1; threads <= BENCH_HOT_THREADS; threads *= 2) {
+        bench_hot_resource(&out, threads, 0, BENCH_HOT_OPS / scale);
+        bench_hot_resource(&out, threads, RESOURCE_RELAXED_QUOTA, BENCH_HOT_OPS / scale);
+    }
+    for (int threads = 1; threads <= BENCH_HOT_THREADS; threads *= 2) {
+        bench_neighbours(&out, threads, BENCH_RESOURCE_OPS / scale);
+    }
+
+    for (int count = 1000; count <= 1000000; count *= 10) {
+        bench_array_growth(&out, count);
+    }
+
+    for (size_t i = 0; i < sizeof(scenario_sizes) / sizeof(scenario_sizes[0]); i++) {
+        bench_run_virtual(&out, scenario_sizes[i], BENCH_RUN_VIRTUAL_MS / scale);
+    }
+    for (size_t i = 0; i < sizeof(scenario_sizes) / sizeof(scenario_sizes[0]); i++) {
+        bench_run_fleet(&out, scenario_sizes[i], BENCH_RUN_VIRTUAL_MS / scale, 0);
+        bench_run_fleet(&out, scenario_sizes[i], BENCH_RUN_VIRTUAL_MS / scale, 1);
+    }
+    for (size_t i = 0; i < sizeof(scenario_sizes) / sizeof(scenario_sizes[0]); i++) {
+        bench_run_pool(&out, scenario_sizes[i], cores, BENCH_RUN_POOL_MS / scale);
+    }
+    for (int partitions = 1; partitions <= BENCH_MAX_PARTITIONS; partitions *= 2) {
+        bench_run_partitioned(&out, 1000, partitions, cores, BENCH_RUN_POOL_MS / scale);
+        bench_run_partitioned(&out, 10000, partitions, cores, BENCH_RUN_POOL_MS / scale);
+    }
+    for (int policy = CONTROL_REACTIVE; policy <= CONTROL_PROPORTIONAL; policy++) {
+        bench_run_control(&out, policy, BENCH_RUN_CONTROL_MS / scale);
+    }
+    bench_checkpoint(&out, 1000, BENCH_CHECKPOINT_MS / scale);
+    bench_checkpoint(&out, 10000, BENCH_CHECKPOINT_MS / scale);
+    bench_replay(&out, 1000, CONTROL_REACTIVE, BENCH_TRACE_MS / scale);
+    bench_replay(&out, 10000, CONTROL_REACTIVE, BENCH_TRACE_MS / scale);
+    bench_replay(&out, 1000, CONTROL_PROPORTIONAL, BENCH_TRACE_MS / scale);
+    bench_replay(&out, 10000, CONTROL_PROPORTIONAL, BENCH_TRACE_MS / scale);
+
+    fprintf(out.stream, "\n  ]\n}\n");
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Starts a result object, the caller prints its fields after.
+ *
+ * @param[in,out] out   Pointer to the `BenchOutput`.
+ * @param[in]     name  Name of the benchmark.
+ */
+static void bench_begin(BenchOutput *out, const char *name) {
+    fprintf(out->stream, "%s\n    {\"name\": \"%s\"", out->results > 0 ? "," : "", name);
+    out->results++;
+}
+
+/**
+ * Ends the current result object.
+ *
+ * @param[in,out] out  Pointer to the `BenchOutput`.
+ */
+static void bench_end(BenchOutput *out) {
+    fprintf(out->stream, "}");
+    fflush(out->stream);
+}
+
+/**
+ * Times `event_queue_push` and `event_queue_pop` from a single thread.
+ *
+ * Each round pushes `BENCH_QUEUE_ROUND` events, then pops them all.
+ *
+ * @param[in,out] out      Pointer to the `BenchOutput`.
+ * @param[in]     backend  `EVENT_QUEUE_LOCKED` or `EVENT_QUEUE_LOCKFREE`.
+ * @param[in]     rounds   Number of rounds.
+ */
+static void bench_queue_uncontended(BenchOutput *out, int backend, int rounds) {
+    EventQueue queue;
+    System system;
+    Resource resource;
+    Event event;
+    long long push_ns = 0, pop_ns = 0, start;
+    long popped = 0;
+
+    memset(&system, 0, sizeof(system));
+    memset(&resource, 0, sizeof(resource));
+    event_queue_init_backend(&queue, backend);
+    // Every event is kept, so each push and pop moves one event
+    event_queue_configure(&queue, BENCH_QUEUE_ROUND, EVENT_QUEUE_DROP);
+
+    for (int round = 0; round < rounds; round++) {
+        start = monotonic_now_ns();
+        for (int i = 0; i < BENCH_QUEUE_ROUND; i++) {
+            event_init(&event, &system, &resource, STATUS_LOW, PRIORITY_LOW + i % EVENT_QUEUE_LANES, i);
+            event_queue_push(&queue, &event);
+        }
+        push_ns += monotonic_now_ns() - start;
+
+        start = monotonic_now_ns();
+        while (event_queue_pop(&queue, &event)) {
+            popped++;
+        }
+        pop_ns += monotonic_now_ns() - start;
+    }
+
+    bench_begin(out, "queue_uncontended");
+    fprintf(out->stream, ", \"backend\": \"%s\", \"events\": %ld, \"dropped\": %d, \"push_ns\": %.1f, \"pop_ns\": %.1f",
+            bench_backend_name(backend), (long)rounds * BENCH_QUEUE_ROUND, atomic_load(&queue.dropped),
+            (double)push_ns / ((double)rounds * BENCH_QUEUE_ROUND), popped > 0 ? (double)pop_ns / popped : 0.0);
+    bench_end(out);
+    event_queue_clean(&queue);
+}
+
+/**
+ * Times events going through the queue with several producer threads and the calling thread
+ * draining batches like the manager does.
+ *
+ * Producers push as fast as they can; events the queue refuses are counted as dropped and
+ * events merged into a pending one as coalesced, so every push is accounted for.
+ *
+ * @param[in,out] out        Pointer to the `BenchOutput`.
+ * @param[in]     backend    `EVENT_QUEUE_LOCKED` or `EVENT_QUEUE_LOCKFREE`.
+ * @param[in]     policy     `EVENT_QUEUE_DROP` or `EVENT_QUEUE_COALESCE`.
+ * @param[in]     producers  Number of producer threads, at most `BENCH_MAX_PRODUCERS`.
+ * @param[in]     events     Events pushed by each producer.
+ */
+static void bench_queue_contended(BenchOutput *out, int backend, int policy, int producers, int events) {
+    BenchQueue *bench = (BenchQueue *)calloc(1, sizeof(BenchQueue));
+    BenchProducer workers[BENCH_MAX_PRODUCERS];
+    EventQueue queue;
+    Event batch[MANAGER_BATCH_SIZE];
+    long long start, elapsed;
+    long popped = 0;
+    int count, done, started = 0;
+
+    if (bench == NULL) {
+        return;
+    }
+    event_queue_init_backend(&queue, backend);
+    event_queue_configure(&queue, EVENT_QUEUE_HIGH_WATER, policy);
+    bench->queue = &queue;
+    bench->events = events;
+    atomic_init(&bench->started, 0);
+    atomic_init(&bench->go, 0);
+    atomic_init(&bench->finished, 0);
+
+    for (int i = 0; i < producers; i++) {
+        workers[i].bench = bench;
+        workers[i].index = i;
+        if (pthread_create(&workers[i].thread, NULL, bench_producer_thread, &workers[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+    while (atomic_load(&bench->started) < started) {
+        sched_yield();
+    }
+
+    start = monotonic_now_ns();
+    atomic_store(&bench->go, 1);
+    do {
+        // Read before draining, so events pushed just before the last producer finished are still taken
+        done = (atomic_load(&bench->finished) == started);
+        count = event_queue_drain(&queue, batch, MANAGER_BATCH_SIZE);
+        popped += count;
+        if (count == 0) {
+            // Let the producers run instead of spinning on an empty queue
+            sched_yield();
+        }
+    } while (count > 0 || !done);
+    elapsed = monotonic_now_ns() - start;
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    long pushed = (long)started * events;
+    long dropped = atomic_load(&queue.dropped);
+    bench_begin(out, "queue_contended");
+    fprintf(out->stream, ", \"backend\": \"%s\", \"policy\": \"%s\", \"producers\": %d, \"events\": %ld, "
+            "\"popped\": %ld, \"dropped\": %ld, \"coalesced\": %ld, \"ns_per_event\": %.1f",
+            bench_backend_name(backend), policy == EVENT_QUEUE_COALESCE ? "coalesce" : "drop", started, pushed,
+            popped, dropped, pushed - popped - dropped, pushed > 0 ? (double)elapsed / pushed : 0.0);
+    bench_end(out);
+
+    event_queue_clean(&queue);
+    free(bench);
+}
+
+/**
+ * Pushes the producer's share of events once every producer is ready.
+ *
+ * Each producer reports for its own system with the four statuses in turn, so coalescing
+ * merges only events of the same producer.
+ *
+ * @param[in] args  Pointer to the `BenchProducer`.
+ * @return          NULL.
+ */
+static void *bench_producer_thread(void *args) {
+    BenchProducer *producer = (BenchProducer *)args;
+    BenchQueue *bench = producer->bench;
+    System *system = &bench->systems[producer->index];
+    Event event;
+
+    atomic_fetch_add(&bench->started, 1);
+    while (atomic_load(&bench->go) == 0) {
+        sched_yield();
+    }
+    for (int i = 0; i < bench->events; i++) {
+        event_init(&event, system, &bench->resource, i % 4, PRIORITY_LOW + i % EVENT_QUEUE_LANES, i);
+        event_queue_push(bench->queue, &event);
+    }
+    atomic_fetch_add(&bench->finished, 1);
+    return NULL;
+}
+
+/**
+ * Times `resource_try_consume` and `resource_try_store` with threads sharing one resource,
+ * as the two systems fed by Fuel in `load_data` do.
+ *
+ * @param[in,out] out      Pointer to the `BenchOutput`.
+ * @param[in]     threads  Number of threads, one or two.
+ * @param[in]     ops      Consume and store pairs per thread.
+ */
+static void bench_resource(BenchOutput *out, int threads, long ops) {
+    BenchResource bench;
+    pthread_t workers[2];
+    long long start, elapsed;
+    int started = 0;
+
+    resource_create(&bench.resource, "Fuel", 1000, 2000);
+    if (bench.resource == NULL) {
+        return;
+    }
+    bench.ops = ops;
+    atomic_init(&bench.started, 0);
+    atomic_init(&bench.go, 0);
+
+    for (int i = 0; i < threads && i < 2; i++) {
+        if (pthread_create(&workers[i], NULL, bench_resource_thread, &bench) != 0) {
+            break;
+        }
+        started++;
+    }
+    while (atomic_load(&bench.started) < started) {
+        sched_yield();
+    }
+    start = monotonic_now_ns();
+    atomic_store(&bench.go, 1);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    elapsed = monotonic_now_ns() - start;
+
+    bench_begin(out, "resource_contention");
+    fprintf(out->stream, ", \"threads\": %d, \"ops\": %ld, \"ns_per_op\": %.1f, \"final_amount\": %d",
+            started, 2 * ops * started, started > 0 ? (double)elapsed / (2.0 * ops * started) : 0.0,
+            resource_get_amount(bench.resource));
+    bench_end(out);
+    resource_destroy(bench.resource);
+}
+
+/**
+ * Consumes and stores one unit at a time, leaving the amount where it started.
+ *
+ * @param[in] args  Pointer to the `BenchResource`.
+ * @return          NULL.
+ */
+static void *bench_resource_thread(void *args) {
+    BenchResource *bench = (BenchResource *)args;
+    int stored;
+
+    atomic_fetch_add(&bench->started, 1);
+    while (atomic_load(&bench->go) == 0) {
+        sched_yield();
+    }
+    for (long i = 0; i < bench->ops; i++) {
+        if (resource_try_consume(bench->resource, 1) == STATUS_OK) {
+            resource_try_store(bench->resource, 1, &stored);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Times `resource_try_consume_all` on recipes of `inputs` inputs, each transaction followed by
+ * storing every input back.
+ *
+ * A single input takes the lock-free path and is the baseline. With `shared` the threads run
+ * the same recipe and wait on each other's locks; otherwise each has its own resources, which
+ * shows what the locks cost when nothing is contended.
+ *
+ * @param[in,out] out      Pointer to the `BenchOutput`.
+ * @param[in]     inputs   Inputs of the recipe, at most `BENCH_RECIPE_INPUTS`.
+ * @param[in]     threads  Number of threads, one or two.
+ * @param[in]     shared   Non-zero for the threads to share the resources.
+ * @param[in]     ops      Transactions per thread.
+ */
+static void bench_recipe(BenchOutput *out, int inputs, int threads, int shared, long ops) {
+    BenchRecipe bench;
+    BenchRecipeWorker workers[2];
+    long long start, elapsed;
+    int started = 0, created = 0;
+
+    memset(&bench, 0, sizeof(bench));
+    bench.input_count = inputs;
+    bench.shared = shared;
+    bench.ops = ops;
+    atomic_init(&bench.started, 0);
+    atomic_init(&bench.go, 0);
+    for (int set = 0; set < 2; set++) {
+        for (int i = 0; i < inputs; i++) {
+            resource_create(&bench.resources[set][i], "Input", 1000, 2000);
+            if (bench.resources[set][i] == NULL) {
+                break;
+            }
+            // Ids give the lock order, and the resources of both sets must not share one
+            bench.resources[set][i]->id = set * BENCH_RECIPE_INPUTS + i;
+            bench.resources[set][i]->transactional = (inputs > 1);
+            resource_amount_init(&bench.inputs[set][i], bench.resources[set][i], 1);
+            created++;
+        }
+    }
+
+    for (int i = 0; created == 2 * inputs && i < threads && i < 2; i++) {
+        workers[i].bench = &bench;
+        workers[i].index = i;
+        if (pthread_create(&workers[i].thread, NULL, bench_recipe_thread, &workers[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+    while (atomic_load(&bench.started) < started) {
+        sched_yield();
+    }
+    start = monotonic_now_ns();
+    atomic_store(&bench.go, 1);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    elapsed = monotonic_now_ns() - start;
+
+    if (started > 0) {
+        bench_begin(out, "recipe");
+        fprintf(out->stream, ", \"inputs\": %d, \"threads\": %d, \"shared\": %s, \"transactions\": %ld, \"ns_per_transaction\": %.1f",
+                inputs, started, shared ? "true" : "false", ops * started, (double)elapsed / (ops * started));
+        bench_end(out);
+    }
+    for (int set = 0; set < 2; set++) {
+        for (int i = 0; i < inputs; i++) {
+            resource_destroy(bench.resources[set][i]);
+        }
+    }
+}
+
+/**
+ * Consumes every input of the recipe at once, then stores each back.
+ *
+ * @param[in] args  Pointer to the `BenchRecipeWorker`.
+ * @return          NULL.
+ */
+static void *bench_recipe_thread(void *args) {
+    BenchRecipeWorker *worker = (BenchRecipeWorker *)args;
+    BenchRecipe *bench = worker->bench;
+    const ResourceAmount *inputs = bench->inputs[bench->shared ? 0 : worker->index];
+    int failed, stored;
+
+    atomic_fetch_add(&bench->started, 1);
+    while (atomic_load(&bench->go) == 0) {
+        sched_yield();
+    }
+    for (long i = 0; i < bench->ops; i++) {
+        if (resource_try_consume_all(inputs, bench->input_count, &failed) == STATUS_OK) {
+            for (int k = 0; k < bench->input_count; k++) {
+                resource_try_store(inputs[k].resource, 1, &stored);
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Times threads storing one unit at a time into the same resource, strictly or relaxed.
+ *
+ * The resource has room for half of the stores, so the run also reports any amount above its
+ * capacity, which should stay zero now that relaxed stores reserve their space.
+ *
+ * @param[in,out] out      Pointer to the `BenchOutput`.
+ * @param[in]     threads  Number of threads, at most `BENCH_HOT_THREADS`.
+ * @param[in]     quota    Units each thread may hold back, zero for strict storing.
+ * @param[in]     ops      Stores per thread.
+ */
+static void bench_hot_resource(BenchOutput *out, int threads, int quota, long ops) {
+    BenchHot bench;
+    pthread_t workers[BENCH_HOT_THREADS];
+    long long start, elapsed;
+    int started = 0, capacity = (int)(ops * threads / 2);
+
+    resource_create(&bench.resource, "Distance", 0, capacity);
+    if (bench.resource == NULL) {
+        return;
+    }
+    resource_set_relaxed(bench.resource, quota, RESOURCE_FLUSH_INTERVAL);
+    bench.ops = ops;
+    atomic_init(&bench.started, 0);
+    atomic_init(&bench.go, 0);
+
+    for (int i = 0; i < threads && i < BENCH_HOT_THREADS; i++) {
+        if (pthread_create(&workers[i], NULL, bench_hot_thread, &bench) != 0) {
+            break;
+        }
+        started++;
+    }
+    while (atomic_load(&bench.started) < started) {
+        sched_yield();
+    }
+    start = monotonic_now_ns();
+    atomic_store(&bench.go, 1);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    elapsed = monotonic_now_ns() - start;
+
+    bench_begin(out, "hot_resource");
+    fprintf(out->stream, ", \"threads\": %d, \"quota\": %d, \"stores\": %ld, \"ns_per_store\": %.1f, \"overshoot\": %d",
+            started, quota, ops * started, started > 0 ? (double)elapsed / (ops * started) : 0.0,
+            resource_get_amount(bench.resource) - capacity);
+    bench_end(out);
+    resource_destroy(bench.resource);
+}
+
+/**
+ * Stores one unit at a time into the hot resource, then flushes what it held back.
+ *
+ * @param[in] args  Pointer to the `BenchHot`.
+ * @return          NULL.
+ */
+static void *bench_hot_thread(void *args) {
+    BenchHot *bench = (BenchHot *)args;
+    int stored;
+
+    atomic_fetch_add(&bench->started, 1);
+    while (atomic_load(&bench->go) == 0) {
+        sched_yield();
+    }
+    for (long i = 0; i < bench->ops; i++) {
+        resource_try_store(bench->resource, 1, &stored);
+    }
+    resource_flush_thread();
+    return NULL;
+}
+
+/**
+ * Times threads consuming from and storing into resources of their own, allocated next to each
+ * other from one arena as a scenario's resources are.
+ *
+ * Nothing is shared, so any slowdown as threads are added is false sharing between neighbouring
+ * resources; a `make PADDED=1` build gives every resource its own cache lines and should scale.
+ *
+ * @param[in,out] out      Pointer to the `BenchOutput`.
+ * @param[in]     threads  Number of threads, at most `BENCH_HOT_THREADS`.
+ * @param[in]     ops      Consume and store pairs per thread.
+ */
+static void bench_neighbours(BenchOutput *out, int threads, long ops) {
+    BenchNeighbours bench;
+    BenchNeighbour workers[BENCH_HOT_THREADS];
+    Arena arena;
+    long long start, elapsed;
+    int started = 0, shared = 0;
+
+    arena_init(&arena);
+    for (int i = 0; i < BENCH_HOT_THREADS; i++) {
+        resource_create_arena(&bench.resources[i], "Fuel", 1000, 2000, &arena);
+        if (bench.resources[i] == NULL) {
+            arena_release(&arena);
+            return;
+        }
+    }
+    // Counts the neighbours that start on the cache line the resource before them ends on
+    for (int i = 1; i < BENCH_HOT_THREADS; i++) {
+        uintptr_t end = (uintptr_t)bench.resources[i - 1] + sizeof(Resource) - 1;
+        shared += (end / CACHE_LINE == (uintptr_t)bench.resources[i] / CACHE_LINE);
+    }
+    bench.ops = ops;
+    atomic_init(&bench.started, 0);
+    atomic_init(&bench.go, 0);
+
+    for (int i = 0; i < threads && i < BENCH_HOT_THREADS; i++) {
+        workers[i].bench = &bench;
+        workers[i].index = i;
+        if (pthread_create(&workers[i].thread, NULL, bench_neighbour_thread, &workers[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+    while (atomic_load(&bench.started) < started) {
+        sched_yield();
+    }
+    start = monotonic_now_ns();
+    atomic_store(&bench.go, 1);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    elapsed = monotonic_now_ns() - start;
+
+    bench_begin(out, "neighbouring_resources");
+#ifdef P2_PADDED
+    fprintf(out->stream, ", \"padded\": true");
+#else
+    fprintf(out->stream, ", \"padded\": false");
+#endif
+    fprintf(out->stream, ", \"resource_bytes\": %zu, \"shared_lines\": %d, \"threads\": %d, \"ops\": %ld, \"ns_per_op\": %.1f",
+            sizeof(Resource), shared, started, 2 * ops * started, started > 0 ? (double)elapsed / (2.0 * ops * started) : 0.0);
+    bench_end(out);
+    // Arena resources are not destroyed one by one, only their semaphores need it
+    for (int i = 0; i < BENCH_HOT_THREADS; i++) {
+        sem_destroy(&bench.resources[i]->resource_mutex);
+    }
+    arena_release(&arena);
+}
+
+/**
+ * Consumes and stores one unit at a time on the thread's own resource.
+ *
+ * @param[in] args  Pointer to the thread's `BenchNeighbour`.
+ * @return          NULL.
+ */
+static void *bench_neighbour_thread(void *args) {
+    BenchNeighbour *worker = (BenchNeighbour *)args;
+    BenchNeighbours *bench = worker->bench;
+    Resource *resource = bench->resources[worker->index];
+    int stored;
+
+    atomic_fetch_add(&bench->started, 1);
+    while (atomic_load(&bench->go) == 0) {
+        sched_yield();
+    }
+    for (long i = 0; i < bench->ops; i++) {
+        if (resource_try_consume(resource, 1) == STATUS_OK) {
+            resource_try_store(resource, 1, &stored);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Times adding systems one by one to an empty `SystemArray`.
+ *
+ * @param[in,out] out    Pointer to the `BenchOutput`.
+ * @param[in]     count  Number of systems to add.
+ */
+static void bench_array_growth(BenchOutput *out, int count) {
+    SystemArray array;
+    System *systems = (System *)calloc(count, sizeof(System));
+    long long start, elapsed;
+
+    if (systems == NULL) {
+        return;
+    }
+    system_array_init(&array);
+    start = monotonic_now_ns();
+    for (int i = 0; i < count; i++) {
+        system_array_add(&array, &systems[i]);
+    }
+    elapsed = monotonic_now_ns() - start;
+
+    bench_begin(out, "system_array_add");
+    fprintf(out->stream, ", \"systems\": %d, \"capacity\": %d, \"ns_per_add\": %.1f",
+            count, array.capacity, (double)elapsed / count);
+    bench_end(out);
+
+    // The systems share one allocation, so the array is freed without destroying them
+    free(array.systems);
+    free(systems);
+}
+
+/**
+ * Loads enough copies of the sample scenario for `systems` systems.
+ *
+ * The copies are independent, each with its own four resources. Terminal roles are removed so
+ * every run lasts its whole time limit and does a fixed amount of work.
+ *
+ * @param[in,out] manager  Pointer to the initialized `Manager`.
+ * @param[in]     systems  Number of systems wanted, rounded up to a multiple of four.
+ */
+static void bench_load_copies(Manager *manager, int systems) {
+    DemoParams params;
+
+    demo_params_init(&params);
+    for (int i = 0; i < systems; i += 4) {
+        load_data_params(manager, &params);
+    }
+    for (int i = 0; i < manager->resource_array.size; i++) {
+        manager->resource_array.resources[i]->flags = 0;
+    }
+    manager->log_events = 0;
+    manager->headless = 1;
+}
+
+/**
+ * Runs a scenario of `systems` systems on the virtual clock.
+ *
+ * @param[in,out] out       Pointer to the `BenchOutput`.
+ * @param[in]     systems   Number of systems.
+ * @param[in]     limit_ms  Simulated milliseconds to run for.
+ */
+static void bench_run_virtual(BenchOutput *out, int systems, long long limit_ms) {
+    Manager manager;
+    long long start, elapsed, steps;
+
+    manager_init(&manager);
+    bench_load_copies(&manager, systems);
+
+    start = monotonic_now_ns();
+    steps = manager_run_virtual(&manager, limit_ms * 1000000LL, NULL);
+    elapsed = monotonic_now_ns() - start;
+
+    bench_begin(out, "scenario_virtual");
+    fprintf(out->stream, ", \"systems\": %d, \"simulated_ms\": %lld, \"steps\": %lld, \"wall_ns\": %lld, \"ns_per_step\": %.1f",
+            manager.system_array.size, limit_ms, steps, elapsed, steps > 0 ? (double)elapsed / steps : 0.0);
+    bench_end(out);
+    manager_clean(&manager);
+}
+
+/**
+ * Loads the sample scenario with every system repeated to reach `systems` systems.
+ *
+ * Unlike `bench_load_copies`, the copies share the four resources, whose amounts and capacities
+ * are scaled to match, so the systems form four groups of identical systems.
+ *
+ * @param[in,out] manager  Pointer to the initialized `Manager`.
+ * @param[in]     systems  Number of systems wanted, rounded up to a multiple of four.
+ */
+static void bench_load_fleet(Manager *manager, int systems) {
+    DemoParams params;
+    int copies = (systems + 3) / 4;
+
+    demo_params_init(&params);
+    params.fuel_amount *= copies;
+    params.fuel_capacity *= copies;
+    params.oxygen_amount *= copies;
+    params.oxygen_capacity *= copies;
+    params.energy_amount *= copies;
+    params.energy_capacity *= copies;
+    params.distance_capacity *= copies;
+    load_data_params(manager, &params);
+    for (int i = 0; i < manager->resource_array.size; i++) {
+        manager->resource_array.resources[i]->flags = 0;
+    }
+    manager->log_events = 0;
+    manager->headless = 1;
+
+    for (int copy = 1; copy < copies; copy++) {
+        for (int i = 0; i < 4; i++) {
+            System *original = manager->system_array.systems[i];
+            System *system;
+            system_create_arena(&system, original->name, original->consumed, original->produced, original->processing_time, &manager->event_queue, &manager->arena);
+            system_array_add(&manager->system_array, system);
+        }
+    }
+}
+
+/**
+ * Runs a scenario of `systems` systems sharing four resources on the virtual clock.
+ *
+ * @param[in,out] out       Pointer to the `BenchOutput`.
+ * @param[in]     systems   Number of systems.
+ * @param[in]     limit_ms  Simulated milliseconds to run for.
+ * @param[in]     tick      Non-zero to run on `tick_engine_run` instead of `manager_run_virtual`.
+ */
+static void bench_run_fleet(BenchOutput *out, int systems, long long limit_ms, int tick) {
+    Manager manager;
+    TickEngine engine;
+    long long start, elapsed, steps = 0;
+
+    manager_init(&manager);
+    bench_load_fleet(&manager, systems);
+
+    // Building the engine is part of what a tick run costs
+    start = monotonic_now_ns();
+    if (!tick) {
+        steps = manager_run_virtual(&manager, limit_ms * 1000000LL, NULL);
+    }
+    else if (tick_engine_build(&engine, &manager)) {
+        steps = tick_engine_run(&engine, &manager, limit_ms * 1000000LL);
+        tick_engine_clean(&engine);
+    }
+    elapsed = monotonic_now_ns() - start;
+
+    bench_begin(out, "scenario_fleet");
+    fprintf(out->stream, ", \"engine\": \"%s\", \"systems\": %d, \"simulated_ms\": %lld, \"steps\": %lld, \"wall_ns\": %lld, \"ns_per_step\": %.1f",
+            tick ? "tick" : "heap", manager.system_array.size, limit_ms, steps, elapsed, steps > 0 ? (double)elapsed / steps : 0.0);
+    bench_end(out);
+    manager_clean(&manager);
+}
+
+/**
+ * Runs a scenario of `systems` systems in real time on the worker pool.
+ *
+ * The manager runs on its own thread as in `p2 --pool`. After `duration_ms` every system is
+ * terminated, and the steps taken and their lateness are collected from the systems.
+ *
+ * @param[in,out] out          Pointer to the `BenchOutput`.
+ * @param[in]     systems      Number of systems.
+ * @param[in]     workers      Number of worker threads.
+ * @param[in]     duration_ms  Wall clock milliseconds to run for.
+ */
+static void bench_run_pool(BenchOutput *out, int systems, int workers, long long duration_ms) {
+    Manager manager;
+    Scheduler scheduler;
+    pthread_t manager_thread_id;
+    struct timespec pause;
+    long long total_ns = 0, max_ns = 0;
+    long steps = 0;
+
+    manager_init(&manager);
+    bench_load_copies(&manager, systems);
+    if (!scheduler_init(&scheduler, &manager.system_array, workers)) {
+        manager_clean(&manager);
+        return;
+    }
+    if (pthread_create(&manager_thread_id, NULL, manager_thread, &manager) != 0) {
+        scheduler_clean(&scheduler);
+        manager_clean(&manager);
+        return;
+    }
+    if (!scheduler_start(&scheduler)) {
+        atomic_store(&manager.simulation_running, 0);
+        pthread_join(manager_thread_id, NULL);
+        scheduler_clean(&scheduler);
+        manager_clean(&manager);
+        return;
+    }
+
+    pause.tv_sec = duration_ms / 1000;
+    pause.tv_nsec = (duration_ms % 1000) * 1000000L;
+    while (nanosleep(&pause, &pause) != 0) {
+        // Interrupted by a signal, keep sleeping
+    }
+
+    // Stop the way the manager does on a terminal event, then wake it from its wait
+    atomic_store(&manager.simulation_running, 0);
+    for (int i = 0; i < manager.system_array.size; i++) {
+        system_set_control(manager.system_array.systems[i], TERMINATE, 0);
+    }
+    sem_post(&manager.event_queue.eventQueue_items);
+    pthread_join(manager_thread_id, NULL);
+    scheduler_join(&scheduler);
+    scheduler_clean(&scheduler);
+
+    for (int i = 0; i < manager.system_array.size; i++) {
+        LatenessStats *lateness = &manager.system_array.systems[i]->lateness;
+        steps += lateness->count;
+        total_ns += lateness->total_ns;
+        max_ns = (lateness->max_ns > max_ns) ? lateness->max_ns : max_ns;
+    }
+
+    bench_begin(out, "scenario_pool");
+    fprintf(out->stream, ", \"systems\": %d, \"workers\": %d, \"duration_ms\": %lld, \"steps\": %ld, "
+            "\"lateness_mean_ns\": %.0f, \"lateness_max_ns\": %lld",
+            manager.system_array.size, workers, duration_ms, steps, steps > 0 ? (double)total_ns / steps : 0.0, max_ns);
+    bench_end(out);
+    manager_clean(&manager);
+}
+
+/**
+ * Runs a scenario of `systems` systems in real time split between `partitions` Managers.
+ *
+ * Like `bench_run_pool`, with the copies of the sample scenario shared out between the
+ * partitions as `p2 --partitions --pool` does. The events handled by every Manager show how
+ * event handling grows with the partitions; one partition is the pool run with a coordinator
+ * in front.
+ *
+ * @param[in,out] out          Pointer to the `BenchOutput`.
+ * @param[in]     systems      Number of systems.
+ * @param[in]     partitions   Number of partitions.
+ * @param[in]     workers      Number of worker threads, shared between the partitions, each gets at least one.
+ * @param[in]     duration_ms  Wall clock milliseconds to run for.
+ */
+static void bench_run_partitioned(BenchOutput *out, int systems, int partitions, int workers, long long duration_ms) {
+    Manager manager;
+    PartitionSet set;
+    pthread_t coordinator;
+    struct timespec pause;
+    long events, dropped, steps = 0;
+    int started = 0;
+
+    manager_init(&manager);
+    bench_load_copies(&manager, systems);
+    if (!partition_build(&set, &manager, partitions)) {
+        manager_clean(&manager);
+        return;
+    }
+    if (!partition_start(&set, workers) || pthread_create(&coordinator, NULL, manager_thread, &manager) != 0) {
+        partition_stop(&set);
+        partition_clean(&set);
+        manager_clean(&manager);
+        return;
+    }
+
+    pause.tv_sec = duration_ms / 1000;
+    pause.tv_nsec = (duration_ms % 1000) * 1000000L;
+    while (nanosleep(&pause, &pause) != 0) {
+        // Interrupted by a signal, keep sleeping
+    }
+
+    // Stop the coordinator as a terminal event would, partition_stop terminates the systems
+    atomic_store(&manager.simulation_running, 0);
+    sem_post(&manager.event_queue.eventQueue_items);
+    pthread_join(coordinator, NULL);
+    partition_stop(&set);
+
+    events = manager.events_handled;
+    dropped = atomic_load(&manager.event_queue.dropped);
+    for (int p = 0; p < set.partition_count; p++) {
+        started += set.partitions[p].worker_count;
+        events += set.partitions[p].manager.events_handled;
+        dropped += atomic_load(&set.partitions[p].manager.event_queue.dropped);
+    }
+    for (int i = 0; i < manager.system_array.size; i++) {
+        steps += manager.system_array.systems[i]->lateness.count;
+    }
+
+    bench_begin(out, "scenario_partitioned");
+    fprintf(out->stream, ", \"systems\": %d, \"partitions\": %d, \"shared_resources\": %d, \"workers\": %d, "
+            "\"duration_ms\": %lld, \"steps\": %ld, \"events_handled\": %ld, \"events_per_s\": %.0f, \"events_dropped\": %ld",
+            manager.system_array.size, set.partition_count, set.shared_count, started, duration_ms, steps, events,
+            duration_ms > 0 ? events * 1000.0 / duration_ms : 0.0, dropped);
+    bench_end(out);
+    partition_clean(&set);
+    manager_clean(&manager);
+}
+
+/**
+ * Loads a three stage pipeline whose first stages produce faster than the next ones consume.
+ *
+ * A mine fills Ore four times faster than a smelter turns it into Metal, which it makes faster
+ * than a factory turns Metal into Goods, so both buffers keep running into capacity unless the
+ * controller throttles their producers.
+ *
+ * @param[in,out] manager  Pointer to the initialized `Manager`.
+ */
+static void bench_load_pipeline(Manager *manager) {
+    Resource *ore, *metal, *goods;
+    System *system;
+    ResourceAmount none, amount_in, amount_out;
+
+    resource_create_arena(&ore, "Ore", 0, 100, &manager->arena);
+    resource_create_arena(&metal, "Metal", 0, 100, &manager->arena);
+    resource_create_arena(&goods, "Goods", 0, 100000, &manager->arena);
+    resource_array_add(&manager->resource_array, ore);
+    resource_array_add(&manager->resource_array, metal);
+    resource_array_add(&manager->resource_array, goods);
+
+    resource_amount_init(&none, NULL, 0);
+    resource_amount_init(&amount_out, ore, 10);
+    system_create_arena(&system, "Mine", none, amount_out, 10, &manager->event_queue, &manager->arena);
+    system_array_add(&manager->system_array, system);
+    resource_amount_init(&amount_in, ore, 5);
+    resource_amount_init(&amount_out, metal, 5);
+    system_create_arena(&system, "Smelter", amount_in, amount_out, 20, &manager->event_queue, &manager->arena);
+    system_array_add(&manager->system_array, system);
+    resource_amount_init(&amount_in, metal, 10);
+    resource_amount_init(&amount_out, goods, 1);
+    system_create_arena(&system, "Factory", amount_in, amount_out, 100, &manager->event_queue, &manager->arena);
+    system_array_add(&manager->system_array, system);
+
+    manager->log_events = 0;
+    manager->headless = 1;
+}
+
+/**
+ * Runs the pipeline of `bench_load_pipeline` on the virtual clock under one controller policy.
+ *
+ * Reports the events the manager handled, how often a system's status or pace changed and the
+ * Goods produced, the pipeline's throughput.
+ *
+ * @param[in,out] out       Pointer to the `BenchOutput`.
+ * @param[in]     policy    `CONTROL_*` policy to run with.
+ * @param[in]     limit_ms  Simulated milliseconds to run for.
+ */
+static void bench_run_control(BenchOutput *out, int policy, long long limit_ms) {
+    Manager manager;
+    long long start, elapsed, steps;
+
+    manager_init(&manager);
+    bench_load_pipeline(&manager);
+    if (!manager_set_controller(&manager, policy)) {
+        manager_clean(&manager);
+        return;
+    }
+
+    start = monotonic_now_ns();
+    steps = manager_run_virtual(&manager, limit_ms * 1000000LL, NULL);
+    elapsed = monotonic_now_ns() - start;
+
+    bench_begin(out, "control");
+    fprintf(out->stream, ", \"policy\": \"%s\", \"simulated_ms\": %lld, \"steps\": %lld, \"events\": %ld, \"status_changes\": %ld, \"goods\": %d, \"wall_ns\": %lld",
+            bench_control_name(policy), limit_ms, steps, manager.events_handled, manager.status_changes,
+            resource_get_amount(manager.resource_array.resources[2]), elapsed);
+    bench_end(out);
+    manager_clean(&manager);
+}
+
+/**
+ * Checkpoints a virtual run of `systems` systems and restores `BENCH_BRANCHES` Managers from it.
+ *
+ * The stall is what the run waits for `scenario_checkpoint` to fork, the write what the child
+ * takes until the file is complete. Every branch loads the same file into its own Manager.
+ *
+ * @param[in,out] out       Pointer to the `BenchOutput`.
+ * @param[in]     systems   Number of systems.
+ * @param[in]     limit_ms  Simulated milliseconds to run before the checkpoint.
+ */
+static void bench_checkpoint(BenchOutput *out, int systems, long long limit_ms) {
+    Manager manager;
+    Manager branches[BENCH_BRANCHES];
+    char path[64];
+    struct stat info;
+    long long start, stall, write, restore;
+    long writer;
+    int restored = 0;
+
+    snprintf(path, sizeof(path), "/tmp/p2bench-%d.ckpt", (int)getpid());
+    manager_init(&manager);
+    bench_load_copies(&manager, systems);
+    manager_run_virtual(&manager, limit_ms * 1000000LL, NULL);
+
+    start = monotonic_now_ns();
+    writer = scenario_checkpoint(&manager, path);
+    stall = monotonic_now_ns() - start;
+    if (!scenario_checkpoint_wait(writer) || stat(path, &info) != 0) {
+        manager_clean(&manager);
+        unlink(path);
+        return;
+    }
+    write = monotonic_now_ns() - start;
+
+    start = monotonic_now_ns();
+    for (int i = 0; i < BENCH_BRANCHES; i++) {
+        manager_init(&branches[i]);
+        restored += scenario_load(&branches[i], path);
+    }
+    restore = monotonic_now_ns() - start;
+
+    bench_begin(out, "checkpoint");
+    fprintf(out->stream, ", \"systems\": %d, \"simulated_ms\": %lld, \"bytes\": %lld, \"stall_ns\": %lld, \"write_ns\": %lld, \"branches\": %d, \"restore_ns\": %.1f",
+            manager.system_array.size, limit_ms, (long long)info.st_size, stall, write, restored,
+            (double)restore / BENCH_BRANCHES);
+    bench_end(out);
+    for (int i = 0; i < BENCH_BRANCHES; i++) {
+        manager_clean(&branches[i]);
+    }
+    manager_clean(&manager);
+    unlink(path);
+}
+
+/**
+ * Records a virtual run of `systems` systems into a trace and replays it into a fresh Manager.
+ *
+ * The run is made twice, without and with the trace, so the cost of recording shows. The
+ * replay is the manager's reaction alone: every recorded push handled with no system stepping,
+ * reported per event along with whether it made the recorded status changes.
+ *
+ * @param[in,out] out       Pointer to the `BenchOutput`.
+ * @param[in]     systems   Number of systems.
+ * @param[in]     policy    `CONTROL_*` policy of the run and the replay.
+ * @param[in]     limit_ms  Simulated milliseconds to record.
+ */
+static void bench_replay(BenchOutput *out, int systems, int policy, long long limit_ms) {
+    Manager plain, recorded, replayed;
+    Trace trace;
+    TraceReplay replay;
+    char path[64];
+    struct stat info;
+    long long start, plain_ns, recorded_ns;
+    int ok;
+
+    snprintf(path, sizeof(path), "/tmp/p2bench-%d.trace", (int)getpid());
+    manager_init(&plain);
+    manager_init(&recorded);
+    manager_init(&replayed);
+    bench_load_copies(&plain, systems);
+    bench_load_copies(&recorded, systems);
+    bench_load_copies(&replayed, systems);
+    ok = manager_set_controller(&plain, policy) && manager_set_controller(&recorded, policy)
+         && manager_set_controller(&replayed, policy) && trace_open(&trace, &recorded, path, 1);
+    if (!ok) {
+        manager_clean(&plain);
+        manager_clean(&recorded);
+        manager_clean(&replayed);
+        return;
+    }
+
+    start = monotonic_now_ns();
+    manager_run_virtual(&plain, limit_ms * 1000000LL, NULL);
+    plain_ns = monotonic_now_ns() - start;
+
+    recorded.trace = &trace;
+    recorded.event_queue.trace = &trace;
+    start = monotonic_now_ns();
+    manager_run_virtual(&recorded, limit_ms * 1000000LL, NULL);
+    recorded_ns = monotonic_now_ns() - start;
+    recorded.trace = NULL;
+    recorded.event_queue.trace = NULL;
+    trace_close(&trace);
+
+    if (stat(path, &info) == 0 && trace_replay(&replayed, path, NULL, &replay)) {
+        bench_begin(out, "replay");
+        fprintf(out->stream, ", \"systems\": %d, \"policy\": \"%s\", \"simulated_ms\": %lld, \"bytes\": %lld, \"run_ns\": %lld, \"recorded_run_ns\": %lld, \"events\": %lld, \"replay_ns\": %lld, \"ns_per_event\": %.1f, \"status_changes\": %lld, \"same\": %s",
+                recorded.system_array.size, bench_control_name(policy), limit_ms, (long long)info.st_size, plain_ns, recorded_ns,
+                replay.events, replay.wall_ns, replay.events > 0 ? (double)replay.wall_ns / replay.events : 0.0,
+                replay.replayed_changes, replay.difference < 0 ? "true" : "false");
+        bench_end(out);
+    }
+    manager_clean(&plain);
+    manager_clean(&recorded);
+    manager_clean(&replayed);
+    unlink(path);
+}
+
+/**
+ * Times setting up and tearing down Managers of `systems` systems, as a sweep does for every run.
+ *
+ * Setup is `manager_init` and loading the copies of the sample scenario, teardown is
+ * `manager_clean`, which releases the Manager's arena. The arena's size and the resident set
+ * are read once the first Manager is loaded, the resident set again after the last is torn
+ * down, both relative to before the first run.
+ *
+ * @param[in,out] out      Pointer to the `BenchOutput`.
+ * @param[in]     systems  Number of systems of each Manager.
+ * @param[in]     runs     Number of Managers to set up and tear down.
+ */
+static void bench_lifetime(BenchOutput *out, int systems, int runs) {
+    Manager manager;
+    long long start, setup = 0, teardown = 0;
+    long before = bench_rss_kb(), loaded = before, after;
+    size_t reserved = 0;
+
+    for (int run = 0; run < runs; run++) {
+        start = monotonic_now_ns();
+        manager_init(&manager);
+        bench_load_copies(&manager, systems);
+        setup += monotonic_now_ns() - start;
+        if (run == 0) {
+            loaded = bench_rss_kb();
+            reserved = manager.arena.reserved;
+        }
+
+        start = monotonic_now_ns();
+        manager_clean(&manager);
+        teardown += monotonic_now_ns() - start;
+    }
+    after = bench_rss_kb();
+
+    bench_begin(out, "lifetime");
+    fprintf(out->stream, ", \"systems\": %d, \"runs\": %d, \"setup_ns\": %.1f, \"teardown_ns\": %.1f, \"arena_kb\": %zu, \"rss_loaded_kb\": %ld, \"rss_after_kb\": %ld",
+            systems, runs, (double)setup / runs, (double)teardown / runs, reserved / 1024, loaded - before, after - before);
+    bench_end(out);
+}
+
+/**
+ * Reads the resident set size of the benchmark process.
+ *
+ * @return  Resident memory in kilobytes, zero if it cannot be read.
+ */
+static long bench_rss_kb(void) {
+    FILE *statm = fopen("/proc/self/statm", "r");
+    long pages = 0;
+
+    if (statm == NULL) {
+        return 0;
+    }
+    if (fscanf(statm, "%*s %ld", &pages) != 1) {
+        pages = 0;
+    }
+    fclose(statm);
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * Names an event queue backend for the results.
+ *
+ * @param[in] backend  `EVENT_QUEUE_LOCKED` or `EVENT_QUEUE_LOCKFREE`.
+ * @return             Name of the backend.
+ */
+static const char *bench_backend_name(int backend) {
+    return backend == EVENT_QUEUE_LOCKFREE ? "lockfree" : "locked";
+}
+
+/**
+ * Names a controller policy for the results.
+ *
+ * @param[in] policy  `CONTROL_REACTIVE`, `CONTROL_HYSTERESIS` or `CONTROL_PROPORTIONAL`.
+ * @return            Name of the policy, as given to `--control`.
+ */
+static const char *bench_control_name(int policy) {
+    return policy == CONTROL_PROPORTIONAL ? "proportional" : (policy == CONTROL_HYSTERESIS ? "hysteresis" : "reactive");
+}
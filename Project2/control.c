@@ -0,0 +1,229 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Helpers just used by the controllers, static so they can't get linked into other files
+
+static int control_fill(Resource *resource);
+static void control_apply(Manager *manager, Resource *resource, int status, int pace);
+static void control_pace(Manager *manager, Resource *resource);
+
+/**
+ * Sets up a `Controller` for the resources of a `ResourceArray`.
+ *
+ * Every policy but `CONTROL_REACTIVE` gives the resources watermarks, so systems report
+ * `STATUS_LOW` when they take a resource below `THRESHOLD_RESOURCE_LOW` of its capacity and
+ * `STATUS_HIGH` when they fill it above `THRESHOLD_RESOURCE_HIGH`. Goal resources get no high
+ * watermark, reaching their capacity is the point. Call once the scenario is loaded and before
+ * any system runs.
+ *
+ * @param[out]    controller  Pointer to the `Controller` to set up.
+ * @param[in]     policy      `CONTROL_REACTIVE`, `CONTROL_HYSTERESIS` or `CONTROL_PROPORTIONAL`.
+ * @param[in,out] resources   Pointer to the `ResourceArray` the controller steers.
+ * @return                    Non-zero on success; zero if memory ran out (the controller is then reactive).
+ */
+int controller_init(Controller *controller, int policy, ResourceArray *resources) {
+    int count = (policy != CONTROL_REACTIVE) ? resources->size : 0;
+
+    controller->policy = CONTROL_REACTIVE;
+    controller->resource_count = 0;
+    controller->status = NULL;
+    controller->pace = NULL;
+    controller->next_ns = 0;
+    if (policy == CONTROL_REACTIVE) {
+        return 1;
+    }
+
+    // Both columns share a single allocation
+    controller->status = (int *)malloc((size_t)count * 2 * sizeof(int) + 1);
+    if (controller->status == NULL) {
+        return 0;
+    }
+    controller->pace = controller->status + count;
+    for (int i = 0; i < count; i++) {
+        Resource *resource = resources->resources[i];
+
+        controller->status[i] = STANDARD;
+        controller->pace[i] = 0;
+        resource->low_mark = (int)(resource->max_capacity * THRESHOLD_RESOURCE_LOW);
+        resource->high_mark = (resource->flags & RESOURCE_GOAL) ? 0 : (int)(resource->max_capacity * THRESHOLD_RESOURCE_HIGH);
+    }
+    controller->policy = policy;
+    controller->resource_count = count;
+    return 1;
+}
+
+/**
+ * Frees the state of a `Controller`, which becomes reactive.
+ *
+ * @param[in,out] controller  Pointer to the `Controller` to clean.
+ */
+void controller_clean(Controller *controller) {
+    // The status column is the start of the allocation holding both columns
+    free(controller->status);
+    controller->status = NULL;
+    controller->pace = NULL;
+    controller->resource_count = 0;
+    controller->policy = CONTROL_REACTIVE;
+}
+
+/**
+ * Looks up a controller policy by name.
+ *
+ * @param[in] name  "reactive", "hysteresis" or "proportional".
+ * @return          The matching `CONTROL_*` policy, or -1 if there is none.
+ */
+int controller_policy(const char *name) {
+    if (strcmp(name, "reactive") == 0) {
+        return CONTROL_REACTIVE;
+    }
+    if (strcmp(name, "hysteresis") == 0) {
+        return CONTROL_HYSTERESIS;
+    }
+    if (strcmp(name, "proportional") == 0) {
+        return CONTROL_PROPORTIONAL;
+    }
+    return -1;
+}
+
+/**
+ * Reacts to an event that is not the end of the simulation, for every policy but `CONTROL_REACTIVE`.
+ *
+ * The hysteresis policy runs the producers of a resource that ran low or short at
+ * `CONTROL_PACE_MAX` and those of a resource that filled up or ran into capacity at
+ * `CONTROL_PACE_MIN`, slow enough for most consumers to drain it, but only when that changes
+ * their status: the events that keep coming while they catch up change nothing. `controller_update` brings them
+ * back to standard when the fill level has crossed `CONTROL_SETPOINT`. The proportional policy
+ * recomputes the pace of the resource's producers at once instead of at the next pass.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @param[in]     event    Pointer to the `Event` to react to.
+ */
+void controller_event(Manager *manager, const Event *event) {
+    Controller *controller = &manager->controller;
+    Resource *resource = event->resource;
+    int status;
+
+    if (resource == NULL || resource->id < 0 || resource->id >= controller->resource_count || (resource->flags & RESOURCE_GOAL)) {
+        return;
+    }
+
+    if (controller->policy == CONTROL_PROPORTIONAL) {
+        control_pace(manager, resource);
+        return;
+    }
+
+    switch (event->status) {
+        case STATUS_EMPTY:
+        case STATUS_LOW:
+        case STATUS_INSUFFICIENT:
+            status = FAST;
+            break;
+        case STATUS_CAPACITY:
+        case STATUS_HIGH:
+            status = SLOW;
+            break;
+        default:
+            return;
+    }
+    if (controller->status[resource->id] != status) {
+        control_apply(manager, resource, status, (status == FAST) ? CONTROL_PACE_MAX : CONTROL_PACE_MIN);
+    }
+}
+
+/**
+ * Makes the controller's periodic pass over the fill levels once `CONTROL_INTERVAL` has passed.
+ *
+ * The hysteresis policy returns the producers of a resource to standard once its fill level has
+ * crossed `CONTROL_SETPOINT` coming from the watermark that changed them. The proportional
+ * policy sets the pace of every resource's producers from its fill level. Real-time runs call
+ * this with the monotonic clock, virtual runs with the virtual clock before any system steps
+ * at that time, so both virtual engines make their passes at the same points. Does nothing for
+ * `CONTROL_REACTIVE`.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @param[in]     now_ns   Current time in nanoseconds, on the clock the run uses.
+ */
+void controller_update(Manager *manager, long long now_ns) {
+    Controller *controller = &manager->controller;
+
+    if (controller->policy == CONTROL_REACTIVE || now_ns < controller->next_ns) {
+        return;
+    }
+    controller->next_ns = now_ns + CONTROL_INTERVAL * 1000000LL;
+
+    for (int i = 0; i < controller->resource_count; i++) {
+        Resource *resource = manager->resource_array.resources[i];
+        int fill;
+
+        // In a partitioned run each resource is steered by the Manager that owns it
+        if ((resource->flags & RESOURCE_GOAL)
+            || (manager->resource_partition != NULL && manager->resource_partition[i] != manager->partition)) {
+            continue;
+        }
+        // A replay of the trace restores what the pass read before reacting
+        if (manager->trace != NULL) {
+            trace_level(manager->trace, resource);
+        }
+        if (controller->policy == CONTROL_PROPORTIONAL) {
+            control_pace(manager, resource);
+            continue;
+        }
+        fill = control_fill(resource);
+        if ((controller->status[i] == FAST && fill >= (int)(CONTROL_SETPOINT * 100))
+            || (controller->status[i] == SLOW && fill <= (int)(CONTROL_SETPOINT * 100))) {
+            control_apply(manager, resource, STANDARD, 0);
+        }
+    }
+}
+
+/**
+ * Computes how full a resource is.
+ *
+ * @param[in] resource  Pointer to the `Resource`.
+ * @return              Amount as a percentage of the capacity, 100 for a resource without capacity.
+ */
+static int control_fill(Resource *resource) {
+    if (resource->max_capacity <= 0) {
+        return 100;
+    }
+    return (int)((long long)resource_get_amount(resource) * 100 / resource->max_capacity);
+}
+
+/**
+ * Gives the producers of a resource a new status and pace, and remembers it for the resource.
+ *
+ * @param[in,out] manager   Pointer to the `Manager`.
+ * @param[in]     resource  Pointer to the `Resource` whose producers change.
+ * @param[in]     status    New status of the producers.
+ * @param[in]     pace      New pace of the producers, zero to follow the status.
+ */
+static void control_apply(Manager *manager, Resource *resource, int status, int pace) {
+    Controller *controller = &manager->controller;
+
+    controller->status[resource->id] = status;
+    controller->pace[resource->id] = pace;
+    manager_set_producers(manager, resource, status, pace);
+}
+
+/**
+ * Sets the pace of a resource's producers from how far its fill level is from `CONTROL_SETPOINT`.
+ *
+ * Producers run `CONTROL_GAIN` percent faster for every percent the resource is below the set
+ * point, and slower above it, between `CONTROL_PACE_MIN` and `CONTROL_PACE_MAX`. The pace moves
+ * in steps of `CONTROL_PACE_STEP` so producers are not touched for every unit that changes. A
+ * system producing several resources follows whichever was handled last.
+ *
+ * @param[in,out] manager   Pointer to the `Manager`.
+ * @param[in]     resource  Pointer to the `Resource` whose producers are paced.
+ */
+static void control_pace(Manager *manager, Resource *resource) {
+    Controller *controller = &manager->controller;
+    int pace = 100 + CONTROL_GAIN * ((int)(CONTROL_SETPOINT * 100) - control_fill(resource));
+
+    pace = pace / CONTROL_PACE_STEP * CONTROL_PACE_STEP;
+    pace = (pace < CONTROL_PACE_MIN) ? CONTROL_PACE_MIN : ((pace > CONTROL_PACE_MAX) ? CONTROL_PACE_MAX : pace);
+    if (controller->pace[resource->id] != pace) {
+        control_apply(manager, resource, (pace > 100) ? FAST : ((pace < 100) ? SLOW : STANDARD), pace);
+    }
+}
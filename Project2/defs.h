@@ -1,4 +1,10 @@
 #include <semaphore.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
 
 // Don't worry about these! These are special codes that allow us to do some formatting in the terminal
 // Such as clearing the line before printing or moving the location of the "cursor" that will print.
@@ -14,45 +20,250 @@
 #define SLOW         2
 #define STANDARD     3
 #define FAST         4
+#define SYSTEM_STATUS_BITS 8       // Low bits of System::control that hold the status, the pace is above them
+
+#define SYSTEM_PHASE_CONVERT 0     // Waiting to consume its input
+#define SYSTEM_PHASE_PROCESS 1     // Input consumed, processing until the next step
+#define SYSTEM_PHASE_STORE   2     // Output produced, waiting to be stored
 
 #define STATUS_OK          -1
 #define STATUS_EMPTY        0
 #define STATUS_LOW          1
 #define STATUS_INSUFFICIENT 2
 #define STATUS_CAPACITY     3
+#define STATUS_HIGH         4
 #define STATUS_PRODUCED     10
 
+#define RESOURCE_CRITICAL 0x1     // Resource flag: the simulation terminates when it runs out
+#define RESOURCE_GOAL     0x2     // Resource flag: the simulation terminates when it reaches capacity
+#define RESOURCE_RELAXED  0x4     // Resource flag: may buffer stores per thread, switched on with `--relaxed`
+
+#define RESOURCE_RELAXED_QUOTA 32   // Default units a thread may hold back from a relaxed resource
+#define RESOURCE_FLUSH_INTERVAL 5   // Default milliseconds a thread may hold back units from a relaxed resource
+
 #define THRESHOLD_RESOURCE_LOW 0.3  // Percentage of resource before it is considered low.
-#define MANAGER_WAIT_TIME 5         // Milliseconds for the manager to wait between popping the queue
+#define THRESHOLD_RESOURCE_HIGH 0.8 // Percentage of resource after which it is considered high.
+#define MANAGER_BATCH_SIZE 64       // Most events the manager takes from the queue per lock acquisition
+#define MANAGER_DISPLAY_INTERVAL 1000 // Milliseconds between refreshes of the simulation display, the longest the manager sleeps
 #define SYSTEM_WAIT_TIME 20         // Milliseconds between loops of the system when production cannot occur
 
+#define EVENT_POOL_CHUNK 64         // EventNodes allocated at a time when the queue's pool runs dry
+#define EVENT_QUEUE_HIGH_WATER 4096 // Default limit of events pending in the queue at once
+
+#define EVENT_RING_CAPACITY 1024    // Slots per priority lane in the lock-free queue, must be a power of two
+
+#define EVENT_QUEUE_LOCKED   0      // Queue backend: pooled linked lists guarded by eventQueue_mutex
+#define EVENT_QUEUE_LOCKFREE 1      // Queue backend: bounded multi-producer, single-consumer rings built on atomics
+
+#define EVENT_INDEX_BUCKETS 1024    // Hash buckets used to find a pending event for the same condition, must be a power of two
+
+#define EVENT_QUEUE_DROP     0      // Queue policy: keep every event, discard new ones once the high-water mark is hit
+#define EVENT_QUEUE_COALESCE 1      // Queue policy: merge each event into a pending one for the same system/resource/status
+
+#define CONTROL_REACTIVE     0      // Controller policy: every shortage speeds producers up, every full store slows them down
+#define CONTROL_HYSTERESIS   1      // Controller policy: producers switch at the watermarks and return to standard at the set point
+#define CONTROL_PROPORTIONAL 2      // Controller policy: producers are paced by how far the fill level is from the set point
+
+#define CONTROL_INTERVAL 10         // Milliseconds between the controller's passes over the fill levels
+#define CONTROL_SETPOINT 0.5        // Fill level the controllers steer towards
+#define CONTROL_GAIN 2              // Percent of pace per percent the fill level is below the set point
+#define CONTROL_PACE_MIN 20         // Slowest pace, well below the rate of SLOW
+#define CONTROL_PACE_MAX 200        // Fastest pace, the rate of FAST
+#define CONTROL_PACE_STEP 20        // Proportional paces are multiples of this
+
+#define VIRTUAL_TIME_LIMIT 3600000  // Default milliseconds of simulated time a virtual clock run may last
+#define VIRTUAL_MIN_PROCESS 1       // Milliseconds a virtual step that starts processing waits at least, so the clock always moves
+#define SWEEP_STEPS_PER_MS 4        // Steps each system of a sweep run may take per simulated millisecond before the run is cut short
+
+#define ARENA_BLOCK_SIZE 16384      // Bytes of an arena's first block, later blocks double up to ARENA_BLOCK_MAX
+#define ARENA_BLOCK_MAX (4 << 20)
+#define ARENA_NAME_BUCKETS 64       // First size of an arena's name table, must be a power of two
+
+#define CACHE_LINE 64               // Bytes of a cache line
+
+// `make PADDED=1` gives every Resource and the mutable fields of every System cache lines of their own
+#ifdef P2_PADDED
+#define CACHE_ALIGNED _Alignas(CACHE_LINE)
+#else
+#define CACHE_ALIGNED
+#endif
+
+#define PLACEMENT_MAX_NODES 64      // Most NUMA nodes placement_build looks for
+#define PARTITION_MAX 64            // Most partitions of a partitioned run
+
+#define SCHEDULER_IDLE_WAIT 10      // Milliseconds an idle worker waits before trying to steal again
+#define TIMER_WHEEL_SLOTS 1024      // Slots in the scheduler's timer wheel, must be a power of two
+#define TIMER_WHEEL_TICK_US 1000    // Microseconds covered by each slot of the timer wheel
+
+#define RENDER_LOG_LINES 1024       // Event log lines the renderer can hold, must be a power of two
+#define RENDER_LOG_LINE 192         // Longest event log line kept, including the newline
+
+#define TELEMETRY_MAGIC "P2TELEM"   // First bytes of a telemetry file, including the terminator
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_SNAPSHOT 1        // Record type: resource amounts, system statuses and queue depth
+#define TELEMETRY_EVENT 2           // Record type: one event handled by the manager
+#define TELEMETRY_BUFFER 65536      // Bytes of records collected before they are written out, at least
+#define TELEMETRY_INTERVAL 100      // Default milliseconds between snapshots
+
+#define TRACE_MAGIC "P2TRACE"       // First bytes of a trace file, including the terminator
+#define TRACE_VERSION 1
+#define TRACE_PUSH 1                // Record type: one call of event_queue_push
+#define TRACE_STATUS 2              // Record type: a system given a different status or pace by its manager
+#define TRACE_LOST 3                // Record type: records dropped because the ring was full, their number in `amount`
+#define TRACE_LEVEL 4               // Record type: amount of a resource read by a controller pass, the pass follows the last of them
+#define TRACE_RING 65536            // Records that can wait for the manager to write them, must be a power of two
+#define TRACE_BUFFER 4096           // Records written out at once
+#define TRACE_INTERVAL 10           // Longest the manager sleeps with records waiting, in milliseconds
+
+#define ENDPOINT_INTERVAL 100       // Milliseconds between the snapshots the control socket answers from
+#define ENDPOINT_CLIENTS 16         // Most connections the control socket serves at once
+#define ENDPOINT_LINE 256           // Longest command line, including the newline
+#define ENDPOINT_COMMANDS 64        // Changes the control socket can have waiting for the manager, must be a power of two
+#define ENDPOINT_PATH 108           // Longest socket path, the size of sockaddr_un's sun_path
+
+#define ENDPOINT_SET_STATUS 0       // Command: give a system a status
+#define ENDPOINT_SET_TIME 1         // Command: give a system a processing time
+#define ENDPOINT_TERMINATE 2        // Command: terminate the simulation
+
+#define STATS_SUB_BITS 3            // Histogram precision: each power of two is split into 2^STATS_SUB_BITS buckets
+#define STATS_MAX_BITS 40           // Histogram values are clamped below 2^STATS_MAX_BITS
+#define STATS_BUCKETS ((STATS_MAX_BITS - STATS_SUB_BITS + 1) << STATS_SUB_BITS)
+
+#define STATS_PUSH_WAIT     0       // Histogram: nanoseconds a push waited for the event queue's lock
+#define STATS_DRAIN_WAIT    1       // Histogram: nanoseconds the manager waited for the event queue's lock
+#define STATS_EVENT_LATENCY 2       // Histogram: nanoseconds from an event's push to its handling
+#define STATS_QUEUE_DEPTH   3       // Histogram: events pending each time the manager drained the queue
+#define STATS_STEP_BUSY     4       // Histogram: nanoseconds spent in each system step
+#define STATS_RESOURCE_WAIT 5       // Histogram: nanoseconds waited for the lock of a transactional resource
+#define STATS_HISTOGRAMS    6
+
+#define STATS_RESOURCE_RETRIES 0    // Counter: compare-and-swap retries on resource amounts
+#define STATS_RING_RETRIES     1    // Counter: position claims lost to another producer in the lock-free queue
+#define STATS_COUNTERS         2
+
 #define PRIORITY_HIGH 3
 #define PRIORITY_MED 2
 #define PRIORITY_LOW 1
+#define EVENT_QUEUE_LANES (PRIORITY_HIGH - PRIORITY_LOW + 1) // One FIFO per priority level
+
+// Block of memory handed out by an Arena, followed by its `size` bytes
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;    // Block filled before this one
+    size_t size;
+    size_t used;
+} ArenaBlock;
+
+// Name interned by arena_intern, chained in its bucket of the arena's name table
+typedef struct ArenaName {
+    struct ArenaName *next;
+    unsigned int hash;
+    char text[];
+} ArenaName;
+
+// Bump allocator for everything a Manager owns, released in one go by arena_release
+typedef struct Arena {
+    ArenaBlock *blocks;         // Block being allocated from, then the blocks filled before it
+    size_t next_size;           // Bytes of the next block
+    size_t reserved;            // Bytes of every block together
+    ArenaName **names;          // Interned names hashed into `name_buckets` chains, NULL until the first
+    int name_buckets;
+    int name_count;
+} Arena;
 
 // Represents the resource amounts for the entire rocket
 typedef struct Resource {
-    char *name;      // Dynamically allocated string
-    int amount;
+    CACHE_ALIGNED char *name;      // Dynamically allocated string
+    int id;          // Index in the ResourceArray it was added to
     int max_capacity;
-    sem_t resource_mutex;
+    int flags;       // RESOURCE_* roles given by the scenario
+    int transactional;     // Non-zero once a recipe consumes it together with other resources, changes then take resource_mutex
+    int relaxed_quota;     // Units each thread may store without touching `amount`, zero for strict storing
+    long long relaxed_interval_ns;  // How long a thread may hold back stored units
+    int low_mark;          // Consuming below this reports STATUS_LOW, zero for none, set by controller_init
+    int high_mark;         // Storing above this reports STATUS_HIGH, zero for none
+    // Written by every system using the resource, the fields above are only read once it runs
+    CACHE_ALIGNED atomic_int amount;  // Changed with compare-and-swap, see resource_try_consume / resource_try_store
+    atomic_int reserved;   // Capacity threads have claimed for stores they buffer, `amount + reserved` never passes `max_capacity`
+    sem_t resource_mutex;  // Only needed by transactions spanning several resources
 } Resource;
 
+// Units one thread has stored into a relaxed resource but not yet added to its amount,
+// a cache line each so threads never write to the same line
+typedef struct ResourceDelta {
+    _Alignas(CACHE_LINE) Resource *resource;
+    int pending;
+    int reserved;           // Capacity claimed from the resource's `reserved` and not yet stored into
+    long long due_ns;       // When `pending` must be flushed, zero until resource_flush_due first sees it
+} ResourceDelta;
+
 // Represents the amount of a resource consumed/produced for a single system
 typedef struct ResourceAmount {
     Resource *resource;
     int amount;
 } ResourceAmount;
 
+// Inputs and outputs of a system with several of either, see system_set_recipe
+typedef struct Recipe {
+    int input_count;
+    int output_count;
+    ResourceAmount *inputs;     // Ordered by resource id, the order resource_try_consume_all locks them in
+    ResourceAmount *outputs;
+    int *stored;                // Output of each product still to be stored, they add up to amount_stored
+} Recipe;
+
+// Running totals of how late something started compared to when it was due
+typedef struct LatenessStats {
+    long long total_ns;
+    long long max_ns;
+    long count;
+} LatenessStats;
+
+#ifdef P2_STATS
+// Where a system's time went, virtual milliseconds in virtual runs
+typedef struct SystemStats {
+    long steps;
+    long long busy_ns;     // Time spent inside system_step
+    long long process_ms;  // Time spent processing its input
+    long long backoff_ms;  // Time spent waiting after a failed conversion or store
+} SystemStats;
+
+// Log-linear histogram of non-negative values, within 1/2^STATS_SUB_BITS of the true value
+typedef struct StatsHistogram {
+    atomic_ullong buckets[STATS_BUCKETS];
+    atomic_ullong count;
+    atomic_ullong sum;
+    atomic_ullong max;
+} StatsHistogram;
+
+// Statistics collected by one thread, only that thread writes them
+typedef struct StatsShard {
+    StatsHistogram histograms[STATS_HISTOGRAMS];
+    atomic_ullong counters[STATS_COUNTERS];
+    struct StatsShard *next;   // Next shard in the list every thread's shard is added to
+} StatsShard;
+#endif
+
 // A system which consumes resources, waits for `processing_time` milliseconds, then produced the produced resource
 typedef struct System {
-    char *name;     // Dynamically allocated string
-    ResourceAmount consumed;
-    ResourceAmount produced;
-    int amount_stored;
+    CACHE_ALIGNED char *name;     // Dynamically allocated string
+    int id;         // Index in the SystemArray it was added to
+    ResourceAmount consumed;    // First input of a recipe
+    ResourceAmount produced;    // First output of a recipe
+    Recipe *recipe;             // NULL unless the system has several inputs or outputs
     int processing_time;
-    int status; 
     struct EventQueue *event_queue;  // Pointer to event queue shared by all systems and manager
+    // Written by the manager with system_set_control, read with system_status and system_get_control
+    CACHE_ALIGNED atomic_int control; // Status, and above it the percent of the standard rate set by a controller, zero to follow the status
+    // Written by the thread stepping the system
+    CACHE_ALIGNED int amount_stored;
+    int phase;      // SYSTEM_PHASE_*, where `system_step` resumes
+    long long timer_due;             // Monotonic time in nanoseconds the current wait ends at, the base for the next one
+    int timer_pending;               // Non-zero while a wait is scheduled and its lateness not yet recorded
+    struct System *timer_next;       // Next system in the same timer wheel slot or inbox
+    LatenessStats lateness;          // How late the system's steps started compared to when they were due
+#ifdef P2_STATS
+    SystemStats stats;               // Written only by the thread stepping the system
+#endif
 } System;
 
 // Used to send notifications to the manager about an issue / state of the system
@@ -62,19 +273,64 @@ typedef struct Event {
     int status;     
     int priority;   // Higher values indicate higher priority
     int amount;     // Amount of the resource in question
+    int count;      // Number of reports merged into this event while it was pending
+#ifdef P2_STATS
+    long long pushed_ns; // Monotonic time the event was first pushed
+#endif
 } Event;
 
 // Linked List Node for the Event queue
 typedef struct EventNode {
     Event event;
     struct EventNode *next;
+    struct EventNode *index_next;  // Next node in the same bucket of the queue's index
+    struct EventNode **index_link; // Pointer that points at this node in its bucket, NULL when not indexed
 } EventNode;
 
-// Linked List structure with a head and no tail, single instance shared by all systems
-typedef struct EventQueue {
+// Block of EventNodes handed out by the queue's pool, kept in a list so they can be freed together
+typedef struct EventNodeChunk {
+    struct EventNodeChunk *next;
+    EventNode nodes[EVENT_POOL_CHUNK];
+} EventNodeChunk;
+
+// FIFO of the events that share one priority level
+typedef struct EventLane {
     EventNode *head;
+    EventNode *tail;
+} EventLane;
+
+// Slot of an EventRing, `sequence` tells producers and the consumer whose turn it is to use the slot
+typedef struct EventCell {
+    atomic_size_t sequence;
+    Event event;
+} EventCell;
+
+// Bounded ring that any number of threads push to and a single thread pops from without locks
+typedef struct EventRing {
+    EventCell *cells;
+    size_t mask;                             // Capacity - 1, capacity is a power of two
+    _Alignas(64) atomic_size_t enqueue_pos;  // Claimed by producers with compare-and-swap
+    _Alignas(64) atomic_size_t dequeue_pos;  // Only written by the consumer
+} EventRing;
+
+// Priority queue made of one FIFO lane per priority level, single instance shared by all systems
+typedef struct EventQueue {
+    int backend;               // EVENT_QUEUE_LOCKED or EVENT_QUEUE_LOCKFREE, fixed at init
+    EventLane lanes[EVENT_QUEUE_LANES]; // Indexed by priority - PRIORITY_LOW, used by the locked backend
+    EventRing rings[EVENT_QUEUE_LANES]; // Indexed by priority - PRIORITY_LOW, used by the lock-free backend
     int size;
+    EventNode *free_list;      // Nodes ready for reuse, protected by eventQueue_mutex
+    EventNodeChunk *chunks;    // Every chunk the pool allocated with malloc
+    Arena *arena;              // Pools, rings and index come from here when set, see event_queue_init_arena
+    int pool_size;             // Number of nodes allocated across all chunks
+    int high_water_mark;       // Most events allowed to be pending at once
+    int policy;                // EVENT_QUEUE_DROP or EVENT_QUEUE_COALESCE
+    EventNode **index;         // EVENT_INDEX_BUCKETS chains of pending nodes hashed by system/resource/status
+    atomic_int dropped;        // Events discarded because the queue was full
+    atomic_int wakeups;        // Posts of event_queue_wake the next drain takes back
+    struct Trace *trace;       // Records every push when set, see trace_open
     sem_t eventQueue_mutex;    
+    sem_t eventQueue_items;    // Counts pending events so the manager can sleep until one is pushed
 } EventQueue;
 
 // A basic dynamic array to store all of the systems in the simulation
@@ -82,40 +338,528 @@ typedef struct SystemArray {
     System **systems;
     int size;
     int capacity;
+    Arena *arena;       // Storage comes from here when set and the systems belong to it, see system_array_init_arena
 } SystemArray;
 
+// Structure-of-arrays copy of the fields the manager scans, row i describes SystemArray.systems[i]
+typedef struct SystemTable {
+    int size;               // Zero when the table has not been built
+    int *status;            // Only written by the manager, which mirrors each change into the System
+    int *pace;              // Written and mirrored like `status`
+    int *processing_time;
+    int *consumed;          // Id of the consumed resource, -1 for none
+    int *produced;          // Id of the produced resource, -1 for none
+    int *outputs;           // Outputs of the system's recipe, zero without one; `produced` is the first
+    System **systems;       // The System each row describes
+} SystemTable;
+
+// Compressed sparse rows of the systems producing and consuming each resource, indexed by resource id
+typedef struct ResourceIndex {
+    int resource_count;     // Resources and systems the index was built for, zero when not built
+    int system_count;
+    int *producer_start;    // Producers of resource r are producers[producer_start[r]] up to producers[producer_start[r + 1] - 1]
+    int *producers;         // Indices in the SystemArray
+    int *consumer_start;    // Same layout as producer_start for the consumers
+    int *consumers;
+} ResourceIndex;
+
+// Systems a TickEngine steps together because every field their steps depend on is the same
+typedef struct TickGroup {
+    int consumed;           // Id of the consumed resource, -1 for none
+    int consume_amount;
+    int produced;           // Id of the produced resource, -1 for none
+    int produce_amount;
+    int processing_time;
+    int size;               // Number of members
+    System *system;         // The only member of a group of one system with a recipe, stepped with system_step; NULL otherwise
+    int next_due;           // Earliest `due` of any member
+    int cursor;             // First member not yet stepped in the millisecond being stepped
+    int *rows;              // Index of each member in the SystemArray, ascending
+    int *due;               // Millisecond of the run each member steps at next
+    int *phase;             // SYSTEM_PHASE_* of each member
+    int *stored;            // Output each member has not stored yet
+} TickGroup;
+
+// Steps the systems of a Manager on the virtual clock a whole TickGroup at a time, see tick_engine_run
+typedef struct TickEngine {
+    int group_count;        // Zero when the engine has not been built
+    TickGroup *groups;      // Ordered by their first member
+    int *columns;           // Every group's member columns, in one allocation
+    int *heap;              // Groups with a member due in the millisecond being stepped, by the row of that member
+    int heap_count;
+} TickEngine;
+
 // A basic resource array to store all resources in the simulation
 typedef struct ResourceArray {
     Resource **resources;
     int size;
     int capacity;
+    Arena *arena;       // Storage comes from here when set and the resources belong to it
 } ResourceArray;
 
+// CPUs of each NUMA node the process may run on, and the node given to every resource and system
+typedef struct Placement {
+    int node_count;         // At least one once built
+    int cpu_count;
+    int *cpu_start;         // CPUs of node n are cpus[cpu_start[n]] up to cpus[cpu_start[n + 1] - 1]
+    int *cpus;
+    int *node_ids;          // Number of each node in sysfs
+    int *resource_node;     // Indexed by resource id
+    int *system_node;       // Indexed by system id
+    int resource_count;
+    int system_count;
+} Placement;
+
+// Fixed-size Chase-Lev deque, the owning worker pushes and takes at the bottom, other workers steal from the top
+typedef struct WorkDeque {
+    _Atomic(System *) *slots;
+    long mask;                     // Capacity - 1, capacity is a power of two
+    _Alignas(64) atomic_long top;
+    _Alignas(64) atomic_long bottom;
+} WorkDeque;
+
+// A thread of the scheduler with its own ready systems
+typedef struct Worker {
+    struct Scheduler *scheduler;
+    int index;
+    int node;             // Placement node the worker is pinned to, zero without placement
+    pthread_t thread;
+    WorkDeque deque;      // Systems ready to step now
+} Worker;
+
+// Hashed timer wheel, slot i holds the systems due in ticks congruent to i modulo TIMER_WHEEL_SLOTS
+typedef struct TimerWheel {
+    System *slots[TIMER_WHEEL_SLOTS];  // Only touched by the timer thread
+    long long tick;                    // Tick being processed, ticks count TIMER_WHEEL_TICK_US from time zero
+    _Atomic(System *) inbox;           // Systems scheduled by the workers, taken all at once by the timer thread
+    atomic_llong next_wake;            // Monotonic time in nanoseconds the timer thread plans to wake at
+    sem_t wakeup;                      // Posted when a worker schedules something earlier than `next_wake`
+    pthread_t thread;
+    WorkDeque *ready;                  // Systems whose wait is over, one deque per node, pushed by the timer thread and stolen by workers
+    int ready_count;
+    const int *system_node;            // Node of each system by id, NULL to use a single ready deque
+} TimerWheel;
+
+// Runs every system of a SystemArray as timed tasks on a fixed group of worker threads
+typedef struct Scheduler {
+    Worker *workers;
+    int worker_count;
+    SystemArray *system_array;
+    const Placement *placement;  // Nodes the workers are pinned to, NULL for none
+    TimerWheel wheel;
+    atomic_int active;    // Systems that have not terminated yet
+    atomic_int idle;      // Workers waiting on `wakeup`
+    sem_t wakeup;         // Posted when work is made ready so idle workers can steal it
+} Scheduler;
+
+// Copy of the changing simulation state, taken by the manager and formatted by the renderer
+typedef struct RenderSnapshot {
+    int *amounts;           // One per resource
+    int *statuses;          // One per system
+    unsigned long sequence; // Increases with every snapshot taken into this buffer
+    sem_t lock;             // Held by whichever thread is using the snapshot, the manager only tries it
+} RenderSnapshot;
+
+// Thread that draws the simulation display so terminal output never holds up the manager
+typedef struct Renderer {
+    struct Manager *manager;
+    int resource_count;              // Resources and systems covered by the snapshots
+    int system_count;
+    RenderSnapshot snapshots[2];     // Double buffer, the manager fills the one the renderer did not read last
+    atomic_int latest;               // Index of the most recent snapshot
+    unsigned long next_sequence;     // Sequence of the next snapshot, only used by the manager
+    unsigned long rendered_sequence; // Sequence of the last snapshot drawn, only used by the renderer
+    atomic_long skipped;             // Snapshots not taken because the renderer was still reading the buffer
+    char (*log_lines)[RENDER_LOG_LINE]; // Ring of event log lines written by the manager and read by the renderer
+    atomic_size_t log_head;          // Next line the manager writes
+    atomic_size_t log_tail;          // Next line the renderer reads
+    atomic_long log_dropped;         // Lines discarded because the ring was full
+    char *frame;                     // Output being assembled, written with a single write()
+    size_t frame_size;
+    size_t frame_capacity;
+    atomic_int running;
+    sem_t wakeup;                    // Posted when a snapshot or log line is waiting
+    pthread_t thread;
+} Renderer;
+
+// Resource amounts, system statuses and queue counters at one point, what the control socket answers from
+typedef struct EndpointSnapshot {
+    int *amounts;
+    int *statuses;
+    int *processing_times;  // End of the statuses' allocation
+    int queue_depth;
+    int queue_dropped;
+    long events_handled;
+    long long taken_ms;     // Monotonic time the snapshot was taken
+    unsigned long sequence; // Zero until the first snapshot
+    sem_t lock;             // Held while the snapshot is written or read
+} EndpointSnapshot;
+
+// A change the control socket leaves to the manager
+typedef struct EndpointCommand {
+    int type;               // ENDPOINT_SET_STATUS, ENDPOINT_SET_TIME or ENDPOINT_TERMINATE
+    int system;             // Index in the SystemArray
+    int value;
+} EndpointCommand;
+
+// One connection to the control socket
+typedef struct EndpointClient {
+    int fd;                 // -1 while the slot is free
+    char line[ENDPOINT_LINE]; // Command read so far
+    size_t line_size;
+    char *reply;            // Reply still to be written
+    size_t reply_size;
+    size_t reply_sent;
+    size_t reply_capacity;
+} EndpointClient;
+
+// Unix domain socket answering queries and taking commands on its own thread, see endpoint_init
+typedef struct Endpoint {
+    struct Manager *manager;
+    char path[ENDPOINT_PATH];
+    int listen_fd;
+    int epoll_fd;
+    int wake_fd;            // eventfd that stops the thread
+    int resource_count;     // Resources and systems covered by the snapshots
+    int system_count;
+    EndpointSnapshot snapshots[2]; // Double buffer, the manager fills the one the socket did not read last
+    atomic_int latest;      // Index of the most recent snapshot
+    unsigned long next_sequence; // Only used by the manager
+    long long next_ms;      // Monotonic time the manager takes the next snapshot, only used by the manager
+    EndpointCommand commands[ENDPOINT_COMMANDS]; // Ring written by the socket and applied by the manager
+    atomic_size_t command_head; // Next command the socket writes
+    atomic_size_t command_tail; // Next command the manager applies
+    EndpointClient clients[ENDPOINT_CLIENTS];
+    atomic_int running;
+    pthread_t thread;
+} Endpoint;
+
+// Start of a telemetry file, followed by `names_size` bytes of NUL-terminated names: every resource, then every system
+typedef struct TelemetryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t resource_count;
+    uint32_t system_count;
+    uint32_t names_size;
+} TelemetryHeader;
+
+// Start of every telemetry record
+typedef struct TelemetryRecord {
+    uint32_t type;          // TELEMETRY_SNAPSHOT or TELEMETRY_EVENT
+    uint32_t size;          // Bytes in the whole record, a multiple of 8
+    int64_t time_ns;        // Nanoseconds since the start of the run, on the virtual clock for virtual runs
+} TelemetryRecord;
+
+// Record of an event handled by the manager
+typedef struct TelemetryEvent {
+    TelemetryRecord record;
+    int32_t system;         // Id of the reporting system
+    int32_t resource;       // Id of the reported resource
+    int32_t status;
+    int32_t priority;
+    int32_t amount;
+    int32_t count;
+} TelemetryEvent;
+
+// Record of the simulation state, followed by one int32_t amount per resource and one uint8_t status per system
+typedef struct TelemetrySnapshot {
+    TelemetryRecord record;
+    int32_t queue_depth;    // Events pending in the queue
+    int32_t reserved;
+} TelemetrySnapshot;
+
+// Writes TelemetryRecords for a Manager to a file
+typedef struct Telemetry {
+    struct Manager *manager;
+    int fd;
+    int virtual_clock;          // Non-zero to stamp records with the manager's virtual time
+    long long start_ns;         // Monotonic time the records' clock starts from in real-time runs
+    long long interval_ns;      // Time between snapshots
+    long long next_snapshot_ns; // Time of the next snapshot, on the records' clock
+    unsigned char *buffer;      // Records not written yet
+    size_t buffer_size;         // TELEMETRY_BUFFER, or more if a snapshot would not fit twice
+    size_t used;
+    size_t snapshot_size;       // Bytes in each snapshot record of this file
+    int failed;                 // Non-zero once a write failed, later records are discarded
+} Telemetry;
+
+// Start of a trace file, followed by `names_size` bytes of NUL-terminated names, every resource then every system, padded with NULs to 8 bytes
+typedef struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t resource_count;
+    uint32_t system_count;
+    uint32_t names_size;
+} TraceHeader;
+
+// Every record of a trace, the file is a header followed by these
+typedef struct TraceRecord {
+    int64_t time_ns;        // Nanoseconds since the start of the run, on the virtual clock for virtual runs
+    int32_t system;         // Id of the pushing or changed system, -1 for level records
+    int32_t resource;       // Id of the reported or read resource, -1 for status records
+    int32_t amount;         // Reported or read amount, the pace of status records
+    int8_t type;            // TRACE_PUSH, TRACE_STATUS, TRACE_LOST or TRACE_LEVEL
+    int8_t status;          // STATUS_* of a push, the new status of a status record
+    int8_t priority;
+    int8_t reserved;
+} TraceRecord;
+
+typedef struct TraceCell {
+    atomic_size_t sequence;
+    TraceRecord record;
+} TraceCell;
+
+// Collects TraceRecords from any thread without allocating, the manager writes them to a file
+typedef struct Trace {
+    struct Manager *manager;
+    int fd;                     // -1 when the records are only taken with trace_take
+    int virtual_clock;          // Non-zero to stamp records with the manager's virtual time, the run has a single thread
+    long long start_ns;         // Monotonic time the records' clock starts from in real-time runs
+    TraceCell *cells;           // Ring of TRACE_RING records, claimed like an EventRing
+    _Alignas(64) atomic_size_t enqueue_pos;
+    _Alignas(64) atomic_size_t dequeue_pos;
+    atomic_long lost;           // Records dropped since the last TRACE_LOST record
+    long long dropped;          // Records dropped over the whole trace
+    TraceRecord *buffer;        // TRACE_BUFFER records taken from the ring and not written yet
+    int used;
+    int failed;                 // Non-zero once a write failed, later records are discarded
+} Trace;
+
+// Outcome of trace_replay
+typedef struct TraceReplay {
+    long long events;           // Pushes replayed
+    long long skipped;          // Pushes naming a system or resource the Manager does not have
+    long long lost;             // Records the recording dropped
+    long long recorded_changes; // Status records in the trace
+    long long replayed_changes; // Status changes the replay made
+    long long difference;       // Index of the first status change that differs, -1 if none does
+    TraceRecord recorded;       // The recorded and replayed status changes at `difference`, type 0 if there is none
+    TraceRecord replayed;
+    long long wall_ns;          // Time spent replaying
+} TraceReplay;
+
+// Decides how the producers of each resource react to its fill level, see control.c
+typedef struct Controller {
+    int policy;             // CONTROL_*, CONTROL_REACTIVE keeps no state
+    int resource_count;     // Resources the columns below cover
+    int *status;            // Status last given to the producers of each resource
+    int *pace;              // Pace last given to the producers of each resource
+    long long next_ns;      // When the next pass over the fill levels is due, on the run's clock
+} Controller;
+
 // Container structure which contains all of the core data for our simulation
 typedef struct Manager {
-    int simulation_running; // non-zero if the simulation is running, zero if it should be stopped
+    atomic_int simulation_running; // non-zero if the simulation is running, zero if it should be stopped, read by other threads
+    Arena arena;            // Every resource, system, name, array and event node of the Manager, a Manager must not be copied
     SystemArray system_array;
     ResourceArray resource_array;
     EventQueue event_queue;
     sem_t manager_mutex;    
+    long long display_deadline; // Monotonic time in milliseconds when the display is next refreshed
+    long long virtual_time;     // Nanoseconds of simulated time when running on the virtual clock
+    long long step_limit;       // Most steps manager_run_virtual takes before giving up, zero for no limit
+    int log_events;             // Non-zero to print a line for every handled event and the reason for terminating
+    Resource *terminal_resource; // Resource whose event terminated the simulation, NULL while running
+    int terminal_status;        // STATUS_* of the event that terminated the simulation
+    SystemTable system_table;   // Built by manager_build_tables to scan systems without chasing pointers, optional
+    ResourceIndex resource_index; // Systems affected by each resource, rebuilt when systems or resources are added
+    Renderer *renderer;         // Draws the display on its own thread when set, see renderer_init
+    Telemetry *telemetry;       // Receives every handled event and periodic snapshots when set
+    Endpoint *endpoint;         // Serves the control socket when set, see endpoint_init
+    Trace *trace;               // Records every status change when set, see trace_open
+    int headless;               // Non-zero to skip the terminal display
+    void *scenario_map;         // Compiled scenario mapped by scenario_load, NULL if none
+    size_t scenario_map_size;
+    Controller controller;      // Reacts to events that do not end the simulation, set by manager_set_controller
+    long events_handled;        // Events handled since the Manager was initialized
+    long status_changes;        // Times a system was given a different status or pace, termination aside
+    struct Manager *coordinator; // Set on the Manager of a partition, it is handed the events this Manager does not own
+    const int *resource_partition; // Partition owning every resource, -1 if the coordinator does; NULL unless partitioned
+    int partition;              // Partition this Manager runs, -1 for the coordinator and unpartitioned Managers
 } Manager;
 
+// A group of connected systems with a Manager of its own, see partition_build
+typedef struct Partition {
+    Manager manager;        // Lists the partition's systems and every resource, owns only its queue and index
+    Scheduler scheduler;    // The partition's worker group on a pool run
+    int worker_count;       // Workers of the scheduler, zero for a thread per system
+    pthread_t thread;       // Runs manager_thread on the partition's Manager
+    pthread_t *system_threads; // One per system when there is no scheduler
+    int manager_started;    // Non-zero once `thread` runs
+    int systems_started;    // System threads running, or non-zero once the scheduler runs
+} Partition;
+
+// Partitions of a Manager's systems, the Manager itself coordinating them
+typedef struct PartitionSet {
+    Manager *coordinator;
+    Partition *partitions;
+    int partition_count;
+    int *resource_partition;   // Partition of every resource, -1 for resources systems of several partitions use
+    int *system_partition;
+    int shared_count;          // Resources the coordinator handles because partitions share them
+} PartitionSet;
+
+// Lowest and highest amount a resource reached during a run
+typedef struct ResourceRange {
+    int min;
+    int max;
+} ResourceRange;
+
+// Numbers used to build the sample scenario in `load_data_params`
+typedef struct DemoParams {
+    int fuel_amount, fuel_capacity;
+    int oxygen_amount, oxygen_capacity;
+    int energy_amount, energy_capacity;
+    int distance_amount, distance_capacity;
+    int propulsion_consume, propulsion_produce, propulsion_time;
+    int life_support_consume, life_support_produce, life_support_time;
+    int crew_consume, crew_time;
+    int generator_consume, generator_produce, generator_time;
+} DemoParams;
+
 // Manager functions
 void manager_init(Manager *manager);
+void manager_init_backend(Manager *manager, int queue_backend);
 void manager_clean(Manager *manager);
 void manager_run(Manager *manager);
+void manager_handle_event(Manager *manager, const Event *event);
+int manager_build_tables(Manager *manager);
+int manager_set_controller(Manager *manager, int policy);
+void manager_set_producers(Manager *manager, Resource *resource, int status, int pace);
 void *manager_thread(void *args);
+long long manager_run_virtual(Manager *manager, long long limit_ns, ResourceRange *ranges);
+
+// Arena functions
+void arena_init(Arena *arena);
+void arena_release(Arena *arena);
+void *arena_alloc(Arena *arena, size_t size, size_t align);
+char *arena_intern(Arena *arena, const char *name);
+
+// Placement functions
+int placement_build(Placement *placement, ResourceArray *resources, SystemArray *systems);
+void placement_clean(Placement *placement);
+int placement_pin(const Placement *placement, pthread_t thread, int node, int slot);
+int placement_partition(ResourceArray *resources, SystemArray *systems, int count, int *resource_part, int *system_part);
+
+// Partition functions
+int partition_build(PartitionSet *set, Manager *manager, int count);
+int partition_start(PartitionSet *set, int worker_count);
+void partition_stop(PartitionSet *set);
+void partition_clean(PartitionSet *set);
+
+// Controller functions
+int controller_init(Controller *controller, int policy, ResourceArray *resources);
+void controller_clean(Controller *controller);
+int controller_policy(const char *name);
+void controller_event(Manager *manager, const Event *event);
+void controller_update(Manager *manager, long long now_ns);
+
+// Tick engine functions
+int tick_engine_build(TickEngine *engine, Manager *manager);
+long long tick_engine_run(TickEngine *engine, Manager *manager, long long limit_ns);
+void tick_engine_clean(TickEngine *engine);
+
+// Scenario functions
+void load_data(Manager *manager);
+void load_data_params(Manager *manager, const DemoParams *params);
+void demo_params_init(DemoParams *params);
+int demo_params_set(DemoParams *params, const char *name, int value);
+void demo_params_print_names(FILE *stream);
+int scenario_load(Manager *manager, const char *path);
+int scenario_compile(const char *text_path, const char *binary_path);
+void scenario_unload(Manager *manager);
+long scenario_checkpoint(Manager *manager, const char *path);
+int scenario_checkpoint_wait(long writer);
+
+// Parameter sweep functions
+int sweep_main(int argc, char *argv[]);
+
+// Renderer functions
+int renderer_init(Renderer *renderer, Manager *manager);
+int renderer_start(Renderer *renderer);
+void renderer_stop(Renderer *renderer);
+void renderer_clean(Renderer *renderer);
+void renderer_publish(Renderer *renderer);
+void renderer_logv(Renderer *renderer, const char *format, va_list args);
+
+// Control socket functions
+int endpoint_init(Endpoint *endpoint, Manager *manager, const char *path);
+int endpoint_start(Endpoint *endpoint);
+void endpoint_stop(Endpoint *endpoint);
+void endpoint_clean(Endpoint *endpoint);
+void endpoint_poll(Endpoint *endpoint);
+
+// Telemetry functions
+int telemetry_open(Telemetry *telemetry, Manager *manager, const char *path, int interval_ms, int virtual_clock);
+void telemetry_close(Telemetry *telemetry);
+long long telemetry_now(Telemetry *telemetry);
+void telemetry_event(Telemetry *telemetry, const Event *event);
+void telemetry_snapshot(Telemetry *telemetry, long long time_ns);
+void telemetry_poll(Telemetry *telemetry);
+
+// Trace functions
+int trace_open(Trace *trace, Manager *manager, const char *path, int virtual_clock);
+void trace_close(Trace *trace);
+void trace_push(Trace *trace, const Event *event);
+void trace_status(Trace *trace, const System *system, int status, int pace);
+void trace_level(Trace *trace, Resource *resource);
+int trace_take(Trace *trace, TraceRecord *record);
+void trace_poll(Trace *trace);
+int trace_replay(Manager *manager, const char *path, Trace *record, TraceReplay *result);
+
+// Statistics functions, compiled in with `make STATS=1`
+#ifdef P2_STATS
+void stats_record(int histogram, long long value);
+void stats_count(int counter, long long amount);
+void stats_sem_wait(sem_t *sem, int histogram);
+void stats_event_handled(const Event *event);
+void stats_print(FILE *stream, SystemArray *systems);
+void stats_clean(void);
+#else
+#define stats_record(histogram, value) ((void)0)
+#define stats_count(counter, amount) ((void)0)
+#define stats_sem_wait(sem, histogram) sem_wait(sem)
+#define stats_event_handled(event) ((void)0)
+#define stats_print(stream, systems) ((void)0)
+#define stats_clean() ((void)0)
+#endif
 
 // System functions
 void system_create(System **system, const char *name, ResourceAmount consumed, ResourceAmount produced, int processing_time, EventQueue *event_queue);
+void system_create_arena(System **system, const char *name, ResourceAmount consumed, ResourceAmount produced, int processing_time, EventQueue *event_queue, Arena *arena);
 void system_destroy(System *system);
 void system_run(System *system);
+int system_step(System *system);
+int system_set_recipe(System *system, const ResourceAmount *inputs, int input_count, const ResourceAmount *outputs, int output_count);
+int system_set_recipe_arena(System *system, const ResourceAmount *inputs, int input_count, const ResourceAmount *outputs, int output_count, Arena *arena);
+long long system_next_due(System *system, int delay, long long now);
 void *system_thread(void *args);
+const char *system_status_name(int status);
+void system_set_control(System *system, int status, int pace);
+int system_status(const System *system);
+void system_get_control(const System *system, int *status, int *pace);
+
 
+// Scheduler functions
+int scheduler_init(Scheduler *scheduler, SystemArray *system_array, int worker_count);
+int scheduler_init_placement(Scheduler *scheduler, SystemArray *system_array, int worker_count, const Placement *placement);
+int scheduler_start(Scheduler *scheduler);
+void scheduler_join(Scheduler *scheduler);
+void scheduler_clean(Scheduler *scheduler);
+long long monotonic_now_ns(void);
+void lateness_record(LatenessStats *stats, long long lateness_ns);
 
 // Resource functions
 void resource_create(Resource **resource, const char *name, int amount, int max_capacity);
+void resource_create_arena(Resource **resource, const char *name, int amount, int max_capacity, Arena *arena);
 void resource_destroy(Resource *resource);
+int resource_get_amount(Resource *resource);
+int resource_try_consume(Resource *resource, int amount);
+int resource_try_store(Resource *resource, int amount, int *stored);
+int resource_try_consume_all(const ResourceAmount *inputs, int count, int *failed);
+void resource_set_relaxed(Resource *resource, int quota, int interval_ms);
+void resource_flush_due(long long now_ns, long long wait_ns);
+void resource_flush_thread(void);
 
 // ResourceAmount functions
 void resource_amount_init(ResourceAmount *resource_amount, Resource *resource, int amount);
@@ -125,15 +869,32 @@ void event_init(Event *event, System *system, Resource *resource, int status, in
 
 // EventQueue functions
 void event_queue_init(EventQueue *queue);
+void event_queue_init_backend(EventQueue *queue, int backend);
+void event_queue_init_arena(EventQueue *queue, int backend, Arena *arena);
 void event_queue_clean(EventQueue *queue);
+void event_queue_configure(EventQueue *queue, int high_water_mark, int policy);
 void event_queue_push(EventQueue *queue, const Event *event); 
 int event_queue_pop(EventQueue *queue, Event* event);
+int event_queue_drain(EventQueue *queue, Event *out, int max);
+int event_queue_peek(EventQueue *queue, Event *out, int max, int from);
+int event_queue_wait(EventQueue *queue, int timeout_ms);
+int event_queue_size(EventQueue *queue);
+void event_queue_wake(EventQueue *queue);
 
 // Dynamic array functions for systems and resources
 void system_array_init(SystemArray *array);
+void system_array_init_arena(SystemArray *array, Arena *arena);
 void system_array_clean(SystemArray *array);
 void system_array_add(SystemArray *array, System *system);
+void system_array_print_lateness(SystemArray *array);
+
+int system_table_build(SystemTable *table, SystemArray *array);
+void system_table_clean(SystemTable *table);
 
 void resource_array_init(ResourceArray *array);
+void resource_array_init_arena(ResourceArray *array, Arena *arena);
 void resource_array_clean(ResourceArray *array);
-void resource_array_add(ResourceArray *array, Resource *resource);
\ No newline at end of file
+void resource_array_add(ResourceArray *array, Resource *resource);
+
+int resource_index_build(ResourceIndex *index, ResourceArray *resources, SystemArray *systems);
+void resource_index_clean(ResourceIndex *index);
\ No newline at end of file
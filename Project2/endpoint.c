@@ -0,0 +1,720 @@
+#define _GNU_SOURCE     // accept4
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+// Helpers just used by the control socket, static so they can't get linked into other files
+
+static void *endpoint_thread(void *args);
+static void endpoint_accept(Endpoint *endpoint);
+static void endpoint_read(Endpoint *endpoint, EndpointClient *client);
+static void endpoint_write(Endpoint *endpoint, EndpointClient *client);
+static void endpoint_close(Endpoint *endpoint, EndpointClient *client);
+static void endpoint_execute(Endpoint *endpoint, EndpointClient *client, char *line);
+static void endpoint_query(Endpoint *endpoint, EndpointClient *client, const char *what);
+static int endpoint_command(Endpoint *endpoint, int type, int system, int value);
+static void endpoint_reply(EndpointClient *client, const char *format, ...);
+static int endpoint_split(char *line, char **words, int max);
+static int endpoint_find_system(Endpoint *endpoint, const char *name);
+static int endpoint_find_resource(Endpoint *endpoint, const char *name);
+static int endpoint_parse(const char *word, const char *const *names, int first, int count, int *value);
+static int endpoint_index(const char *word, int count);
+static void endpoint_publish(Endpoint *endpoint, long long now_ms);
+
+// Names accepted for system statuses, indexed from TERMINATE, and for event statuses, indexed from STATUS_EMPTY
+static const char *const endpoint_system_statuses[] = {"TERMINATE", "DISABLED", "SLOW", "STANDARD", "FAST"};
+static const char *const endpoint_event_statuses[] = {"EMPTY", "LOW", "INSUFFICIENT", "CAPACITY", "HIGH"};
+
+/**
+ * Opens the control socket of a loaded Manager.
+ *
+ * The socket is a Unix domain stream socket at `path`, replacing any socket file left there.
+ * Clients send one command per line and get the lines of the reply back, the last one "ok" or
+ * "error ..." (see README.md for the commands). Queries are answered from the latest snapshot
+ * the manager published, so they never lock a resource or the event queue; changes to systems
+ * and termination are handed to the manager through a ring and applied on its next pass.
+ * Injected events are pushed onto the event queue of their system like any other. Call once the
+ * scenario is loaded, then set `manager->endpoint` and start it with `endpoint_start`.
+ *
+ * @param[out] endpoint  Pointer to the `Endpoint` to initialize.
+ * @param[in]  manager   Pointer to the loaded `Manager`.
+ * @param[in]  path      Path of the socket, shorter than `ENDPOINT_PATH`.
+ * @return               Non-zero on success; zero if the socket could not be opened or memory ran out.
+ */
+int endpoint_init(Endpoint *endpoint, Manager *manager, const char *path) {
+    struct sockaddr_un address;
+    struct epoll_event watch;
+    int ok = 1;
+
+    memset(endpoint, 0, sizeof(*endpoint));
+    endpoint->manager = manager;
+    endpoint->listen_fd = endpoint->epoll_fd = endpoint->wake_fd = -1;
+    endpoint->resource_count = manager->resource_array.size;
+    endpoint->system_count = manager->system_array.size;
+    atomic_init(&endpoint->latest, 0);
+    atomic_init(&endpoint->command_head, 0);
+    atomic_init(&endpoint->command_tail, 0);
+    atomic_init(&endpoint->running, 0);
+    endpoint->next_sequence = 1;
+    for (int i = 0; i < ENDPOINT_CLIENTS; i++) {
+        endpoint->clients[i].fd = -1;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        EndpointSnapshot *snapshot = &endpoint->snapshots[i];
+        snapshot->amounts = (int *)calloc(endpoint->resource_count + 1, sizeof(int));
+        snapshot->statuses = (int *)calloc(2 * (size_t)endpoint->system_count + 1, sizeof(int));
+        // Statuses and processing times share a single allocation
+        snapshot->processing_times = (snapshot->statuses != NULL) ? snapshot->statuses + endpoint->system_count : NULL;
+        ok = ok && snapshot->amounts != NULL && snapshot->statuses != NULL;
+        sem_init(&snapshot->lock, 0, 1);
+    }
+    if (!ok) {
+        printf("Could not allocate memory for the control socket\n");
+        endpoint_clean(endpoint);
+        return 0;
+    }
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        printf("Control socket path too long: %s\n", path);
+        endpoint_clean(endpoint);
+        return 0;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    // A socket left behind by an earlier run would make bind fail
+    unlink(path);
+
+    endpoint->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (endpoint->listen_fd < 0 || bind(endpoint->listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0
+        || listen(endpoint->listen_fd, ENDPOINT_CLIENTS) != 0) {
+        perror("Failed to open the control socket");
+        endpoint_clean(endpoint);
+        return 0;
+    }
+    strcpy(endpoint->path, path);
+
+    endpoint->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    endpoint->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (endpoint->epoll_fd < 0 || endpoint->wake_fd < 0) {
+        perror("Failed to set up the control socket");
+        endpoint_clean(endpoint);
+        return 0;
+    }
+    // The data of an event is the client it belongs to, NULL for the listening socket and the eventfd
+    memset(&watch, 0, sizeof(watch));
+    watch.events = EPOLLIN;
+    watch.data.ptr = NULL;
+    if (epoll_ctl(endpoint->epoll_fd, EPOLL_CTL_ADD, endpoint->listen_fd, &watch) != 0
+        || epoll_ctl(endpoint->epoll_fd, EPOLL_CTL_ADD, endpoint->wake_fd, &watch) != 0) {
+        perror("Failed to set up the control socket");
+        endpoint_clean(endpoint);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Starts the control socket's thread.
+ *
+ * @param[in,out] endpoint  Pointer to the initialized `Endpoint`.
+ * @return                  Non-zero on success; zero if the thread could not be created.
+ */
+int endpoint_start(Endpoint *endpoint) {
+    atomic_store(&endpoint->running, 1);
+    if (pthread_create(&endpoint->thread, NULL, endpoint_thread, endpoint) != 0) {
+        atomic_store(&endpoint->running, 0);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Stops the control socket's thread, dropping the clients still connected.
+ *
+ * @param[in,out] endpoint  Pointer to the started `Endpoint`.
+ */
+void endpoint_stop(Endpoint *endpoint) {
+    uint64_t one = 1;
+
+    if (atomic_exchange(&endpoint->running, 0) == 0) {
+        return;
+    }
+    if (write(endpoint->wake_fd, &one, sizeof(one)) < 0) {
+        // The counter only fails to grow when it is already non-zero, the thread wakes anyway
+    }
+    pthread_join(endpoint->thread, NULL);
+}
+
+/**
+ * Closes the socket, removes its file and frees everything held by a stopped `Endpoint`.
+ *
+ * @param[in,out] endpoint  Pointer to the `Endpoint` to clean.
+ */
+void endpoint_clean(Endpoint *endpoint) {
+    for (int i = 0; i < ENDPOINT_CLIENTS; i++) {
+        if (endpoint->clients[i].fd >= 0) {
+            endpoint_close(endpoint, &endpoint->clients[i]);
+        }
+    }
+    if (endpoint->listen_fd >= 0) {
+        close(endpoint->listen_fd);
+        if (endpoint->path[0] != '\0') {
+            unlink(endpoint->path);
+        }
+    }
+    if (endpoint->epoll_fd >= 0) {
+        close(endpoint->epoll_fd);
+    }
+    if (endpoint->wake_fd >= 0) {
+        close(endpoint->wake_fd);
+    }
+    endpoint->listen_fd = endpoint->epoll_fd = endpoint->wake_fd = -1;
+    endpoint->path[0] = '\0';
+
+    for (int i = 0; i < 2; i++) {
+        // The processing times are the end of the statuses' allocation
+        free(endpoint->snapshots[i].amounts);
+        free(endpoint->snapshots[i].statuses);
+        endpoint->snapshots[i].amounts = NULL;
+        endpoint->snapshots[i].statuses = NULL;
+        endpoint->snapshots[i].processing_times = NULL;
+        sem_destroy(&endpoint->snapshots[i].lock);
+    }
+}
+
+/**
+ * Applies the changes asked for on the control socket and publishes a snapshot when one is due.
+ *
+ * Called by the manager on every pass. A new status goes through the same path as the
+ * manager's own, so the `SystemTable` stays in step; termination stops every system the way a
+ * terminal event does, without a terminal resource.
+ *
+ * @param[in,out] endpoint  Pointer to the `Endpoint`.
+ */
+void endpoint_poll(Endpoint *endpoint) {
+    Manager *manager = endpoint->manager;
+    size_t tail = atomic_load_explicit(&endpoint->command_tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&endpoint->command_head, memory_order_acquire);
+    long long now_ms = monotonic_now_ns() / 1000000;
+    int changed = (tail != head);
+
+    for (; tail != head; tail++) {
+        const EndpointCommand *command = &endpoint->commands[tail & (ENDPOINT_COMMANDS - 1)];
+        System *system = (command->system >= 0) ? manager->system_array.systems[command->system] : NULL;
+
+        if (command->type == ENDPOINT_TERMINATE && atomic_load(&manager->simulation_running) != 0) {
+            if (manager->log_events) {
+                printf("Termination requested on the control socket. Terminating all systems.\n");
+            }
+            atomic_store(&manager->simulation_running, 0);
+            manager_set_producers(manager, NULL, TERMINATE, 0);
+        }
+        else if (command->type == ENDPOINT_SET_STATUS && system != NULL && atomic_load(&manager->simulation_running) != 0) {
+            int current_status, current_pace;
+
+            system_get_control(system, &current_status, &current_pace);
+            manager->status_changes += (current_status != command->value || current_pace != 0) && command->value != TERMINATE;
+            if (manager->trace != NULL && (current_status != command->value || current_pace != 0)) {
+                trace_status(manager->trace, system, command->value, 0);
+            }
+            if (command->system < manager->system_table.size) {
+                manager->system_table.status[command->system] = command->value;
+                manager->system_table.pace[command->system] = 0;
+            }
+            system_set_control(system, command->value, 0);
+        }
+        else if (command->type == ENDPOINT_SET_TIME && system != NULL) {
+            if (command->system < manager->system_table.size) {
+                manager->system_table.processing_time[command->system] = command->value;
+            }
+            system->processing_time = command->value;
+        }
+    }
+    atomic_store_explicit(&endpoint->command_tail, tail, memory_order_release);
+
+    // A change shows up in the next query at once
+    if (changed || now_ms >= endpoint->next_ms) {
+        endpoint_publish(endpoint, now_ms);
+    }
+}
+
+/**
+ * Takes a snapshot of the amounts, statuses and queue counters for the socket to answer from.
+ *
+ * The snapshot goes into the buffer the socket did not read last; if a query is still reading
+ * that buffer the snapshot is skipped instead of waiting, and taken on the next pass.
+ *
+ * @param[in,out] endpoint  Pointer to the `Endpoint`.
+ * @param[in]     now_ms    Current monotonic time in milliseconds.
+ */
+static void endpoint_publish(Endpoint *endpoint, long long now_ms) {
+    Manager *manager = endpoint->manager;
+    int back = 1 - atomic_load(&endpoint->latest);
+    EndpointSnapshot *snapshot = &endpoint->snapshots[back];
+
+    if (sem_trywait(&snapshot->lock) != 0) {
+        return;
+    }
+    for (int i = 0; i < endpoint->resource_count; i++) {
+        snapshot->amounts[i] = resource_get_amount(manager->resource_array.resources[i]);
+    }
+    for (int i = 0; i < endpoint->system_count; i++) {
+        System *system = manager->system_array.systems[i];
+        snapshot->statuses[i] = (i < manager->system_table.size) ? manager->system_table.status[i] : system_status(system);
+        snapshot->processing_times[i] = system->processing_time;
+    }
+    // Read by the manager, which takes the queue's lock to drain it anyway
+    snapshot->queue_depth = event_queue_size(&manager->event_queue);
+    snapshot->queue_dropped = atomic_load(&manager->event_queue.dropped);
+    snapshot->events_handled = manager->events_handled;
+    snapshot->taken_ms = now_ms;
+    snapshot->sequence = endpoint->next_sequence++;
+    sem_post(&snapshot->lock);
+
+    atomic_store(&endpoint->latest, back);
+    endpoint->next_ms = now_ms + ENDPOINT_INTERVAL;
+}
+
+/**
+ * Main loop of the control socket's thread.
+ *
+ * Waits on epoll for new connections, commands and room to write replies, until woken through
+ * the eventfd by `endpoint_stop`.
+ *
+ * @param[in,out] args  Pointer to the `Endpoint`.
+ * @return              NULL.
+ */
+static void *endpoint_thread(void *args) {
+    Endpoint *endpoint = (Endpoint *)args;
+    struct epoll_event events[ENDPOINT_CLIENTS + 2];
+
+    while (atomic_load(&endpoint->running)) {
+        int count = epoll_wait(endpoint->epoll_fd, events, ENDPOINT_CLIENTS + 2, -1);
+
+        if (count < 0 && errno != EINTR) {
+            perror("Failed to wait on the control socket");
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            EndpointClient *client = (EndpointClient *)events[i].data.ptr;
+
+            if (client == NULL) {
+                // The eventfd only fires to stop the loop, which checks running next
+                endpoint_accept(endpoint);
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                endpoint_read(endpoint, client);
+            }
+            if (client->fd >= 0 && (events[i].events & EPOLLOUT)) {
+                endpoint_write(endpoint, client);
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Accepts every pending connection, closing those beyond `ENDPOINT_CLIENTS`.
+ *
+ * @param[in,out] endpoint  Pointer to the `Endpoint`.
+ */
+static void endpoint_accept(Endpoint *endpoint) {
+    int fd;
+
+    while ((fd = accept4(endpoint->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        EndpointClient *client = NULL;
+        struct epoll_event watch;
+
+        for (int i = 0; i < ENDPOINT_CLIENTS && client == NULL; i++) {
+            if (endpoint->clients[i].fd < 0) {
+                client = &endpoint->clients[i];
+            }
+        }
+        memset(&watch, 0, sizeof(watch));
+        watch.events = EPOLLIN;
+        watch.data.ptr = client;
+        if (client == NULL || epoll_ctl(endpoint->epoll_fd, EPOLL_CTL_ADD, fd, &watch) != 0) {
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+        client->line_size = 0;
+        client->reply_size = client->reply_sent = 0;
+    }
+}
+
+/**
+ * Reads what a client sent and runs every complete line, closing the connection at its end.
+ *
+ * @param[in,out] endpoint  Pointer to the `Endpoint`.
+ * @param[in,out] client    Pointer to the connected `EndpointClient`.
+ */
+static void endpoint_read(Endpoint *endpoint, EndpointClient *client) {
+    char buffer[ENDPOINT_LINE];
+    ssize_t size;
+
+    while ((size = read(client->fd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t i = 0; i < size; i++) {
+            if (buffer[i] == '\n') {
+                client->line[client->line_size] = '\0';
+                endpoint_execute(endpoint, client, client->line);
+                client->line_size = 0;
+            }
+            else if (client->line_size < ENDPOINT_LINE - 1) {
+                client->line[client->line_size++] = buffer[i];
+            }
+            // Longer lines are cut, the command then fails to parse
+        }
+    }
+    if (size == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        endpoint_close(endpoint, client);
+        return;
+    }
+    endpoint_write(endpoint, client);
+}
+
+/**
+ * Writes as much of a client's reply as the socket takes, watching for room when it is full.
+ *
+ * @param[in,out] endpoint  Pointer to the `Endpoint`.
+ * @param[in,out] client    Pointer to the connected `EndpointClient`.
+ */
+static void endpoint_write(Endpoint *endpoint, EndpointClient *client) {
+    struct epoll_event watch;
+
+    while (client->reply_sent < client->reply_size) {
+        ssize_t written = send(client->fd, client->reply + client->reply_sent,
+                               client->reply_size - client->reply_sent, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                endpoint_close(endpoint, client);
+                return;
+            }
+            break;
+        }
+        client->reply_sent += (size_t)written;
+    }
+    if (client->reply_sent == client->reply_size) {
+        client->reply_size = client->reply_sent = 0;
+    }
+
+    memset(&watch, 0, sizeof(watch));
+    watch.events = EPOLLIN | ((client->reply_size > 0) ? EPOLLOUT : 0);
+    watch.data.ptr = client;
+    epoll_ctl(endpoint->epoll_fd, EPOLL_CTL_MOD, client->fd, &watch);
+}
+
+/**
+ * Closes a client's connection and frees its slot.
+ *
+ * @param[in,out] endpoint  Pointer to the `Endpoint`.
+ * @param[in,out] client    Pointer to the connected `EndpointClient`.
+ */
+static void endpoint_close(Endpoint *endpoint, EndpointClient *client) {
+    epoll_ctl(endpoint->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    client->fd = -1;
+    free(client->reply);
+    client->reply = NULL;
+    client->reply_size = client->reply_sent = client->reply_capacity = 0;
+}
+
+/**
+ * Runs one command line and appends its reply.
+ *
+ * @param[in,out] endpoint  Pointer to the `Endpoint`.
+ * @param[in,out] client    Pointer to the `EndpointClient` that sent the line.
+ * @param[in,out] line      Command line without its newline, split in place.
+ */
+static void endpoint_execute(Endpoint *endpoint, EndpointClient *client, char *line) {
+    Manager *manager = endpoint->manager;
+    char *words[6];
+    int count = endpoint_split(line, words, 6);
+    int system, resource, value, amount = 0, priority = PRIORITY_MED;
+    Event event;
+
+    if (count == 0) {
+        return;
+    }
+
+    if (strcmp(words[0], "resources") == 0 || strcmp(words[0], "systems") == 0 || strcmp(words[0], "queue") == 0) {
+        endpoint_query(endpoint, client, words[0]);
+    }
+    else if (strcmp(words[0], "status") == 0 && count == 3) {
+        if ((system = endpoint_find_system(endpoint, words[1])) < 0) {
+            endpoint_reply(client, "error unknown system %s\n", words[1]);
+        }
+        else if (!endpoint_parse(words[2], endpoint_system_statuses, TERMINATE, 5, &value)) {
+            endpoint_reply(client, "error unknown status %s\n", words[2]);
+        }
+        else {
+            endpoint_reply(client, endpoint_command(endpoint, ENDPOINT_SET_STATUS, system, value) ? "ok\n" : "error busy\n");
+        }
+    }
+    else if (strcmp(words[0], "time") == 0 && count == 3) {
+        if ((system = endpoint_find_system(endpoint, words[1])) < 0) {
+            endpoint_reply(client, "error unknown system %s\n", words[1]);
+        }
+        else if ((value = atoi(words[2])) <= 0) {
+            endpoint_reply(client, "error processing time must be positive\n");
+        }
+        else {
+            endpoint_reply(client, endpoint_command(endpoint, ENDPOINT_SET_TIME, system, value) ? "ok\n" : "error busy\n");
+        }
+    }
+    else if (strcmp(words[0], "event") == 0 && count >= 4) {
+        if ((system = endpoint_find_system(endpoint, words[1])) < 0) {
+            endpoint_reply(client, "error unknown system %s\n", words[1]);
+        }
+        else if ((resource = endpoint_find_resource(endpoint, words[2])) < 0) {
+            endpoint_reply(client, "error unknown resource %s\n", words[2]);
+        }
+        else if (!endpoint_parse(words[3], endpoint_event_statuses, STATUS_EMPTY, 5, &value)) {
+            endpoint_reply(client, "error unknown status %s\n", words[3]);
+        }
+        else {
+            amount = (count > 4) ? atoi(words[4]) : resource_get_amount(manager->resource_array.resources[resource]);
+            priority = (count > 5) ? atoi(words[5]) : priority;
+            event_init(&event, manager->system_array.systems[system], manager->resource_array.resources[resource],
+                       value, priority, amount);
+            // The system's own queue, its partition's in a partitioned run
+            event_queue_push(manager->system_array.systems[system]->event_queue, &event);
+            endpoint_reply(client, "ok\n");
+        }
+    }
+    else if (strcmp(words[0], "terminate") == 0 && count == 1) {
+        endpoint_reply(client, endpoint_command(endpoint, ENDPOINT_TERMINATE, -1, 0) ? "ok\n" : "error busy\n");
+    }
+    else {
+        endpoint_reply(client, "error usage: resources | systems | queue | status <system> <status> | time <system> <ms>"
+                               " | event <system> <resource> <status> [amount [priority]] | terminate\n");
+    }
+}
+
+/**
+ * Answers a query from the latest snapshot, whose sequence and age come first.
+ *
+ * Names and capacities never change during a run, so they are read from the Manager.
+ *
+ * @param[in,out] endpoint  Pointer to the `Endpoint`.
+ * @param[in,out] client    Pointer to the `EndpointClient` to answer.
+ * @param[in]     what      "resources", "systems" or "queue".
+ */
+static void endpoint_query(Endpoint *endpoint, EndpointClient *client, const char *what) {
+    Manager *manager = endpoint->manager;
+    EndpointSnapshot *snapshot = &endpoint->snapshots[atomic_load(&endpoint->latest)];
+
+    sem_wait(&snapshot->lock);
+    if (snapshot->sequence == 0) {
+        sem_post(&snapshot->lock);
+        endpoint_reply(client, "error no snapshot yet\n");
+        return;
+    }
+    endpoint_reply(client, "snapshot %lu %lld ms\n", snapshot->sequence, monotonic_now_ns() / 1000000 - snapshot->taken_ms);
+    if (strcmp(what, "resources") == 0) {
+        for (int i = 0; i < endpoint->resource_count; i++) {
+            Resource *resource = manager->resource_array.resources[i];
+            endpoint_reply(client, "%s\t%d\t%d\n", resource->name, snapshot->amounts[i], resource->max_capacity);
+        }
+    }
+    else if (strcmp(what, "systems") == 0) {
+        for (int i = 0; i < endpoint->system_count; i++) {
+            endpoint_reply(client, "%s\t%s\t%d\n", manager->system_array.systems[i]->name,
+                           system_status_name(snapshot->statuses[i]), snapshot->processing_times[i]);
+        }
+    }
+    else {
+        endpoint_reply(client, "depth\t%d\ndropped\t%d\nhandled\t%ld\n",
+                       snapshot->queue_depth, snapshot->queue_dropped, snapshot->events_handled);
+    }
+    sem_post(&snapshot->lock);
+    endpoint_reply(client, "ok\n");
+}
+
+/**
+ * Hands a change to the manager and wakes it to apply it.
+ *
+ * @param[in,out] endpoint  Pointer to the `Endpoint`.
+ * @param[in]     type      `ENDPOINT_SET_STATUS`, `ENDPOINT_SET_TIME` or `ENDPOINT_TERMINATE`.
+ * @param[in]     system    Index of the system, -1 for none.
+ * @param[in]     value     New status or processing time.
+ * @return                  Non-zero if the change was queued; zero if the ring was full.
+ */
+static int endpoint_command(Endpoint *endpoint, int type, int system, int value) {
+    size_t head = atomic_load_explicit(&endpoint->command_head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&endpoint->command_tail, memory_order_acquire);
+    EndpointCommand *command;
+
+    if (head - tail >= ENDPOINT_COMMANDS) {
+        return 0;
+    }
+    command = &endpoint->commands[head & (ENDPOINT_COMMANDS - 1)];
+    command->type = type;
+    command->system = system;
+    command->value = value;
+    atomic_store_explicit(&endpoint->command_head, head + 1, memory_order_release);
+    event_queue_wake(&endpoint->manager->event_queue);
+    return 1;
+}
+
+/**
+ * Appends formatted text to a client's reply, growing it as needed.
+ *
+ * @param[in,out] client  Pointer to the `EndpointClient`.
+ * @param[in]     format  printf-style format.
+ */
+static void endpoint_reply(EndpointClient *client, const char *format, ...) {
+    va_list args;
+    int length;
+
+    for (;;) {
+        size_t space = client->reply_capacity - client->reply_size;
+
+        va_start(args, format);
+        length = vsnprintf((client->reply != NULL) ? client->reply + client->reply_size : NULL, space, format, args);
+        va_end(args);
+        if (length < 0) {
+            return;
+        }
+        if ((size_t)length < space) {
+            client->reply_size += length;
+            return;
+        }
+
+        // Double the reply and format again
+        size_t capacity = (client->reply_capacity > 0) ? client->reply_capacity * 2 : 4096;
+        char *grown = (char *)malloc(capacity);
+        if (grown == NULL) {
+            return;
+        }
+        if (client->reply_size > 0) {
+            memcpy(grown, client->reply, client->reply_size);
+        }
+        free(client->reply);
+        client->reply = grown;
+        client->reply_capacity = capacity;
+    }
+}
+
+/**
+ * Splits a command line into words in place, a word may be quoted to hold spaces.
+ *
+ * @param[in,out] line   Command line, its separators are overwritten.
+ * @param[out]    words  Start of every word.
+ * @param[in]     max    Most words to find.
+ * @return               Number of words found.
+ */
+static int endpoint_split(char *line, char **words, int max) {
+    int count = 0;
+
+    while (*line != '\0' && count < max) {
+        char end = ' ';
+
+        while (*line == ' ' || *line == '\t' || *line == '\r') {
+            line++;
+        }
+        if (*line == '\0') {
+            break;
+        }
+        if (*line == '"') {
+            end = '"';
+            line++;
+        }
+        words[count++] = line;
+        while (*line != '\0' && *line != end && (end == '"' || (*line != '\t' && *line != '\r'))) {
+            line++;
+        }
+        if (*line != '\0') {
+            *line++ = '\0';
+        }
+    }
+    return count;
+}
+
+/**
+ * Finds a system by name, or by index when no system has that name.
+ *
+ * @param[in] endpoint  Pointer to the `Endpoint`.
+ * @param[in] name      Name or index of the system.
+ * @return              Index of the first system with that name, or -1 if there is none.
+ */
+static int endpoint_find_system(Endpoint *endpoint, const char *name) {
+    for (int i = 0; i < endpoint->system_count; i++) {
+        if (strcmp(endpoint->manager->system_array.systems[i]->name, name) == 0) {
+            return i;
+        }
+    }
+    return endpoint_index(name, endpoint->system_count);
+}
+
+/**
+ * Finds a resource by name, or by index when no resource has that name.
+ *
+ * @param[in] endpoint  Pointer to the `Endpoint`.
+ * @param[in] name      Name or index of the resource.
+ * @return              Index of the first resource with that name, or -1 if there is none.
+ */
+static int endpoint_find_resource(Endpoint *endpoint, const char *name) {
+    for (int i = 0; i < endpoint->resource_count; i++) {
+        if (strcmp(endpoint->manager->resource_array.resources[i]->name, name) == 0) {
+            return i;
+        }
+    }
+    return endpoint_index(name, endpoint->resource_count);
+}
+
+/**
+ * Reads a status given by name, in any case, or by number.
+ *
+ * @param[in]  word   Word to read.
+ * @param[in]  names  Name of every status from `first` on.
+ * @param[in]  first  Value of the first name.
+ * @param[in]  count  Number of names.
+ * @param[out] value  The status read.
+ * @return            Non-zero if the word is one of the statuses; zero otherwise.
+ */
+static int endpoint_parse(const char *word, const char *const *names, int first, int count, int *value) {
+    char *end;
+    long number = strtol(word, &end, 10);
+
+    if (*word != '\0' && *end == '\0') {
+        *value = (int)number;
+        return number >= first && number < first + count;
+    }
+    for (int i = 0; i < count; i++) {
+        if (strcasecmp(word, names[i]) == 0) {
+            *value = first + i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Reads an index given as a number.
+ *
+ * @param[in] word   Word to read.
+ * @param[in] count  Number of valid indices.
+ * @return           The index, or -1 if the word is not a number below `count`.
+ */
+static int endpoint_index(const char *word, int count) {
+    char *end;
+    long number = strtol(word, &end, 10);
+
+    return (*word != '\0' && *end == '\0' && number >= 0 && number < count) ? (int)number : -1;
+}
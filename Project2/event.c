@@ -1,6 +1,9 @@
 #include "defs.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
 
 /* Event functions */
 
@@ -22,46 +25,180 @@ void event_init(Event *event, System *system, Resource *resource, int status, in
     event->status = status;
     event->priority = priority;
     event->amount = amount;
+    event->count = 1;
+#ifdef P2_STATS
+    event->pushed_ns = 0;
+#endif
 }
 
 /* EventQueue functions */
 
+// Helpers for the queue's node pool, only called while holding `eventQueue_mutex`
+static int event_pool_grow(EventQueue *queue);
+static EventNode *event_pool_take(EventQueue *queue);
+static void event_pool_give(EventQueue *queue, EventNode *node);
+static EventNode *event_queue_find_match(EventQueue *queue, const Event *event);
+static void event_queue_unindex(EventNode *node);
+static size_t event_queue_hash(const Event *event);
+static int event_queue_lane(int priority);
+
+// Lock-free backend, one bounded ring per lane
+static int event_ring_init(EventRing *ring, size_t capacity, Arena *arena);
+static int event_ring_push(EventRing *ring, const Event *event);
+static int event_ring_pop(EventRing *ring, Event *event);
+
 /**
- * Initializes the `EventQueue`.
- *
- * Sets up the queue for use, initializing any necessary data (e.g., semaphores when threading).
+ * Initializes the `EventQueue` with the default locked backend.
  *
  * @param[out] queue  Pointer to the `EventQueue` to initialize.
  */
 void event_queue_init(EventQueue *queue) {
+    event_queue_init_backend(queue, EVENT_QUEUE_LOCKED);
+}
+
+/**
+ * Initializes the `EventQueue` with the given backend.
+ *
+ * Sets up the queue for use, initializing any necessary data (e.g., semaphores when threading).
+ * The locked backend's node pool starts with one chunk and the default high-water mark and coalescing policy.
+ * The lock-free backend preallocates `EVENT_RING_CAPACITY` slots per lane and drops events when a lane is full,
+ * it never coalesces. It supports any number of pushing threads but only one popping thread.
+ *
+ * @param[out] queue    Pointer to the `EventQueue` to initialize.
+ * @param[in]  backend  `EVENT_QUEUE_LOCKED` or `EVENT_QUEUE_LOCKFREE`.
+ */
+void event_queue_init_backend(EventQueue *queue, int backend) {
+    event_queue_init_arena(queue, backend, NULL);
+}
+
+/**
+ * Initializes an `EventQueue` whose node pool, rings and index come from an `Arena`.
+ *
+ * Nodes are still recycled through the pool's free list, the arena only supplies new chunks.
+ * Everything the queue allocated goes when the arena is released, `event_queue_clean` no longer
+ * frees it. Without an arena this is `event_queue_init_backend`.
+ *
+ * @param[out]    queue    Pointer to the `EventQueue` to initialize.
+ * @param[in]     backend  `EVENT_QUEUE_LOCKED` or `EVENT_QUEUE_LOCKFREE`.
+ * @param[in,out] arena    Pointer to the `Arena`, or NULL to use malloc.
+ */
+void event_queue_init_arena(EventQueue *queue, int backend, Arena *arena) {
     if(queue == NULL){
         return;
     }
-    // sets the head of the queue to null
-    queue->head = NULL;
-    // initializes the semaphore
+    queue->backend = backend;
+    queue->arena = arena;
+    // sets the head and tail of every lane to null
+    for (int i = 0; i < EVENT_QUEUE_LANES; i++) {
+        queue->lanes[i].head = NULL;
+        queue->lanes[i].tail = NULL;
+    }
+    queue->size = 0;
+
+    queue->free_list = NULL;
+    queue->chunks = NULL;
+    queue->pool_size = 0;
+    queue->high_water_mark = EVENT_QUEUE_HIGH_WATER;
+    queue->policy = EVENT_QUEUE_COALESCE;
+    queue->index = NULL;
+    atomic_init(&queue->dropped, 0);
+    atomic_init(&queue->wakeups, 0);
+    queue->trace = NULL;
+
+    for (int i = 0; i < EVENT_QUEUE_LANES; i++) {
+        queue->rings[i].cells = NULL;
+    }
+
+    if (backend == EVENT_QUEUE_LOCKFREE) {
+        for (int i = 0; i < EVENT_QUEUE_LANES; i++) {
+            if (!event_ring_init(&queue->rings[i], EVENT_RING_CAPACITY, arena)) {
+                perror("Failed to allocate memory for EventRing");
+            }
+        }
+        queue->high_water_mark = EVENT_RING_CAPACITY * EVENT_QUEUE_LANES;
+        queue->policy = EVENT_QUEUE_DROP;
+    }
+    else {
+        // Preallocate the first chunk so the first pushes don't have to
+        event_pool_grow(queue);
+        queue->index = (arena != NULL) ? (EventNode **)arena_alloc(arena, EVENT_INDEX_BUCKETS * sizeof(EventNode *), _Alignof(EventNode *))
+                                       : (EventNode **)calloc(EVENT_INDEX_BUCKETS, sizeof(EventNode *));
+        if (queue->index != NULL && arena != NULL) {
+            memset(queue->index, 0, EVENT_INDEX_BUCKETS * sizeof(EventNode *));
+        }
+        if (queue->index == NULL) {
+            perror("Failed to allocate memory for the EventQueue index");
+            queue->policy = EVENT_QUEUE_DROP;
+        }
+    }
+
+    // initializes the semaphores, items starts at zero since nothing is pending
     sem_init(&queue->eventQueue_mutex, 0, 1);
+    sem_init(&queue->eventQueue_items, 0, 0);
+}
+
+/**
+ * Sets the size limit and coalescing behaviour of the `EventQueue`.
+ *
+ * With `EVENT_QUEUE_COALESCE` an event for a system, resource and status that is already pending
+ * updates the pending event's amount and repeat count instead of taking a new slot, so the queue
+ * never holds more than one event per distinct condition. With `EVENT_QUEUE_DROP` every event is kept.
+ * Either way, once `high_water_mark` events are pending new ones are dropped.
+ * Has no effect on the lock-free backend.
+ *
+ * @param[in,out] queue            Pointer to the `EventQueue` to configure.
+ * @param[in]     high_water_mark  Most events allowed to be pending at once, must be positive.
+ * @param[in]     policy           `EVENT_QUEUE_DROP` or `EVENT_QUEUE_COALESCE`.
+ */
+void event_queue_configure(EventQueue *queue, int high_water_mark, int policy) {
+    // The lock-free rings are sized at init and always drop
+    if (queue == NULL || high_water_mark <= 0 || queue->backend == EVENT_QUEUE_LOCKFREE) {
+        return;
+    }
+    sem_wait(&queue->eventQueue_mutex);
+    queue->high_water_mark = high_water_mark;
+    queue->policy = (queue->index != NULL) ? policy : EVENT_QUEUE_DROP;
+    sem_post(&queue->eventQueue_mutex);
 }
 
 /**
  * Cleans up the `EventQueue`.
  *
  * Frees any memory and resources associated with the `EventQueue`.
+ * Every node lives in one of the pool's chunks, so only the chunks are freed. A queue with an
+ * arena frees nothing, its memory is released with the arena.
  * 
  * @param[in,out] queue  Pointer to the `EventQueue` to clean.
  */
 void event_queue_clean(EventQueue *queue) {
     // cleans the queue 
     if (queue != NULL){
-        EventNode *current = queue->head;
+        EventNodeChunk *current = queue->chunks;
         while (current != NULL) {
-            EventNode *next = current->next; 
+            EventNodeChunk *next = current->next; 
             free(current);                  
             current = next;                 
         }
-        queue->head = NULL; 
+        queue->chunks = NULL;
+        queue->free_list = NULL;
+        for (int i = 0; i < EVENT_QUEUE_LANES; i++) {
+            if (queue->arena == NULL) {
+                free(queue->rings[i].cells);
+            }
+            queue->rings[i].cells = NULL;
+        }
+        if (queue->arena == NULL) {
+            free(queue->index);
+        }
+        queue->index = NULL;
+        queue->pool_size = 0;
+        for (int i = 0; i < EVENT_QUEUE_LANES; i++) {
+            queue->lanes[i].head = NULL;
+            queue->lanes[i].tail = NULL;
+        }
         queue->size = 0;
         sem_destroy(&queue->eventQueue_mutex);    
+        sem_destroy(&queue->eventQueue_items);
     }
 }
 
@@ -69,19 +206,65 @@ void event_queue_clean(EventQueue *queue) {
  * Pushes an `Event` onto the `EventQueue`.
  *
  * Adds the event to the queue in a thread-safe manner, maintaining priority order (highest first).
+ * Each priority level is its own FIFO, so the push is an O(1) append to the tail of its lane.
+ * Priorities outside PRIORITY_LOW..PRIORITY_HIGH share the nearest lane.
+ * With the coalescing policy an event matching a pending one is merged into it (see `event_queue_configure`).
+ * If the queue is at its high-water mark the event is dropped.
+ * With a trace the push is recorded first, whatever becomes of the event.
  *
  * @param[in,out] queue  Pointer to the `EventQueue`.
  * @param[in]     event  Pointer to the `Event` to push onto the queue.
  */
 void event_queue_push(EventQueue *queue, const Event *event) {
+    EventNode *node = NULL;
+
+    if (queue->trace != NULL) {
+        trace_push(queue->trace, event);
+    }
+#ifdef P2_STATS
+    // Stamped here so the latency covers the wait for the lock too
+    Event stamped = *event;
+    stamped.pushed_ns = monotonic_now_ns();
+    event = &stamped;
+#endif
+
+    if (queue->backend == EVENT_QUEUE_LOCKFREE) {
+        if (event_ring_push(&queue->rings[event_queue_lane(event->priority)], event)) {
+            sem_post(&queue->eventQueue_items);
+        }
+        else {
+            atomic_fetch_add(&queue->dropped, 1);
+        }
+        return;
+    }
+
     // Unlocks the program
-    sem_wait(&queue->eventQueue_mutex);
-    
-    // allocates memory for node
-    EventNode *node = (EventNode *)malloc(sizeof(EventNode));
+    stats_sem_wait(&queue->eventQueue_mutex, STATS_PUSH_WAIT);
+
+    if (queue->policy == EVENT_QUEUE_COALESCE) {
+        node = event_queue_find_match(queue, event);
+        if (node != NULL) {
+            // The manager only needs the latest amount for a condition it has not handled yet,
+            // the push time stays that of the first report
+            node->event.amount = event->amount;
+            node->event.count += event->count;
+            sem_post(&queue->eventQueue_mutex);
+            return;
+        }
+    }
+
+    if (queue->size >= queue->high_water_mark) {
+        atomic_fetch_add(&queue->dropped, 1);
+        sem_post(&queue->eventQueue_mutex);
+        return;
+    }
+
+    // takes a node from the pool
+    node = event_pool_take(queue);
     // Checks if node is null
     if (node == NULL) {
         perror("Failed to allocate memory for new EventNode");
+        atomic_fetch_add(&queue->dropped, 1);
         sem_post(&queue->eventQueue_mutex); 
         return;
     }
@@ -89,24 +272,34 @@ void event_queue_push(EventQueue *queue, const Event *event) {
     node->event = *event;
     node->next = NULL;
 
-    
-    if (queue->head == NULL || queue->head->event.priority < event->priority) {
-        node->next = queue->head;
-        queue->head = node;
+    // Events of equal priority keep the order they were pushed in
+    EventLane *lane = &queue->lanes[event_queue_lane(event->priority)];
+    if (lane->tail == NULL) {
+        lane->head = node;
     } 
     else {
-        EventNode *curr = queue->head;
-        while (curr->next != NULL && curr->next->event.priority >= event->priority) {
-            curr = curr->next;
+        lane->tail->next = node;
+    }
+    lane->tail = node;
+
+    // Only coalescing looks nodes up, so the drop policy leaves them out of the index
+    node->index_link = NULL;
+    if (queue->policy == EVENT_QUEUE_COALESCE) {
+        EventNode **bucket = &queue->index[event_queue_hash(event)];
+        node->index_next = *bucket;
+        if (*bucket != NULL) {
+            (*bucket)->index_link = &node->index_next;
         }
-        node->next = curr->next;
-        curr->next = node;
+        node->index_link = bucket;
+        *bucket = node;
     }
 
     // Increments size of the queue
     queue->size++;
     // Locks the program 
     sem_post(&queue->eventQueue_mutex);
+    // Wakes the manager if it is waiting on the queue
+    sem_post(&queue->eventQueue_items);
 }
 
 
@@ -114,31 +307,471 @@ void event_queue_push(EventQueue *queue, const Event *event) {
  * Pops an `Event` from the `EventQueue`.
  *
  * Removes the highest priority event from the queue in a thread-safe manner.
+ * Only the fixed number of lanes is scanned, so the pop is O(1).
+ * With the lock-free backend only one thread may pop.
  *
  * @param[in,out] queue  Pointer to the `EventQueue`.
  * @param[out]    event  Pointer to the `Event` structure to store the popped event.
  * @return               Non-zero if an event was successfully popped; zero otherwise.
  */
 int event_queue_pop(EventQueue *queue, Event *event) {
+    EventLane *lane = NULL;
+
+    if (queue->backend == EVENT_QUEUE_LOCKFREE) {
+        for (int i = EVENT_QUEUE_LANES - 1; i >= 0; i--) {
+            if (event_ring_pop(&queue->rings[i], event)) {
+                sem_trywait(&queue->eventQueue_items);
+                return 1;
+            }
+        }
+        return 0;
+    }
+
     // Unlocks the program
     sem_wait(&queue->eventQueue_mutex);
-    if (queue->head == NULL) {
+    // Finds the highest priority lane with something in it
+    for (int i = EVENT_QUEUE_LANES - 1; i >= 0; i--) {
+        if (queue->lanes[i].head != NULL) {
+            lane = &queue->lanes[i];
+            break;
+        }
+    }
+    if (lane == NULL) {
     	sem_post(&queue->eventQueue_mutex); 
         return 0; 
     }
 
-    *event = queue->head->event;
+    *event = lane->head->event;
 
-    EventNode *remove = queue->head;
-    queue->head = queue->head->next;
+    EventNode *remove = lane->head;
+    lane->head = remove->next;
+    if (lane->head == NULL) {
+        lane->tail = NULL;
+    }
+    event_queue_unindex(remove);
 
-    // frees remove
-    free(remove);
+    // returns remove to the pool
+    event_pool_give(queue, remove);
 
     // size of the queue decrements
     queue->size--;
     
     // Locks the program
     sem_post(&queue->eventQueue_mutex);
+    // Keeps the pending count in step with the queue, the post for this event already happened in push
+    sem_trywait(&queue->eventQueue_items);
+    return 1;
+}
+
+/**
+ * Adds a chunk of `EVENT_POOL_CHUNK` nodes to the queue's free list.
+ *
+ * Chunks from the queue's arena are not kept in `chunks`, the arena frees them.
+ *
+ * @param[in,out] queue  Pointer to the `EventQueue` owning the pool.
+ * @return               Non-zero if the chunk was allocated; zero otherwise.
+ */
+static int event_pool_grow(EventQueue *queue) {
+    EventNodeChunk *chunk = (queue->arena != NULL) ? (EventNodeChunk *)arena_alloc(queue->arena, sizeof(EventNodeChunk), _Alignof(EventNodeChunk))
+                                                   : (EventNodeChunk *)malloc(sizeof(EventNodeChunk));
+    if (chunk == NULL) {
+        return 0;
+    }
+
+    for (int i = 0; i < EVENT_POOL_CHUNK; i++) {
+        chunk->nodes[i].next = queue->free_list;
+        queue->free_list = &chunk->nodes[i];
+    }
+
+    if (queue->arena == NULL) {
+        chunk->next = queue->chunks;
+        queue->chunks = chunk;
+    }
+    queue->pool_size += EVENT_POOL_CHUNK;
+    return 1;
+}
+
+/**
+ * Takes a node from the pool, growing it by a chunk when the free list is empty.
+ *
+ * @param[in,out] queue  Pointer to the `EventQueue` owning the pool.
+ * @return               A free node, or NULL if a new chunk could not be allocated.
+ */
+static EventNode *event_pool_take(EventQueue *queue) {
+    EventNode *node;
+
+    if (queue->free_list == NULL && !event_pool_grow(queue)) {
+        return NULL;
+    }
+
+    node = queue->free_list;
+    queue->free_list = node->next;
+    return node;
+}
+
+/**
+ * Returns a node to the pool's free list.
+ *
+ * @param[in,out] queue  Pointer to the `EventQueue` owning the pool.
+ * @param[in]     node   Node that is no longer in the queue.
+ */
+static void event_pool_give(EventQueue *queue, EventNode *node) {
+    node->next = queue->free_list;
+    queue->free_list = node;
+}
+
+/**
+ * Finds a pending event for the same system, resource and status.
+ *
+ * @param[in] queue  Pointer to the `EventQueue` to search.
+ * @param[in] event  Event to match against.
+ * @return           The matching node, or NULL if there is none.
+ */
+static EventNode *event_queue_find_match(EventQueue *queue, const Event *event) {
+    for (EventNode *curr = queue->index[event_queue_hash(event)]; curr != NULL; curr = curr->index_next) {
+        if (curr->event.system == event->system &&
+            curr->event.resource == event->resource &&
+            curr->event.status == event->status) {
+            return curr;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Removes a node that is leaving the queue from its index bucket.
+ *
+ * The node's back-link points at whatever points at it, so this is O(1) however long the chain is.
+ *
+ * @param[in,out] node  Node being popped.
+ */
+static void event_queue_unindex(EventNode *node) {
+    // Pushed under the drop policy
+    if (node->index_link == NULL) {
+        return;
+    }
+
+    *node->index_link = node->index_next;
+    if (node->index_next != NULL) {
+        node->index_next->index_link = node->index_link;
+    }
+    node->index_link = NULL;
+}
+
+/**
+ * Hashes the condition an event reports (its system, resource and status).
+ *
+ * @param[in] event  Event to hash.
+ * @return           Bucket index below `EVENT_INDEX_BUCKETS`.
+ */
+static size_t event_queue_hash(const Event *event) {
+    unsigned long long hash = (unsigned long long)(size_t)event->system;
+    hash = hash * 31 + (unsigned long long)(size_t)event->resource;
+    hash = hash * 31 + (unsigned long long)(event->status + 1);
+    // Fibonacci hashing spreads the pointer bits across the buckets
+    hash *= 11400714819323198485ull;
+    return (size_t)(hash >> 32) & (EVENT_INDEX_BUCKETS - 1);
+}
+
+/**
+ * Maps a priority onto the index of its lane.
+ *
+ * @param[in] priority  Priority of an event.
+ * @return              Lane index, clamped to the PRIORITY_LOW..PRIORITY_HIGH range.
+ */
+static int event_queue_lane(int priority) {
+    if (priority < PRIORITY_LOW) {
+        priority = PRIORITY_LOW;
+    }
+    else if (priority > PRIORITY_HIGH) {
+        priority = PRIORITY_HIGH;
+    }
+    return priority - PRIORITY_LOW;
+}
+
+/**
+ * Pops up to `max` events from the `EventQueue` in one go.
+ *
+ * Events come out in the same order repeated `event_queue_pop` calls would give, but the
+ * lock is taken once for the whole batch so producers contend with the consumer far less.
+ *
+ * @param[in,out] queue  Pointer to the `EventQueue`.
+ * @param[out]    out    Array of at least `max` events to fill.
+ * @param[in]     max    Most events to pop.
+ * @return               Number of events popped, zero if the queue was empty.
+ */
+int event_queue_drain(EventQueue *queue, Event *out, int max) {
+    int count = 0;
+
+    if (queue->backend == EVENT_QUEUE_LOCKFREE) {
+        stats_record(STATS_QUEUE_DEPTH, event_queue_size(queue));
+        for (int i = EVENT_QUEUE_LANES - 1; i >= 0 && count < max; i--) {
+            while (count < max && event_ring_pop(&queue->rings[i], &out[count])) {
+                count++;
+            }
+        }
+    }
+    else {
+        stats_sem_wait(&queue->eventQueue_mutex, STATS_DRAIN_WAIT);
+        stats_record(STATS_QUEUE_DEPTH, queue->size);
+        for (int i = EVENT_QUEUE_LANES - 1; i >= 0 && count < max; i--) {
+            EventLane *lane = &queue->lanes[i];
+            while (count < max && lane->head != NULL) {
+                EventNode *remove = lane->head;
+                out[count++] = remove->event;
+                lane->head = remove->next;
+                event_queue_unindex(remove);
+                event_pool_give(queue, remove);
+            }
+            if (lane->head == NULL) {
+                lane->tail = NULL;
+            }
+        }
+        queue->size -= count;
+        sem_post(&queue->eventQueue_mutex);
+    }
+
+    // Keeps the pending count in step with the queue, including the posts of event_queue_wake
+    if (atomic_load_explicit(&queue->wakeups, memory_order_relaxed) != 0) {
+        for (int i = atomic_exchange(&queue->wakeups, 0); i > 0; i--) {
+            sem_trywait(&queue->eventQueue_items);
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        sem_trywait(&queue->eventQueue_items);
+    }
+    return count;
+}
+
+/**
+ * Copies pending events out of an `EventQueue` without removing them.
+ *
+ * The events come in the order `event_queue_drain` would give, starting `from` events in, so
+ * repeated calls with `from` advanced by each count walk the whole queue. With the lock-free
+ * backend only the consumer may call this, as with `event_queue_drain`.
+ *
+ * @param[in,out] queue  Pointer to the `EventQueue`.
+ * @param[out]    out    Array of at least `max` events to fill.
+ * @param[in]     max    Most events to copy.
+ * @param[in]     from   Number of pending events to skip.
+ * @return               Number of events copied, zero once `from` reaches the end of the queue.
+ */
+int event_queue_peek(EventQueue *queue, Event *out, int max, int from) {
+    int count = 0;
+
+    if (queue->backend == EVENT_QUEUE_LOCKFREE) {
+        for (int i = EVENT_QUEUE_LANES - 1; i >= 0 && count < max; i--) {
+            EventRing *ring = &queue->rings[i];
+            size_t pos = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+
+            // Published cells stay put until the consumer pops them, which is the caller
+            while (ring->cells != NULL && count < max
+                   && atomic_load_explicit(&ring->cells[pos & ring->mask].sequence, memory_order_acquire) == pos + 1) {
+                if (from > 0) {
+                    from--;
+                }
+                else {
+                    out[count++] = ring->cells[pos & ring->mask].event;
+                }
+                pos++;
+            }
+        }
+        return count;
+    }
+
+    sem_wait(&queue->eventQueue_mutex);
+    for (int i = EVENT_QUEUE_LANES - 1; i >= 0 && count < max; i--) {
+        for (EventNode *node = queue->lanes[i].head; node != NULL && count < max; node = node->next) {
+            if (from > 0) {
+                from--;
+            }
+            else {
+                out[count++] = node->event;
+            }
+        }
+    }
+    sem_post(&queue->eventQueue_mutex);
+    return count;
+}
+
+/**
+ * Wakes the thread waiting on the `EventQueue` without pushing an event.
+ *
+ * The wait returns as if an event had been pushed, and the next `event_queue_drain` takes the
+ * wakeup back, so the count of pending events stays right.
+ *
+ * @param[in,out] queue  Pointer to the `EventQueue`.
+ */
+void event_queue_wake(EventQueue *queue) {
+    // Posted first, a drain only takes back posts that have happened
+    sem_post(&queue->eventQueue_items);
+    atomic_fetch_add(&queue->wakeups, 1);
+}
+
+/**
+ * Waits until the `EventQueue` has a pending event or the timeout passes.
+ *
+ * Blocks on the pending-items semaphore instead of polling, so an idle manager uses no CPU.
+ * The event is not removed, call `event_queue_pop` afterwards to take it.
+ *
+ * @param[in,out] queue       Pointer to the `EventQueue`.
+ * @param[in]     timeout_ms  Longest time to wait in milliseconds, zero or less returns immediately.
+ * @return                    Non-zero if an event is pending; zero if the wait timed out.
+ */
+int event_queue_wait(EventQueue *queue, int timeout_ms) {
+    struct timespec deadline;
+    int result;
+
+    if (timeout_ms <= 0) {
+        result = sem_trywait(&queue->eventQueue_items);
+    }
+    else {
+        // sem_timedwait takes an absolute CLOCK_REALTIME deadline
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        do {
+            result = sem_timedwait(&queue->eventQueue_items, &deadline);
+        } while (result != 0 && errno == EINTR);
+    }
+
+    if (result != 0) {
+        return 0;
+    }
+
+    // Give the count back so the pop that follows can account for the event
+    sem_post(&queue->eventQueue_items);
+    return 1;
+}
+
+/**
+ * Returns the number of pending events.
+ *
+ * With the lock-free backend the count is a snapshot that may already be out of date.
+ *
+ * @param[in] queue  Pointer to the `EventQueue`.
+ * @return           Number of events waiting to be popped.
+ */
+int event_queue_size(EventQueue *queue) {
+    int size = 0;
+
+    if (queue->backend == EVENT_QUEUE_LOCKFREE) {
+        for (int i = 0; i < EVENT_QUEUE_LANES; i++) {
+            size += (int)(atomic_load_explicit(&queue->rings[i].enqueue_pos, memory_order_relaxed) -
+                          atomic_load_explicit(&queue->rings[i].dequeue_pos, memory_order_relaxed));
+        }
+        return size;
+    }
+
+    sem_wait(&queue->eventQueue_mutex);
+    size = queue->size;
+    sem_post(&queue->eventQueue_mutex);
+    return size;
+}
+
+/**
+ * Allocates the slots of an `EventRing` and marks them all free.
+ *
+ * @param[out]    ring      Pointer to the `EventRing` to initialize.
+ * @param[in]     capacity  Number of slots, must be a power of two.
+ * @param[in,out] arena     Pointer to the `Arena` to allocate the slots from, or NULL to use malloc.
+ * @return                  Non-zero if the slots were allocated; zero otherwise.
+ */
+static int event_ring_init(EventRing *ring, size_t capacity, Arena *arena) {
+    ring->cells = (arena != NULL) ? (EventCell *)arena_alloc(arena, capacity * sizeof(EventCell), _Alignof(EventCell))
+                                  : (EventCell *)malloc(capacity * sizeof(EventCell));
+    if (ring->cells == NULL) {
+        ring->mask = 0;
+        return 0;
+    }
+
+    // A slot is free for the producer whose position equals its sequence
+    for (size_t i = 0; i < capacity; i++) {
+        atomic_init(&ring->cells[i].sequence, i);
+    }
+    ring->mask = capacity - 1;
+    atomic_init(&ring->enqueue_pos, 0);
+    atomic_init(&ring->dequeue_pos, 0);
+    return 1;
+}
+
+/**
+ * Pushes an `Event` onto an `EventRing` without taking a lock.
+ *
+ * Producers claim a position with compare-and-swap, write the slot, then publish it by
+ * advancing the slot's sequence. A producer never waits on another producer or the consumer.
+ *
+ * @param[in,out] ring   Pointer to the `EventRing`.
+ * @param[in]     event  Pointer to the `Event` to push.
+ * @return               Non-zero if the event was pushed; zero if the ring is full.
+ */
+static int event_ring_push(EventRing *ring, const Event *event) {
+    EventCell *cell;
+    size_t pos, sequence;
+    ptrdiff_t diff;
+
+    if (ring->cells == NULL) {
+        return 0;
+    }
+
+    pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+    for (;;) {
+        cell = &ring->cells[pos & ring->mask];
+        sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        diff = (ptrdiff_t)sequence - (ptrdiff_t)pos;
+
+        if (diff == 0) {
+            // The slot is free, try to claim this position
+            if (atomic_compare_exchange_weak_explicit(&ring->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            // The consumer has not freed this slot yet, the ring is full
+            return 0;
+        }
+        else {
+            // Another producer claimed the position first
+            pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+            stats_count(STATS_RING_RETRIES, 1);
+        }
+    }
+
+    cell->event = *event;
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+    return 1;
+}
+
+/**
+ * Pops the oldest `Event` from an `EventRing`, must only be called by the single consumer.
+ *
+ * @param[in,out] ring   Pointer to the `EventRing`.
+ * @param[out]    event  Pointer to the `Event` structure to store the popped event.
+ * @return               Non-zero if an event was popped; zero if no published event is waiting.
+ */
+static int event_ring_pop(EventRing *ring, Event *event) {
+    EventCell *cell;
+    size_t pos;
+
+    if (ring->cells == NULL) {
+        return 0;
+    }
+
+    pos = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+    cell = &ring->cells[pos & ring->mask];
+    if (atomic_load_explicit(&cell->sequence, memory_order_acquire) != pos + 1) {
+        return 0;
+    }
+
+    *event = cell->event;
+    // Free the slot for the producer that wraps around to it
+    atomic_store_explicit(&cell->sequence, pos + ring->mask + 1, memory_order_release);
+    atomic_store_explicit(&ring->dequeue_pos, pos + 1, memory_order_relaxed);
     return 1;
 }
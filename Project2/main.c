@@ -3,17 +3,331 @@
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>
+#include <unistd.h>
 
-void load_data(Manager *manager);
+static int run_thread_per_system(Manager *manager, const Placement *placement);
+static int run_pool(Manager *manager, int worker_count, const Placement *placement);
+static int run_partitioned(Manager *manager, int partition_count, int worker_count);
+static void print_placement(const Placement *placement);
+static int run_virtual(Manager *manager, long long limit_ms, int tick, const char *checkpoint, long long checkpoint_ms);
+static int run_replay(Manager *manager, const char *path, Trace *record);
+static void print_change(Manager *manager, const TraceRecord *change);
 
-int main(void) {
+int main(int argc, char *argv[]) {
     Manager manager;
-    manager_init(&manager); 
-    load_data(&manager);
+    int queue_backend = EVENT_QUEUE_LOCKED;
+    int worker_count = 0;   // Zero runs one thread per system
+    long long virtual_limit = 0;  // Non-zero runs on the virtual clock for at most this many milliseconds
+    int verbose = 0;
+#ifdef P2_STATS
+    int lateness = 1;             // Non-zero to print each system's lateness after a real-time run, always with the statistics
+#else
+    int lateness = 0;
+#endif
+    int tick = 0;                 // Non-zero to run the virtual clock with the tick engine
+    const char *scenario = NULL;  // Scenario file to load instead of the sample data
+    int tables = 0;               // Non-zero to build the manager's structure-of-arrays tables
+    int render = 0;               // Non-zero to draw the display on a renderer thread
+    Renderer renderer;
+    int headless = 0;             // Non-zero to skip the terminal display and event lines
+    const char *telemetry_path = NULL;
+    int telemetry_interval = TELEMETRY_INTERVAL;
+    Telemetry telemetry;
+    int relaxed_quota = 0;        // Non-zero to buffer stores into the resources flagged relaxed
+    int relaxed_interval = RESOURCE_FLUSH_INTERVAL;
+    int control = -1;             // Controller policy, -1 keeps the one the scenario was loaded with
+    const char *checkpoint = NULL;  // Checkpoint to write during a virtual run
+    long long checkpoint_ms = 0;
+    int pin = 0;                  // Non-zero to pin the threads to the NUMA nodes of their systems
+    Placement placement;
+    int partitions = 0;           // Non-zero splits the systems between this many Managers
+    const char *socket_path = NULL;  // Control socket to serve during a real-time run
+    Endpoint endpoint;
+    const char *record_path = NULL;  // Trace to record every push and status change into
+    const char *replay_path = NULL;  // Trace to replay instead of running the systems
+    Trace trace;
+    int result;
 
+    // A sweep builds its own managers
+    if (argc > 1 && strcmp(argv[1], "--sweep") == 0) {
+        return sweep_main(argc - 2, argv + 2);
+    }
+    if (argc == 4 && strcmp(argv[1], "--compile") == 0) {
+        return scenario_compile(argv[2], argv[3]) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Parse the command line options
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--lockfree") == 0) {
+            queue_backend = EVENT_QUEUE_LOCKFREE;
+        }
+        else if (strcmp(argv[i], "--pool") == 0) {
+            // Optional worker count, defaults to the number of cores
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0) {
+                worker_count = atoi(argv[++i]);
+            }
+            else {
+                worker_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+                if (worker_count < 1) {
+                    worker_count = 1;
+                }
+            }
+        }
+        else if (strcmp(argv[i], "--virtual") == 0) {
+            // Optional limit in milliseconds of simulated time
+            virtual_limit = VIRTUAL_TIME_LIMIT;
+            if (i + 1 < argc && atoll(argv[i + 1]) > 0) {
+                virtual_limit = atoll(argv[++i]);
+            }
+        }
+        else if (strcmp(argv[i], "--tick") == 0) {
+            // Implies a virtual clock run, with the default limit unless --virtual gives one
+            tick = 1;
+        }
+        else if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = 1;
+        }
+        else if (strcmp(argv[i], "--lateness") == 0) {
+            lateness = 1;
+        }
+        else if (strcmp(argv[i], "--headless") == 0) {
+            headless = 1;
+        }
+        else if (strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc) {
+            telemetry_path = argv[++i];
+            // Optional milliseconds between snapshots
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0) {
+                telemetry_interval = atoi(argv[++i]);
+            }
+        }
+        else if (strcmp(argv[i], "--render") == 0) {
+            render = 1;
+        }
+        else if (strcmp(argv[i], "--soa") == 0) {
+            tables = 1;
+        }
+        else if (strcmp(argv[i], "--relaxed") == 0) {
+            relaxed_quota = RESOURCE_RELAXED_QUOTA;
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0) {
+                relaxed_quota = atoi(argv[++i]);
+                if (i + 1 < argc && atoi(argv[i + 1]) > 0) {
+                    relaxed_interval = atoi(argv[++i]);
+                }
+            }
+        }
+        else if (strcmp(argv[i], "--control") == 0 && i + 1 < argc && controller_policy(argv[i + 1]) >= 0) {
+            control = controller_policy(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--checkpoint") == 0 && i + 2 < argc && atoll(argv[i + 2]) >= 0) {
+            checkpoint = argv[++i];
+            checkpoint_ms = atoll(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--partitions") == 0) {
+            // Optional partition count, defaults to the number of cores
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0) {
+                partitions = atoi(argv[++i]);
+            }
+            else {
+                partitions = (int)sysconf(_SC_NPROCESSORS_ONLN);
+                if (partitions < 1) {
+                    partitions = 1;
+                }
+            }
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--pin") == 0) {
+            pin = 1;
+        }
+        else if (strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) {
+            scenario = argv[++i];
+        }
+        else {
+            printf("Usage: %s [--lockfree] [--pool [workers]] [--virtual [limit_ms]] [--tick] [--verbose] [--lateness] [--scenario file] [--soa] [--render]\n"
+               "          [--headless] [--telemetry file [interval_ms]] [--relaxed [quota [interval_ms]]]\n"
+               "          [--control reactive|hysteresis|proportional] [--checkpoint file at_ms] [--pin]\n"
+               "          [--partitions [count]] [--socket path] [--record trace] [--replay trace]\n", argv[0]);
+            printf("       %s --compile scenario.txt scenario.bin\n", argv[0]);
+            printf("       %s --sweep [-j jobs] [--limit limit_ms] name=values...\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    // Partitions start their threads without a placement, refuse it rather than print one that is never applied
+    if (pin && partitions > 0) {
+        printf("--pin cannot be combined with --partitions\n");
+        return EXIT_FAILURE;
+    }
+
+    manager_init_backend(&manager, queue_backend); 
+    if (scenario == NULL) {
+        load_data(&manager);
+    }
+    else if (!scenario_load(&manager, scenario)) {
+        manager_clean(&manager);
+        return EXIT_FAILURE;
+    }
+    if (tick && virtual_limit == 0) {
+        virtual_limit = VIRTUAL_TIME_LIMIT;
+    }
+    // Virtual runs have a single thread, so they always store strictly and stay exact
+    for (int i = 0; relaxed_quota > 0 && virtual_limit == 0 && replay_path == NULL && i < manager.resource_array.size; i++) {
+        Resource *resource = manager.resource_array.resources[i];
+        if (resource->flags & RESOURCE_RELAXED) {
+            resource_set_relaxed(resource, relaxed_quota, relaxed_interval);
+        }
+    }
+    if (checkpoint != NULL && virtual_limit == 0) {
+        virtual_limit = VIRTUAL_TIME_LIMIT;
+    }
+    if (control >= 0 && !manager_set_controller(&manager, control)) {
+        printf("Could not allocate memory for the controller, reacting to every event instead\n");
+    }
+    if (tables && !manager_build_tables(&manager)) {
+        printf("Could not allocate memory for the system table, scanning the system array instead\n");
+    }
+
+    if (telemetry_path != NULL) {
+        if (!telemetry_open(&telemetry, &manager, telemetry_path, telemetry_interval, virtual_limit > 0 || replay_path != NULL)) {
+            manager_clean(&manager);
+            return EXIT_FAILURE;
+        }
+        manager.telemetry = &telemetry;
+    }
+    if (record_path != NULL) {
+        if (!trace_open(&trace, &manager, record_path, virtual_limit > 0 || replay_path != NULL)) {
+            if (manager.telemetry != NULL) {
+                telemetry_close(&telemetry);
+            }
+            manager_clean(&manager);
+            return EXIT_FAILURE;
+        }
+        // A replay records into the trace itself
+        if (replay_path == NULL) {
+            manager.trace = &trace;
+            manager.event_queue.trace = &trace;
+        }
+    }
+    if (headless) {
+        manager.headless = 1;
+        manager.log_events = 0;
+    }
+
+    if (replay_path != NULL) {
+        manager.log_events = verbose && !headless;
+        result = run_replay(&manager, replay_path, (record_path != NULL) ? &trace : NULL);
+    }
+    else if (virtual_limit > 0) {
+        // Printing every event would dominate a virtual run
+        manager.log_events = verbose && !headless;
+        result = run_virtual(&manager, virtual_limit, tick, checkpoint, checkpoint_ms);
+    }
+    else {
+        if (render && renderer_init(&renderer, &manager)) {
+            if (renderer_start(&renderer)) {
+                manager.renderer = &renderer;
+            }
+            else {
+                renderer_clean(&renderer);
+                render = 0;
+            }
+        }
+        else if (render) {
+            printf("Could not allocate memory for the renderer, drawing the display inline\n");
+            render = 0;
+        }
+
+        // Placement only matters to threads running at the same time, virtual runs have one
+        if (pin && !placement_build(&placement, &manager.resource_array, &manager.system_array)) {
+            printf("Could not allocate memory for the placement, leaving the threads unpinned\n");
+            pin = 0;
+        }
+        if (pin) {
+            print_placement(&placement);
+        }
+
+        // A virtual run has no time for anyone to connect, so the socket is only served here
+        if (socket_path != NULL) {
+            if (endpoint_init(&endpoint, &manager, socket_path) && endpoint_start(&endpoint)) {
+                manager.endpoint = &endpoint;
+            }
+            else {
+                printf("Could not open the control socket, running without it\n");
+                if (endpoint.listen_fd >= 0) {
+                    endpoint_clean(&endpoint);
+                }
+            }
+        }
+
+        if (partitions > 0) {
+            result = run_partitioned(&manager, partitions, worker_count);
+        }
+        else if (worker_count > 0) {
+            result = run_pool(&manager, worker_count, pin ? &placement : NULL);
+        }
+        else {
+            result = run_thread_per_system(&manager, pin ? &placement : NULL);
+        }
+
+        if (pin) {
+            placement_clean(&placement);
+        }
+
+        if (manager.endpoint != NULL) {
+            endpoint_stop(&endpoint);
+            endpoint_clean(&endpoint);
+            manager.endpoint = NULL;
+        }
+
+        if (render) {
+            renderer_stop(&renderer);
+            renderer_clean(&renderer);
+            manager.renderer = NULL;
+        }
+
+        if (result == EXIT_SUCCESS && lateness) {
+            system_array_print_lateness(&manager.system_array);
+        }
+    }
+
+    if (record_path != NULL) {
+        manager.trace = NULL;
+        manager.event_queue.trace = NULL;
+        trace_close(&trace);
+    }
+    if (manager.telemetry != NULL) {
+        telemetry_close(&telemetry);
+        manager.telemetry = NULL;
+    }
+
+    // Only compiled in with `make STATS=1`, goes to stderr so virtual runs keep a reproducible stdout
+    stats_print(stderr, &manager.system_array);
+    stats_clean();
+
+    // Cleans the manager
+    manager_clean(&manager); 
+
+    return result;
+}
+
+/**
+ * Runs the simulation with a dedicated thread for the manager and for every system.
+ *
+ * @param[in,out] manager    Pointer to the loaded `Manager`.
+ * @param[in]     placement  Placement to pin every system's thread to its node, NULL to leave them unpinned.
+ * @return                   `EXIT_SUCCESS`, or `EXIT_FAILURE` if a thread could not be created.
+ */
+static int run_thread_per_system(Manager *manager, const Placement *placement) {
     // Thread Initialization
     pthread_t t1; 
-    pthread_t *t2 = malloc(manager.system_array.size * sizeof(pthread_t));
+    pthread_t *t2 = malloc(manager->system_array.size * sizeof(pthread_t));
+    int slots[PLACEMENT_MAX_NODES] = {0};  // Threads pinned to each node so far
 
     // Checks if t2 is null
     if (t2 == NULL) {
@@ -22,81 +336,268 @@ int main(void) {
     }
 
     // Thread creation 
-    if (pthread_create(&t1, NULL, manager_thread, &manager) != 0) {
+    if (pthread_create(&t1, NULL, manager_thread, manager) != 0) {
         printf("Could not create manager thread");
         free(t2); 
         return EXIT_FAILURE;
     }
     
-    for (int i = 0; i < manager.system_array.size; i++) {
-        System *system = manager.system_array.systems[i]; 
+    for (int i = 0; i < manager->system_array.size; i++) {
+        System *system = manager->system_array.systems[i]; 
         if (pthread_create(&t2[i], NULL, system_thread, system) != 0) {
             printf("Could not create system thread");
             free(t2); 
             return EXIT_FAILURE;
         }
+        if (placement != NULL) {
+            int node = placement->system_node[i];
+            placement_pin(placement, t2[i], node, slots[node]++);
+        }
     }
 
     // Joins mutiple threads together
     pthread_join(t1, NULL);
 
-    for (int i = 0; i < manager.system_array.size; i++) {
+    for (int i = 0; i < manager->system_array.size; i++) {
         pthread_join(t2[i], NULL);
     }
 
     // Frees thread t2
     free(t2);
-    // Cleans the manager
-    manager_clean(&manager); 
+    return EXIT_SUCCESS;
+}
 
-    return 0;
+/**
+ * Runs the simulation with the systems scheduled on a fixed pool of worker threads.
+ *
+ * @param[in,out] manager       Pointer to the loaded `Manager`.
+ * @param[in]     worker_count  Number of worker threads.
+ * @param[in]     placement     Placement to pin the workers and keep systems on their nodes, NULL for none.
+ * @return                      `EXIT_SUCCESS`, or `EXIT_FAILURE` if the pool could not be started.
+ */
+static int run_pool(Manager *manager, int worker_count, const Placement *placement) {
+    Scheduler scheduler;
+    pthread_t t1;
+
+    if (!scheduler_init_placement(&scheduler, &manager->system_array, worker_count, placement)) {
+        printf("Could not allocate memory for the scheduler");
+        return EXIT_FAILURE;
+    }
+
+    if (pthread_create(&t1, NULL, manager_thread, manager) != 0) {
+        printf("Could not create manager thread");
+        scheduler_clean(&scheduler);
+        return EXIT_FAILURE;
+    }
+
+    if (!scheduler_start(&scheduler)) {
+        printf("Could not create worker threads");
+        // Stop the manager, no system will ever report to it
+        atomic_store(&manager->simulation_running, 0);
+        pthread_join(t1, NULL);
+        scheduler_clean(&scheduler);
+        return EXIT_FAILURE;
+    }
+
+    pthread_join(t1, NULL);
+    scheduler_join(&scheduler);
+    scheduler_clean(&scheduler);
+    return EXIT_SUCCESS;
 }
 
+/**
+ * Runs the simulation with the systems split between partitions, each with a Manager of its own.
+ *
+ * The loaded Manager coordinates the partitions from this thread, see `partition_build`.
+ *
+ * @param[in,out] manager          Pointer to the loaded `Manager`.
+ * @param[in]     partition_count  Partitions wanted.
+ * @param[in]     worker_count     Workers shared between the partitions, zero for a thread per system.
+ * @return                         `EXIT_SUCCESS`, or `EXIT_FAILURE` if the partitions could not be set up or started.
+ */
+static int run_partitioned(Manager *manager, int partition_count, int worker_count) {
+    PartitionSet set;
+    int result = EXIT_SUCCESS;
+
+    if (!partition_build(&set, manager, partition_count)) {
+        printf("Could not allocate memory for the partitions\n");
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "%d partitions, %d shared resources\n", set.partition_count, set.shared_count);
+    for (int p = 0; p < set.partition_count; p++) {
+        fprintf(stderr, "Partition %d: %d systems\n", p, set.partitions[p].manager.system_array.size);
+    }
+
+    if (partition_start(&set, worker_count)) {
+        manager_thread(manager);
+    }
+    else {
+        printf("Could not start the partitions\n");
+        result = EXIT_FAILURE;
+    }
+    partition_stop(&set);
+    partition_clean(&set);
+    return result;
+}
 
 /**
- * Loads sample data for the simulation.
+ * Runs the simulation on the virtual clock and prints the final state.
  *
- * Calls all of the functions required to create resources and systems and add them to the Manager's data.
+ * Everything printed to stdout depends only on the scenario, so repeated runs give identical
+ * output. The wall clock time is printed to stderr. A checkpoint is written once the run
+ * reaches `checkpoint_ms`, and loading it with `--scenario` carries on from there with the same
+ * results; the run itself goes on while a child process writes it.
  *
- * @param[in,out] manager  Pointer to the `Manager` to populate with resource and system data.
+ * @param[in,out] manager        Pointer to the loaded `Manager`.
+ * @param[in]     limit_ms       Milliseconds of simulated time to stop at.
+ * @param[in]     tick           Non-zero to step groups of identical systems with the tick engine.
+ * @param[in]     checkpoint     Path of the checkpoint to write, or NULL for none.
+ * @param[in]     checkpoint_ms  Simulated time in milliseconds to write it at.
+ * @return                       `EXIT_SUCCESS`, or `EXIT_FAILURE` if the tick engine could not be built or the checkpoint written.
  */
-void load_data(Manager *manager) {
-    // Create resources
-    Resource *fuel, *oxygen, *energy, *distance;
-    resource_create(&fuel, "Fuel", 1000, 1000);
-    resource_create(&oxygen, "Oxygen", 20, 50);
-    resource_create(&energy, "Energy", 30, 50);
-    resource_create(&distance, "Distance", 0, 5000);
-
-    resource_array_add(&manager->resource_array, fuel);
-    resource_array_add(&manager->resource_array, oxygen);
-    resource_array_add(&manager->resource_array, energy);
-    resource_array_add(&manager->resource_array, distance);
-
-    // Create systems
-    System *propulsion_system, *life_support_system, *crew_capsule_system, *generator_system;
-    ResourceAmount consume_fuel, produce_distance;
-    resource_amount_init(&consume_fuel, fuel, 5);
-    resource_amount_init(&produce_distance, distance, 25);
-    system_create(&propulsion_system, "Propulsion", consume_fuel, produce_distance, 50, &manager->event_queue);
-
-    ResourceAmount consume_energy, produce_oxygen;
-    resource_amount_init(&consume_energy, energy, 7);
-    resource_amount_init(&produce_oxygen, oxygen, 4);
-    system_create(&life_support_system, "Life Support", consume_energy, produce_oxygen, 10, &manager->event_queue);
-
-    ResourceAmount consume_oxygen, produce_nothing;
-    resource_amount_init(&consume_oxygen, oxygen, 1);
-    resource_amount_init(&produce_nothing, NULL, 0);
-    system_create(&crew_capsule_system, "Crew", consume_oxygen, produce_nothing, 2, &manager->event_queue);
-
-    ResourceAmount consume_fuel_for_energy, produce_energy;
-    resource_amount_init(&consume_fuel_for_energy, fuel, 5);
-    resource_amount_init(&produce_energy, energy, 10);
-    system_create(&generator_system, "Generator", consume_fuel_for_energy, produce_energy, 20, &manager->event_queue);
-
-    system_array_add(&manager->system_array, propulsion_system);
-    system_array_add(&manager->system_array, life_support_system);
-    system_array_add(&manager->system_array, crew_capsule_system);
-    system_array_add(&manager->system_array, generator_system);
-}
\ No newline at end of file
+static int run_virtual(Manager *manager, long long limit_ms, int tick, const char *checkpoint, long long checkpoint_ms) {
+    TickEngine engine;
+    long long start = monotonic_now_ns();
+    long long steps = 0;
+    long long stall = 0;
+    long writer = -1;
+    double wall;
+
+    if (tick && !tick_engine_build(&engine, manager)) {
+        printf("Could not allocate memory for the tick engine\n");
+        return EXIT_FAILURE;
+    }
+    if (tick) {
+        fprintf(stderr, "Tick engine: %d systems in %d groups\n", manager->system_array.size, engine.group_count);
+    }
+    // The run stops at the checkpoint and carries on from it
+    for (int leg = (checkpoint != NULL) ? 0 : 1; leg < 2; leg++) {
+        long long until = (leg == 0 && checkpoint_ms < limit_ms) ? checkpoint_ms : limit_ms;
+
+        if (tick) {
+            steps += tick_engine_run(&engine, manager, until * 1000000LL);
+        }
+        else {
+            steps += manager_run_virtual(manager, until * 1000000LL, NULL);
+        }
+        if (leg == 0) {
+            long long fork_start = monotonic_now_ns();
+            writer = scenario_checkpoint(manager, checkpoint);
+            stall = monotonic_now_ns() - fork_start;
+        }
+    }
+    if (tick) {
+        tick_engine_clean(&engine);
+    }
+    wall = (monotonic_now_ns() - start) / 1e9;
+
+    if (manager->terminal_resource == NULL) {
+        printf("Time limit reached.\n");
+    }
+    else if (manager->terminal_status == STATUS_EMPTY) {
+        printf("%s depleted.\n", manager->terminal_resource->name);
+    }
+    else {
+        printf("%s at capacity.\n", manager->terminal_resource->name);
+    }
+    printf("Simulated time: %.3f s in %lld steps\n", manager->virtual_time / 1e9, steps);
+    for (int i = 0; i < manager->resource_array.size; i++) {
+        Resource *resource = manager->resource_array.resources[i];
+        printf("%s: %d / %d\n", resource->name, resource_get_amount(resource), resource->max_capacity);
+    }
+    fprintf(stderr, "Events handled: %ld, status changes: %ld\n", manager->events_handled, manager->status_changes);
+    fprintf(stderr, "Wall time: %.3f s (%.0fx real time)\n", wall, wall > 0 ? manager->virtual_time / 1e9 / wall : 0.0);
+    if (checkpoint != NULL) {
+        if (!scenario_checkpoint_wait(writer)) {
+            fprintf(stderr, "Could not write the checkpoint %s\n", checkpoint);
+            return EXIT_FAILURE;
+        }
+        fprintf(stderr, "Checkpoint %s written at %lld ms, the run stalled %.3f ms for it\n", checkpoint,
+                (checkpoint_ms < limit_ms) ? checkpoint_ms : limit_ms, stall / 1e6);
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Replays a trace into the loaded Manager and prints how its status changes compare.
+ *
+ * Like a virtual run, stdout only depends on the trace and the build, so replaying one trace
+ * with two builds and comparing their output shows whether the manager's reactions changed.
+ * The replay's throughput is printed to stderr.
+ *
+ * @param[in,out] manager  Pointer to the loaded `Manager`.
+ * @param[in]     path     Path of the trace.
+ * @param[in,out] record   Pointer to the open `Trace` to record the replay into, or NULL.
+ * @return                 `EXIT_SUCCESS` if the replay made the recorded status changes, `EXIT_FAILURE` otherwise.
+ */
+static int run_replay(Manager *manager, const char *path, Trace *record) {
+    TraceReplay replay;
+    double wall;
+
+    if (!trace_replay(manager, path, record, &replay)) {
+        return EXIT_FAILURE;
+    }
+    wall = replay.wall_ns / 1e9;
+
+    printf("Replayed %lld events over %.3f s of recorded time\n", replay.events, manager->virtual_time / 1e9);
+    if (replay.skipped > 0) {
+        printf("Skipped %lld events of systems or resources the scenario does not have\n", replay.skipped);
+    }
+    if (replay.lost > 0) {
+        printf("The recording dropped %lld records\n", replay.lost);
+    }
+    if (manager->terminal_resource != NULL) {
+        printf("%s %s.\n", manager->terminal_resource->name,
+               (manager->terminal_status == STATUS_EMPTY) ? "depleted" : "at capacity");
+    }
+    printf("Status changes: %lld recorded, %lld replayed\n", replay.recorded_changes, replay.replayed_changes);
+    if (replay.difference < 0) {
+        printf("Same status changes as recorded\n");
+    }
+    else {
+        printf("First difference at status change %lld\n  recorded: ", replay.difference);
+        print_change(manager, &replay.recorded);
+        printf("  replayed: ");
+        print_change(manager, &replay.replayed);
+    }
+    fprintf(stderr, "Events handled: %ld, status changes: %ld\n", manager->events_handled, manager->status_changes);
+    fprintf(stderr, "Wall time: %.3f s (%.0f events/s, %.0f ns per event)\n", wall,
+            wall > 0 ? replay.events / wall : 0.0, replay.events > 0 ? (double)replay.wall_ns / replay.events : 0.0);
+    return (replay.difference < 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Prints the line of a status change for `run_replay`.
+ *
+ * @param[in] manager  Pointer to the `Manager` the change was made in.
+ * @param[in] change   Pointer to the status record, of type 0 if there was no change.
+ */
+static void print_change(Manager *manager, const TraceRecord *change) {
+    if (change->type != TRACE_STATUS || change->system < 0 || change->system >= manager->system_array.size) {
+        printf("nothing\n");
+        return;
+    }
+    printf("%s %s, pace %d, at %.3f s\n", manager->system_array.systems[change->system]->name,
+           system_status_name(change->status), change->amount, change->time_ns / 1e9);
+}
+
+/**
+ * Prints where a placement puts the systems, to stderr so the display is left alone.
+ *
+ * @param[in] placement  Pointer to the built `Placement`.
+ */
+static void print_placement(const Placement *placement) {
+    for (int n = 0; n < placement->node_count; n++) {
+        int systems = 0;
+        int resources = 0;
+
+        for (int i = 0; i < placement->system_count; i++) {
+            systems += (placement->system_node[i] == n);
+        }
+        for (int i = 0; i < placement->resource_count; i++) {
+            resources += (placement->resource_node[i] == n);
+        }
+        fprintf(stderr, "Node %d: %d CPUs, %d systems, %d resources\n", placement->node_ids[n],
+            placement->cpu_start[n + 1] - placement->cpu_start[n], systems, resources);
+    }
+}
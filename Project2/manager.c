@@ -4,30 +4,77 @@
 #include <unistd.h>
 #include <string.h>
 #include <time.h>
+#include <stdarg.h>
 
 // This function is only used by this file, so declared here and set to static to avoid having it linked by any other file
 
 static void display_simulation_state(Manager *manager);
+static long long manager_now_ms(void);
+static void manager_log(Manager *manager, const char *format, ...);
+static void manager_set_status(Manager *manager, int index, int status, int pace);
+static int manager_index_ready(Manager *manager);
+static int manager_produces(const System *system, const Resource *resource);
+static int manager_forwards(Manager *manager, const Event *event);
+
+/**
+ * Initializes the `Manager` with the default locked event queue.
+ *
+ * @param[out] manager  Pointer to the `Manager` to initialize.
+ */
+void manager_init(Manager *manager) {
+    manager_init_backend(manager, EVENT_QUEUE_LOCKED);
+}
 
 /**
  * Initializes the `Manager`.
  *
  * Sets up the manager by initializing the system array, resource array, and event queue.
- * Prepares the simulation to be run.
+ * Prepares the simulation to be run. The arrays and the queue take their memory from the
+ * Manager's arena, and so should the resources and systems added to it: create them with
+ * `resource_create_arena` and `system_create_arena` on `&manager->arena`.
  *
- * @param[out] manager  Pointer to the `Manager` to initialize.
+ * @param[out] manager        Pointer to the `Manager` to initialize.
+ * @param[in]  queue_backend  `EVENT_QUEUE_LOCKED` or `EVENT_QUEUE_LOCKFREE`.
  */
-void manager_init(Manager *manager) {
-    manager->simulation_running = 1; // Any non-zero value to state the sim is running
-    system_array_init(&manager->system_array);
-    resource_array_init(&manager->resource_array);
-    event_queue_init(&manager->event_queue);
+void manager_init_backend(Manager *manager, int queue_backend) {
+    atomic_store(&manager->simulation_running, 1); // Any non-zero value to state the sim is running
+    arena_init(&manager->arena);
+    system_array_init_arena(&manager->system_array, &manager->arena);
+    resource_array_init_arena(&manager->resource_array, &manager->arena);
+    event_queue_init_arena(&manager->event_queue, queue_backend, &manager->arena);
+    manager->display_deadline = 0; // Display on the first run
+    manager->virtual_time = 0;
+    manager->step_limit = 0;
+    manager->log_events = 1;
+    manager->terminal_resource = NULL;
+    manager->terminal_status = STATUS_OK;
+    manager->system_table.size = 0;
+    manager->system_table.status = NULL;
+    manager->system_table.systems = NULL;
+    manager->resource_index.resource_count = 0;
+    manager->resource_index.system_count = 0;
+    manager->resource_index.producer_start = NULL;
+    manager->resource_index.producers = NULL;
+    manager->renderer = NULL;
+    manager->telemetry = NULL;
+    manager->endpoint = NULL;
+    manager->trace = NULL;
+    manager->headless = 0;
+    manager->scenario_map = NULL;
+    manager->scenario_map_size = 0;
+    controller_init(&manager->controller, CONTROL_REACTIVE, &manager->resource_array);
+    manager->events_handled = 0;
+    manager->status_changes = 0;
+    manager->coordinator = NULL;
+    manager->resource_partition = NULL;
+    manager->partition = -1;
 }
 
 /**
  * Cleans up the `Manager`.
  *
- * Frees all resources associated with the manager.
+ * Frees all resources associated with the manager. Everything it owns lives in its arena or
+ * in a mapped scenario, so teardown is one release of each instead of a free per object.
  *
  * @param[in,out] manager  Pointer to the `Manager` to clean.
  */
@@ -36,82 +83,327 @@ void manager_clean(Manager *manager) {
     if(manager == NULL){
         return;
     }
-    // Call sysetm, resource, and event clean functions  
+    system_table_clean(&manager->system_table);
+    resource_index_clean(&manager->resource_index);
+    controller_clean(&manager->controller);
+    // Objects living in a compiled scenario are not freed one by one
+    scenario_unload(manager);
+    // Call sysetm, resource, and event clean functions, they only forget what the arena holds
     system_array_clean(&manager->system_array);
     resource_array_clean(&manager->resource_array);
     event_queue_clean(&manager->event_queue);
+    arena_release(&manager->arena);
     
-    manager->simulation_running = 0;
+    atomic_store(&manager->simulation_running, 0);
 }
 
 /**
  * Runs the manager loop.
  *
  * Handles event processing, updates system statuses, and displays the simulation state.
+ * Pending events are taken from the queue in batches of up to `MANAGER_BATCH_SIZE` per lock
+ * acquisition and handled outside the queue's lock.
  * Continues until the simulation is no longer running. (In a multi-threaded implementation)
  *
  * @param[in,out] manager  Pointer to the `Manager`.
  */
 void manager_run(Manager *manager) {
-    Event event;
-    int i, status;
-    int event_found_flag = 0, no_oxygen_flag = 0, distance_reached_flag = 0, need_more_flag = 0, need_less_flag = 0;
-    
-    System *sys = NULL;
+    Event batch[MANAGER_BATCH_SIZE];
+    int count;
 
     // Update the display of the current state of things
     display_simulation_state(manager);
+    if (manager->telemetry != NULL) {
+        telemetry_poll(manager->telemetry);
+    }
+    // Only the loaded Manager writes the trace, the Managers of its partitions just add to it
+    if (manager->trace != NULL && manager->coordinator == NULL) {
+        trace_poll(manager->trace);
+    }
+    // Changes asked for on the control socket, which may terminate the simulation
+    if (manager->endpoint != NULL) {
+        endpoint_poll(manager->endpoint);
+    }
+    controller_update(manager, monotonic_now_ns());
 
-    // Process events if one is popped
-    
-    event_found_flag = event_queue_pop(&manager->event_queue, &event);
-
-    while (event_found_flag) {
-        // Handle the event
-        printf("Event: [%s] Reported Resource [%s : %d] Status [%d]\n",
-                event.system->name,
-                event.resource->name,
-                event.amount,
-                event.status);
-
-        // Set some flags based on the event that we can react to below
-        no_oxygen_flag        = (event.status == STATUS_EMPTY && strcmp(event.resource->name, "Oxygen") == 0);
-        distance_reached_flag = (event.status == STATUS_CAPACITY && strcmp(event.resource->name, "Distance") == 0);
-        need_more_flag        = (event.status == STATUS_LOW || event.status == STATUS_EMPTY || event.status == STATUS_INSUFFICIENT);
-        need_less_flag        = (event.status == STATUS_CAPACITY);
-
-        if (no_oxygen_flag) {
-            printf("Oxygen depleted. Terminating all systems.\n");
+    // Process events while any are pending
+    do {
+        count = event_queue_drain(&manager->event_queue, batch, MANAGER_BATCH_SIZE);
+        for (int i = 0; i < count; i++) {
+            manager_handle_event(manager, &batch[i]);
         }
+    } while (count == MANAGER_BATCH_SIZE);
+}
 
-        if (distance_reached_flag) {
-            printf("Destination reached. Terminating all systems.\n");
-        }
+/**
+ * Reacts to a single event.
+ *
+ * Terminates the simulation when a critical resource runs out or a goal resource reaches capacity. Otherwise the
+ * reactive policy speeds up or slows down the systems producing the reported resource on every event, and any other
+ * policy leaves the decision to `controller_event`. The Manager of a partition hands terminal events and those of
+ * resources it shares with other partitions to its coordinator instead (see `partition_build`).
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @param[in]     event    Pointer to the `Event` to handle.
+ */
+void manager_handle_event(Manager *manager, const Event *event) {
+    int critical_empty_flag = 0, goal_reached_flag = 0, need_more_flag = 0, need_less_flag = 0;
 
-        if (no_oxygen_flag || distance_reached_flag) {
-            status = TERMINATE;
-            manager->simulation_running = 0;
-        }
-        else if (need_more_flag) {
-            status = FAST;
+    // Once terminated, events still in the batch must not bring systems back to life
+    if (atomic_load(&manager->simulation_running) == 0 ||
+        (manager->coordinator != NULL && atomic_load(&manager->coordinator->simulation_running) == 0)) {
+        return;
+    }
+    if (manager_forwards(manager, event)) {
+        event_queue_push(&manager->coordinator->event_queue, event);
+        return;
+    }
+
+    manager->events_handled++;
+    stats_event_handled(event);
+    if (manager->telemetry != NULL) {
+        telemetry_event(manager->telemetry, event);
+    }
+
+    // Handle the event
+    if (manager->log_events) {
+        manager_log(manager, "Event: [%s] Reported Resource [%s : %d] Status [%d] Repeats [%d]\n",
+                event->system->name,
+                event->resource->name,
+                event->amount,
+                event->status,
+                event->count);
+    }
+
+    // Set some flags based on the event that we can react to below
+    critical_empty_flag   = (event->status == STATUS_EMPTY && (event->resource->flags & RESOURCE_CRITICAL));
+    goal_reached_flag     = (event->status == STATUS_CAPACITY && (event->resource->flags & RESOURCE_GOAL));
+    need_more_flag        = (event->status == STATUS_LOW || event->status == STATUS_EMPTY || event->status == STATUS_INSUFFICIENT);
+    need_less_flag        = (event->status == STATUS_CAPACITY || event->status == STATUS_HIGH);
+
+    if (critical_empty_flag && manager->log_events) {
+        manager_log(manager, "%s depleted. Terminating all systems.\n", event->resource->name);
+    }
+
+    if (goal_reached_flag && manager->log_events) {
+        manager_log(manager, "Destination reached (%s at capacity). Terminating all systems.\n", event->resource->name);
+    }
+
+    if (critical_empty_flag || goal_reached_flag) {
+        atomic_store(&manager->simulation_running, 0);
+        manager->terminal_resource = event->resource;
+        manager->terminal_status = event->status;
+        manager_set_producers(manager, NULL, TERMINATE, 0);
+    }
+    else if (manager->controller.policy != CONTROL_REACTIVE) {
+        controller_event(manager, event);
+    }
+    else if (need_more_flag) {
+        manager_set_producers(manager, event->resource, FAST, 0);
+    }
+    else if (need_less_flag) {
+        manager_set_producers(manager, event->resource, SLOW, 0);
+    }
+}
+
+/**
+ * Sets the status and pace of the systems producing a resource, or of every system.
+ *
+ * @param[in,out] manager   Pointer to the `Manager`.
+ * @param[in]     resource  Pointer to the produced `Resource`, NULL for every system.
+ * @param[in]     status    New status of the systems.
+ * @param[in]     pace      New pace of the systems, zero to follow the status.
+ */
+void manager_set_producers(Manager *manager, Resource *resource, int status, int pace) {
+    int i;
+
+    if (resource != NULL && manager_index_ready(manager)
+        && resource->id >= 0 && resource->id < manager->resource_index.resource_count) {
+        // Only the systems producing the resource can react
+        ResourceIndex *index = &manager->resource_index;
+        int resource_id = resource->id;
+
+        for (i = index->producer_start[resource_id]; i < index->producer_start[resource_id + 1]; i++) {
+            manager_set_status(manager, index->producers[i], status, pace);
         }
-        else if (need_less_flag) {
-            status = SLOW;
+    }
+    else if (manager->system_table.size > 0) {
+        // Streaming through the id columns and only touching the systems that change
+        SystemTable *table = &manager->system_table;
+        const int *produced = table->produced;
+        const int *outputs = table->outputs;
+        int *statuses = table->status;
+        int *paces = table->pace;
+        int size = table->size;
+        int resource_id = (resource != NULL) ? resource->id : -1;
+
+        for (i = 0; i < size; i++) {
+            // Only a recipe with further outputs needs a look at its System
+            int producer = (resource == NULL || produced[i] == resource_id
+                            || (outputs[i] > 1 && manager_produces(table->systems[i], resource)));
+
+            if (producer && (statuses[i] != status || paces[i] != pace)) {
+                manager->status_changes += (status != TERMINATE);
+                if (manager->trace != NULL) {
+                    trace_status(manager->trace, table->systems[i], status, pace);
+                }
+                statuses[i] = status;
+                paces[i] = pace;
+                system_set_control(table->systems[i], status, pace);
+            }
         }
+    }
+    else {
+        // Update all of the systems to speed up or slow down production, or terminate
+        for (i = 0; i < manager->system_array.size; i++) {
+            System *sys = manager->system_array.systems[i];
+            int current_status, current_pace;
 
-        if (no_oxygen_flag || distance_reached_flag || need_more_flag || need_less_flag) {
-            // Update all of the systems to speed up or slow down production, or terminate
-            for (i = 0; i < manager->system_array.size; i++) {
-                sys = manager->system_array.systems[i];
-                if (status == TERMINATE || sys->produced.resource == event.resource) {
-                    sys->status = status;
+            system_get_control(sys, &current_status, &current_pace);
+            if ((resource == NULL || manager_produces(sys, resource)) && (current_status != status || current_pace != pace)) {
+                manager->status_changes += (status != TERMINATE);
+                if (manager->trace != NULL) {
+                    trace_status(manager->trace, sys, status, pace);
                 }
-            }   
+                system_set_control(sys, status, pace);
+            }
         }
+    }
+}
 
-        event_found_flag = event_queue_pop(&manager->event_queue, &event);
+/**
+ * Tells whether a system produces a resource, as its single product or as any output of its recipe.
+ *
+ * @param[in] system    Pointer to the `System`.
+ * @param[in] resource  Pointer to the `Resource`.
+ * @return              Non-zero if the system produces the resource.
+ */
+static int manager_produces(const System *system, const Resource *resource) {
+    if (system->produced.resource == resource) {
+        return 1;
     }
-    
+    for (int i = 0; system->recipe != NULL && i < system->recipe->output_count; i++) {
+        if (system->recipe->outputs[i].resource == resource) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Prints a line of the event log, through the renderer's ring when there is one so a slow
+ * terminal never blocks the manager.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @param[in]     format   printf-style format of the line, including its newline.
+ */
+static void manager_log(Manager *manager, const char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    if (manager->renderer != NULL) {
+        renderer_logv(manager->renderer, format, args);
+    }
+    else {
+        vprintf(format, args);
+    }
+    va_end(args);
+}
+
+/**
+ * Sets the status and pace of one system, keeping the `SystemTable` in step when it is built.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @param[in]     index    Index of the system in the `SystemArray`.
+ * @param[in]     status   New status of the system.
+ * @param[in]     pace     New pace of the system, zero to follow the status.
+ */
+static void manager_set_status(Manager *manager, int index, int status, int pace) {
+    System *system = manager->system_array.systems[index];
+    int current_status, current_pace;
+
+    system_get_control(system, &current_status, &current_pace);
+    manager->status_changes += (current_status != status || current_pace != pace) && status != TERMINATE;
+    if (manager->trace != NULL && (current_status != status || current_pace != pace)) {
+        trace_status(manager->trace, system, status, pace);
+    }
+    if (index < manager->system_table.size) {
+        manager->system_table.status[index] = status;
+        manager->system_table.pace[index] = pace;
+    }
+    system_set_control(system, status, pace);
+}
+
+/**
+ * Decides whether the Manager of a partition leaves an event to its coordinator.
+ *
+ * The coordinator ends the run for every partition, and it reacts for the resources that
+ * systems of several partitions use, since no single partition can reach all their producers.
+ *
+ * @param[in] manager  Pointer to the `Manager`.
+ * @param[in] event    Pointer to the `Event` about to be handled.
+ * @return             Non-zero if the event goes to the coordinator; zero to handle it here.
+ */
+static int manager_forwards(Manager *manager, const Event *event) {
+    Resource *resource = event->resource;
+
+    if (manager->coordinator == NULL) {
+        return 0;
+    }
+    if ((event->status == STATUS_EMPTY && (resource->flags & RESOURCE_CRITICAL))
+        || (event->status == STATUS_CAPACITY && (resource->flags & RESOURCE_GOAL))) {
+        return 1;
+    }
+    return resource->id >= 0 && manager->resource_partition[resource->id] != manager->partition;
+}
+
+/**
+ * Makes sure the `ResourceIndex` describes every system and resource of the Manager.
+ *
+ * The index is built when the first event after loading is handled, and rebuilt if systems or
+ * resources have been added since.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @return                 Non-zero if the index can be used; zero if it could not be built.
+ */
+static int manager_index_ready(Manager *manager) {
+    ResourceIndex *index = &manager->resource_index;
+
+    if (index->producer_start != NULL && index->resource_count == manager->resource_array.size
+        && index->system_count == manager->system_array.size) {
+        return 1;
+    }
+    resource_index_clean(index);
+    return resource_index_build(index, &manager->resource_array, &manager->system_array);
+}
+
+/**
+ * Builds the Manager's `SystemTable` so its passes over every system scan columns instead of
+ * following a pointer per system.
+ *
+ * Call once the scenario is loaded. Resources must have been added to the Manager's
+ * `ResourceArray`, which gives them the ids stored in the table.
+ *
+ * @param[in,out] manager  Pointer to the loaded `Manager`.
+ * @return                 Non-zero on success; zero if memory ran out (the Manager keeps using the arrays).
+ */
+int manager_build_tables(Manager *manager) {
+    system_table_clean(&manager->system_table);
+    return system_table_build(&manager->system_table, &manager->system_array);
+}
+
+/**
+ * Chooses the policy that reacts to events which do not end the simulation.
+ *
+ * Call once the scenario is loaded and before any system runs; see `controller_init`.
+ *
+ * @param[in,out] manager  Pointer to the loaded `Manager`.
+ * @param[in]     policy   `CONTROL_REACTIVE`, `CONTROL_HYSTERESIS` or `CONTROL_PROPORTIONAL`.
+ * @return                 Non-zero on success; zero if memory ran out (the Manager stays reactive).
+ */
+int manager_set_controller(Manager *manager, int policy) {
+    controller_clean(&manager->controller);
+    return controller_init(&manager->controller, policy, &manager->resource_array);
 }
 
 // Don't worry much about these! These are special codes that allow us to do some formatting in the terminal
@@ -132,13 +424,22 @@ void manager_run(Manager *manager) {
  * @param[in] manager  Pointer to the `Manager` containing the simulation state.
  */
 void display_simulation_state(Manager *manager) {
-    // Static integers are allocated to the data segment, so they persist between function calls
-    static const int display_interval = 1;
-    static time_t last_display_time = 0;
-
     // If it has not been long enough since our previous display refresh, keep waiting.
-    time_t current_time = time(NULL);
-    if (difftime(current_time, last_display_time) < display_interval) {
+    long long current_time = manager_now_ms();
+    if (current_time < manager->display_deadline) {
+        return;
+    }
+
+    // Nobody is watching a headless run, the deadline still paces the manager's waits
+    if (manager->headless) {
+        manager->display_deadline = current_time + MANAGER_DISPLAY_INTERVAL;
+        return;
+    }
+
+    // The renderer thread formats and writes the frame from a snapshot
+    if (manager->renderer != NULL) {
+        renderer_publish(manager->renderer);
+        manager->display_deadline = current_time + MANAGER_DISPLAY_INTERVAL;
         return;
     }
 
@@ -159,7 +460,7 @@ void display_simulation_state(Manager *manager) {
     for (int i = 0; i < manager->resource_array.size; i++) {
         resource = manager->resource_array.resources[i];
 
-        amount = resource->amount;
+        amount = resource_get_amount(resource);
         max_capacity = resource->max_capacity;
 
         printf(ANSI_LN_CLR "%s: %d / %d\n", resource->name, amount, max_capacity);
@@ -176,43 +477,55 @@ void display_simulation_state(Manager *manager) {
         system = manager->system_array.systems[i];
 
         // Map system status code to a human-readable string
-        const char *status_str;
-        switch (system->status) {
-            case TERMINATE:
-                status_str = "TERMINATE";
-                break;
-            case DISABLED:
-                status_str = "DISABLED";
-                break;
-            case SLOW:
-                status_str = "SLOW";
-                break;
-            case STANDARD:
-                status_str = "STANDARD";
-                break;
-            case FAST:
-                status_str = "FAST";
-                break;
-            default:
-                status_str = "UNKNOWN";
-                break;
-        }
+        const char *status_str = system_status_name(manager->system_table.size > 0 ? manager->system_table.status[i] : system_status(system));
 
         printf(ANSI_LN_CLR  "%-20s: %-10s\n", system->name, status_str);
     }
 
     printf(ANSI_LN_CLR  "\n");
 
-    last_display_time = current_time;
+    manager->display_deadline = current_time + MANAGER_DISPLAY_INTERVAL;
     // Flush the output to ensure it appears immediately
     fflush(stdout);
 }
 
+/**
+ * Reads the monotonic clock.
+ *
+ * @return  Current monotonic time in milliseconds.
+ */
+static long long manager_now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
 // Creates the thread for the manager function
 void *manager_thread(void *args){
     Manager *manager = (Manager *)args;
-    while(manager->simulation_running != 0){
+    while(atomic_load(&manager->simulation_running) != 0){
         manager_run(manager);
+        // Sleep until a system pushes an event or the display, a snapshot, a control pass or the trace is due
+        if (atomic_load(&manager->simulation_running) != 0) {
+            long long timeout = manager->display_deadline - manager_now_ms();
+            if (manager->telemetry != NULL) {
+                long long snapshot = (manager->telemetry->next_snapshot_ns - telemetry_now(manager->telemetry) + 999999) / 1000000;
+                timeout = (snapshot < timeout) ? snapshot : timeout;
+            }
+            if (manager->controller.policy != CONTROL_REACTIVE) {
+                long long pass = (manager->controller.next_ns - monotonic_now_ns() + 999999) / 1000000;
+                timeout = (pass < timeout) ? pass : timeout;
+            }
+            if (manager->endpoint != NULL) {
+                long long snapshot = manager->endpoint->next_ms - manager_now_ms();
+                timeout = (snapshot < timeout) ? snapshot : timeout;
+            }
+            // Pushes to the queues of partitions do not wake the loaded Manager
+            if (manager->trace != NULL && manager->coordinator == NULL && timeout > TRACE_INTERVAL) {
+                timeout = TRACE_INTERVAL;
+            }
+            event_queue_wait(&manager->event_queue, (int)timeout);
+        }
     }
     return NULL;
 }
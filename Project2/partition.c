@@ -0,0 +1,312 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+// Helpers just used by the partitions, static so they can't get linked into other files
+
+static int partition_fill(PartitionSet *set, int partition, int size);
+static int partition_compact(PartitionSet *set, int count);
+
+/**
+ * Splits the systems of a loaded `Manager` between up to `count` partitions, each with a Manager of its own.
+ *
+ * Systems are grouped along the consumption graph by `placement_partition`: connected
+ * components stay whole unless one is heavier than a partition's share, in which case its
+ * resources are split between partitions. A resource used by systems of more than one
+ * partition is shared, and `manager` becomes the coordinator of the partitions: it handles the
+ * events of the shared resources, with an index over every system, and the events that end the
+ * run, terminating every partition. Each partition's Manager handles the rest of its systems'
+ * events on its own thread, from a queue of its own, so event handling grows with the number
+ * of partitions. Partitions that would get no system are dropped.
+ *
+ * Every system reports to its partition's queue until `partition_clean`. The partitions list
+ * every resource so resource ids stay valid in their indexes, but only steer their own.
+ *
+ * @param[out]    set      Pointer to the `PartitionSet` to build.
+ * @param[in,out] manager  Pointer to the loaded `Manager`, it must outlive the partitions.
+ * @param[in]     count    Partitions wanted, at most `PARTITION_MAX`.
+ * @return                 Non-zero on success; zero if memory ran out.
+ */
+int partition_build(PartitionSet *set, Manager *manager, int count) {
+    int resource_count = manager->resource_array.size, system_count = manager->system_array.size;
+    int sizes[PARTITION_MAX] = {0};
+
+    count = (count < 1) ? 1 : ((count > PARTITION_MAX) ? PARTITION_MAX : count);
+    set->coordinator = manager;
+    set->partitions = NULL;
+    set->partition_count = 0;
+    set->shared_count = 0;
+    // Both columns share a single allocation
+    set->resource_partition = (int *)malloc(((size_t)resource_count + system_count) * sizeof(int) + 1);
+    if (set->resource_partition == NULL) {
+        return 0;
+    }
+    set->system_partition = set->resource_partition + resource_count;
+    if (!placement_partition(&manager->resource_array, &manager->system_array, count,
+                             set->resource_partition, set->system_partition)) {
+        free(set->resource_partition);
+        return 0;
+    }
+
+    count = partition_compact(set, count);
+    if (count == 0) {
+        free(set->resource_partition);
+        return 0;
+    }
+    for (int s = 0; s < system_count; s++) {
+        sizes[set->system_partition[s]]++;
+    }
+    set->partitions = (Partition *)calloc((size_t)count, sizeof(Partition));
+    if (set->partitions == NULL) {
+        free(set->resource_partition);
+        return 0;
+    }
+    for (int p = 0; p < count; p++) {
+        // Counted first so a partition that fails half way is cleaned too
+        set->partition_count++;
+        if (!partition_fill(set, p, sizes[p])) {
+            partition_clean(set);
+            return 0;
+        }
+    }
+
+    // The coordinator owns the shared resources, and its statuses are the systems' own from now on
+    manager->resource_partition = set->resource_partition;
+    manager->partition = -1;
+    if (manager->system_table.size > 0) {
+        system_table_clean(&manager->system_table);
+    }
+    for (int s = 0; s < system_count; s++) {
+        System *system = manager->system_array.systems[s];
+        system->event_queue = &set->partitions[set->system_partition[s]].manager.event_queue;
+    }
+    // Systems push to their partition's queue, the events forwarded from there were recorded already
+    manager->event_queue.trace = NULL;
+    return 1;
+}
+
+/**
+ * Starts the Manager of every partition and the threads running its systems.
+ *
+ * With `worker_count` the workers are shared out between the partitions by their number of
+ * systems, at least one each, and every partition runs its systems on a `Scheduler` of its
+ * own. Otherwise every system gets a thread. The coordinator is not started, run
+ * `manager_thread` on it, then call `partition_stop` once it returns, even if this failed.
+ *
+ * @param[in,out] set           Pointer to the built `PartitionSet`.
+ * @param[in]     worker_count  Workers in total, zero for a thread per system.
+ * @return                      Non-zero if everything started; zero otherwise.
+ */
+int partition_start(PartitionSet *set, int worker_count) {
+    Manager *coordinator = set->coordinator;
+    int system_count = coordinator->system_array.size;
+
+    for (int p = 0; p < set->partition_count; p++) {
+        Partition *partition = &set->partitions[p];
+        Manager *manager = &partition->manager;
+        SystemArray *systems = &manager->system_array;
+
+        // Only the coordinator's thread may write to the renderer
+        manager->log_events = coordinator->log_events && coordinator->renderer == NULL;
+        if (pthread_create(&partition->thread, NULL, manager_thread, manager) != 0) {
+            return 0;
+        }
+        partition->manager_started = 1;
+
+        if (worker_count > 0) {
+            partition->worker_count = (int)((long)worker_count * systems->size / (system_count > 0 ? system_count : 1));
+            partition->worker_count = (partition->worker_count < 1) ? 1 : partition->worker_count;
+            if (!scheduler_init(&partition->scheduler, systems, partition->worker_count)) {
+                partition->worker_count = 0;
+                return 0;
+            }
+            if (!scheduler_start(&partition->scheduler)) {
+                return 0;
+            }
+            partition->systems_started = 1;
+            continue;
+        }
+
+        partition->system_threads = (pthread_t *)malloc((size_t)systems->size * sizeof(pthread_t) + 1);
+        if (partition->system_threads == NULL) {
+            return 0;
+        }
+        for (int i = 0; i < systems->size; i++) {
+            if (pthread_create(&partition->system_threads[i], NULL, system_thread, systems->systems[i]) != 0) {
+                return 0;
+            }
+            partition->systems_started++;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Stops the Managers of the partitions and waits for every system to terminate.
+ *
+ * Call once the coordinator's `manager_thread` has returned. Every system is terminated again
+ * after the partitions' Managers have stopped, since one of them may have changed a system
+ * the coordinator had just terminated.
+ *
+ * @param[in,out] set  Pointer to the `PartitionSet` given to `partition_start`.
+ */
+void partition_stop(PartitionSet *set) {
+    Manager *coordinator = set->coordinator;
+
+    atomic_store(&coordinator->simulation_running, 0);
+    for (int p = 0; p < set->partition_count; p++) {
+        Partition *partition = &set->partitions[p];
+        if (partition->manager_started) {
+            atomic_store(&partition->manager.simulation_running, 0);
+            event_queue_wake(&partition->manager.event_queue);
+            pthread_join(partition->thread, NULL);
+            partition->manager_started = 0;
+        }
+    }
+    for (int i = 0; i < coordinator->system_array.size; i++) {
+        system_set_control(coordinator->system_array.systems[i], TERMINATE, 0);
+    }
+
+    for (int p = 0; p < set->partition_count; p++) {
+        Partition *partition = &set->partitions[p];
+        if (partition->worker_count > 0 && partition->systems_started) {
+            scheduler_join(&partition->scheduler);
+        }
+        for (int i = 0; partition->worker_count == 0 && i < partition->systems_started; i++) {
+            pthread_join(partition->system_threads[i], NULL);
+        }
+        partition->systems_started = 0;
+    }
+}
+
+/**
+ * Frees the partitions and gives the systems and the coordinator back their single-Manager state.
+ *
+ * @param[in,out] set  Pointer to the `PartitionSet` to clean, stopped if it was started.
+ */
+void partition_clean(PartitionSet *set) {
+    Manager *coordinator = set->coordinator;
+
+    for (int i = 0; i < coordinator->system_array.size; i++) {
+        coordinator->system_array.systems[i]->event_queue = &coordinator->event_queue;
+    }
+    coordinator->resource_partition = NULL;
+    coordinator->partition = -1;
+    coordinator->event_queue.trace = coordinator->trace;
+
+    for (int p = 0; set->partitions != NULL && p < set->partition_count; p++) {
+        Partition *partition = &set->partitions[p];
+        if (partition->worker_count > 0) {
+            scheduler_clean(&partition->scheduler);
+        }
+        free(partition->system_threads);
+        // The arrays only borrow the coordinator's systems and resources, see partition_fill
+        manager_clean(&partition->manager);
+    }
+    free(set->partitions);
+    free(set->resource_partition);
+    set->partitions = NULL;
+    set->resource_partition = NULL;
+    set->system_partition = NULL;
+    set->partition_count = 0;
+}
+
+/**
+ * Sets up the Manager of one partition.
+ *
+ * Its system array lists the partition's systems in the coordinator's order, taken from its own
+ * arena; its resource array is the coordinator's. Neither takes ownership, so the ids and the
+ * objects stay the coordinator's. The queue, controller and tables follow the coordinator's.
+ *
+ * @param[in,out] set        Pointer to the `PartitionSet` being built.
+ * @param[in]     partition  Index of the partition.
+ * @param[in]     size       Number of systems in the partition.
+ * @return                   Non-zero on success; zero if memory ran out.
+ */
+static int partition_fill(PartitionSet *set, int partition, int size) {
+    Manager *coordinator = set->coordinator;
+    Manager *manager = &set->partitions[partition].manager;
+    SystemArray *systems = &manager->system_array;
+    int filled = 0;
+
+    manager_init_backend(manager, coordinator->event_queue.backend);
+    event_queue_configure(&manager->event_queue, coordinator->event_queue.high_water_mark, coordinator->event_queue.policy);
+    manager->coordinator = coordinator;
+    manager->resource_partition = set->resource_partition;
+    manager->partition = partition;
+    manager->headless = 1;
+    // Recorded into the coordinator's trace, which only the coordinator writes out
+    manager->trace = coordinator->trace;
+    manager->event_queue.trace = coordinator->event_queue.trace;
+
+    systems->systems = (System **)arena_alloc(&manager->arena, (size_t)size * sizeof(System *) + 1, _Alignof(System *));
+    if (systems->systems == NULL) {
+        return 0;
+    }
+    for (int s = 0; s < coordinator->system_array.size; s++) {
+        if (set->system_partition[s] == partition) {
+            systems->systems[filled++] = coordinator->system_array.systems[s];
+        }
+    }
+    systems->size = systems->capacity = filled;
+    manager->resource_array.resources = coordinator->resource_array.resources;
+    manager->resource_array.size = manager->resource_array.capacity = coordinator->resource_array.size;
+
+    if (!manager_set_controller(manager, coordinator->controller.policy)) {
+        return 0;
+    }
+    if (coordinator->system_table.size > 0 && !manager_build_tables(manager)) {
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Numbers the partitions that got systems and gives each resource the partition of its systems.
+ *
+ * A resource belongs to a partition only if every system using it is there; one used across
+ * partitions is shared and one used by no system never sees an event, both go to the coordinator.
+ *
+ * @param[in,out] set    Pointer to the `PartitionSet` being built, systems placed by `placement_partition`.
+ * @param[in]     count  Number of partitions asked of `placement_partition`.
+ * @return               Number of partitions with at least one system, or zero if memory ran out.
+ */
+static int partition_compact(PartitionSet *set, int count) {
+    Manager *coordinator = set->coordinator;
+    ResourceIndex index;
+    int renumber[PARTITION_MAX];
+    int used = 0;
+
+    if (!resource_index_build(&index, &coordinator->resource_array, &coordinator->system_array)) {
+        return 0;
+    }
+    for (int p = 0; p < count; p++) {
+        renumber[p] = -1;
+    }
+    for (int s = 0; s < coordinator->system_array.size; s++) {
+        int *partition = &set->system_partition[s];
+        if (renumber[*partition] < 0) {
+            renumber[*partition] = used++;
+        }
+        *partition = renumber[*partition];
+    }
+
+    for (int r = 0; r < coordinator->resource_array.size; r++) {
+        int partition = -2;     // No system seen yet
+
+        for (int i = index.producer_start[r]; i < index.producer_start[r + 1] && partition != -1; i++) {
+            int system = set->system_partition[index.producers[i]];
+            partition = (partition == -2 || partition == system) ? system : -1;
+        }
+        for (int i = index.consumer_start[r]; i < index.consumer_start[r + 1] && partition != -1; i++) {
+            int system = set->system_partition[index.consumers[i]];
+            partition = (partition == -2 || partition == system) ? system : -1;
+        }
+        set->shared_count += (partition == -1);
+        set->resource_partition[r] = (partition >= 0) ? partition : -1;
+    }
+    resource_index_clean(&index);
+    return (used > 0) ? used : 1;
+}
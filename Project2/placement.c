@@ -0,0 +1,394 @@
+#define _GNU_SOURCE     // CPU affinity
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+
+// A resource to be placed, sorted so that each connected component is together, heaviest first
+typedef struct PlacementItem {
+    int component_weight;   // Uses of every resource in the resource's component
+    int component;          // Smallest resource id of the component
+    int weight;             // Systems consuming or producing the resource
+    int resource;
+} PlacementItem;
+
+// Helpers just used by placement, static so they can't get linked into other files
+
+static int placement_read_nodes(int *cpus, int *cpu_start, int *node_ids, int *cpu_count);
+static int placement_parse_cpulist(const char *list, const cpu_set_t *allowed, int *cpus, int count);
+static int placement_item_count(const System *system);
+static Resource *placement_item(const System *system, int k);
+static int placement_find(int *parent, int resource);
+static int placement_item_compare(const void *a, const void *b);
+static int placement_lightest(const long *load, int count);
+
+/**
+ * Finds the NUMA nodes the process may run on and gives every resource and system a node.
+ *
+ * Nodes and their CPUs come from /sys/devices/system/node, keeping only the CPUs in the
+ * process's affinity mask. Without sysfs every allowed CPU makes up a single node. Resources
+ * and systems are then shared out between the nodes by `placement_partition`, so the systems
+ * fighting over a resource share a node.
+ *
+ * The memory of the resources stays where it was allocated, node placement only decides where
+ * the threads stepping the systems run (see `scheduler_init_placement` and `placement_pin`).
+ *
+ * @param[out] placement  Pointer to the `Placement` to build.
+ * @param[in]  resources  Resources of the scenario, their ids must be their indices.
+ * @param[in]  systems    Systems of the scenario, their ids must be their indices.
+ * @return                Non-zero on success; zero if memory ran out.
+ */
+int placement_build(Placement *placement, ResourceArray *resources, SystemArray *systems) {
+    int cpus[CPU_SETSIZE];
+    int cpu_start[PLACEMENT_MAX_NODES + 1];
+    int node_ids[PLACEMENT_MAX_NODES];
+    int cpu_count = 0, node_count;
+    int resource_count = resources->size, system_count = systems->size;
+    int *columns;
+
+    node_count = placement_read_nodes(cpus, cpu_start, node_ids, &cpu_count);
+
+    // Kept: CPUs, node starts and ids, then a node per resource and per system
+    columns = (int *)malloc(((size_t)cpu_count + 2 * node_count + 1 + resource_count + system_count) * sizeof(int));
+    if (columns == NULL) {
+        return 0;
+    }
+
+    placement->node_count = node_count;
+    placement->cpu_count = cpu_count;
+    placement->cpus = columns;
+    placement->cpu_start = placement->cpus + cpu_count;
+    placement->node_ids = placement->cpu_start + node_count + 1;
+    placement->resource_node = placement->node_ids + node_count;
+    placement->system_node = placement->resource_node + resource_count;
+    placement->resource_count = resource_count;
+    placement->system_count = system_count;
+    memcpy(placement->cpus, cpus, (size_t)cpu_count * sizeof(int));
+    memcpy(placement->cpu_start, cpu_start, ((size_t)node_count + 1) * sizeof(int));
+    memcpy(placement->node_ids, node_ids, (size_t)node_count * sizeof(int));
+
+    if (!placement_partition(resources, systems, node_count, placement->resource_node, placement->system_node)) {
+        free(columns);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Shares resources and systems out between `count` parts along the consumption graph.
+ *
+ * Resources that share a system form a component; components are handed out heaviest first to
+ * the part with the least load so far, counting a resource's load as the number of systems that
+ * use it. A component heavier than a part's share is split, its resources placed one by one the
+ * same way. Each system then goes to the part of its most contended resource, the one the most
+ * systems use. Systems without resources are spread round-robin.
+ *
+ * @param[in]  resources      Resources of the scenario, their ids must be their indices.
+ * @param[in]  systems        Systems of the scenario.
+ * @param[in]  count          Number of parts, at least one.
+ * @param[out] resource_part  Part given to every resource, indexed by resource id.
+ * @param[out] system_part    Part given to every system, indexed like `systems`.
+ * @return                    Non-zero on success; zero if memory ran out.
+ */
+int placement_partition(ResourceArray *resources, SystemArray *systems, int count, int *resource_part, int *system_part) {
+    int resource_count = resources->size, system_count = systems->size, total = 0;
+    long *load = (long *)calloc((size_t)count, sizeof(long));
+    PlacementItem *items;
+    int *parent, *weight;
+
+    // Scratch: the union-find parents and weights of the resources next to their sort items
+    items = (PlacementItem *)malloc((size_t)resource_count * sizeof(PlacementItem) + 1);
+    parent = (int *)malloc(2 * (size_t)resource_count * sizeof(int) + 1);
+    if (load == NULL || items == NULL || parent == NULL) {
+        free(load);
+        free(items);
+        free(parent);
+        return 0;
+    }
+    weight = parent + resource_count;
+
+    // Weigh every resource and join the resources each system uses into one component
+    for (int r = 0; r < resource_count; r++) {
+        parent[r] = r;
+        weight[r] = 0;
+    }
+    for (int s = 0; s < system_count; s++) {
+        System *system = systems->systems[s];
+        int first = -1;
+
+        for (int k = 0; k < placement_item_count(system); k++) {
+            Resource *resource = placement_item(system, k);
+            int root;
+
+            if (resource == NULL) {
+                continue;
+            }
+            weight[resource->id]++;
+            total++;
+            root = placement_find(parent, resource->id);
+            if (first < 0) {
+                first = root;
+            }
+            else if (root != first) {
+                // The smaller id becomes the root, so a component is named by its first resource
+                if (root < first) {
+                    parent[first] = root;
+                    first = root;
+                }
+                else {
+                    parent[root] = first;
+                }
+            }
+        }
+    }
+
+    for (int r = 0; r < resource_count; r++) {
+        items[r].component = placement_find(parent, r);
+        items[r].weight = weight[r];
+        items[r].resource = r;
+        items[r].component_weight = 0;
+    }
+    for (int r = 0; r < resource_count; r++) {
+        items[items[r].component].component_weight += weight[r];
+    }
+    for (int r = 0; r < resource_count; r++) {
+        items[r].component_weight = items[items[r].component].component_weight;
+    }
+    qsort(items, (size_t)resource_count, sizeof(PlacementItem), placement_item_compare);
+
+    for (int i = 0; i < resource_count; ) {
+        int end = i;
+        int split = ((long)items[i].component_weight * count > total) && count > 1;
+        int part = placement_lightest(load, count);
+
+        while (end < resource_count && items[end].component == items[i].component) {
+            end++;
+        }
+        for (; i < end; i++) {
+            if (split) {
+                part = placement_lightest(load, count);
+            }
+            resource_part[items[i].resource] = part;
+            load[part] += items[i].weight;
+        }
+    }
+
+    for (int s = 0; s < system_count; s++) {
+        System *system = systems->systems[s];
+        Resource *busiest = NULL;
+
+        for (int k = 0; k < placement_item_count(system); k++) {
+            Resource *resource = placement_item(system, k);
+            if (resource != NULL && (busiest == NULL || weight[resource->id] > weight[busiest->id])) {
+                busiest = resource;
+            }
+        }
+        system_part[s] = (busiest != NULL) ? resource_part[busiest->id] : s % count;
+    }
+
+    free(load);
+    free(items);
+    free(parent);
+    return 1;
+}
+
+/**
+ * Frees the columns of a `Placement`.
+ *
+ * @param[in,out] placement  Pointer to the `Placement` to clean.
+ */
+void placement_clean(Placement *placement) {
+    // The CPU column is the start of the allocation holding every column
+    free(placement->cpus);
+    placement->cpus = NULL;
+    placement->cpu_start = NULL;
+    placement->node_ids = NULL;
+    placement->resource_node = NULL;
+    placement->system_node = NULL;
+    placement->node_count = 0;
+    placement->cpu_count = 0;
+}
+
+/**
+ * Pins a thread to one CPU of a node.
+ *
+ * Threads given consecutive slots on the same node get consecutive CPUs of the node, wrapping
+ * around once every CPU has a thread.
+ *
+ * @param[in] placement  Pointer to the built `Placement`.
+ * @param[in] thread     Thread to pin.
+ * @param[in] node       Node to run the thread on.
+ * @param[in] slot       Number of threads already pinned to the node.
+ * @return               Non-zero if the thread was pinned; zero otherwise.
+ */
+int placement_pin(const Placement *placement, pthread_t thread, int node, int slot) {
+    int count = placement->cpu_start[node + 1] - placement->cpu_start[node];
+    cpu_set_t set;
+
+    if (count <= 0) {
+        return 0;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(placement->cpus[placement->cpu_start[node] + slot % count], &set);
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
+/**
+ * Reads the NUMA nodes with CPUs the process may run on.
+ *
+ * @param[out] cpus       CPUs of every node, node after node, at least `CPU_SETSIZE` entries.
+ * @param[out] cpu_start  Where each node's CPUs start, then the total, `PLACEMENT_MAX_NODES` + 1 entries.
+ * @param[out] node_ids   Number of each node in sysfs, `PLACEMENT_MAX_NODES` entries.
+ * @param[out] cpu_count  Number of CPUs found.
+ * @return                Number of nodes found, at least one.
+ */
+static int placement_read_nodes(int *cpus, int *cpu_start, int *node_ids, int *cpu_count) {
+    cpu_set_t allowed;
+    char path[64], list[4096];
+    int node_count = 0, count = 0;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        CPU_ZERO(&allowed);
+        CPU_SET(0, &allowed);
+    }
+
+    for (int node = 0; node < PLACEMENT_MAX_NODES; node++) {
+        FILE *file;
+        int found;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        file = fopen(path, "r");
+        if (file == NULL) {
+            continue;
+        }
+        found = (fgets(list, sizeof(list), file) != NULL) ? placement_parse_cpulist(list, &allowed, cpus, count) : count;
+        fclose(file);
+        // A node without any CPU this process may use cannot run anything
+        if (found > count) {
+            cpu_start[node_count] = count;
+            node_ids[node_count++] = node;
+            count = found;
+        }
+    }
+
+    if (node_count == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                cpus[count++] = cpu;
+            }
+        }
+        cpu_start[0] = 0;
+        node_ids[0] = 0;
+        node_count = 1;
+    }
+    cpu_start[node_count] = count;
+    *cpu_count = count;
+    return node_count;
+}
+
+/**
+ * Appends the allowed CPUs of a sysfs CPU list such as "0-3,8-11".
+ *
+ * @param[in]     list     CPU list to parse.
+ * @param[in]     allowed  CPUs the process may run on.
+ * @param[in,out] cpus     CPUs found so far.
+ * @param[in]     count    Number of CPUs found so far.
+ * @return                 Number of CPUs found including the new ones.
+ */
+static int placement_parse_cpulist(const char *list, const cpu_set_t *allowed, int *cpus, int count) {
+    const char *c = list;
+
+    while (*c >= '0' && *c <= '9') {
+        char *end;
+        long first = strtol(c, &end, 10), last = first;
+
+        if (*end == '-') {
+            last = strtol(end + 1, &end, 10);
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET((int)cpu, allowed) && count < CPU_SETSIZE) {
+                cpus[count++] = (int)cpu;
+            }
+        }
+        c = (*end == ',') ? end + 1 : end;
+    }
+    return count;
+}
+
+/**
+ * Counts the resources a system consumes and produces, as listed by `placement_item`.
+ *
+ * @param[in] system  Pointer to the `System`.
+ * @return            Number of inputs and outputs.
+ */
+static int placement_item_count(const System *system) {
+    return (system->recipe != NULL) ? system->recipe->input_count + system->recipe->output_count : 2;
+}
+
+/**
+ * Gets one of the resources a system consumes and produces.
+ *
+ * @param[in] system  Pointer to the `System`.
+ * @param[in] k       Inputs first, then outputs.
+ * @return            The resource, NULL if the system has none in that place.
+ */
+static Resource *placement_item(const System *system, int k) {
+    if (system->recipe != NULL) {
+        return (k < system->recipe->input_count) ? system->recipe->inputs[k].resource
+                                                 : system->recipe->outputs[k - system->recipe->input_count].resource;
+    }
+    return (k == 0) ? system->consumed.resource : system->produced.resource;
+}
+
+/**
+ * Finds the root of a resource's component, halving the path on the way.
+ *
+ * @param[in,out] parent    Union-find parent of every resource.
+ * @param[in]     resource  Id of the resource.
+ * @return                  Id of the component's root.
+ */
+static int placement_find(int *parent, int resource) {
+    while (parent[resource] != resource) {
+        parent[resource] = parent[parent[resource]];
+        resource = parent[resource];
+    }
+    return resource;
+}
+
+/**
+ * Orders resources by component, heaviest component first, then heaviest resource first.
+ */
+static int placement_item_compare(const void *a, const void *b) {
+    const PlacementItem *x = (const PlacementItem *)a;
+    const PlacementItem *y = (const PlacementItem *)b;
+
+    if (x->component_weight != y->component_weight) {
+        return (x->component_weight > y->component_weight) ? -1 : 1;
+    }
+    if (x->component != y->component) {
+        return (x->component < y->component) ? -1 : 1;
+    }
+    if (x->weight != y->weight) {
+        return (x->weight > y->weight) ? -1 : 1;
+    }
+    return (x->resource < y->resource) ? -1 : (x->resource > y->resource);
+}
+
+/**
+ * Finds the part with the least load, the first of them on a tie.
+ *
+ * @param[in] load   Load of every part.
+ * @param[in] count  Number of parts.
+ * @return           Index of the part.
+ */
+static int placement_lightest(const long *load, int count) {
+    int lightest = 0;
+
+    for (int n = 1; n < count; n++) {
+        if (load[n] < load[lightest]) {
+            lightest = n;
+        }
+    }
+    return lightest;
+}
@@ -0,0 +1,315 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+// Helpers just used by the renderer, static so they can't get linked into other files
+
+static void *renderer_thread(void *args);
+static void renderer_append(Renderer *renderer, const char *format, ...);
+static void renderer_append_state(Renderer *renderer, const RenderSnapshot *snapshot);
+static void renderer_append_log(Renderer *renderer);
+static void renderer_flush(Renderer *renderer);
+
+/**
+ * Initializes a `Renderer` for a loaded Manager.
+ *
+ * The snapshots are sized for the Manager's resources and systems at this point, so call it
+ * once the scenario is loaded. Set `manager->renderer` afterwards to route the display and the
+ * event log through it.
+ *
+ * @param[out] renderer  Pointer to the `Renderer` to initialize.
+ * @param[in]  manager   Pointer to the loaded `Manager`.
+ * @return               Non-zero on success; zero if memory ran out.
+ */
+int renderer_init(Renderer *renderer, Manager *manager) {
+    int ok = 1;
+
+    memset(renderer, 0, sizeof(*renderer));
+    renderer->manager = manager;
+    renderer->resource_count = manager->resource_array.size;
+    renderer->system_count = manager->system_array.size;
+    atomic_init(&renderer->latest, 0);
+    atomic_init(&renderer->skipped, 0);
+    atomic_init(&renderer->log_head, 0);
+    atomic_init(&renderer->log_tail, 0);
+    atomic_init(&renderer->log_dropped, 0);
+    atomic_init(&renderer->running, 0);
+    renderer->next_sequence = 1;
+
+    for (int i = 0; i < 2; i++) {
+        RenderSnapshot *snapshot = &renderer->snapshots[i];
+        snapshot->amounts = (int *)calloc(renderer->resource_count + 1, sizeof(int));
+        snapshot->statuses = (int *)calloc(renderer->system_count + 1, sizeof(int));
+        ok = ok && snapshot->amounts != NULL && snapshot->statuses != NULL;
+        sem_init(&snapshot->lock, 0, 1);
+    }
+    renderer->log_lines = malloc(RENDER_LOG_LINES * sizeof(*renderer->log_lines));
+    renderer->frame_capacity = 4096;
+    renderer->frame = (char *)malloc(renderer->frame_capacity);
+    sem_init(&renderer->wakeup, 0, 0);
+
+    if (!ok || renderer->log_lines == NULL || renderer->frame == NULL) {
+        renderer_clean(renderer);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Starts the renderer's thread.
+ *
+ * @param[in,out] renderer  Pointer to the initialized `Renderer`.
+ * @return                  Non-zero on success; zero if the thread could not be created.
+ */
+int renderer_start(Renderer *renderer) {
+    atomic_store(&renderer->running, 1);
+    if (pthread_create(&renderer->thread, NULL, renderer_thread, renderer) != 0) {
+        atomic_store(&renderer->running, 0);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Stops the renderer's thread once it has written the event log lines still in the ring.
+ *
+ * @param[in,out] renderer  Pointer to the started `Renderer`.
+ */
+void renderer_stop(Renderer *renderer) {
+    if (atomic_exchange(&renderer->running, 0) == 0) {
+        return;
+    }
+    sem_post(&renderer->wakeup);
+    pthread_join(renderer->thread, NULL);
+}
+
+/**
+ * Frees everything held by a stopped `Renderer`.
+ *
+ * @param[in,out] renderer  Pointer to the `Renderer` to clean.
+ */
+void renderer_clean(Renderer *renderer) {
+    for (int i = 0; i < 2; i++) {
+        free(renderer->snapshots[i].amounts);
+        free(renderer->snapshots[i].statuses);
+        renderer->snapshots[i].amounts = NULL;
+        renderer->snapshots[i].statuses = NULL;
+        sem_destroy(&renderer->snapshots[i].lock);
+    }
+    free(renderer->log_lines);
+    free(renderer->frame);
+    renderer->log_lines = NULL;
+    renderer->frame = NULL;
+    sem_destroy(&renderer->wakeup);
+}
+
+/**
+ * Takes a snapshot of the resource amounts and system statuses for the renderer to draw.
+ *
+ * Called by the manager. The snapshot goes into the buffer the renderer did not read last;
+ * if the renderer is still drawing from that buffer the snapshot is skipped instead of waiting,
+ * so a slow terminal only costs frames.
+ *
+ * @param[in,out] renderer  Pointer to the `Renderer`.
+ */
+void renderer_publish(Renderer *renderer) {
+    Manager *manager = renderer->manager;
+    int back = 1 - atomic_load(&renderer->latest);
+    RenderSnapshot *snapshot = &renderer->snapshots[back];
+
+    if (sem_trywait(&snapshot->lock) != 0) {
+        atomic_fetch_add_explicit(&renderer->skipped, 1, memory_order_relaxed);
+        return;
+    }
+
+    for (int i = 0; i < renderer->resource_count; i++) {
+        snapshot->amounts[i] = resource_get_amount(manager->resource_array.resources[i]);
+    }
+    // Statuses are only written by the manager, so they are copied exactly as it last set them
+    for (int i = 0; i < renderer->system_count; i++) {
+        snapshot->statuses[i] = (i < manager->system_table.size) ? manager->system_table.status[i]
+                                                                  : system_status(manager->system_array.systems[i]);
+    }
+    snapshot->sequence = renderer->next_sequence++;
+
+    sem_post(&snapshot->lock);
+    atomic_store(&renderer->latest, back);
+    sem_post(&renderer->wakeup);
+}
+
+/**
+ * Adds a line to the event log without blocking.
+ *
+ * Called by the manager only. The line is formatted into the next free slot of the ring; when
+ * the ring is full the line is dropped and counted.
+ *
+ * @param[in,out] renderer  Pointer to the `Renderer`.
+ * @param[in]     format    printf-style format of the line, including its newline.
+ * @param[in]     args      Arguments of the format.
+ */
+void renderer_logv(Renderer *renderer, const char *format, va_list args) {
+    size_t head = atomic_load_explicit(&renderer->log_head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&renderer->log_tail, memory_order_acquire);
+    char *line;
+    int length;
+
+    if (head - tail >= RENDER_LOG_LINES) {
+        atomic_fetch_add_explicit(&renderer->log_dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    line = renderer->log_lines[head & (RENDER_LOG_LINES - 1)];
+    length = vsnprintf(line, RENDER_LOG_LINE, format, args);
+    if (length >= RENDER_LOG_LINE) {
+        // Keep the line break of a truncated line
+        line[RENDER_LOG_LINE - 2] = '\n';
+    }
+    atomic_store_explicit(&renderer->log_head, head + 1, memory_order_release);
+
+    // Cheap while the renderer is busy, it takes every pending line at once when it gets to them
+    sem_post(&renderer->wakeup);
+}
+
+/**
+ * Main loop of the renderer's thread.
+ *
+ * Each time it is woken, draws the latest snapshot if it has not been drawn yet, followed by
+ * the pending event log lines, all with a single write().
+ *
+ * @param[in,out] args  Pointer to the `Renderer`.
+ * @return              NULL.
+ */
+static void *renderer_thread(void *args) {
+    Renderer *renderer = (Renderer *)args;
+    int running = 1;
+
+    while (running) {
+        sem_wait(&renderer->wakeup);
+        // Several posts may have piled up while the last frame was written, one pass covers them all
+        while (sem_trywait(&renderer->wakeup) == 0) {
+        }
+        running = atomic_load(&renderer->running);
+
+        renderer->frame_size = 0;
+        if (running) {
+            RenderSnapshot *snapshot = &renderer->snapshots[atomic_load(&renderer->latest)];
+
+            sem_wait(&snapshot->lock);
+            if (snapshot->sequence != renderer->rendered_sequence) {
+                renderer_append_state(renderer, snapshot);
+                renderer->rendered_sequence = snapshot->sequence;
+            }
+            sem_post(&snapshot->lock);
+        }
+        renderer_append_log(renderer);
+        renderer_flush(renderer);
+    }
+    return NULL;
+}
+
+/**
+ * Appends formatted text to the frame, growing it as needed.
+ *
+ * @param[in,out] renderer  Pointer to the `Renderer`.
+ * @param[in]     format    printf-style format.
+ */
+static void renderer_append(Renderer *renderer, const char *format, ...) {
+    va_list args;
+    int length;
+
+    for (;;) {
+        size_t space = renderer->frame_capacity - renderer->frame_size;
+
+        va_start(args, format);
+        length = vsnprintf(renderer->frame + renderer->frame_size, space, format, args);
+        va_end(args);
+        if (length < 0) {
+            return;
+        }
+        if ((size_t)length < space) {
+            renderer->frame_size += length;
+            return;
+        }
+
+        // Double the frame and format again
+        char *grown = (char *)malloc(renderer->frame_capacity * 2);
+        if (grown == NULL) {
+            return;
+        }
+        memcpy(grown, renderer->frame, renderer->frame_size);
+        free(renderer->frame);
+        renderer->frame = grown;
+        renderer->frame_capacity *= 2;
+    }
+}
+
+/**
+ * Appends the resource amounts and system statuses of a snapshot, laid out like
+ * `display_simulation_state`.
+ *
+ * @param[in,out] renderer  Pointer to the `Renderer`.
+ * @param[in]     snapshot  Pointer to the locked `RenderSnapshot` to draw.
+ */
+static void renderer_append_state(Renderer *renderer, const RenderSnapshot *snapshot) {
+    Manager *manager = renderer->manager;
+
+    renderer_append(renderer, ANSI_CLEAR ANSI_MV_TL);
+    renderer_append(renderer, ANSI_LN_CLR "Current Resource Amounts:\n");
+    renderer_append(renderer, ANSI_LN_CLR "-------------------------\n");
+    for (int i = 0; i < renderer->resource_count; i++) {
+        Resource *resource = manager->resource_array.resources[i];
+        renderer_append(renderer, ANSI_LN_CLR "%s: %d / %d\n", resource->name, snapshot->amounts[i], resource->max_capacity);
+    }
+    renderer_append(renderer, ANSI_LN_CLR "\n");
+
+    renderer_append(renderer, ANSI_LN_CLR "System Statuses:\n");
+    renderer_append(renderer, ANSI_LN_CLR "---------------\n");
+    for (int i = 0; i < renderer->system_count; i++) {
+        renderer_append(renderer, ANSI_LN_CLR "%-20s: %-10s\n", manager->system_array.systems[i]->name,
+                        system_status_name(snapshot->statuses[i]));
+    }
+    renderer_append(renderer, ANSI_LN_CLR "\n");
+}
+
+/**
+ * Moves every pending event log line into the frame.
+ *
+ * @param[in,out] renderer  Pointer to the `Renderer`.
+ */
+static void renderer_append_log(Renderer *renderer) {
+    size_t tail = atomic_load_explicit(&renderer->log_tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&renderer->log_head, memory_order_acquire);
+    long dropped = atomic_exchange_explicit(&renderer->log_dropped, 0, memory_order_relaxed);
+
+    for (; tail != head; tail++) {
+        renderer_append(renderer, "%s", renderer->log_lines[tail & (RENDER_LOG_LINES - 1)]);
+    }
+    atomic_store_explicit(&renderer->log_tail, tail, memory_order_release);
+
+    if (dropped > 0) {
+        renderer_append(renderer, "[%ld event lines dropped, the display fell behind]\n", dropped);
+    }
+}
+
+/**
+ * Writes the frame to stdout, retrying until all of it is written.
+ *
+ * @param[in,out] renderer  Pointer to the `Renderer`.
+ */
+static void renderer_flush(Renderer *renderer) {
+    size_t written = 0;
+
+    while (written < renderer->frame_size) {
+        ssize_t result = write(STDOUT_FILENO, renderer->frame + written, renderer->frame_size - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        written += (size_t)result;
+    }
+}
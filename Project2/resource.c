@@ -3,6 +3,20 @@
 #include <stdio.h>
 #include <string.h>
 
+// Helpers just used by the resource functions, static so they can't get linked into other files
+
+static void resource_lock(Resource *resource);
+static void resource_unlock(Resource *resource);
+static int resource_index_items(System *system, int outputs, const ResourceAmount **items);
+static int resource_store_relaxed(Resource *resource, ResourceDelta *delta, int amount, int *stored);
+static ResourceDelta *resource_delta(Resource *resource);
+static int resource_reserve(Resource *resource, int amount);
+static void resource_commit(Resource *resource, int stored, int reserved);
+static void resource_flush_delta(ResourceDelta *delta);
+
+static _Thread_local ResourceDelta *resource_deltas;   // Relaxed resources the calling thread has stored into
+static _Thread_local int resource_delta_count, resource_delta_capacity;
+
 /* Resource functions */
 
 /**
@@ -17,32 +31,72 @@
  * @param[in]  max_capacity  Maximum capacity of the resource.
  */
 void resource_create(Resource **resource, const char *name, int amount, int max_capacity) {
+    resource_create_arena(resource, name, amount, max_capacity, NULL);
+}
+
+/**
+ * Creates a new `Resource` object in an `Arena`.
+ *
+ * The resource and its interned name live until the arena is released, so it must not be
+ * passed to `resource_destroy`; add it to a `ResourceArray` using the same arena. Without an
+ * arena this is `resource_create`.
+ *
+ * @param[out] resource      Pointer to the `Resource*` to be allocated and initialized, NULL if memory ran out.
+ * @param[in]  name          Name of the resource (the string is copied).
+ * @param[in]  amount        Initial amount of the resource.
+ * @param[in]  max_capacity  Maximum capacity of the resource.
+ * @param[in,out] arena      Pointer to the `Arena` to allocate from, or NULL to use malloc.
+ */
+void resource_create_arena(Resource **resource, const char *name, int amount, int max_capacity, Arena *arena) {
     // Checks if resource is null
     if(resource == NULL){
         return;
     }
-    // Dynamically allocates memory for resource and name
-    (*resource) = (Resource *)malloc(sizeof(Resource)); 
-    (*resource)->name = (char *)malloc(strlen(name) + 1);
-    // Checks if name is null
-    if((*resource)->name == NULL){
-        // Frees the pointer resource
-        free(*resource);
-        // Makes the pointer resource null
-        *resource = NULL;
-        return;
+    if (arena != NULL) {
+        // Both live as long as the arena, nothing is freed on failure
+        (*resource) = (Resource *)arena_alloc(arena, sizeof(Resource), _Alignof(Resource));
+        if ((*resource) == NULL || ((*resource)->name = arena_intern(arena, name)) == NULL) {
+            *resource = NULL;
+            return;
+        }
+    }
+    else {
+        // Dynamically allocates memory for resource and name
+        (*resource) = (Resource *)malloc(sizeof(Resource)); 
+        if ((*resource) == NULL) {
+            return;
+        }
+        (*resource)->name = (char *)malloc(strlen(name) + 1);
+        // Checks if name is null
+        if((*resource)->name == NULL){
+            // Frees the pointer resource
+            free(*resource);
+            // Makes the pointer resource null
+            *resource = NULL;
+            return;
+        }
+        // Copies the strings 
+        strcpy((*resource)->name, name);
     }
-    // Copies the strings 
-    strcpy((*resource)->name, name);
     
-    (*resource)->amount = amount;
+    (*resource)->id = -1;
+    atomic_init(&(*resource)->amount, amount);
+    atomic_init(&(*resource)->reserved, 0);
     (*resource)->max_capacity = max_capacity;
+    (*resource)->flags = 0;
+    (*resource)->transactional = 0;
+    (*resource)->relaxed_quota = 0;
+    (*resource)->relaxed_interval_ns = 0;
+    (*resource)->low_mark = 0;
+    (*resource)->high_mark = 0;
 
     // Initalizes the semaphore
     if (sem_init(&(*resource)->resource_mutex, 0, 1) != 0) {
         perror("Failed to initialize semaphore");
-        free((*resource)->name);
-        free(*resource);
+        if (arena == NULL) {
+            free((*resource)->name);
+            free(*resource);
+        }
         *resource = NULL;
     }
 }
@@ -56,10 +110,358 @@ void resource_create(Resource **resource, const char *name, int amount, int max_
  */
 void resource_destroy(Resource *resource) {
     if(resource != NULL){
+        sem_destroy(&resource->resource_mutex);
         free(resource->name);
         free(resource);
     }
-    sem_destroy(&resource->resource_mutex);
+}
+
+/**
+ * Reads the current amount of a `Resource` without locking.
+ *
+ * @param[in] resource  Pointer to the `Resource`.
+ * @return              The amount at the time of the read.
+ */
+int resource_get_amount(Resource *resource) {
+    return atomic_load_explicit(&resource->amount, memory_order_relaxed);
+}
+
+/**
+ * Removes `amount` units from a `Resource` if enough are available.
+ *
+ * Uses a compare-and-swap loop on the amount, so consumers never block each other.
+ * Nothing is removed unless the whole amount is available. A transactional resource is
+ * locked for the change, so it cannot happen in the middle of `resource_try_consume_all`.
+ *
+ * @param[in,out] resource  Pointer to the `Resource` to consume from.
+ * @param[in]     amount    Number of units required.
+ * @return                  `STATUS_OK` if consumed, `STATUS_EMPTY` if the resource is empty,
+ *                          or `STATUS_INSUFFICIENT` if there is some but not enough.
+ */
+int resource_try_consume(Resource *resource, int amount) {
+    int locked = resource->transactional;
+    int current, result;
+
+    if (locked) {
+        resource_lock(resource);
+    }
+    current = atomic_load_explicit(&resource->amount, memory_order_relaxed);
+    for (;;) {
+        if (current < amount) {
+            result = (current == 0) ? STATUS_EMPTY : STATUS_INSUFFICIENT;
+            break;
+        }
+        if (atomic_compare_exchange_weak_explicit(&resource->amount, &current, current - amount,
+                                                  memory_order_acq_rel, memory_order_relaxed)) {
+            result = STATUS_OK;
+            break;
+        }
+        // Another system changed the amount first, `current` now holds its value
+        stats_count(STATS_RESOURCE_RETRIES, 1);
+    }
+    if (locked) {
+        resource_unlock(resource);
+    }
+    return result;
+}
+
+/**
+ * Adds up to `amount` units to a `Resource` without exceeding its capacity.
+ *
+ * Uses a compare-and-swap loop on the amount. When there is not enough space, as much as
+ * fits is stored. A relaxed resource takes the units into the calling thread's buffer instead,
+ * see `resource_set_relaxed`.
+ *
+ * @param[in,out] resource  Pointer to the `Resource` to store into.
+ * @param[in]     amount    Number of units to store.
+ * @param[out]    stored    Number of units actually stored.
+ * @return                  `STATUS_OK` if everything was stored, `STATUS_CAPACITY` otherwise.
+ */
+int resource_try_store(Resource *resource, int amount, int *stored) {
+    int locked = resource->transactional;
+    int current, space, add;
+    ResourceDelta *delta;
+
+    if (resource->relaxed_quota > 0) {
+        if ((delta = resource_delta(resource)) != NULL) {
+            return resource_store_relaxed(resource, delta, amount, stored);
+        }
+        // Without a buffer the store still has to claim its space past other threads' reservations
+        add = resource_reserve(resource, amount);
+        resource_commit(resource, add, add);
+        *stored = add;
+        return (add == amount) ? STATUS_OK : STATUS_CAPACITY;
+    }
+    if (locked) {
+        resource_lock(resource);
+    }
+    current = atomic_load_explicit(&resource->amount, memory_order_relaxed);
+    for (;;) {
+        space = resource->max_capacity - current;
+        add = (space >= amount) ? amount : (space > 0 ? space : 0);
+        if (add == 0 || atomic_compare_exchange_weak_explicit(&resource->amount, &current, current + add,
+                                                              memory_order_acq_rel, memory_order_relaxed)) {
+            break;
+        }
+        stats_count(STATS_RESOURCE_RETRIES, 1);
+    }
+    if (locked) {
+        resource_unlock(resource);
+    }
+
+    *stored = add;
+    return (add == amount) ? STATUS_OK : STATUS_CAPACITY;
+}
+
+/**
+ * Consumes every input of a recipe, or none of them.
+ *
+ * The inputs are locked one after another in the order given, which must be ascending resource
+ * id (`system_set_recipe` sorts them), so two recipes sharing resources always lock them in the
+ * same order and cannot deadlock. Once all are held the amounts are checked and then taken.
+ * Only transactions touching the same resources wait for each other; every resource a recipe
+ * consumes together with others must be transactional, so single-resource changes take its lock too.
+ *
+ * @param[in]  inputs  Inputs to consume, ordered by resource id, each resource at most once.
+ * @param[in]  count   Number of inputs.
+ * @param[out] failed  Set to the index of the first input that was short, untouched on success.
+ * @return             `STATUS_OK` if everything was consumed, otherwise the `STATUS_EMPTY` or
+ *                     `STATUS_INSUFFICIENT` of the first short input and nothing was consumed.
+ */
+int resource_try_consume_all(const ResourceAmount *inputs, int count, int *failed) {
+    int result = STATUS_OK;
+
+    if (count == 1) {
+        result = resource_try_consume(inputs[0].resource, inputs[0].amount);
+        *failed = (result != STATUS_OK) ? 0 : *failed;
+        return result;
+    }
+
+    for (int i = 0; i < count; i++) {
+        resource_lock(inputs[i].resource);
+    }
+    for (int i = 0; i < count; i++) {
+        int current = atomic_load_explicit(&inputs[i].resource->amount, memory_order_relaxed);
+        if (current < inputs[i].amount) {
+            result = (current == 0) ? STATUS_EMPTY : STATUS_INSUFFICIENT;
+            *failed = i;
+            break;
+        }
+    }
+    if (result == STATUS_OK) {
+        // Every other writer of these resources waits on their locks, nothing can change in between
+        for (int i = 0; i < count; i++) {
+            atomic_fetch_sub_explicit(&inputs[i].resource->amount, inputs[i].amount, memory_order_acq_rel);
+        }
+    }
+    for (int i = count - 1; i >= 0; i--) {
+        resource_unlock(inputs[i].resource);
+    }
+    return result;
+}
+
+/**
+ * Lets threads buffer what they store into a `Resource`, or makes storing strict again.
+ *
+ * A thread then adds stored units to its own buffer and only adds them to the resource once it
+ * holds `quota` units or has held them for about `interval_ms` (see `resource_flush_due`), so
+ * producers stop contending on the resource's cache line. A buffer claims up to `quota` units
+ * of capacity in the resource's `reserved` when it opens and stores draw that claim down, so
+ * the amount never exceeds `max_capacity`. In exchange a store can find the resource full while
+ * other threads still hold part of its space, and consumers only see units once they are
+ * flushed. Threads must call `resource_flush_thread` before they exit.
+ * Set this before any system runs.
+ *
+ * @param[in,out] resource     Pointer to the `Resource`.
+ * @param[in]     quota        Most units a thread holds back, zero for strict storing.
+ * @param[in]     interval_ms  Longest a thread holds units back, in milliseconds.
+ */
+void resource_set_relaxed(Resource *resource, int quota, int interval_ms) {
+    resource->relaxed_quota = (quota > 0) ? quota : 0;
+    resource->relaxed_interval_ns = (long long)(interval_ms > 0 ? interval_ms : 0) * 1000000LL;
+}
+
+/**
+ * Flushes the calling thread's held-back units that would otherwise be held too long.
+ *
+ * Called by the thread loops after each step with the time they already read, and before they
+ * wait. Units are due one interval after the call that first sees them, and are flushed by the
+ * first call at or past that time, or before a wait that would take the thread past it.
+ *
+ * @param[in] now_ns   Current monotonic time in nanoseconds.
+ * @param[in] wait_ns  How long the thread is about to wait before its next call, zero if it is not.
+ */
+void resource_flush_due(long long now_ns, long long wait_ns) {
+    for (int i = 0; i < resource_delta_count; i++) {
+        ResourceDelta *delta = &resource_deltas[i];
+
+        if (delta->pending == 0 && delta->reserved == 0) {
+            continue;
+        }
+        if (delta->due_ns == 0) {
+            delta->due_ns = now_ns + delta->resource->relaxed_interval_ns;
+        }
+        if (delta->due_ns <= now_ns + wait_ns) {
+            resource_flush_delta(delta);
+        }
+    }
+}
+
+/**
+ * Flushes everything the calling thread holds back and frees its buffer.
+ *
+ * Every thread that stores into relaxed resources calls this before it exits, so no unit is lost.
+ */
+void resource_flush_thread(void) {
+    for (int i = 0; i < resource_delta_count; i++) {
+        resource_flush_delta(&resource_deltas[i]);
+    }
+    free(resource_deltas);
+    resource_deltas = NULL;
+    resource_delta_count = resource_delta_capacity = 0;
+}
+
+/**
+ * Stores units into the calling thread's buffer for a relaxed `Resource`.
+ *
+ * The units come out of the capacity the buffer has reserved. When that does not cover them the
+ * buffer reserves `quota` units more, or as many as the store needs if that is more.
+ *
+ * @param[in,out] resource  Pointer to the relaxed `Resource`.
+ * @param[in,out] delta     Calling thread's buffer for the resource.
+ * @param[in]     amount    Number of units to store.
+ * @param[out]    stored    Number of units actually stored.
+ * @return                  `STATUS_OK` if everything was stored, `STATUS_CAPACITY` otherwise.
+ */
+static int resource_store_relaxed(Resource *resource, ResourceDelta *delta, int amount, int *stored) {
+    int add;
+
+    // Only reservations and flushes write to the resource's cache line, once per `quota` units
+    if (delta->reserved < amount) {
+        int want = (amount > resource->relaxed_quota) ? amount : resource->relaxed_quota;
+        delta->reserved += resource_reserve(resource, want - delta->reserved);
+    }
+    add = (delta->reserved >= amount) ? amount : delta->reserved;
+    delta->reserved -= add;
+    delta->pending += add;
+    if (delta->pending >= resource->relaxed_quota) {
+        resource_flush_delta(delta);
+    }
+    *stored = add;
+    return (add == amount) ? STATUS_OK : STATUS_CAPACITY;
+}
+
+/**
+ * Finds the calling thread's buffer for a relaxed `Resource`, adding one if there is none.
+ *
+ * @param[in] resource  Pointer to the relaxed `Resource`.
+ * @return              Pointer to the buffer, or NULL if memory ran out (the store is then strict).
+ */
+static ResourceDelta *resource_delta(Resource *resource) {
+    ResourceDelta *grown;
+    int capacity;
+
+    for (int i = 0; i < resource_delta_count; i++) {
+        if (resource_deltas[i].resource == resource) {
+            return &resource_deltas[i];
+        }
+    }
+    if (resource_delta_count == resource_delta_capacity) {
+        // Doubles the buffer, aligned so no entry shares a cache line with another thread's data
+        capacity = (resource_delta_capacity == 0) ? 4 : resource_delta_capacity * 2;
+        grown = (ResourceDelta *)aligned_alloc(_Alignof(ResourceDelta), (size_t)capacity * sizeof(ResourceDelta));
+        if (grown == NULL) {
+            return NULL;
+        }
+        if (resource_deltas != NULL) {
+            memcpy(grown, resource_deltas, (size_t)resource_delta_count * sizeof(ResourceDelta));
+            free(resource_deltas);
+        }
+        resource_deltas = grown;
+        resource_delta_capacity = capacity;
+    }
+    resource_deltas[resource_delta_count].resource = resource;
+    resource_deltas[resource_delta_count].pending = 0;
+    resource_deltas[resource_delta_count].reserved = 0;
+    resource_deltas[resource_delta_count].due_ns = 0;
+    return &resource_deltas[resource_delta_count++];
+}
+
+/**
+ * Claims up to `amount` units of a relaxed `Resource`'s free capacity.
+ *
+ * Uses a compare-and-swap loop on `reserved`. The amount is read after `reserved`, and
+ * `resource_commit` adds to the amount before it releases the reservation, so a stale read only
+ * ever counts stored units twice and the claim never takes capacity that is not free.
+ *
+ * @param[in,out] resource  Pointer to the relaxed `Resource`.
+ * @param[in]     amount    Number of units wanted.
+ * @return                  Number of units claimed, less than `amount` when the resource is nearly full.
+ */
+static int resource_reserve(Resource *resource, int amount) {
+    int current = atomic_load_explicit(&resource->reserved, memory_order_acquire);
+    int space, add;
+
+    for (;;) {
+        space = resource->max_capacity - current - atomic_load_explicit(&resource->amount, memory_order_acquire);
+        add = (space >= amount) ? amount : (space > 0 ? space : 0);
+        if (add == 0 || atomic_compare_exchange_weak_explicit(&resource->reserved, &current, current + add,
+                                                              memory_order_acq_rel, memory_order_acquire)) {
+            return add;
+        }
+        stats_count(STATS_RESOURCE_RETRIES, 1);
+    }
+}
+
+/**
+ * Adds stored units to a relaxed `Resource` and releases the capacity reserved for them.
+ *
+ * @param[in,out] resource  Pointer to the relaxed `Resource`.
+ * @param[in]     stored    Units to add to the amount.
+ * @param[in]     reserved  Units of reservation to release, at least `stored`.
+ */
+static void resource_commit(Resource *resource, int stored, int reserved) {
+    if (resource->transactional) {
+        resource_lock(resource);
+    }
+    atomic_fetch_add_explicit(&resource->amount, stored, memory_order_acq_rel);
+    if (resource->transactional) {
+        resource_unlock(resource);
+    }
+    atomic_fetch_sub_explicit(&resource->reserved, reserved, memory_order_acq_rel);
+}
+
+/**
+ * Adds a thread's held-back units to their resource and releases the rest of its reservation.
+ *
+ * @param[in,out] delta  Buffer to flush.
+ */
+static void resource_flush_delta(ResourceDelta *delta) {
+    if (delta->pending == 0 && delta->reserved == 0) {
+        return;
+    }
+    resource_commit(delta->resource, delta->pending, delta->pending + delta->reserved);
+    delta->pending = 0;
+    delta->reserved = 0;
+    delta->due_ns = 0;
+}
+
+/**
+ * Takes the lock of a transactional `Resource`.
+ *
+ * @param[in,out] resource  Pointer to the `Resource`.
+ */
+static void resource_lock(Resource *resource) {
+    stats_sem_wait(&resource->resource_mutex, STATS_RESOURCE_WAIT);
+}
+
+/**
+ * Releases the lock of a transactional `Resource`.
+ *
+ * @param[in,out] resource  Pointer to the `Resource`.
+ */
+static void resource_unlock(Resource *resource) {
+    sem_post(&resource->resource_mutex);
 }
 
 /* ResourceAmount functions */
@@ -86,10 +488,25 @@ void resource_amount_init(ResourceAmount *resource_amount, Resource *resource, i
  * @param[out] array  Pointer to the `ResourceArray` to initialize.
  */
 void resource_array_init(ResourceArray *array) {
+    resource_array_init_arena(array, NULL);
+}
+
+/**
+ * Initializes a `ResourceArray` whose storage comes from an `Arena`.
+ *
+ * Such an array holds resources created in the same arena: cleaning it destroys none of them,
+ * they are released with the arena. Without an arena this is `resource_array_init`.
+ *
+ * @param[out]    array  Pointer to the `ResourceArray` to initialize.
+ * @param[in,out] arena  Pointer to the `Arena`, or NULL to use malloc.
+ */
+void resource_array_init_arena(ResourceArray *array, Arena *arena) {
     if(array != NULL){
         array->size = 0;
         array->capacity = 1;
-        array->resources = (Resource **)calloc(array->capacity, sizeof(Resource *));
+        array->arena = arena;
+        // An arena's array allocates on the first add, there is nothing to free
+        array->resources = (arena == NULL) ? (Resource **)calloc(array->capacity, sizeof(Resource *)) : NULL;
 
         if(array->resources == NULL){
             array->capacity = 0;
@@ -101,7 +518,8 @@ void resource_array_init(ResourceArray *array) {
  * Cleans up the `ResourceArray` by destroying all resources and freeing memory.
  *
  * Iterates through the array, calls `resource_destroy` on each `Resource`,
- * and frees the array memory.
+ * and frees the array memory. An array with an arena only forgets its resources, releasing
+ * the arena frees them and the storage at once.
  *
  * @param[in,out] array  Pointer to the `ResourceArray` to clean.
  */
@@ -109,6 +527,13 @@ void resource_array_clean(ResourceArray *array) {
     if(array == NULL || array->resources == NULL){
         return;
     }
+    // Storage and resources go with the arena
+    if (array->arena != NULL) {
+        array->resources = NULL;
+        array->size = 0;
+        array->capacity = 0;
+        return;
+    }
     for(int i = 0; i < array->size; i++){
         if(array->resources[i] != NULL){
             resource_destroy(array->resources[i]);
@@ -137,17 +562,137 @@ void resource_array_add(ResourceArray *array, Resource *resource) {
     if(array->size >= array->capacity){
         // Doubles the size of the array
         size_t new_capacity = (array->capacity == 0) ? 1 : array->capacity * 2; 
-        Resource **new_resource = (Resource **)malloc(new_capacity * sizeof(Resource *));
+        Resource **new_resource = (array->arena != NULL) ? (Resource **)arena_alloc(array->arena, new_capacity * sizeof(Resource *), _Alignof(Resource *))
+                                                         : (Resource **)malloc(new_capacity * sizeof(Resource *));
         if(new_resource == NULL){
             return;
         }
         for(int i = 0; i < array->size; i++){
             new_resource[i] = array->resources[i];
         }
-        free(array->resources);
+        // The old storage of an arena's array is left behind, doubling keeps it under half of what was allocated
+        if (array->arena == NULL) {
+            free(array->resources);
+        }
 
         array->resources = new_resource;
         array->capacity = new_capacity;
     }
+    resource->id = array->size;
     array->resources[array->size++] = resource;
-}
\ No newline at end of file
+}
+
+/**
+ * Builds the producer and consumer lists of every resource.
+ *
+ * A counting pass sizes each resource's row, then a second pass fills the rows, so each row
+ * lists its systems in `SystemArray` order. Every input and output of a recipe counts. Systems
+ * whose resources were not added to `resources` are left out.
+ *
+ * @param[out] index      Pointer to the `ResourceIndex` to build.
+ * @param[in]  resources  Pointer to the `ResourceArray` giving the resource ids.
+ * @param[in]  systems    Pointer to the `SystemArray` to index.
+ * @return                Non-zero on success; zero if memory ran out (the index is then empty).
+ */
+int resource_index_build(ResourceIndex *index, ResourceArray *resources, SystemArray *systems) {
+    int resource_count = resources->size;
+    int *starts = (int *)calloc(2 * ((size_t)resource_count + 1), sizeof(int));
+    int *entries, *fill[2];
+    int *row_start[2];
+    size_t entry_count = 0;
+    const ResourceAmount *items;
+
+    index->resource_count = 0;
+    index->system_count = 0;
+    index->producer_start = index->producers = index->consumer_start = index->consumers = NULL;
+    if (starts == NULL) {
+        return 0;
+    }
+    index->producer_start = starts;
+    index->consumer_start = starts + resource_count + 1;
+    row_start[0] = index->consumer_start;
+    row_start[1] = index->producer_start;
+
+    // Count each resource's systems one slot ahead, then turn the counts into row starts
+    for (int i = 0; i < systems->size; i++) {
+        for (int outputs = 0; outputs < 2; outputs++) {
+            int count = resource_index_items(systems->systems[i], outputs, &items);
+            for (int k = 0; k < count; k++) {
+                Resource *resource = items[k].resource;
+                if (resource != NULL && resource->id >= 0 && resource->id < resource_count) {
+                    row_start[outputs][resource->id + 1]++;
+                    entry_count++;
+                }
+            }
+        }
+    }
+    for (int r = 0; r < resource_count; r++) {
+        index->producer_start[r + 1] += index->producer_start[r];
+        index->consumer_start[r + 1] += index->consumer_start[r];
+    }
+
+    // The producers come first in the one allocation of entries
+    entries = (int *)malloc(entry_count * sizeof(int) + 1);
+    fill[0] = (int *)malloc(2 * ((size_t)resource_count + 1) * sizeof(int));
+    if (entries == NULL || fill[0] == NULL) {
+        free(entries);
+        free(fill[0]);
+        resource_index_clean(index);
+        return 0;
+    }
+    index->producers = entries;
+    index->consumers = entries + index->producer_start[resource_count];
+
+    // Fill the rows, using copies of the row starts as cursors
+    fill[1] = fill[0] + resource_count + 1;
+    memcpy(fill[0], index->consumer_start, ((size_t)resource_count + 1) * sizeof(int));
+    memcpy(fill[1], index->producer_start, ((size_t)resource_count + 1) * sizeof(int));
+    for (int i = 0; i < systems->size; i++) {
+        for (int outputs = 0; outputs < 2; outputs++) {
+            int *row = outputs ? index->producers : index->consumers;
+            int count = resource_index_items(systems->systems[i], outputs, &items);
+            for (int k = 0; k < count; k++) {
+                Resource *resource = items[k].resource;
+                if (resource != NULL && resource->id >= 0 && resource->id < resource_count) {
+                    row[fill[outputs][resource->id]++] = i;
+                }
+            }
+        }
+    }
+    free(fill[0]);
+
+    index->resource_count = resource_count;
+    index->system_count = systems->size;
+    return 1;
+}
+
+/**
+ * Lists the inputs or the outputs of a system, its recipe's if it has one.
+ *
+ * @param[in]  system   Pointer to the `System`.
+ * @param[in]  outputs  Non-zero for the outputs, zero for the inputs.
+ * @param[out] items    Set to the first `ResourceAmount`.
+ * @return              Number of entries at `items`; some may have no resource.
+ */
+static int resource_index_items(System *system, int outputs, const ResourceAmount **items) {
+    if (system->recipe != NULL) {
+        *items = outputs ? system->recipe->outputs : system->recipe->inputs;
+        return outputs ? system->recipe->output_count : system->recipe->input_count;
+    }
+    *items = outputs ? &system->produced : &system->consumed;
+    return 1;
+}
+
+/**
+ * Frees a `ResourceIndex`, the resources and systems themselves are untouched.
+ *
+ * @param[in,out] index  Pointer to the `ResourceIndex` to clean.
+ */
+void resource_index_clean(ResourceIndex *index) {
+    // The start arrays and the entry arrays are each one allocation
+    free(index->producer_start);
+    free(index->producers);
+    index->resource_count = 0;
+    index->system_count = 0;
+    index->producer_start = index->producers = index->consumer_start = index->consumers = NULL;
+}
@@ -0,0 +1,1471 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define SCENARIO_MAGIC "P2SCENE"    // First bytes of a compiled scenario, including the terminator
+#define SCENARIO_VERSION 5          // Bumped whenever the compiled format changes
+#define SCENARIO_ALIGN 64           // Alignment of each section of a compiled scenario
+#define SCENARIO_LINE_MAX 1024      // Longest line of a text scenario, including the newline
+#define SCENARIO_RECIPE_MAX 16      // Most inputs plus outputs of a recipe line
+#define SCENARIO_MAX_TOKENS (2 * SCENARIO_RECIPE_MAX + 5)  // More tokens than any line of a text scenario has
+#define SCENARIO_WRITE_BUFFER 65536 // Bytes a checkpoint collects before each write
+
+// Start of a compiled scenario, every offset is from the start of the file
+typedef struct ScenarioHeader {
+    char magic[8];
+    unsigned int version;
+    unsigned int resource_size;     // sizeof(Resource) of the build that compiled the file
+    unsigned int system_size;       // sizeof(System) of the build that compiled the file
+    unsigned int resource_count;
+    unsigned int system_count;
+    unsigned int reserved;
+    unsigned long long resources_offset;  // Images of every Resource
+    unsigned long long systems_offset;    // Images of every System
+    unsigned long long names_offset;      // NUL-terminated names, referred to by their offset from here
+    unsigned long long names_size;
+    unsigned long long file_size;
+    unsigned long long state_offset;      // ScenarioState of a checkpoint, zero for a compiled scenario
+} ScenarioHeader;
+
+// Simulation state held by a checkpoint after its objects, see scenario_checkpoint
+typedef struct ScenarioState {
+    long long virtual_time;
+    long long controller_next_ns;
+    long long events_handled;
+    long long status_changes;
+    int simulation_running;
+    int terminal_resource;          // Id of the resource that ended the simulation, -1 while running
+    int terminal_status;
+    int controller_policy;
+    unsigned int controller_count;  // Resources covered by the controller's status then pace columns, which follow
+    unsigned int event_count;
+    unsigned long long recipes_offset;  // Recipe images, each followed by its arrays as system_set_recipe lays them out
+    unsigned long long events_offset;   // ScenarioEvents pending in the queue, up to the end of the file
+} ScenarioState;
+
+// An event pending in the queue of a checkpointed Manager, objects referred to by id
+typedef struct ScenarioEvent {
+    int system;
+    int resource;       // -1 for none
+    int status;
+    int priority;
+    int amount;
+    int count;
+} ScenarioEvent;
+
+// Buffered writes to a file descriptor, usable in a forked child since it never allocates
+typedef struct ScenarioWriter {
+    int fd;
+    int failed;                 // Non-zero once a write failed
+    unsigned long long offset;  // Bytes written so far, including the buffered ones
+    size_t used;
+    char buffer[SCENARIO_WRITE_BUFFER];
+} ScenarioWriter;
+
+// A resource of a parsed scenario
+typedef struct ScenarioResourceSpec {
+    size_t name;        // Offset in ScenarioSpec.names
+    int amount;
+    int max_capacity;
+    int flags;          // RESOURCE_* roles
+} ScenarioResourceSpec;
+
+// An input or output of a recipe in a parsed scenario
+typedef struct ScenarioItemSpec {
+    long resource;      // Index of the resource
+    int amount;
+} ScenarioItemSpec;
+
+// A system of a parsed scenario, resources are referred to by index, -1 for none
+typedef struct ScenarioSystemSpec {
+    size_t name;        // Offset in ScenarioSpec.names
+    long consumed;
+    int consume_amount;
+    long produced;
+    int produce_amount;
+    int processing_time;
+    long items;         // Index in ScenarioSpec.items of a recipe's first input, -1 for a single-resource system
+    int input_count;    // The outputs follow the inputs
+    int output_count;
+} ScenarioSystemSpec;
+
+// A parsed scenario, shared by loading a text scenario and compiling it
+typedef struct ScenarioSpec {
+    ScenarioResourceSpec *resources;
+    size_t resource_count, resource_capacity;
+    ScenarioSystemSpec *systems;
+    size_t system_count, system_capacity;
+    ScenarioItemSpec *items;
+    size_t item_count, item_capacity;
+    char *names;
+    size_t names_size, names_capacity;
+    long *lookup;               // Open-addressed table of resource indices hashed by name, -1 for empty slots
+    size_t lookup_capacity;     // Zero or a power of two
+} ScenarioSpec;
+
+// Names used to set each field of `DemoParams`, as `<resource or system>.<field>`
+typedef struct DemoParamName {
+    const char *name;
+    size_t offset;
+} DemoParamName;
+
+static const DemoParamName demo_param_names[] = {
+    {"fuel.amount",            offsetof(DemoParams, fuel_amount)},
+    {"fuel.capacity",          offsetof(DemoParams, fuel_capacity)},
+    {"oxygen.amount",          offsetof(DemoParams, oxygen_amount)},
+    {"oxygen.capacity",        offsetof(DemoParams, oxygen_capacity)},
+    {"energy.amount",          offsetof(DemoParams, energy_amount)},
+    {"energy.capacity",        offsetof(DemoParams, energy_capacity)},
+    {"distance.amount",        offsetof(DemoParams, distance_amount)},
+    {"distance.capacity",      offsetof(DemoParams, distance_capacity)},
+    {"propulsion.consume",     offsetof(DemoParams, propulsion_consume)},
+    {"propulsion.produce",     offsetof(DemoParams, propulsion_produce)},
+    {"propulsion.time",        offsetof(DemoParams, propulsion_time)},
+    {"life_support.consume",   offsetof(DemoParams, life_support_consume)},
+    {"life_support.produce",   offsetof(DemoParams, life_support_produce)},
+    {"life_support.time",      offsetof(DemoParams, life_support_time)},
+    {"crew.consume",           offsetof(DemoParams, crew_consume)},
+    {"crew.time",              offsetof(DemoParams, crew_time)},
+    {"generator.consume",      offsetof(DemoParams, generator_consume)},
+    {"generator.produce",      offsetof(DemoParams, generator_produce)},
+    {"generator.time",         offsetof(DemoParams, generator_time)},
+};
+
+#define DEMO_PARAM_COUNT ((int)(sizeof(demo_param_names) / sizeof(demo_param_names[0])))
+
+/**
+ * Fills `DemoParams` with the numbers of the original sample scenario.
+ *
+ * @param[out] params  Pointer to the `DemoParams` to fill.
+ */
+void demo_params_init(DemoParams *params) {
+    params->fuel_amount = 1000;
+    params->fuel_capacity = 1000;
+    params->oxygen_amount = 20;
+    params->oxygen_capacity = 50;
+    params->energy_amount = 30;
+    params->energy_capacity = 50;
+    params->distance_amount = 0;
+    params->distance_capacity = 5000;
+
+    params->propulsion_consume = 5;
+    params->propulsion_produce = 25;
+    params->propulsion_time = 50;
+    params->life_support_consume = 7;
+    params->life_support_produce = 4;
+    params->life_support_time = 10;
+    params->crew_consume = 1;
+    params->crew_time = 2;
+    params->generator_consume = 5;
+    params->generator_produce = 10;
+    params->generator_time = 20;
+}
+
+/**
+ * Sets one field of `DemoParams` by name, e.g. "oxygen.amount" or "crew.time".
+ *
+ * @param[in,out] params  Pointer to the `DemoParams` to change.
+ * @param[in]     name    Name of the field.
+ * @param[in]     value   New value of the field.
+ * @return                Non-zero if the name was known; zero otherwise.
+ */
+int demo_params_set(DemoParams *params, const char *name, int value) {
+    for (int i = 0; i < DEMO_PARAM_COUNT; i++) {
+        if (strcmp(demo_param_names[i].name, name) == 0) {
+            *(int *)((char *)params + demo_param_names[i].offset) = value;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Prints the names accepted by `demo_params_set`.
+ *
+ * @param[in] stream  Stream to print to.
+ */
+void demo_params_print_names(FILE *stream) {
+    for (int i = 0; i < DEMO_PARAM_COUNT; i++) {
+        fprintf(stream, "  %s\n", demo_param_names[i].name);
+    }
+}
+
+/**
+ * Loads sample data for the simulation.
+ *
+ * Calls all of the functions required to create resources and systems and add them to the Manager's data.
+ *
+ * @param[in,out] manager  Pointer to the `Manager` to populate with resource and system data.
+ */
+void load_data(Manager *manager) {
+    DemoParams params;
+    demo_params_init(&params);
+    load_data_params(manager, &params);
+}
+
+/**
+ * Loads the sample scenario with the given numbers.
+ *
+ * Calls all of the functions required to create resources and systems and add them to the Manager's data.
+ *
+ * @param[in,out] manager  Pointer to the `Manager` to populate with resource and system data.
+ * @param[in]     params   Amounts, capacities and processing times to use.
+ */
+void load_data_params(Manager *manager, const DemoParams *params) {
+    // Create resources
+    Resource *fuel, *oxygen, *energy, *distance;
+    resource_create_arena(&fuel, "Fuel", params->fuel_amount, params->fuel_capacity, &manager->arena);
+    resource_create_arena(&oxygen, "Oxygen", params->oxygen_amount, params->oxygen_capacity, &manager->arena);
+    resource_create_arena(&energy, "Energy", params->energy_amount, params->energy_capacity, &manager->arena);
+    resource_create_arena(&distance, "Distance", params->distance_amount, params->distance_capacity, &manager->arena);
+
+    resource_array_add(&manager->resource_array, fuel);
+    resource_array_add(&manager->resource_array, oxygen);
+    resource_array_add(&manager->resource_array, energy);
+    resource_array_add(&manager->resource_array, distance);
+
+    // The crew needs oxygen to survive, the trip ends at the destination
+    if (oxygen != NULL) {
+        oxygen->flags = RESOURCE_CRITICAL;
+    }
+    if (distance != NULL) {
+        distance->flags = RESOURCE_GOAL | RESOURCE_RELAXED;
+    }
+    // Stored into by a system on every cycle, `--relaxed` lets the stores be buffered
+    if (energy != NULL) {
+        energy->flags = RESOURCE_RELAXED;
+    }
+
+    // Create systems
+    System *propulsion_system, *life_support_system, *crew_capsule_system, *generator_system;
+    ResourceAmount consume_fuel, produce_distance;
+    resource_amount_init(&consume_fuel, fuel, params->propulsion_consume);
+    resource_amount_init(&produce_distance, distance, params->propulsion_produce);
+    system_create_arena(&propulsion_system, "Propulsion", consume_fuel, produce_distance, params->propulsion_time, &manager->event_queue, &manager->arena);
+
+    ResourceAmount consume_energy, produce_oxygen;
+    resource_amount_init(&consume_energy, energy, params->life_support_consume);
+    resource_amount_init(&produce_oxygen, oxygen, params->life_support_produce);
+    system_create_arena(&life_support_system, "Life Support", consume_energy, produce_oxygen, params->life_support_time, &manager->event_queue, &manager->arena);
+
+    ResourceAmount consume_oxygen, produce_nothing;
+    resource_amount_init(&consume_oxygen, oxygen, params->crew_consume);
+    resource_amount_init(&produce_nothing, NULL, 0);
+    system_create_arena(&crew_capsule_system, "Crew", consume_oxygen, produce_nothing, params->crew_time, &manager->event_queue, &manager->arena);
+
+    ResourceAmount consume_fuel_for_energy, produce_energy;
+    resource_amount_init(&consume_fuel_for_energy, fuel, params->generator_consume);
+    resource_amount_init(&produce_energy, energy, params->generator_produce);
+    system_create_arena(&generator_system, "Generator", consume_fuel_for_energy, produce_energy, params->generator_time, &manager->event_queue, &manager->arena);
+
+    system_array_add(&manager->system_array, propulsion_system);
+    system_array_add(&manager->system_array, life_support_system);
+    system_array_add(&manager->system_array, crew_capsule_system);
+    system_array_add(&manager->system_array, generator_system);
+}
+
+/* Scenario files */
+
+/**
+ * Grows a malloc'd array so it can hold at least `needed` items.
+ *
+ * Allocates a larger block and copies the items over, doubling the capacity each time.
+ *
+ * @param[in]     items      The array, may be NULL when `capacity` is zero.
+ * @param[in]     needed     Number of items the array must be able to hold.
+ * @param[in,out] capacity   Number of items the array can hold, updated when it grows.
+ * @param[in]     item_size  Size of one item in bytes.
+ * @return                   The array to use from now on, or NULL if it could not grow (`items` is then unchanged).
+ */
+static void *scenario_reserve(void *items, size_t needed, size_t *capacity, size_t item_size) {
+    size_t new_capacity;
+    void *grown;
+
+    if (needed <= *capacity) {
+        return items;
+    }
+    new_capacity = (*capacity == 0) ? 16 : *capacity * 2;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    grown = malloc(new_capacity * item_size);
+    if (grown == NULL) {
+        return NULL;
+    }
+    if (items != NULL) {
+        memcpy(grown, items, *capacity * item_size);
+        free(items);
+    }
+    *capacity = new_capacity;
+    return grown;
+}
+
+/**
+ * Hashes a name with 64-bit FNV-1a.
+ *
+ * @param[in] name  NUL-terminated name.
+ * @return          Hash of the name.
+ */
+static unsigned long long scenario_hash(const char *name) {
+    unsigned long long hash = 14695981039346656037ULL;
+
+    for (; *name != '\0'; name++) {
+        hash = (hash ^ (unsigned char)*name) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Finds a resource of the scenario by name.
+ *
+ * @param[in] spec  Pointer to the `ScenarioSpec`.
+ * @param[in] name  Name of the resource.
+ * @return          Index of the resource, or -1 if there is none with that name.
+ */
+static long scenario_find_resource(const ScenarioSpec *spec, const char *name) {
+    size_t mask = spec->lookup_capacity - 1;
+
+    if (spec->lookup_capacity == 0) {
+        return -1;
+    }
+    for (size_t slot = scenario_hash(name) & mask; spec->lookup[slot] >= 0; slot = (slot + 1) & mask) {
+        if (strcmp(spec->names + spec->resources[spec->lookup[slot]].name, name) == 0) {
+            return spec->lookup[slot];
+        }
+    }
+    return -1;
+}
+
+/**
+ * Adds the last resource of the scenario to the name lookup, rebuilding it when half full.
+ *
+ * @param[in,out] spec  Pointer to the `ScenarioSpec`.
+ * @return              Non-zero on success; zero if memory ran out.
+ */
+static int scenario_index_resource(ScenarioSpec *spec) {
+    size_t mask, slot;
+
+    if (spec->resource_count * 2 > spec->lookup_capacity) {
+        size_t capacity = (spec->lookup_capacity == 0) ? 64 : spec->lookup_capacity * 2;
+        long *lookup = (long *)malloc(capacity * sizeof(long));
+
+        if (lookup == NULL) {
+            return 0;
+        }
+        for (size_t i = 0; i < capacity; i++) {
+            lookup[i] = -1;
+        }
+        // Reinsert everything but the new resource, which is added below
+        for (size_t i = 0; i + 1 < spec->resource_count; i++) {
+            slot = scenario_hash(spec->names + spec->resources[i].name) & (capacity - 1);
+            while (lookup[slot] >= 0) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            lookup[slot] = (long)i;
+        }
+        free(spec->lookup);
+        spec->lookup = lookup;
+        spec->lookup_capacity = capacity;
+    }
+
+    mask = spec->lookup_capacity - 1;
+    slot = scenario_hash(spec->names + spec->resources[spec->resource_count - 1].name) & mask;
+    while (spec->lookup[slot] >= 0) {
+        slot = (slot + 1) & mask;
+    }
+    spec->lookup[slot] = (long)spec->resource_count - 1;
+    return 1;
+}
+
+/**
+ * Copies a name into the scenario's name table.
+ *
+ * @param[in,out] spec  Pointer to the `ScenarioSpec`.
+ * @param[in]     name  Name to copy.
+ * @return              Offset of the copy in `spec->names`, or -1 if memory ran out.
+ */
+static long scenario_add_name(ScenarioSpec *spec, const char *name) {
+    size_t length = strlen(name) + 1;
+    size_t offset = spec->names_size;
+    char *names = (char *)scenario_reserve(spec->names, spec->names_size + length, &spec->names_capacity, 1);
+
+    if (names == NULL) {
+        return -1;
+    }
+    spec->names = names;
+    memcpy(spec->names + offset, name, length);
+    spec->names_size += length;
+    return (long)offset;
+}
+
+/**
+ * Frees everything held by a `ScenarioSpec`.
+ *
+ * @param[in,out] spec  Pointer to the `ScenarioSpec` to clean.
+ */
+static void scenario_spec_clean(ScenarioSpec *spec) {
+    free(spec->resources);
+    free(spec->systems);
+    free(spec->items);
+    free(spec->names);
+    free(spec->lookup);
+    memset(spec, 0, sizeof(*spec));
+}
+
+/**
+ * Splits the next token off a line of a scenario file.
+ *
+ * Tokens are separated by spaces or tabs, a token in double quotes may contain spaces,
+ * and a '#' outside quotes starts a comment running to the end of the line.
+ *
+ * @param[in,out] cursor  Position in the line, moved past the token, which is NUL-terminated in place.
+ * @param[out]    token   Start of the token.
+ * @return                1 if a token was found, 0 at the end of the line, -1 on an unterminated quote.
+ */
+static int scenario_next_token(char **cursor, char **token) {
+    char *p = *cursor;
+
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+        p++;
+    }
+    if (*p == '\0' || *p == '#') {
+        *cursor = p;
+        return 0;
+    }
+
+    if (*p == '"') {
+        *token = ++p;
+        while (*p != '"') {
+            if (*p == '\0' || *p == '\n') {
+                return -1;
+            }
+            p++;
+        }
+    }
+    else {
+        *token = p;
+        while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' && *p != '#') {
+            p++;
+        }
+        if (*p == '#') {
+            // The comment runs to the end of the line, so the line ends with this token
+            *p = '\0';
+            *cursor = p;
+            return 1;
+        }
+    }
+    if (*p != '\0') {
+        *p++ = '\0';
+    }
+    *cursor = p;
+    return 1;
+}
+
+/**
+ * Parses a whole token as a non-negative `int`.
+ *
+ * @param[in]  token  Token to parse.
+ * @param[out] value  The number.
+ * @return            Non-zero if the token was a number in range; zero otherwise.
+ */
+static int scenario_parse_int(const char *token, int *value) {
+    char *end;
+    long parsed;
+
+    errno = 0;
+    parsed = strtol(token, &end, 10);
+    if (errno != 0 || end == token || *end != '\0' || parsed < 0 || parsed > INT_MAX) {
+        return 0;
+    }
+    *value = (int)parsed;
+    return 1;
+}
+
+/**
+ * Parses the tokens of a `recipe` line and adds the system to a `ScenarioSpec`.
+ *
+ * @param[in,out] spec         Pointer to the `ScenarioSpec` being filled.
+ * @param[in]     path         Path of the file, used in error messages.
+ * @param[in]     line_number  Line the tokens come from, used in error messages.
+ * @param[in]     tokens       Tokens of the line, starting with "recipe".
+ * @param[in]     count        Number of tokens, at least four.
+ * @return                     Non-zero on success; zero if the line is invalid (an error has been printed).
+ */
+static int scenario_parse_recipe(ScenarioSpec *spec, const char *path, int line_number, char **tokens, int count) {
+    ScenarioSystemSpec system;
+    ScenarioSystemSpec *systems;
+    ScenarioItemSpec *items;
+    long name;
+    int arrow = 2;
+
+    // Tokens past SCENARIO_MAX_TOKENS were not kept, so count them before looking at any
+    while (count <= SCENARIO_MAX_TOKENS && arrow < count - 1 && strcmp(tokens[arrow], "->") != 0) {
+        arrow++;
+    }
+    if (count > SCENARIO_MAX_TOKENS || arrow >= count - 1 || (arrow - 2) % 2 != 0 || (count - arrow - 2) % 2 != 0) {
+        fprintf(stderr, "%s:%d: expected \"recipe <name> <consumed> <amount> ... -> <produced> <amount> ... <time>\" "
+                        "with at most %d inputs and outputs\n", path, line_number, SCENARIO_RECIPE_MAX);
+        return 0;
+    }
+    if (!scenario_parse_int(tokens[count - 1], &system.processing_time) || system.processing_time == 0) {
+        fprintf(stderr, "%s:%d: processing time must be positive\n", path, line_number);
+        return 0;
+    }
+
+    items = (ScenarioItemSpec *)scenario_reserve(spec->items, spec->item_count + (count - 4) / 2,
+                                                 &spec->item_capacity, sizeof(ScenarioItemSpec));
+    if (items == NULL) {
+        perror("Failed to allocate memory for the scenario");
+        return 0;
+    }
+    spec->items = items;
+    system.items = (long)spec->item_count;
+    system.input_count = system.output_count = 0;
+
+    // Pairs of resource and amount on each side of the arrow, `-` pairs are left out
+    for (int i = 2; i < count - 1; i += 2) {
+        ScenarioItemSpec item;
+
+        if (i == arrow) {
+            i--;
+            continue;
+        }
+        if (strcmp(tokens[i], "-") == 0) {
+            continue;
+        }
+        item.resource = scenario_find_resource(spec, tokens[i]);
+        if (item.resource < 0) {
+            fprintf(stderr, "%s:%d: unknown resource \"%s\"\n", path, line_number, tokens[i]);
+            return 0;
+        }
+        if (!scenario_parse_int(tokens[i + 1], &item.amount)) {
+            fprintf(stderr, "%s:%d: amounts must be non-negative numbers\n", path, line_number);
+            return 0;
+        }
+        spec->items[spec->item_count++] = item;
+        system.input_count += (i < arrow);
+        system.output_count += (i > arrow);
+    }
+
+    // The first input and output also describe the system where one resource is expected
+    system.consumed = (system.input_count > 0) ? spec->items[system.items].resource : -1;
+    system.consume_amount = (system.input_count > 0) ? spec->items[system.items].amount : 0;
+    system.produced = (system.output_count > 0) ? spec->items[system.items + system.input_count].resource : -1;
+    system.produce_amount = (system.output_count > 0) ? spec->items[system.items + system.input_count].amount : 0;
+
+    systems = (ScenarioSystemSpec *)scenario_reserve(spec->systems, spec->system_count + 1,
+                                                     &spec->system_capacity, sizeof(ScenarioSystemSpec));
+    if (systems == NULL || (name = scenario_add_name(spec, tokens[1])) < 0) {
+        perror("Failed to allocate memory for the scenario");
+        return 0;
+    }
+    spec->systems = systems;
+    system.name = (size_t)name;
+    spec->systems[spec->system_count++] = system;
+    return 1;
+}
+
+/**
+ * Parses a text scenario.
+ *
+ * Each line is blank, a comment, or one of:
+ *
+ *     resource <name> <amount> <max_capacity> [critical] [goal] [relaxed]
+ *     system <name> <consumed> <amount> <produced> <amount> <processing_time>
+ *     recipe <name> [<consumed> <amount> ...] -> [<produced> <amount> ...] <processing_time>
+ *
+ * where `<consumed>` and `<produced>` name a resource declared on an earlier line, or are `-`
+ * for none. Amounts are non-negative and processing times, in milliseconds, positive. A recipe
+ * consumes all of its inputs at once or none of them, and has at most
+ * `SCENARIO_RECIPE_MAX` inputs and outputs. Names containing spaces are written in double quotes. The simulation terminates
+ * when a `critical` resource runs out or a `goal` resource reaches capacity. Stores into a
+ * `relaxed` resource may be buffered per thread when the run asks for it (see `resource_set_relaxed`).
+ *
+ * @param[in]  file  Open scenario file.
+ * @param[in]  path  Path of the file, used in error messages.
+ * @param[out] spec  Pointer to the zeroed `ScenarioSpec` to fill.
+ * @return           Non-zero on success; zero if the file is invalid (an error has been printed).
+ */
+static int scenario_parse(FILE *file, const char *path, ScenarioSpec *spec) {
+    char line[SCENARIO_LINE_MAX];
+    char *cursor, *tokens[SCENARIO_MAX_TOKENS];
+    int line_number = 0, count, found;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line_number++;
+        if (strchr(line, '\n') == NULL && !feof(file)) {
+            fprintf(stderr, "%s:%d: line is longer than %d characters\n", path, line_number, SCENARIO_LINE_MAX - 2);
+            return 0;
+        }
+
+        cursor = line;
+        count = 0;
+        while ((found = scenario_next_token(&cursor, &tokens[count < SCENARIO_MAX_TOKENS ? count : SCENARIO_MAX_TOKENS - 1])) > 0) {
+            count++;
+        }
+        if (found < 0) {
+            fprintf(stderr, "%s:%d: unterminated quote\n", path, line_number);
+            return 0;
+        }
+        if (count == 0) {
+            continue;
+        }
+
+        if (strcmp(tokens[0], "resource") == 0 && count >= 4 && count <= 7) {
+            ScenarioResourceSpec resource;
+            ScenarioResourceSpec *resources;
+            long name;
+
+            if (!scenario_parse_int(tokens[2], &resource.amount) || !scenario_parse_int(tokens[3], &resource.max_capacity)) {
+                fprintf(stderr, "%s:%d: amount and capacity must be non-negative numbers\n", path, line_number);
+                return 0;
+            }
+            resource.flags = 0;
+            for (int i = 4; i < count; i++) {
+                if (strcmp(tokens[i], "critical") == 0) {
+                    resource.flags |= RESOURCE_CRITICAL;
+                }
+                else if (strcmp(tokens[i], "goal") == 0) {
+                    resource.flags |= RESOURCE_GOAL;
+                }
+                else if (strcmp(tokens[i], "relaxed") == 0) {
+                    resource.flags |= RESOURCE_RELAXED;
+                }
+                else {
+                    fprintf(stderr, "%s:%d: unknown resource role \"%s\", expected critical, goal or relaxed\n", path, line_number, tokens[i]);
+                    return 0;
+                }
+            }
+            if (strcmp(tokens[1], "-") == 0 || scenario_find_resource(spec, tokens[1]) >= 0) {
+                fprintf(stderr, "%s:%d: resource \"%s\" is already declared or reserved\n", path, line_number, tokens[1]);
+                return 0;
+            }
+            resources = (ScenarioResourceSpec *)scenario_reserve(spec->resources, spec->resource_count + 1,
+                                                                 &spec->resource_capacity, sizeof(ScenarioResourceSpec));
+            if (resources == NULL || (name = scenario_add_name(spec, tokens[1])) < 0) {
+                perror("Failed to allocate memory for the scenario");
+                return 0;
+            }
+            spec->resources = resources;
+            resource.name = (size_t)name;
+            spec->resources[spec->resource_count++] = resource;
+            if (!scenario_index_resource(spec)) {
+                perror("Failed to allocate memory for the scenario");
+                return 0;
+            }
+        }
+        else if (strcmp(tokens[0], "system") == 0 && count == 7) {
+            ScenarioSystemSpec system;
+            ScenarioSystemSpec *systems;
+            long name;
+
+            system.consumed = (strcmp(tokens[2], "-") == 0) ? -1 : scenario_find_resource(spec, tokens[2]);
+            system.produced = (strcmp(tokens[4], "-") == 0) ? -1 : scenario_find_resource(spec, tokens[4]);
+            if ((system.consumed < 0 && strcmp(tokens[2], "-") != 0) || (system.produced < 0 && strcmp(tokens[4], "-") != 0)) {
+                fprintf(stderr, "%s:%d: unknown resource \"%s\"\n", path, line_number, system.consumed < 0 && strcmp(tokens[2], "-") != 0 ? tokens[2] : tokens[4]);
+                return 0;
+            }
+            if (!scenario_parse_int(tokens[3], &system.consume_amount) || !scenario_parse_int(tokens[5], &system.produce_amount)) {
+                fprintf(stderr, "%s:%d: amounts must be non-negative numbers\n", path, line_number);
+                return 0;
+            }
+            // A system that takes no time to process would step forever at one instant of a virtual run
+            if (!scenario_parse_int(tokens[6], &system.processing_time) || system.processing_time == 0) {
+                fprintf(stderr, "%s:%d: processing time must be positive\n", path, line_number);
+                return 0;
+            }
+            systems = (ScenarioSystemSpec *)scenario_reserve(spec->systems, spec->system_count + 1,
+                                                             &spec->system_capacity, sizeof(ScenarioSystemSpec));
+            if (systems == NULL || (name = scenario_add_name(spec, tokens[1])) < 0) {
+                perror("Failed to allocate memory for the scenario");
+                return 0;
+            }
+            spec->systems = systems;
+            system.name = (size_t)name;
+            system.items = -1;
+            system.input_count = system.output_count = 0;
+            spec->systems[spec->system_count++] = system;
+        }
+        else if (strcmp(tokens[0], "recipe") == 0 && count >= 4) {
+            if (!scenario_parse_recipe(spec, path, line_number, tokens, count)) {
+                return 0;
+            }
+        }
+        else {
+            fprintf(stderr, "%s:%d: expected \"resource <name> <amount> <capacity> [critical] [goal] [relaxed]\" or "
+                            "\"system <name> <consumed> <amount> <produced> <amount> <time>\" or "
+                            "\"recipe <name> <consumed> <amount> ... -> <produced> <amount> ... <time>\"\n", path, line_number);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Creates the resources and systems of a parsed scenario and adds them to the Manager.
+ *
+ * @param[in,out] manager  Pointer to the `Manager` to populate.
+ * @param[in]     spec     Pointer to the parsed `ScenarioSpec`.
+ * @return                 Non-zero on success; zero if memory ran out.
+ */
+static int scenario_build(Manager *manager, const ScenarioSpec *spec) {
+    Resource **resources = (Resource **)malloc((spec->resource_count + 1) * sizeof(Resource *));
+    ResourceAmount consumed, produced;
+    ResourceAmount items[SCENARIO_RECIPE_MAX];
+    System *system;
+
+    if (resources == NULL) {
+        perror("Failed to allocate memory for the scenario");
+        return 0;
+    }
+
+    for (size_t i = 0; i < spec->resource_count; i++) {
+        const ScenarioResourceSpec *resource = &spec->resources[i];
+
+        resource_create_arena(&resources[i], spec->names + resource->name, resource->amount, resource->max_capacity, &manager->arena);
+        if (resources[i] == NULL) {
+            free(resources);
+            return 0;
+        }
+        resources[i]->flags = resource->flags;
+        resource_array_add(&manager->resource_array, resources[i]);
+    }
+
+    for (size_t i = 0; i < spec->system_count; i++) {
+        const ScenarioSystemSpec *spec_system = &spec->systems[i];
+
+        resource_amount_init(&consumed, spec_system->consumed >= 0 ? resources[spec_system->consumed] : NULL, spec_system->consume_amount);
+        resource_amount_init(&produced, spec_system->produced >= 0 ? resources[spec_system->produced] : NULL, spec_system->produce_amount);
+        system_create_arena(&system, spec->names + spec_system->name, consumed, produced, spec_system->processing_time, &manager->event_queue, &manager->arena);
+        if (system == NULL) {
+            free(resources);
+            return 0;
+        }
+        if (spec_system->items >= 0) {
+            for (int k = 0; k < spec_system->input_count + spec_system->output_count; k++) {
+                const ScenarioItemSpec *item = &spec->items[spec_system->items + k];
+                resource_amount_init(&items[k], resources[item->resource], item->amount);
+            }
+            // A system left out on failure goes with the arena
+            if (!system_set_recipe_arena(system, items, spec_system->input_count, items + spec_system->input_count, spec_system->output_count, &manager->arena)) {
+                free(resources);
+                return 0;
+            }
+        }
+        system_array_add(&manager->system_array, system);
+    }
+
+    free(resources);
+    return 1;
+}
+
+/**
+ * Rounds a file offset up to the alignment of the compiled format.
+ *
+ * @param[in] offset  Offset in bytes.
+ * @return            The next multiple of `SCENARIO_ALIGN`.
+ */
+static unsigned long long scenario_align(unsigned long long offset) {
+    return (offset + SCENARIO_ALIGN - 1) & ~(unsigned long long)(SCENARIO_ALIGN - 1);
+}
+
+/**
+ * Writes zero bytes to a file until it reaches an offset.
+ *
+ * @param[in] out   File being written.
+ * @param[in] from  Current offset.
+ * @param[in] to    Offset to reach.
+ * @return          Non-zero on success; zero if the write failed.
+ */
+static int scenario_pad(FILE *out, unsigned long long from, unsigned long long to) {
+    for (; from < to; from++) {
+        if (fputc(0, out) == EOF) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Writes a parsed scenario in the compiled format.
+ *
+ * The file holds a `ScenarioHeader` followed by an image of every `Resource`, an image of every
+ * `System` and the names. In the images, `name` holds an offset into the names and
+ * `ResourceAmount.resource` holds the resource's index plus one, or zero for none;
+ * `scenario_map_compiled` turns them back into pointers.
+ *
+ * @param[in] spec  Pointer to the parsed `ScenarioSpec`.
+ * @param[in] out   File opened for writing.
+ * @return          Non-zero on success; zero if a write failed.
+ */
+static int scenario_write(const ScenarioSpec *spec, FILE *out) {
+    ScenarioHeader header;
+    Resource resource;
+    System system;
+    int ok;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SCENARIO_MAGIC, sizeof(header.magic));
+    header.version = SCENARIO_VERSION;
+    header.resource_size = sizeof(Resource);
+    header.system_size = sizeof(System);
+    header.resource_count = spec->resource_count;
+    header.system_count = spec->system_count;
+    header.resources_offset = scenario_align(sizeof(ScenarioHeader));
+    header.systems_offset = scenario_align(header.resources_offset + spec->resource_count * sizeof(Resource));
+    header.names_offset = scenario_align(header.systems_offset + spec->system_count * sizeof(System));
+    header.names_size = spec->names_size;
+    header.file_size = header.names_offset + spec->names_size;
+
+    ok = fwrite(&header, sizeof(header), 1, out) == 1 && scenario_pad(out, sizeof(header), header.resources_offset);
+
+    for (size_t i = 0; ok && i < spec->resource_count; i++) {
+        memset(&resource, 0, sizeof(resource));
+        resource.name = (char *)(uintptr_t)spec->resources[i].name;
+        resource.id = (int)i;
+        atomic_init(&resource.amount, spec->resources[i].amount);
+        resource.max_capacity = spec->resources[i].max_capacity;
+        resource.flags = spec->resources[i].flags;
+        ok = fwrite(&resource, sizeof(resource), 1, out) == 1;
+    }
+    ok = ok && scenario_pad(out, header.resources_offset + spec->resource_count * sizeof(Resource), header.systems_offset);
+
+    for (size_t i = 0; ok && i < spec->system_count; i++) {
+        // Same starting state as system_create, everything not set here is zero
+        memset(&system, 0, sizeof(system));
+        system.name = (char *)(uintptr_t)spec->systems[i].name;
+        resource_amount_init(&system.consumed, (Resource *)(uintptr_t)(spec->systems[i].consumed + 1), spec->systems[i].consume_amount);
+        resource_amount_init(&system.produced, (Resource *)(uintptr_t)(spec->systems[i].produced + 1), spec->systems[i].produce_amount);
+        system.processing_time = spec->systems[i].processing_time;
+        system.id = -1;
+        system_set_control(&system, STANDARD, 0);
+        system.phase = SYSTEM_PHASE_CONVERT;
+        ok = fwrite(&system, sizeof(system), 1, out) == 1;
+    }
+    ok = ok && scenario_pad(out, header.systems_offset + spec->system_count * sizeof(System), header.names_offset);
+
+    return ok && fwrite(spec->names, 1, spec->names_size, out) == spec->names_size;
+}
+
+/**
+ * Checks the state section of a mapped checkpoint.
+ *
+ * @param[in] map     The mapped file.
+ * @param[in] header  Its header, already checked up to the names.
+ * @return            The `ScenarioState`, or NULL if the section is corrupt.
+ */
+static const ScenarioState *scenario_check_state(const char *map, const ScenarioHeader *header) {
+    const ScenarioState *state = (const ScenarioState *)(map + header->state_offset);
+    unsigned long long columns;
+
+    if (header->state_offset % SCENARIO_ALIGN != 0 || header->state_offset < header->names_offset + header->names_size
+        || header->state_offset + sizeof(ScenarioState) > header->file_size) {
+        return NULL;
+    }
+    columns = header->state_offset + sizeof(ScenarioState) + (unsigned long long)state->controller_count * 2 * sizeof(int);
+    if ((state->controller_count != 0 && state->controller_count != header->resource_count)
+        || state->terminal_resource < -1 || state->terminal_resource >= (long long)header->resource_count
+        || state->controller_policy < CONTROL_REACTIVE || state->controller_policy > CONTROL_PROPORTIONAL
+        || state->recipes_offset < columns || state->events_offset < state->recipes_offset
+        || state->events_offset + (unsigned long long)state->event_count * sizeof(ScenarioEvent) != header->file_size) {
+        return NULL;
+    }
+    return state;
+}
+
+/**
+ * Turns a recipe image of a mapped checkpoint back into a `Recipe`.
+ *
+ * The image is laid out as `system_set_recipe` allocates a recipe, with each item's resource
+ * held as its index plus one.
+ *
+ * @param[in,out] map        The mapped file.
+ * @param[in]     header     Its header.
+ * @param[in]     state      Its checked state.
+ * @param[in]     offset     Offset of the recipe image in the file.
+ * @param[in]     resources  The mapped resources the indices refer to.
+ * @return                   The recipe, or NULL if the image is corrupt.
+ */
+static Recipe *scenario_map_recipe(char *map, const ScenarioHeader *header, const ScenarioState *state, unsigned long long offset, Resource *resources) {
+    Recipe *recipe;
+    unsigned long long size;
+
+    if (offset < state->recipes_offset || offset % sizeof(long long) != 0 || offset + sizeof(Recipe) > state->events_offset) {
+        return NULL;
+    }
+    recipe = (Recipe *)(map + offset);
+    if (recipe->input_count < 0 || recipe->output_count < 0
+        || recipe->input_count > (int)header->resource_count || recipe->output_count > (int)header->resource_count) {
+        return NULL;
+    }
+    size = sizeof(Recipe) + (unsigned long long)(recipe->input_count + recipe->output_count) * sizeof(ResourceAmount)
+           + (unsigned long long)recipe->output_count * sizeof(int);
+    if (offset + size > state->events_offset) {
+        return NULL;
+    }
+    recipe->inputs = (ResourceAmount *)(recipe + 1);
+    recipe->outputs = recipe->inputs + recipe->input_count;
+    recipe->stored = (int *)(recipe->outputs + recipe->output_count);
+    for (int i = 0; i < recipe->input_count + recipe->output_count; i++) {
+        uintptr_t index = (uintptr_t)recipe->inputs[i].resource;
+
+        if (index == 0 || index > header->resource_count) {
+            return NULL;
+        }
+        recipe->inputs[i].resource = &resources[index - 1];
+    }
+    return recipe;
+}
+
+/**
+ * Puts the Manager back in the state a checkpoint was taken in, once its objects are mapped.
+ *
+ * The clock, the outcome so far and the controller are copied back and the pending events
+ * pushed again, in the priority order they were taken out of the queue.
+ *
+ * @param[in,out] manager    Pointer to the `Manager` the checkpoint's objects were added to.
+ * @param[in]     map        The mapped file.
+ * @param[in]     state      Its checked state.
+ * @param[in]     resources  The mapped resources.
+ * @param[in]     systems    The mapped systems.
+ * @param[in]     path       Path of the file, used in error messages.
+ */
+static void scenario_restore_state(Manager *manager, const char *map, const ScenarioState *state, Resource *resources, System *systems, const char *path) {
+    const int *columns = (const int *)(state + 1);
+    const ScenarioEvent *events = (const ScenarioEvent *)(map + state->events_offset);
+    int count = (int)state->controller_count;
+    Event event;
+
+    manager->virtual_time = state->virtual_time;
+    atomic_store(&manager->simulation_running, state->simulation_running);
+    manager->terminal_resource = (state->terminal_resource >= 0) ? &resources[state->terminal_resource] : NULL;
+    manager->terminal_status = state->terminal_status;
+    manager->events_handled = (long)state->events_handled;
+    manager->status_changes = (long)state->status_changes;
+
+    if (state->controller_policy != CONTROL_REACTIVE) {
+        if (manager_set_controller(manager, state->controller_policy) && manager->controller.resource_count == count) {
+            memcpy(manager->controller.status, columns, (size_t)count * sizeof(int));
+            memcpy(manager->controller.pace, columns + count, (size_t)count * sizeof(int));
+            manager->controller.next_ns = state->controller_next_ns;
+        }
+        else {
+            fprintf(stderr, "%s: could not restore the controller, reacting to every event instead\n", path);
+            manager_set_controller(manager, CONTROL_REACTIVE);
+        }
+    }
+
+    for (unsigned int i = 0; i < state->event_count; i++) {
+        const ScenarioEvent *pending = &events[i];
+
+        if (pending->system < 0 || pending->system >= manager->system_array.size
+            || pending->resource < -1 || pending->resource >= manager->resource_array.size) {
+            continue;
+        }
+        event_init(&event, &systems[pending->system], (pending->resource >= 0) ? &resources[pending->resource] : NULL,
+                   pending->status, pending->priority, pending->amount);
+        event.count = pending->count;
+        event_queue_push(&manager->event_queue, &event);
+    }
+}
+
+/**
+ * Maps a compiled scenario or a checkpoint and adds its resources and systems to the Manager.
+ *
+ * The file is mapped copy-on-write and its images are used in place as the `Resource` and
+ * `System` objects, only the pointers and semaphores are fixed up. Nothing is allocated per
+ * object; the mapping is released by `scenario_unload`. A checkpoint also restores the state of
+ * the run it was taken from, see `scenario_checkpoint`, and has to be loaded into an empty Manager.
+ *
+ * @param[in,out] manager  Pointer to the `Manager` to populate.
+ * @param[in]     fd       Open descriptor of the compiled file.
+ * @param[in]     path     Path of the file, used in error messages.
+ * @return                 Non-zero on success; zero if the file is invalid (an error has been printed).
+ */
+static int scenario_map_compiled(Manager *manager, int fd, const char *path) {
+    struct stat info;
+    ScenarioHeader *header;
+    Resource *resources;
+    System *systems;
+    const ScenarioState *state = NULL;
+    const char *names;
+    char *map;
+    size_t size;
+    unsigned int initialized = 0;
+
+    if (manager->scenario_map != NULL) {
+        fprintf(stderr, "%s: a compiled scenario is already loaded\n", path);
+        return 0;
+    }
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(ScenarioHeader)) {
+        fprintf(stderr, "%s: truncated compiled scenario\n", path);
+        return 0;
+    }
+    size = (size_t)info.st_size;
+    map = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("Failed to map the compiled scenario");
+        return 0;
+    }
+
+    header = (ScenarioHeader *)map;
+    if (header->version != SCENARIO_VERSION || header->resource_size != sizeof(Resource) || header->system_size != sizeof(System)) {
+        fprintf(stderr, "%s: compiled by a different version of the simulator, compile it again\n", path);
+        munmap(map, size);
+        return 0;
+    }
+    if (header->file_size != size || header->names_size == 0
+        || header->resources_offset + (unsigned long long)header->resource_count * sizeof(Resource) > header->systems_offset
+        || header->systems_offset + (unsigned long long)header->system_count * sizeof(System) > header->names_offset
+        || header->names_offset + header->names_size > size || map[header->names_offset + header->names_size - 1] != '\0'
+        || (header->state_offset == 0 && header->names_offset + header->names_size != size)
+        || (header->state_offset != 0 && (state = scenario_check_state(map, header)) == NULL)) {
+        fprintf(stderr, "%s: corrupt compiled scenario\n", path);
+        munmap(map, size);
+        return 0;
+    }
+    if (state != NULL && (manager->resource_array.size != 0 || manager->system_array.size != 0)) {
+        fprintf(stderr, "%s: a checkpoint can only be loaded into an empty simulation\n", path);
+        munmap(map, size);
+        return 0;
+    }
+
+    resources = (Resource *)(map + header->resources_offset);
+    systems = (System *)(map + header->systems_offset);
+    names = map + header->names_offset;
+
+    // Turn offsets and indices back into pointers, checking each before it is used
+    for (; initialized < header->resource_count; initialized++) {
+        Resource *resource = &resources[initialized];
+
+        if ((uintptr_t)resource->name >= header->names_size || sem_init(&resource->resource_mutex, 0, 1) != 0) {
+            break;
+        }
+        resource->name = (char *)names + (uintptr_t)resource->name;
+    }
+    for (unsigned int i = 0; initialized == header->resource_count && i < header->system_count; i++) {
+        System *system = &systems[i];
+        uintptr_t consumed = (uintptr_t)system->consumed.resource;
+        uintptr_t produced = (uintptr_t)system->produced.resource;
+        uintptr_t recipe = (uintptr_t)system->recipe;
+
+        if ((uintptr_t)system->name >= header->names_size || consumed > header->resource_count || produced > header->resource_count
+            || (recipe != 0 && (state == NULL || (system->recipe = scenario_map_recipe(map, header, state, recipe, resources)) == NULL))) {
+            initialized = header->resource_count + 1;
+            break;
+        }
+        system->name = (char *)names + (uintptr_t)system->name;
+        system->consumed.resource = (consumed != 0) ? &resources[consumed - 1] : NULL;
+        system->produced.resource = (produced != 0) ? &resources[produced - 1] : NULL;
+        system->event_queue = &manager->event_queue;
+    }
+    if (initialized != header->resource_count) {
+        fprintf(stderr, "%s: corrupt compiled scenario\n", path);
+        for (unsigned int i = 0; i < initialized && i < header->resource_count; i++) {
+            sem_destroy(&resources[i].resource_mutex);
+        }
+        munmap(map, size);
+        return 0;
+    }
+
+    for (unsigned int i = 0; i < header->resource_count; i++) {
+        resource_array_add(&manager->resource_array, &resources[i]);
+    }
+    for (unsigned int i = 0; i < header->system_count; i++) {
+        system_array_add(&manager->system_array, &systems[i]);
+    }
+    manager->scenario_map = map;
+    manager->scenario_map_size = size;
+    if (state != NULL) {
+        scenario_restore_state(manager, map, state, resources, systems, path);
+    }
+    return 1;
+}
+
+/**
+ * Loads a scenario file into the Manager.
+ *
+ * Compiled files (see `scenario_compile`) and checkpoints (see `scenario_checkpoint`) are
+ * recognized by their header and mapped directly, anything else is parsed as a text scenario.
+ *
+ * @param[in,out] manager  Pointer to the `Manager` to populate with resource and system data.
+ * @param[in]     path     Path of the scenario file.
+ * @return                 Non-zero on success; zero otherwise (an error has been printed).
+ */
+int scenario_load(Manager *manager, const char *path) {
+    FILE *file = fopen(path, "rb");
+    char magic[sizeof(((ScenarioHeader *)0)->magic)];
+    ScenarioSpec spec;
+    int ok;
+
+    if (file == NULL) {
+        perror(path);
+        return 0;
+    }
+
+    if (fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, SCENARIO_MAGIC, sizeof(magic)) == 0) {
+        ok = scenario_map_compiled(manager, fileno(file), path);
+        fclose(file);
+        return ok;
+    }
+
+    rewind(file);
+    memset(&spec, 0, sizeof(spec));
+    ok = scenario_parse(file, path, &spec) && scenario_build(manager, &spec);
+    scenario_spec_clean(&spec);
+    fclose(file);
+    return ok;
+}
+
+/**
+ * Compiles a text scenario into the binary format loaded by `scenario_load`.
+ *
+ * The compiled file stores the objects' memory layout, so it is only valid for builds with the
+ * same `Resource` and `System` structures; other builds reject it.
+ *
+ * @param[in] text_path    Path of the text scenario.
+ * @param[in] binary_path  Path of the compiled file to write.
+ * @return                 Non-zero on success; zero otherwise (an error has been printed).
+ */
+int scenario_compile(const char *text_path, const char *binary_path) {
+    FILE *in = fopen(text_path, "r");
+    FILE *out;
+    ScenarioSpec spec;
+    int ok;
+
+    if (in == NULL) {
+        perror(text_path);
+        return 0;
+    }
+    memset(&spec, 0, sizeof(spec));
+    ok = scenario_parse(in, text_path, &spec);
+    fclose(in);
+    if (ok && spec.item_count > 0) {
+        // A compiled System has no room for a recipe's arrays
+        fprintf(stderr, "%s: scenarios with recipes cannot be compiled, load the text file instead\n", text_path);
+        ok = 0;
+    }
+    if (!ok) {
+        scenario_spec_clean(&spec);
+        return 0;
+    }
+
+    out = fopen(binary_path, "wb");
+    if (out == NULL) {
+        perror(binary_path);
+        scenario_spec_clean(&spec);
+        return 0;
+    }
+    ok = scenario_write(&spec, out);
+    if (fclose(out) != 0 || !ok) {
+        perror(binary_path);
+        ok = 0;
+    }
+    scenario_spec_clean(&spec);
+    return ok;
+}
+
+/**
+ * Releases the compiled scenario mapped into the Manager, if any.
+ *
+ * The Manager's arrays do not destroy the objects they hold (see `system_array_init_arena`),
+ * so the objects living in the mapping go with it in a single `munmap`. Call it just before the
+ * arrays are cleaned, since they still point into the mapping.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ */
+void scenario_unload(Manager *manager) {
+    if (manager->scenario_map == NULL) {
+        return;
+    }
+    munmap(manager->scenario_map, manager->scenario_map_size);
+    manager->scenario_map = NULL;
+    manager->scenario_map_size = 0;
+}
+
+/**
+ * Adds bytes to a checkpoint being written, writing the buffer out whenever it fills.
+ *
+ * @param[in,out] writer  Pointer to the `ScenarioWriter`.
+ * @param[in]     data    Bytes to add.
+ * @param[in]     size    Number of bytes.
+ */
+static void scenario_put(ScenarioWriter *writer, const void *data, size_t size) {
+    const char *bytes = (const char *)data;
+
+    writer->offset += size;
+    while (size > 0 && !writer->failed) {
+        size_t room = sizeof(writer->buffer) - writer->used;
+        size_t take = (size < room) ? size : room;
+
+        memcpy(writer->buffer + writer->used, bytes, take);
+        writer->used += take;
+        bytes += take;
+        size -= take;
+        if (writer->used == sizeof(writer->buffer)) {
+            writer->failed = write(writer->fd, writer->buffer, writer->used) != (ssize_t)writer->used;
+            writer->used = 0;
+        }
+    }
+}
+
+/**
+ * Adds zero bytes to a checkpoint being written until it reaches an offset.
+ *
+ * @param[in,out] writer  Pointer to the `ScenarioWriter`.
+ * @param[in]     to      Offset to reach.
+ */
+static void scenario_put_pad(ScenarioWriter *writer, unsigned long long to) {
+    static const char zeros[SCENARIO_ALIGN];
+
+    while (writer->offset < to) {
+        unsigned long long gap = to - writer->offset;
+        scenario_put(writer, zeros, (gap < sizeof(zeros)) ? (size_t)gap : sizeof(zeros));
+    }
+}
+
+/**
+ * Writes a checkpoint of a Manager to an open file.
+ *
+ * The layout is the compiled format of `scenario_write` followed by a `ScenarioState`, the
+ * controller's columns, the images of the recipes and the pending events. In the images, system
+ * and resource pointers hold indices as in `scenario_write`, and `System.recipe` the offset of
+ * its recipe's image. The events are copied without leaving the queue, so the Manager can carry
+ * on after writing. Nothing is allocated, so it is safe in a child forked from a threaded process.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @param[in]     fd       Descriptor of the file, opened for writing and empty.
+ * @return                 Non-zero on success; zero if a write failed.
+ */
+static int scenario_write_checkpoint(Manager *manager, int fd) {
+    ScenarioWriter writer;
+    ScenarioHeader header;
+    ScenarioState state;
+    Event batch[MANAGER_BATCH_SIZE];
+    unsigned long long name_at = 0, recipe_at;
+    int resource_count = manager->resource_array.size;
+    int system_count = manager->system_array.size;
+    int count;
+
+    writer.fd = fd;
+    writer.failed = 0;
+    writer.offset = 0;
+    writer.used = 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SCENARIO_MAGIC, sizeof(header.magic));
+    header.version = SCENARIO_VERSION;
+    header.resource_size = sizeof(Resource);
+    header.system_size = sizeof(System);
+    header.resource_count = (unsigned int)resource_count;
+    header.system_count = (unsigned int)system_count;
+    header.resources_offset = scenario_align(sizeof(ScenarioHeader));
+    header.systems_offset = scenario_align(header.resources_offset + (unsigned long long)resource_count * sizeof(Resource));
+    header.names_offset = scenario_align(header.systems_offset + (unsigned long long)system_count * sizeof(System));
+    for (int i = 0; i < resource_count; i++) {
+        header.names_size += strlen(manager->resource_array.resources[i]->name) + 1;
+    }
+    for (int i = 0; i < system_count; i++) {
+        header.names_size += strlen(manager->system_array.systems[i]->name) + 1;
+    }
+    header.state_offset = scenario_align(header.names_offset + header.names_size);
+
+    memset(&state, 0, sizeof(state));
+    state.virtual_time = manager->virtual_time;
+    state.controller_next_ns = manager->controller.next_ns;
+    state.events_handled = manager->events_handled;
+    state.status_changes = manager->status_changes;
+    state.simulation_running = atomic_load(&manager->simulation_running);
+    state.terminal_resource = (manager->terminal_resource != NULL) ? manager->terminal_resource->id : -1;
+    state.terminal_status = manager->terminal_status;
+    state.controller_policy = manager->controller.policy;
+    state.controller_count = (unsigned int)manager->controller.resource_count;
+    state.recipes_offset = scenario_align(header.state_offset + sizeof(ScenarioState) + (unsigned long long)state.controller_count * 2 * sizeof(int));
+
+    // Written again with the final sizes once the events are counted
+    scenario_put(&writer, &header, sizeof(header));
+    scenario_put_pad(&writer, header.resources_offset);
+
+    for (int i = 0; i < resource_count; i++) {
+        Resource resource = *manager->resource_array.resources[i];
+
+        resource.name = (char *)(uintptr_t)name_at;
+        name_at += strlen(manager->resource_array.resources[i]->name) + 1;
+        memset(&resource.resource_mutex, 0, sizeof(resource.resource_mutex));
+        scenario_put(&writer, &resource, sizeof(resource));
+    }
+    scenario_put_pad(&writer, header.systems_offset);
+
+    recipe_at = state.recipes_offset;
+    for (int i = 0; i < system_count; i++) {
+        System system = *manager->system_array.systems[i];
+        Recipe *recipe = system.recipe;
+
+        system.name = (char *)(uintptr_t)name_at;
+        name_at += strlen(manager->system_array.systems[i]->name) + 1;
+        system.consumed.resource = (Resource *)(uintptr_t)((system.consumed.resource != NULL) ? system.consumed.resource->id + 1 : 0);
+        system.produced.resource = (Resource *)(uintptr_t)((system.produced.resource != NULL) ? system.produced.resource->id + 1 : 0);
+        system.recipe = (Recipe *)(uintptr_t)((recipe != NULL) ? recipe_at : 0);
+        system.event_queue = NULL;
+        system.timer_pending = 0;
+        system.timer_next = NULL;
+        if (recipe != NULL) {
+            recipe_at += (sizeof(Recipe) + (size_t)(recipe->input_count + recipe->output_count) * sizeof(ResourceAmount)
+                          + (size_t)recipe->output_count * sizeof(int) + sizeof(long long) - 1) & ~(sizeof(long long) - 1);
+        }
+        scenario_put(&writer, &system, sizeof(system));
+    }
+    scenario_put_pad(&writer, header.names_offset);
+
+    for (int i = 0; i < resource_count; i++) {
+        scenario_put(&writer, manager->resource_array.resources[i]->name, strlen(manager->resource_array.resources[i]->name) + 1);
+    }
+    for (int i = 0; i < system_count; i++) {
+        scenario_put(&writer, manager->system_array.systems[i]->name, strlen(manager->system_array.systems[i]->name) + 1);
+    }
+    scenario_put_pad(&writer, header.state_offset);
+
+    scenario_put(&writer, &state, sizeof(state));
+    scenario_put(&writer, manager->controller.status, (size_t)state.controller_count * sizeof(int));
+    scenario_put(&writer, manager->controller.pace, (size_t)state.controller_count * sizeof(int));
+    scenario_put_pad(&writer, state.recipes_offset);
+
+    for (int i = 0; i < system_count; i++) {
+        Recipe *recipe = manager->system_array.systems[i]->recipe;
+        Recipe image;
+
+        if (recipe == NULL) {
+            continue;
+        }
+        image = *recipe;
+        image.inputs = image.outputs = NULL;
+        image.stored = NULL;
+        scenario_put(&writer, &image, sizeof(image));
+        for (int j = 0; j < recipe->input_count + recipe->output_count; j++) {
+            ResourceAmount item = (j < recipe->input_count) ? recipe->inputs[j] : recipe->outputs[j - recipe->input_count];
+
+            item.resource = (Resource *)(uintptr_t)(item.resource->id + 1);
+            scenario_put(&writer, &item, sizeof(item));
+        }
+        scenario_put(&writer, recipe->stored, (size_t)recipe->output_count * sizeof(int));
+        scenario_put_pad(&writer, (writer.offset + sizeof(long long) - 1) & ~(unsigned long long)(sizeof(long long) - 1));
+    }
+    state.events_offset = scenario_align(writer.offset);
+    scenario_put_pad(&writer, state.events_offset);
+
+    while ((count = event_queue_peek(&manager->event_queue, batch, MANAGER_BATCH_SIZE, (int)state.event_count)) > 0) {
+        for (int i = 0; i < count; i++) {
+            ScenarioEvent pending;
+
+            pending.system = batch[i].system->id;
+            pending.resource = (batch[i].resource != NULL) ? batch[i].resource->id : -1;
+            pending.status = batch[i].status;
+            pending.priority = batch[i].priority;
+            pending.amount = batch[i].amount;
+            pending.count = batch[i].count;
+            scenario_put(&writer, &pending, sizeof(pending));
+            state.event_count++;
+        }
+    }
+    header.file_size = writer.offset;
+
+    if (!writer.failed && writer.used > 0) {
+        writer.failed = write(fd, writer.buffer, writer.used) != (ssize_t)writer.used;
+    }
+    return !writer.failed
+           && pwrite(fd, &state, sizeof(state), (off_t)header.state_offset) == (ssize_t)sizeof(state)
+           && pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header);
+}
+
+/**
+ * Writes a checkpoint to a temporary file and renames it to its path once complete.
+ *
+ * @param[in,out] manager    Pointer to the `Manager`.
+ * @param[in]     temporary  Path to write to.
+ * @param[in]     path       Path of the finished checkpoint.
+ * @return                   Non-zero on success; zero otherwise (an error has been printed).
+ */
+static int scenario_save(Manager *manager, const char *temporary, const char *path) {
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int ok;
+
+    if (fd < 0) {
+        perror(temporary);
+        return 0;
+    }
+    ok = scenario_write_checkpoint(manager, fd);
+    ok = (close(fd) == 0) && ok;
+    if (!ok || rename(temporary, path) != 0) {
+        perror(path);
+        unlink(temporary);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Writes a checkpoint of a running simulation without holding it up.
+ *
+ * A child process is forked and writes the checkpoint from its copy-on-write view of the
+ * Manager, so the caller only pays for the fork and carries on at once; collect the outcome
+ * with `scenario_checkpoint_wait`. The file appears at `path` once complete. `scenario_load`
+ * maps it like a compiled scenario and the run resumes where it was: the virtual clock, every
+ * resource amount, every system's status, pace, phase, stored output and due time, recipes, the
+ * controller and the pending events are restored. Each Manager loading the same checkpoint gets
+ * its own copy-on-write view, so any number of what-if branches can start from it.
+ *
+ * Take checkpoints between steps of a virtual run, from the thread running it. In a run with
+ * system threads the copy is not consistent, and output held back in relaxed resources' buffers
+ * is not in it. If no process can be forked the checkpoint is written before returning.
+ *
+ * @param[in] manager  Pointer to the `Manager`.
+ * @param[in] path     Path of the checkpoint to write.
+ * @return             Process id of the writer, zero if the checkpoint was written already, -1 on failure.
+ */
+long scenario_checkpoint(Manager *manager, const char *path) {
+    char temporary[PATH_MAX];
+    pid_t child;
+
+    if (snprintf(temporary, sizeof(temporary), "%s.tmp", path) >= (int)sizeof(temporary)) {
+        fprintf(stderr, "%s: path too long\n", path);
+        return -1;
+    }
+    child = fork();
+    if (child == 0) {
+        // Exits without flushing, so nothing buffered by the parent is written twice
+        _exit(scenario_save(manager, temporary, path) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    if (child > 0) {
+        return (long)child;
+    }
+    return scenario_save(manager, temporary, path) ? 0 : -1;
+}
+
+/**
+ * Waits for a checkpoint started by `scenario_checkpoint` to be written.
+ *
+ * @param[in] writer  Value returned by `scenario_checkpoint`.
+ * @return            Non-zero if the checkpoint was written; zero otherwise.
+ */
+int scenario_checkpoint_wait(long writer) {
+    int status;
+
+    if (writer <= 0) {
+        return writer == 0;
+    }
+    while (waitpid((pid_t)writer, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return 0;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
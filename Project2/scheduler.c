@@ -0,0 +1,625 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+
+// Helpers just used by the scheduler, static so they can't get linked into other files
+
+static void *worker_thread(void *args);
+static void worker_run_system(Worker *worker, System *system);
+static System *worker_steal(Worker *worker);
+static void worker_idle(Worker *worker);
+
+static void *timer_thread(void *args);
+static void timer_wheel_schedule(Scheduler *scheduler, System *system);
+static void timer_wheel_insert(TimerWheel *wheel, System *system);
+static int timer_wheel_expire(TimerWheel *wheel, long long now);
+static long long timer_wheel_next_due(TimerWheel *wheel, long long now);
+
+static int work_deque_init(WorkDeque *deque, long capacity);
+static void work_deque_push(WorkDeque *deque, System *system);
+static System *work_deque_take(WorkDeque *deque);
+static System *work_deque_steal(WorkDeque *deque);
+
+static void wait_until_ns(sem_t *semaphore, long long wait_ns);
+
+/**
+ * Initializes the `Scheduler`.
+ *
+ * Sets up `worker_count` workers and hands out the systems round-robin between their deques.
+ * Each deque is sized to hold every system, so none ever needs to grow.
+ *
+ * @param[out] scheduler     Pointer to the `Scheduler` to initialize.
+ * @param[in]  system_array  Systems to run, they must stay alive until `scheduler_join` returns.
+ * @param[in]  worker_count  Number of worker threads, at least one.
+ * @return                   Non-zero on success; zero if memory could not be allocated.
+ */
+int scheduler_init(Scheduler *scheduler, SystemArray *system_array, int worker_count) {
+    return scheduler_init_placement(scheduler, system_array, worker_count, NULL);
+}
+
+/**
+ * Initializes a `Scheduler` whose workers are pinned to the nodes of a `Placement`.
+ *
+ * Workers go to the nodes in turn and each is pinned to its own CPU of its node when started.
+ * A system starts on a worker of its node, and once its wait is over it is made ready on its
+ * node's ready deque. Idle workers steal from their own node before they steal from the others,
+ * so a system mostly runs on its node, next to the systems it shares resources with. Without a
+ * placement this is `scheduler_init`.
+ *
+ * @param[out] scheduler     Pointer to the `Scheduler` to initialize.
+ * @param[in]  system_array  Systems to run, they must stay alive until `scheduler_join` returns.
+ * @param[in]  worker_count  Number of worker threads, at least one.
+ * @param[in]  placement     Placement built for `system_array`, it must stay alive as long as the scheduler; NULL for none.
+ * @return                   Non-zero on success; zero if memory could not be allocated.
+ */
+int scheduler_init_placement(Scheduler *scheduler, SystemArray *system_array, int worker_count, const Placement *placement) {
+    TimerWheel *wheel;
+    long capacity = 1;
+    int node_count = (placement != NULL) ? placement->node_count : 1;
+    int turn[PLACEMENT_MAX_NODES] = {0};
+
+    if (scheduler == NULL || system_array == NULL) {
+        return 0;
+    }
+    wheel = &scheduler->wheel;
+    if (worker_count < 1) {
+        worker_count = 1;
+    }
+
+    // Deque capacity is a power of two that fits every system
+    while (capacity < system_array->size) {
+        capacity *= 2;
+    }
+
+    scheduler->system_array = system_array;
+    scheduler->worker_count = worker_count;
+    scheduler->placement = placement;
+    atomic_init(&scheduler->active, system_array->size);
+    atomic_init(&scheduler->idle, 0);
+    sem_init(&scheduler->wakeup, 0, 0);
+
+    for (int i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+        wheel->slots[i] = NULL;
+    }
+    wheel->tick = monotonic_now_ns() / (TIMER_WHEEL_TICK_US * 1000LL);
+    atomic_init(&wheel->inbox, NULL);
+    atomic_init(&wheel->next_wake, 0);
+    sem_init(&wheel->wakeup, 0, 0);
+    wheel->system_node = (placement != NULL) ? placement->system_node : NULL;
+    wheel->ready_count = node_count;
+
+    scheduler->workers = (Worker *)calloc(worker_count, sizeof(Worker));
+    wheel->ready = (WorkDeque *)calloc(node_count, sizeof(WorkDeque));
+    if (scheduler->workers == NULL || wheel->ready == NULL) {
+        free(scheduler->workers);
+        free(wheel->ready);
+        scheduler->workers = NULL;
+        wheel->ready = NULL;
+        sem_destroy(&scheduler->wakeup);
+        sem_destroy(&wheel->wakeup);
+        return 0;
+    }
+
+    for (int i = 0; i < worker_count; i++) {
+        Worker *worker = &scheduler->workers[i];
+        worker->scheduler = scheduler;
+        worker->index = i;
+        worker->node = i % node_count;
+        if (!work_deque_init(&worker->deque, capacity)) {
+            scheduler_clean(scheduler);
+            return 0;
+        }
+    }
+    for (int n = 0; n < node_count; n++) {
+        if (!work_deque_init(&wheel->ready[n], capacity)) {
+            scheduler_clean(scheduler);
+            return 0;
+        }
+    }
+
+    for (int i = 0; i < system_array->size; i++) {
+        int node = (placement != NULL) ? placement->system_node[i] : 0;
+        // Workers of node n are n, n + node_count, ..., a node without workers hands its systems round-robin
+        int on_node = (node < worker_count) ? (worker_count - node + node_count - 1) / node_count : 0;
+        int target = (on_node > 0) ? node + (turn[node]++ % on_node) * node_count : i % worker_count;
+
+        work_deque_push(&scheduler->workers[target].deque, system_array->systems[i]);
+    }
+    return 1;
+}
+
+/**
+ * Starts the timer thread and the worker threads.
+ *
+ * @param[in,out] scheduler  Pointer to an initialized `Scheduler`.
+ * @return                   Non-zero if every thread started; zero otherwise.
+ */
+int scheduler_start(Scheduler *scheduler) {
+    int started = 0;
+
+    if (pthread_create(&scheduler->wheel.thread, NULL, timer_thread, scheduler) != 0) {
+        return 0;
+    }
+
+    for (started = 0; started < scheduler->worker_count; started++) {
+        Worker *worker = &scheduler->workers[started];
+        if (pthread_create(&worker->thread, NULL, worker_thread, worker) != 0) {
+            break;
+        }
+        // The worker starts wherever it was created and moves to its CPU right away
+        if (scheduler->placement != NULL) {
+            placement_pin(scheduler->placement, worker->thread, worker->node, worker->index / scheduler->placement->node_count);
+        }
+    }
+
+    if (started < scheduler->worker_count) {
+        // Stop the threads that did start once they notice nothing is left to run
+        atomic_store(&scheduler->active, 0);
+        for (int i = 0; i < started; i++) {
+            sem_post(&scheduler->wakeup);
+        }
+        sem_post(&scheduler->wheel.wakeup);
+        for (int i = 0; i < started; i++) {
+            pthread_join(scheduler->workers[i].thread, NULL);
+        }
+        pthread_join(scheduler->wheel.thread, NULL);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Waits for every system to terminate and the threads to exit.
+ *
+ * @param[in,out] scheduler  Pointer to a started `Scheduler`.
+ */
+void scheduler_join(Scheduler *scheduler) {
+    for (int i = 0; i < scheduler->worker_count; i++) {
+        pthread_join(scheduler->workers[i].thread, NULL);
+    }
+    pthread_join(scheduler->wheel.thread, NULL);
+}
+
+/**
+ * Cleans up the `Scheduler`, frees the workers but not the systems.
+ *
+ * @param[in,out] scheduler  Pointer to the `Scheduler` to clean.
+ */
+void scheduler_clean(Scheduler *scheduler) {
+    if (scheduler == NULL || scheduler->workers == NULL) {
+        return;
+    }
+    for (int i = 0; i < scheduler->worker_count; i++) {
+        free(scheduler->workers[i].deque.slots);
+    }
+    for (int i = 0; scheduler->wheel.ready != NULL && i < scheduler->wheel.ready_count; i++) {
+        free(scheduler->wheel.ready[i].slots);
+    }
+    free(scheduler->workers);
+    free(scheduler->wheel.ready);
+    scheduler->workers = NULL;
+    scheduler->wheel.ready = NULL;
+    scheduler->worker_count = 0;
+    sem_destroy(&scheduler->wakeup);
+    sem_destroy(&scheduler->wheel.wakeup);
+}
+
+/**
+ * Reads the monotonic clock.
+ *
+ * @return  Current monotonic time in nanoseconds.
+ */
+long long monotonic_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/**
+ * Adds one sample to a `LatenessStats`.
+ *
+ * @param[in,out] stats       Pointer to the `LatenessStats` to update.
+ * @param[in]     lateness_ns How late the sample started, negative values count as on time.
+ */
+void lateness_record(LatenessStats *stats, long long lateness_ns) {
+    if (lateness_ns < 0) {
+        lateness_ns = 0;
+    }
+    stats->total_ns += lateness_ns;
+    if (lateness_ns > stats->max_ns) {
+        stats->max_ns = lateness_ns;
+    }
+    stats->count++;
+}
+
+/**
+ * Main loop of a worker thread.
+ *
+ * Steps the systems it can take from its own deque or steal from the other workers and the
+ * timer wheel, and sleeps when there is nothing to do. Exits once every system has terminated.
+ *
+ * @param[in,out] args  Pointer to the `Worker`.
+ * @return              NULL.
+ */
+static void *worker_thread(void *args) {
+    Worker *worker = (Worker *)args;
+    Scheduler *scheduler = worker->scheduler;
+    System *system;
+
+    while (atomic_load(&scheduler->active) > 0) {
+        system = work_deque_take(&worker->deque);
+        if (system == NULL) {
+            system = worker_steal(worker);
+        }
+
+        if (system != NULL) {
+            worker_run_system(worker, system);
+        }
+        else {
+            worker_idle(worker);
+        }
+    }
+    // Units held back from relaxed resources must not be lost
+    resource_flush_thread();
+    return NULL;
+}
+
+/**
+ * Steps one system and decides where it waits next.
+ *
+ * A system with a wait goes to the timer wheel, a system that can step again right away
+ * goes back on the deque where idle workers may steal it.
+ *
+ * @param[in,out] worker  Pointer to the `Worker` running the system.
+ * @param[in,out] system  Pointer to the `System` to step.
+ */
+static void worker_run_system(Worker *worker, System *system) {
+    Scheduler *scheduler = worker->scheduler;
+    long long now = monotonic_now_ns();
+    int delay;
+
+    if (system_status(system) == TERMINATE) {
+        // Last system out wakes every idle thread so they can exit
+        if (atomic_fetch_sub(&scheduler->active, 1) == 1) {
+            for (int i = 0; i < scheduler->worker_count; i++) {
+                sem_post(&scheduler->wakeup);
+            }
+            sem_post(&scheduler->wheel.wakeup);
+        }
+        return;
+    }
+
+    if (system->timer_pending) {
+        lateness_record(&system->lateness, now - system->timer_due);
+        system->timer_pending = 0;
+    }
+
+    delay = system_step(system);
+    // The worker may step another system right away, so only what is due is flushed
+    resource_flush_due(now, 0);
+    if (delay > 0) {
+        system->timer_due = system_next_due(system, delay, now);
+        system->timer_pending = 1;
+        timer_wheel_schedule(scheduler, system);
+        return;
+    }
+
+    work_deque_push(&worker->deque, system);
+    if (atomic_load(&scheduler->idle) > 0) {
+        sem_post(&scheduler->wakeup);
+    }
+}
+
+/**
+ * Tries to steal a ready system from the timer wheel and the other workers.
+ *
+ * The ready deque and the workers of the worker's own node come first, the other nodes after.
+ *
+ * @param[in] worker  Pointer to the `Worker` looking for work.
+ * @return            A stolen system, or NULL if every other deque was empty.
+ */
+static System *worker_steal(Worker *worker) {
+    Scheduler *scheduler = worker->scheduler;
+    TimerWheel *wheel = &scheduler->wheel;
+    System *system = NULL;
+
+    for (int local = 1; system == NULL && local >= 0; local--) {
+        for (int n = 0; system == NULL && n < wheel->ready_count; n++) {
+            int node = (worker->node + n) % wheel->ready_count;
+            if ((node == worker->node) == local) {
+                system = work_deque_steal(&wheel->ready[node]);
+            }
+        }
+        for (int i = 1; system == NULL && i < scheduler->worker_count; i++) {
+            Worker *victim = &scheduler->workers[(worker->index + i) % scheduler->worker_count];
+            if ((victim->node == worker->node) == local) {
+                system = work_deque_steal(&victim->deque);
+            }
+        }
+    }
+    return system;
+}
+
+/**
+ * Sleeps until work is made ready or `SCHEDULER_IDLE_WAIT` passes.
+ *
+ * @param[in,out] worker  Pointer to the idle `Worker`.
+ */
+static void worker_idle(Worker *worker) {
+    Scheduler *scheduler = worker->scheduler;
+
+    resource_flush_due(monotonic_now_ns(), (long long)SCHEDULER_IDLE_WAIT * 1000000LL);
+    atomic_fetch_add(&scheduler->idle, 1);
+    wait_until_ns(&scheduler->wakeup, (long long)SCHEDULER_IDLE_WAIT * 1000000LL);
+    atomic_fetch_sub(&scheduler->idle, 1);
+}
+
+/**
+ * Main loop of the timer thread.
+ *
+ * Moves newly scheduled systems into the wheel, hands the systems whose wait is over to the
+ * workers, then sleeps until the next one is due or a worker schedules something earlier.
+ *
+ * @param[in,out] args  Pointer to the `Scheduler`.
+ * @return              NULL.
+ */
+static void *timer_thread(void *args) {
+    Scheduler *scheduler = (Scheduler *)args;
+    TimerWheel *wheel = &scheduler->wheel;
+    System *system, *next;
+    long long now, due;
+    int fired, idle;
+
+    while (atomic_load(&scheduler->active) > 0) {
+        // Tell the workers not to wake us while we are awake anyway
+        atomic_store(&wheel->next_wake, 0);
+
+        system = atomic_exchange(&wheel->inbox, NULL);
+        for (; system != NULL; system = next) {
+            next = system->timer_next;
+            timer_wheel_insert(wheel, system);
+        }
+
+        now = monotonic_now_ns();
+        fired = timer_wheel_expire(wheel, now);
+        idle = atomic_load(&scheduler->idle);
+        for (int i = 0; i < fired && i < idle; i++) {
+            sem_post(&scheduler->wakeup);
+        }
+
+        due = timer_wheel_next_due(wheel, now);
+        atomic_store(&wheel->next_wake, due);
+        // A system may have been scheduled before next_wake was published
+        if (atomic_load(&wheel->inbox) != NULL) {
+            continue;
+        }
+        wait_until_ns(&wheel->wakeup, due - now);
+    }
+    return NULL;
+}
+
+/**
+ * Hands a system to the timer thread, called by the workers.
+ *
+ * The system is pushed onto the wheel's inbox without locking. The timer thread is only woken
+ * if the new wait ends before the time it plans to wake at.
+ *
+ * @param[in,out] scheduler  Pointer to the `Scheduler`.
+ * @param[in,out] system     Pointer to the `System`, its `timer_due` must be set.
+ */
+static void timer_wheel_schedule(Scheduler *scheduler, System *system) {
+    TimerWheel *wheel = &scheduler->wheel;
+    System *head = atomic_load_explicit(&wheel->inbox, memory_order_relaxed);
+
+    do {
+        system->timer_next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&wheel->inbox, &head, system,
+                                                    memory_order_seq_cst, memory_order_relaxed));
+
+    // Pairs with the timer thread publishing next_wake and then checking the inbox
+    long long next_wake = atomic_load(&wheel->next_wake);
+    if (next_wake != 0 && system->timer_due < next_wake) {
+        sem_post(&wheel->wakeup);
+    }
+}
+
+/**
+ * Puts a system into the slot for the tick its wait ends in.
+ *
+ * @param[in,out] wheel   Pointer to the `TimerWheel`.
+ * @param[in,out] system  Pointer to the `System`.
+ */
+static void timer_wheel_insert(TimerWheel *wheel, System *system) {
+    long long tick = system->timer_due / (TIMER_WHEEL_TICK_US * 1000LL);
+
+    // Anything already overdue goes in the slot being processed
+    if (tick < wheel->tick) {
+        tick = wheel->tick;
+    }
+    System **slot = &wheel->slots[tick & (TIMER_WHEEL_SLOTS - 1)];
+    system->timer_next = *slot;
+    *slot = system;
+}
+
+/**
+ * Moves every system whose wait is over onto the ready deque of its node.
+ *
+ * Processes the slots from the current tick up to `now`. A slot can hold systems due a
+ * whole turn of the wheel later, those stay where they are.
+ *
+ * @param[in,out] wheel  Pointer to the `TimerWheel`.
+ * @param[in]     now    Current monotonic time in nanoseconds.
+ * @return               Number of systems made ready.
+ */
+static int timer_wheel_expire(TimerWheel *wheel, long long now) {
+    long long now_tick = now / (TIMER_WHEEL_TICK_US * 1000LL);
+    int fired = 0;
+
+    for (;;) {
+        System **link = &wheel->slots[wheel->tick & (TIMER_WHEEL_SLOTS - 1)];
+        while (*link != NULL) {
+            System *system = *link;
+            if (system->timer_due <= now) {
+                *link = system->timer_next;
+                work_deque_push(&wheel->ready[(wheel->system_node != NULL) ? wheel->system_node[system->id] : 0], system);
+                fired++;
+            }
+            else {
+                link = &system->timer_next;
+            }
+        }
+
+        // Stay on the current tick, part of it is still in the future
+        if (wheel->tick >= now_tick) {
+            break;
+        }
+        wheel->tick++;
+    }
+    return fired;
+}
+
+/**
+ * Finds when the timer thread next has something to do.
+ *
+ * Scans at most one turn of the wheel for the first slot holding a system due in that turn.
+ *
+ * @param[in] wheel  Pointer to the `TimerWheel`.
+ * @param[in] now    Current monotonic time in nanoseconds.
+ * @return           Monotonic time in nanoseconds of the earliest due system, or one turn from now.
+ */
+static long long timer_wheel_next_due(TimerWheel *wheel, long long now) {
+    long long tick_ns = TIMER_WHEEL_TICK_US * 1000LL;
+    long long earliest = now + TIMER_WHEEL_SLOTS * tick_ns;
+
+    for (long long tick = wheel->tick; tick < wheel->tick + TIMER_WHEEL_SLOTS; tick++) {
+        for (System *system = wheel->slots[tick & (TIMER_WHEEL_SLOTS - 1)]; system != NULL; system = system->timer_next) {
+            if (system->timer_due / tick_ns <= tick && system->timer_due < earliest) {
+                earliest = system->timer_due;
+            }
+        }
+        if (earliest / tick_ns <= tick) {
+            break;
+        }
+    }
+    return earliest;
+}
+
+/**
+ * Allocates the slots of a `WorkDeque`.
+ *
+ * @param[out] deque     Pointer to the `WorkDeque` to initialize.
+ * @param[in]  capacity  Number of slots, must be a power of two.
+ * @return               Non-zero if the slots were allocated; zero otherwise.
+ */
+static int work_deque_init(WorkDeque *deque, long capacity) {
+    deque->slots = (_Atomic(System *) *)calloc(capacity, sizeof(*deque->slots));
+    if (deque->slots == NULL) {
+        return 0;
+    }
+    deque->mask = capacity - 1;
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    return 1;
+}
+
+/**
+ * Pushes a system onto the bottom of a deque, only called by the owning thread.
+ *
+ * A system is only ever in one deque or the wheel, so the deque cannot overflow.
+ *
+ * @param[in,out] deque   Pointer to the `WorkDeque`.
+ * @param[in]     system  Pointer to the `System` that is ready.
+ */
+static void work_deque_push(WorkDeque *deque, System *system) {
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+
+    atomic_store_explicit(&deque->slots[bottom & deque->mask], system, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+}
+
+/**
+ * Takes the most recently pushed system from the bottom of a deque, only called by the owning thread.
+ *
+ * @param[in,out] deque  Pointer to the `WorkDeque`.
+ * @return               A system, or NULL if the deque is empty or a thief won the last one.
+ */
+static System *work_deque_take(WorkDeque *deque) {
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    long top;
+    System *system = NULL;
+
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (top <= bottom) {
+        system = atomic_load_explicit(&deque->slots[bottom & deque->mask], memory_order_relaxed);
+        if (top == bottom) {
+            // Last item, race any thief for it
+            if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                         memory_order_seq_cst, memory_order_relaxed)) {
+                system = NULL;
+            }
+            atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        }
+    }
+    else {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return system;
+}
+
+/**
+ * Steals the oldest system from the top of another thread's deque.
+ *
+ * @param[in,out] deque  Pointer to the victim's `WorkDeque`.
+ * @return               A system, or NULL if the deque is empty or another thread took it first.
+ */
+static System *work_deque_steal(WorkDeque *deque) {
+    long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    long bottom;
+    System *system;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (top >= bottom) {
+        return NULL;
+    }
+
+    system = atomic_load_explicit(&deque->slots[top & deque->mask], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL;
+    }
+    return system;
+}
+
+/**
+ * Waits on a semaphore for at most `wait_ns` nanoseconds.
+ *
+ * @param[in,out] semaphore  Semaphore to wait on.
+ * @param[in]     wait_ns    Longest time to wait, zero or less returns immediately.
+ */
+static void wait_until_ns(sem_t *semaphore, long long wait_ns) {
+    struct timespec deadline;
+
+    if (wait_ns <= 0) {
+        return;
+    }
+
+    // sem_timedwait takes an absolute CLOCK_REALTIME deadline
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += wait_ns / 1000000000LL;
+    deadline.tv_nsec += wait_ns % 1000000000LL;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    while (sem_timedwait(semaphore, &deadline) != 0 && errno == EINTR) {
+        // Interrupted by a signal, keep waiting
+    }
+}
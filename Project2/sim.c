@@ -0,0 +1,203 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+// Helpers just used by the virtual clock, static so they can't get linked into other files
+
+static int virtual_before(Manager *manager, int a, int b);
+static void virtual_heap_push(Manager *manager, int *heap, int *count, int index);
+static int virtual_heap_pop(Manager *manager, int *heap, int *count);
+static void virtual_track_range(ResourceRange *ranges, Resource *resource);
+
+/**
+ * Runs the simulation on a virtual clock in the calling thread.
+ *
+ * A discrete-event loop: the system due first takes its step, the manager reacts to the events
+ * that step pushed, and the clock jumps straight to the next system's due time instead of
+ * sleeping. Systems due at the same time step in `system_array` order, so a run always
+ * produces the same result. Each system's `timer_due` holds its due time in virtual nanoseconds;
+ * systems due later than the current virtual time keep their due time, so a run stopped at its
+ * limit, or restored from a checkpoint, carries on exactly where it stopped. A step that starts
+ * processing waits at least `VIRTUAL_MIN_PROCESS`, so a system whose processing time comes to
+ * zero (with a fast status or pace) cannot keep the clock at one instant. With a `step_limit` set
+ * the run also stops once it has taken that many steps, leaving the clock where it got to.
+ *
+ * @param[in,out] manager   Pointer to the loaded `Manager`, its systems must not have threads.
+ * @param[in]     limit_ns  Virtual time in nanoseconds to stop at if nothing terminates the simulation.
+ * @param[out]    ranges    Optional array indexed by resource id, filled with the lowest and highest amounts reached.
+ * @return                  Number of steps taken.
+ */
+long long manager_run_virtual(Manager *manager, long long limit_ns, ResourceRange *ranges) {
+    Event batch[MANAGER_BATCH_SIZE];
+    int *heap;
+    int count = 0, events, index, delay;
+    long long steps = 0;
+    System *system;
+
+    heap = (int *)malloc((manager->system_array.size + 1) * sizeof(int));
+    if (heap == NULL) {
+        perror("Failed to allocate memory for the virtual clock");
+        return 0;
+    }
+
+    for (int i = 0; ranges != NULL && i < manager->resource_array.size; i++) {
+        ranges[i].min = ranges[i].max = resource_get_amount(manager->resource_array.resources[i]);
+    }
+
+    // Every system not waiting from an earlier run is due at the current virtual time
+    for (int i = 0; i < manager->system_array.size; i++) {
+        system = manager->system_array.systems[i];
+        if (system->timer_due < manager->virtual_time) {
+            system->timer_due = manager->virtual_time;
+        }
+        virtual_heap_push(manager, heap, &count, i);
+    }
+
+    while (atomic_load(&manager->simulation_running) != 0 && count > 0) {
+        if (manager->step_limit > 0 && steps >= manager->step_limit) {
+            break;
+        }
+        index = virtual_heap_pop(manager, heap, &count);
+        system = manager->system_array.systems[index];
+        if (system->timer_due > limit_ns) {
+            break;
+        }
+
+        // Snapshots due by this step show the state before it
+        if (manager->telemetry != NULL) {
+            while (manager->telemetry->next_snapshot_ns <= system->timer_due) {
+                telemetry_snapshot(manager->telemetry, manager->telemetry->next_snapshot_ns);
+                manager->telemetry->next_snapshot_ns += manager->telemetry->interval_ns;
+            }
+        }
+
+        manager->virtual_time = system->timer_due;
+        controller_update(manager, manager->virtual_time);
+        if (system_status(system) == TERMINATE) {
+            continue;
+        }
+
+        delay = system_step(system);
+        steps++;
+
+        // Only the stepping system's own resources can have changed
+        if (ranges != NULL && system->recipe != NULL) {
+            for (int i = 0; i < system->recipe->input_count; i++) {
+                virtual_track_range(ranges, system->recipe->inputs[i].resource);
+            }
+            for (int i = 0; i < system->recipe->output_count; i++) {
+                virtual_track_range(ranges, system->recipe->outputs[i].resource);
+            }
+        }
+        else if (ranges != NULL) {
+            virtual_track_range(ranges, system->consumed.resource);
+            virtual_track_range(ranges, system->produced.resource);
+        }
+
+        // The manager reacts at the same virtual time the events happened
+        while ((events = event_queue_drain(&manager->event_queue, batch, MANAGER_BATCH_SIZE)) > 0) {
+            for (int i = 0; i < events; i++) {
+                manager_handle_event(manager, &batch[i]);
+            }
+        }
+
+        if (delay < VIRTUAL_MIN_PROCESS && system->phase == SYSTEM_PHASE_PROCESS) {
+            delay = VIRTUAL_MIN_PROCESS;
+        }
+        system->timer_due = manager->virtual_time + (long long)delay * 1000000LL;
+        virtual_heap_push(manager, heap, &count, index);
+    }
+
+    if (atomic_load(&manager->simulation_running) != 0 && manager->virtual_time < limit_ns
+        && (manager->step_limit == 0 || steps < manager->step_limit)) {
+        manager->virtual_time = limit_ns;
+    }
+
+    free(heap);
+    return steps;
+}
+
+/**
+ * Orders two systems in the virtual clock's heap, by due time and then by index.
+ *
+ * @param[in] manager  Pointer to the `Manager`.
+ * @param[in] a        Index of the first system.
+ * @param[in] b        Index of the second system.
+ * @return             Non-zero if `a` steps before `b`.
+ */
+static int virtual_before(Manager *manager, int a, int b) {
+    long long due_a = manager->system_array.systems[a]->timer_due;
+    long long due_b = manager->system_array.systems[b]->timer_due;
+
+    return (due_a != due_b) ? due_a < due_b : a < b;
+}
+
+/**
+ * Adds a system to the virtual clock's heap.
+ *
+ * @param[in]     manager  Pointer to the `Manager`.
+ * @param[in,out] heap     Heap of system indices.
+ * @param[in,out] count    Number of entries in the heap.
+ * @param[in]     index    Index of the system to add.
+ */
+static void virtual_heap_push(Manager *manager, int *heap, int *count, int index) {
+    int i = (*count)++;
+
+    // Sift the new entry up towards the root
+    while (i > 0 && virtual_before(manager, index, heap[(i - 1) / 2])) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = index;
+}
+
+/**
+ * Removes the system due first from the virtual clock's heap.
+ *
+ * @param[in]     manager  Pointer to the `Manager`.
+ * @param[in,out] heap     Heap of system indices, must not be empty.
+ * @param[in,out] count    Number of entries in the heap.
+ * @return                 Index of the system due first.
+ */
+static int virtual_heap_pop(Manager *manager, int *heap, int *count) {
+    int first = heap[0];
+    int last = heap[--(*count)];
+    int i = 0, child;
+
+    // Sift the last entry down from the root
+    while ((child = 2 * i + 1) < *count) {
+        if (child + 1 < *count && virtual_before(manager, heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!virtual_before(manager, heap[child], last)) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (*count > 0) {
+        heap[i] = last;
+    }
+    return first;
+}
+
+/**
+ * Widens a resource's range to include its current amount.
+ *
+ * @param[in,out] ranges    Array indexed by resource id.
+ * @param[in]     resource  Pointer to the `Resource`, may be NULL.
+ */
+static void virtual_track_range(ResourceRange *ranges, Resource *resource) {
+    int amount;
+
+    if (resource == NULL || resource->id < 0) {
+        return;
+    }
+    amount = resource_get_amount(resource);
+    if (amount < ranges[resource->id].min) {
+        ranges[resource->id].min = amount;
+    }
+    if (amount > ranges[resource->id].max) {
+        ranges[resource->id].max = amount;
+    }
+}
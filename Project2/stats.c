@@ -0,0 +1,283 @@
+#include "defs.h"
+
+// Everything here is compiled in with `make STATS=1`, otherwise the stats_* calls in the core
+// paths are macros that expand to nothing (see defs.h)
+#ifdef P2_STATS
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Adds to a value only the calling thread writes, a relaxed load and store instead of a locked
+// read-modify-write; a macro so the hot paths stay free of calls even without optimization
+#define STATS_ADD(value, amount) \
+    atomic_store_explicit(&(value), atomic_load_explicit(&(value), memory_order_relaxed) + (amount), memory_order_relaxed)
+
+// Merged copy of one histogram across every thread's shard
+typedef struct StatsTotals {
+    unsigned long long buckets[STATS_BUCKETS];
+    unsigned long long count;
+    unsigned long long sum;
+    unsigned long long max;
+} StatsTotals;
+
+// Helpers just used by the statistics, static so they can't get linked into other files
+
+static StatsShard *stats_shard(void);
+static int stats_bucket(unsigned long long value);
+static unsigned long long stats_bucket_high(int bucket);
+static void stats_merge(int histogram, StatsTotals *totals);
+static unsigned long long stats_percentile(const StatsTotals *totals, double fraction);
+
+static _Thread_local StatsShard *stats_local;   // Shard of the calling thread, created on first use
+static _Atomic(StatsShard *) stats_shards;      // Every shard created so far, read when printing
+
+static const char *stats_histogram_names[STATS_HISTOGRAMS] = {
+    "push lock wait (ns)", "drain lock wait (ns)", "event latency (ns)", "queue depth", "system step (ns)",
+    "resource lock wait (ns)"
+};
+static const char *stats_counter_names[STATS_COUNTERS] = {
+    "resource CAS retries", "ring claim retries"
+};
+
+/**
+ * Adds a value to one of the `STATS_*` histograms of the calling thread.
+ *
+ * @param[in] histogram  `STATS_PUSH_WAIT`, `STATS_EVENT_LATENCY`, ...
+ * @param[in] value      Value to add, negative values count as zero.
+ */
+void stats_record(int histogram, long long value) {
+    StatsShard *shard = (stats_local != NULL) ? stats_local : stats_shard();
+    StatsHistogram *target;
+    unsigned long long sample = (value > 0) ? (unsigned long long)value : 0;
+
+    if (shard == NULL) {
+        return;
+    }
+    target = &shard->histograms[histogram];
+    STATS_ADD(target->buckets[stats_bucket(sample)], 1);
+    STATS_ADD(target->count, 1);
+    STATS_ADD(target->sum, sample);
+    if (sample > atomic_load_explicit(&target->max, memory_order_relaxed)) {
+        atomic_store_explicit(&target->max, sample, memory_order_relaxed);
+    }
+}
+
+/**
+ * Adds to one of the `STATS_*` counters of the calling thread.
+ *
+ * @param[in] counter  `STATS_RESOURCE_RETRIES` or `STATS_RING_RETRIES`.
+ * @param[in] amount   Amount to add.
+ */
+void stats_count(int counter, long long amount) {
+    StatsShard *shard = (stats_local != NULL) ? stats_local : stats_shard();
+
+    if (shard != NULL) {
+        STATS_ADD(shard->counters[counter], (unsigned long long)amount);
+    }
+}
+
+/**
+ * Takes a semaphore like `sem_wait`, recording how long the wait took.
+ *
+ * An uncontended take is recorded as zero without reading the clock.
+ *
+ * @param[in,out] sem        Semaphore to take.
+ * @param[in]     histogram  Histogram the wait goes into.
+ */
+void stats_sem_wait(sem_t *sem, int histogram) {
+    long long start;
+
+    if (sem_trywait(sem) == 0) {
+        stats_record(histogram, 0);
+        return;
+    }
+    start = monotonic_now_ns();
+    while (sem_wait(sem) != 0) {
+        // Interrupted by a signal, keep waiting
+    }
+    stats_record(histogram, monotonic_now_ns() - start);
+}
+
+/**
+ * Records how long an event waited between its push and its handling.
+ *
+ * @param[in] event  Pointer to the `Event` being handled.
+ */
+void stats_event_handled(const Event *event) {
+    if (event->pushed_ns != 0) {
+        stats_record(STATS_EVENT_LATENCY, monotonic_now_ns() - event->pushed_ns);
+    }
+}
+
+/**
+ * Prints every histogram and counter merged across threads, then where each system's time went.
+ *
+ * Shards are read while their threads may still be writing, so a summary taken during a run
+ * can be a few samples behind; one taken after the threads are joined is exact.
+ *
+ * @param[in] stream   Stream to print to.
+ * @param[in] systems  Systems to report on, NULL to skip them.
+ */
+void stats_print(FILE *stream, SystemArray *systems) {
+    StatsTotals totals;
+
+    fprintf(stream, "%-22s %10s %10s %10s %10s %10s %10s %10s\n",
+            "Statistic", "Count", "Mean", "p50", "p90", "p99", "p99.9", "Max");
+    for (int i = 0; i < STATS_HISTOGRAMS; i++) {
+        stats_merge(i, &totals);
+        fprintf(stream, "%-22s %10llu %10.0f %10llu %10llu %10llu %10llu %10llu\n",
+                stats_histogram_names[i], totals.count, totals.count > 0 ? (double)totals.sum / totals.count : 0.0,
+                stats_percentile(&totals, 0.5), stats_percentile(&totals, 0.9),
+                stats_percentile(&totals, 0.99), stats_percentile(&totals, 0.999), totals.max);
+    }
+    for (int i = 0; i < STATS_COUNTERS; i++) {
+        unsigned long long total = 0;
+        for (StatsShard *shard = atomic_load(&stats_shards); shard != NULL; shard = shard->next) {
+            total += atomic_load_explicit(&shard->counters[i], memory_order_relaxed);
+        }
+        fprintf(stream, "%-22s %10llu\n", stats_counter_names[i], total);
+    }
+
+    if (systems == NULL) {
+        return;
+    }
+    fprintf(stream, "\n%-20s %10s %12s %12s %12s %8s\n", "System", "Steps", "Busy (us)", "Process (ms)", "Backoff (ms)", "Util %");
+    for (int i = 0; i < systems->size; i++) {
+        System *system = systems->systems[i];
+        SystemStats *stats = &system->stats;
+        long long scheduled = stats->process_ms + stats->backoff_ms;
+
+        fprintf(stream, "%-20s %10ld %12.1f %12lld %12lld %8.1f\n",
+                system->name, stats->steps, stats->busy_ns / 1000.0, stats->process_ms, stats->backoff_ms,
+                scheduled > 0 ? 100.0 * stats->process_ms / scheduled : 0.0);
+    }
+}
+
+/**
+ * Frees every thread's shard, call once no thread records any more.
+ */
+void stats_clean(void) {
+    StatsShard *shard = atomic_exchange(&stats_shards, NULL);
+
+    while (shard != NULL) {
+        StatsShard *next = shard->next;
+        free(shard);
+        shard = next;
+    }
+    stats_local = NULL;
+}
+
+/**
+ * Returns the calling thread's shard, creating it on first use.
+ *
+ * @return  Pointer to the shard, or NULL if memory ran out (the thread's samples are lost).
+ */
+static StatsShard *stats_shard(void) {
+    StatsShard *shard = stats_local;
+
+    if (shard != NULL) {
+        return shard;
+    }
+    // Zeroed memory is a valid initial value for every atomic in the shard
+    shard = (StatsShard *)calloc(1, sizeof(StatsShard));
+    if (shard == NULL) {
+        return NULL;
+    }
+    shard->next = atomic_load(&stats_shards);
+    while (!atomic_compare_exchange_weak(&stats_shards, &shard->next, shard)) {
+        // Another thread added its shard first, `next` now holds the new head
+    }
+    stats_local = shard;
+    return shard;
+}
+
+/**
+ * Finds the histogram bucket of a value.
+ *
+ * Values below 2^STATS_SUB_BITS get a bucket each; above that every power of two is split into
+ * 2^STATS_SUB_BITS equal buckets, so a bucket is never wider than 1/2^STATS_SUB_BITS of its values.
+ *
+ * @param[in] value  Value to place.
+ * @return           Index of its bucket.
+ */
+static int stats_bucket(unsigned long long value) {
+    int shift;
+
+    if (value < (1ULL << STATS_SUB_BITS)) {
+        return (int)value;
+    }
+    if (value >= (1ULL << STATS_MAX_BITS)) {
+        value = (1ULL << STATS_MAX_BITS) - 1;
+    }
+    shift = 63 - __builtin_clzll(value) - STATS_SUB_BITS;
+    return (shift << STATS_SUB_BITS) + (int)(value >> shift);
+}
+
+/**
+ * Returns the highest value that falls into a bucket.
+ *
+ * @param[in] bucket  Index of the bucket.
+ * @return            Highest value of the bucket.
+ */
+static unsigned long long stats_bucket_high(int bucket) {
+    int shift;
+    unsigned long long top;
+
+    if (bucket < (1 << STATS_SUB_BITS)) {
+        return (unsigned long long)bucket;
+    }
+    shift = (bucket >> STATS_SUB_BITS) - 1;
+    top = (unsigned long long)((bucket & ((1 << STATS_SUB_BITS) - 1)) | (1 << STATS_SUB_BITS));
+    return ((top + 1) << shift) - 1;
+}
+
+/**
+ * Sums one histogram over every thread's shard.
+ *
+ * @param[in]  histogram  Histogram to merge.
+ * @param[out] totals     Pointer to the `StatsTotals` to fill.
+ */
+static void stats_merge(int histogram, StatsTotals *totals) {
+    memset(totals, 0, sizeof(*totals));
+    for (StatsShard *shard = atomic_load(&stats_shards); shard != NULL; shard = shard->next) {
+        StatsHistogram *source = &shard->histograms[histogram];
+        unsigned long long max = atomic_load_explicit(&source->max, memory_order_relaxed);
+
+        for (int i = 0; i < STATS_BUCKETS; i++) {
+            totals->buckets[i] += atomic_load_explicit(&source->buckets[i], memory_order_relaxed);
+        }
+        totals->count += atomic_load_explicit(&source->count, memory_order_relaxed);
+        totals->sum += atomic_load_explicit(&source->sum, memory_order_relaxed);
+        totals->max = (max > totals->max) ? max : totals->max;
+    }
+}
+
+/**
+ * Estimates the value below which a fraction of the samples fall.
+ *
+ * @param[in] totals    Pointer to the merged histogram.
+ * @param[in] fraction  Fraction of the samples, between 0 and 1.
+ * @return              Highest value of the bucket holding that sample, at most the largest sample.
+ */
+static unsigned long long stats_percentile(const StatsTotals *totals, double fraction) {
+    unsigned long long rank = (unsigned long long)(fraction * totals->count + 0.5);
+    unsigned long long seen = 0;
+
+    if (totals->count == 0) {
+        return 0;
+    }
+    if (rank == 0) {
+        rank = 1;
+    }
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        seen += totals->buckets[i];
+        if (seen >= rank) {
+            unsigned long long high = stats_bucket_high(i);
+            return (high < totals->max) ? high : totals->max;
+        }
+    }
+    return totals->max;
+}
+
+#endif
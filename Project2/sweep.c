@@ -0,0 +1,283 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SWEEP_MAX_AXES 16       // Most parameters a single sweep can vary
+#define SWEEP_MAX_VALUES 256    // Most values a single parameter can take
+
+// One parameter being varied and the values it takes
+typedef struct SweepAxis {
+    const char *name;
+    int values[SWEEP_MAX_VALUES];
+    int count;
+} SweepAxis;
+
+// Outcome of one configuration of the sweep
+typedef struct SweepResult {
+    int terminal_id;        // Id of the resource that ended the run, -1 if the time limit was reached
+    int terminal_status;
+    long long time_ns;
+    int cut_short;          // Non-zero if the run took its whole step bound before reaching the time limit
+    ResourceRange *ranges;  // One per resource of the scenario
+} SweepResult;
+
+// Everything shared by the threads running a sweep
+typedef struct Sweep {
+    SweepAxis axes[SWEEP_MAX_AXES];
+    int axis_count;
+    long run_count;
+    long long limit_ns;
+    int resource_count;
+    SweepResult *results;
+    atomic_long next_run;   // Next configuration a thread should pick up
+} Sweep;
+
+static int sweep_parse_axis(SweepAxis *axis, char *spec);
+static void sweep_params_for(const Sweep *sweep, long run, DemoParams *params);
+static void *sweep_thread(void *args);
+static void sweep_print(const Sweep *sweep, Manager *layout);
+
+/**
+ * Runs every combination of the given scenario parameters on the virtual clock.
+ *
+ * Each argument is `name=v1,v2,...` or `name=first:last:step` naming a field accepted by
+ * `demo_params_set`. Every configuration gets its own `Manager`, and the configurations are
+ * shared between `-j` threads (one per core by default). The results are printed as one table
+ * row per configuration, in the same order regardless of how many threads ran them. Processing
+ * times must be positive, and each run is cut short after `SWEEP_STEPS_PER_MS` steps per system
+ * and simulated millisecond, so no configuration can hold up the rest.
+ *
+ * @param[in] argc  Number of arguments after `--sweep`.
+ * @param[in] argv  Arguments after `--sweep`.
+ * @return          `EXIT_SUCCESS`, or `EXIT_FAILURE` if the arguments were invalid.
+ */
+int sweep_main(int argc, char *argv[]) {
+    Sweep sweep;
+    Manager layout;
+    DemoParams defaults;
+    pthread_t *threads;
+    int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    long long limit_ms = VIRTUAL_TIME_LIMIT;
+
+    sweep.axis_count = 0;
+    sweep.run_count = 1;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--limit") == 0 && i + 1 < argc) {
+            limit_ms = atoll(argv[++i]);
+        }
+        else if (sweep.axis_count < SWEEP_MAX_AXES && sweep_parse_axis(&sweep.axes[sweep.axis_count], argv[i])) {
+            sweep.run_count *= sweep.axes[sweep.axis_count].count;
+            sweep.axis_count++;
+        }
+        else {
+            fprintf(stderr, "Invalid sweep argument: %s\nUse name=v1,v2,... or name=first:last:step, *.time values of at least 1, with one of:\n", argv[i]);
+            demo_params_print_names(stderr);
+            return EXIT_FAILURE;
+        }
+    }
+    if (jobs < 1) {
+        jobs = 1;
+    }
+    if (limit_ms <= 0) {
+        limit_ms = VIRTUAL_TIME_LIMIT;
+    }
+
+    // A manager with the default scenario gives the resource names and count for the table
+    manager_init(&layout);
+    demo_params_init(&defaults);
+    load_data_params(&layout, &defaults);
+
+    sweep.limit_ns = limit_ms * 1000000LL;
+    sweep.resource_count = layout.resource_array.size;
+    atomic_init(&sweep.next_run, 0);
+    sweep.results = (SweepResult *)calloc(sweep.run_count, sizeof(SweepResult));
+    threads = (pthread_t *)malloc(jobs * sizeof(pthread_t));
+    if (sweep.results == NULL || threads == NULL) {
+        perror("Failed to allocate memory for the sweep");
+        free(sweep.results);
+        free(threads);
+        manager_clean(&layout);
+        return EXIT_FAILURE;
+    }
+    for (long i = 0; i < sweep.run_count; i++) {
+        sweep.results[i].ranges = (ResourceRange *)calloc(sweep.resource_count, sizeof(ResourceRange));
+    }
+
+    for (int i = 0; i < jobs; i++) {
+        if (pthread_create(&threads[i], NULL, sweep_thread, &sweep) != 0) {
+            jobs = i;
+            break;
+        }
+    }
+    if (jobs == 0) {
+        // No thread could be started, run the sweep here instead
+        sweep_thread(&sweep);
+    }
+    for (int i = 0; i < jobs; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    sweep_print(&sweep, &layout);
+
+    for (long i = 0; i < sweep.run_count; i++) {
+        free(sweep.results[i].ranges);
+    }
+    free(sweep.results);
+    free(threads);
+    manager_clean(&layout);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Parses `name=v1,v2,...` or `name=first:last:step` into a `SweepAxis`.
+ *
+ * @param[out]    axis  Pointer to the `SweepAxis` to fill.
+ * @param[in,out] spec  Argument to parse, the '=' is replaced by a terminator.
+ * @return              Non-zero if the argument was valid; zero otherwise.
+ */
+static int sweep_parse_axis(SweepAxis *axis, char *spec) {
+    DemoParams probe;
+    char *values = strchr(spec, '=');
+    int first, last, step, is_time;
+
+    if (values == NULL) {
+        return 0;
+    }
+    *values++ = '\0';
+    axis->name = spec;
+    axis->count = 0;
+
+    demo_params_init(&probe);
+    if (!demo_params_set(&probe, axis->name, 0)) {
+        return 0;
+    }
+    // A system must take some time to process, see manager_run_virtual
+    is_time = strlen(axis->name) > 5 && strcmp(axis->name + strlen(axis->name) - 5, ".time") == 0;
+
+    if (sscanf(values, "%d:%d:%d", &first, &last, &step) == 3) {
+        if (step <= 0 || last < first || (is_time && first < 1)) {
+            return 0;
+        }
+        for (int value = first; value <= last && axis->count < SWEEP_MAX_VALUES; value += step) {
+            axis->values[axis->count++] = value;
+        }
+    }
+    else {
+        for (char *token = strtok(values, ","); token != NULL && axis->count < SWEEP_MAX_VALUES; token = strtok(NULL, ",")) {
+            axis->values[axis->count++] = atoi(token);
+            if (is_time && axis->values[axis->count - 1] < 1) {
+                return 0;
+            }
+        }
+    }
+    return axis->count > 0;
+}
+
+/**
+ * Builds the parameters of one configuration, the last axis changes fastest.
+ *
+ * @param[in]  sweep   Pointer to the `Sweep`.
+ * @param[in]  run     Index of the configuration.
+ * @param[out] params  Pointer to the `DemoParams` to fill.
+ */
+static void sweep_params_for(const Sweep *sweep, long run, DemoParams *params) {
+    demo_params_init(params);
+    for (int i = sweep->axis_count - 1; i >= 0; i--) {
+        const SweepAxis *axis = &sweep->axes[i];
+        demo_params_set(params, axis->name, axis->values[run % axis->count]);
+        run /= axis->count;
+    }
+}
+
+/**
+ * Runs configurations of the sweep until none are left.
+ *
+ * @param[in,out] args  Pointer to the `Sweep`.
+ * @return              NULL.
+ */
+static void *sweep_thread(void *args) {
+    Sweep *sweep = (Sweep *)args;
+    DemoParams params;
+    Manager manager;
+    long run;
+
+    while ((run = atomic_fetch_add(&sweep->next_run, 1)) < sweep->run_count) {
+        SweepResult *result = &sweep->results[run];
+
+        sweep_params_for(sweep, run, &params);
+        manager_init(&manager);
+        manager.log_events = 0;
+        load_data_params(&manager, &params);
+        manager.step_limit = sweep->limit_ns / 1000000LL * manager.system_array.size * SWEEP_STEPS_PER_MS;
+
+        result->cut_short = manager_run_virtual(&manager, sweep->limit_ns, result->ranges) >= manager.step_limit;
+
+        result->time_ns = manager.virtual_time;
+        result->terminal_status = manager.terminal_status;
+        result->terminal_id = (manager.terminal_resource != NULL) ? manager.terminal_resource->id : -1;
+        manager_clean(&manager);
+    }
+    return NULL;
+}
+
+/**
+ * Prints one row per configuration: the swept values, how the run ended, when, and the
+ * lowest and highest level of every resource.
+ *
+ * @param[in] sweep   Pointer to the finished `Sweep`.
+ * @param[in] layout  Manager loaded with the default scenario, used for the resource names.
+ */
+static void sweep_print(const Sweep *sweep, Manager *layout) {
+    char outcome[64];
+
+    printf("%6s", "run");
+    for (int i = 0; i < sweep->axis_count; i++) {
+        printf(" %*s", (int)strlen(sweep->axes[i].name) > 8 ? (int)strlen(sweep->axes[i].name) : 8, sweep->axes[i].name);
+    }
+    printf(" %-16s %12s", "outcome", "time_s");
+    for (int i = 0; i < sweep->resource_count; i++) {
+        printf(" %17s", layout->resource_array.resources[i]->name);
+    }
+    printf("\n");
+
+    for (long run = 0; run < sweep->run_count; run++) {
+        const SweepResult *result = &sweep->results[run];
+
+        printf("%6ld", run);
+        for (int i = 0; i < sweep->axis_count; i++) {
+            int width = (int)strlen(sweep->axes[i].name) > 8 ? (int)strlen(sweep->axes[i].name) : 8;
+            // Same mixed-radix position as sweep_params_for, the last axis changes fastest
+            long index = run;
+            for (int j = sweep->axis_count - 1; j > i; j--) {
+                index /= sweep->axes[j].count;
+            }
+            printf(" %*d", width, sweep->axes[i].values[index % sweep->axes[i].count]);
+        }
+
+        if (result->cut_short) {
+            snprintf(outcome, sizeof(outcome), "steps");
+        }
+        else if (result->terminal_id < 0) {
+            snprintf(outcome, sizeof(outcome), "limit");
+        }
+        else {
+            snprintf(outcome, sizeof(outcome), "%s-%s",
+                     layout->resource_array.resources[result->terminal_id]->name,
+                     result->terminal_status == STATUS_EMPTY ? "empty" : "full");
+        }
+        printf(" %-16s %12.3f", outcome, result->time_ns / 1e9);
+
+        for (int i = 0; i < sweep->resource_count; i++) {
+            char range[32];
+            snprintf(range, sizeof(range), "%d..%d", result->ranges[i].min, result->ranges[i].max);
+            printf(" %17s", range);
+        }
+        printf("\n");
+    }
+}
@@ -1,15 +1,18 @@
 #include "defs.h"
 #include <stdlib.h>
 #include <stdio.h>
-#include <unistd.h>
 #include <string.h>
+#include <time.h>
 
 // Helper functions just used by this C file to clean up our code
 // Using static means they can't get linked into other files
 
-static int system_convert(System *);
-static void system_simulate_process_time(System *);
-static int system_store_resources(System *);
+static int system_advance(System *);
+static int system_convert(System *, Resource **);
+static int system_adjusted_processing_time(System *);
+static int system_store_resources(System *, Resource **);
+static int system_recipe_items(ResourceAmount *items, const ResourceAmount *source, int count);
+static void system_report_level(System *, Resource *, int change);
 
 /**
  * Creates a new `System` object.
@@ -25,39 +28,80 @@ static int system_store_resources(System *);
  * @param[in]  event_queue     Pointer to the `EventQueue` for event handling.
  */
 void system_create(System **system, const char *name, ResourceAmount consumed, ResourceAmount produced, int processing_time, EventQueue *event_queue) {
+    system_create_arena(system, name, consumed, produced, processing_time, event_queue, NULL);
+}
+
+/**
+ * Creates a new `System` object in an `Arena`.
+ *
+ * The system and its interned name live until the arena is released, so it must not be passed
+ * to `system_destroy`; add it to a `SystemArray` using the same arena and give it a recipe with
+ * `system_set_recipe_arena`. Without an arena this is `system_create`.
+ *
+ * @param[out] system          Pointer to the `System*` to be allocated and initialized, NULL if memory ran out.
+ * @param[in]  name            Name of the system (the string is copied).
+ * @param[in]  consumed        `ResourceAmount` representing the resource consumed.
+ * @param[in]  produced        `ResourceAmount` representing the resource produced.
+ * @param[in]  processing_time Processing time in milliseconds.
+ * @param[in]  event_queue     Pointer to the `EventQueue` for event handling.
+ * @param[in,out] arena        Pointer to the `Arena` to allocate from, or NULL to use malloc.
+ */
+void system_create_arena(System **system, const char *name, ResourceAmount consumed, ResourceAmount produced, int processing_time, EventQueue *event_queue, Arena *arena) {
     // Checks if system is null
     if(system == NULL){
         return;
     }
-    // Dynamically allocates memory for system
-    *system = (System *)malloc(sizeof(System));
-    // Checks if the pointer to system is null
-    if(*system == NULL){
-        return;
-    }
-    // Dynamically allocates memory for name
-    (*system)->name = (char *)malloc(strlen(name) + 1);
-    // Checks if name is null
-    if((*system)->name == NULL){
-        // Frees the pointer to system
-        free(*system);
-        // sets the pointer to system to null
-        *system = NULL;
-        return;
+    if (arena != NULL) {
+        // Both live as long as the arena, nothing is freed on failure
+        *system = (System *)arena_alloc(arena, sizeof(System), _Alignof(System));
+        if (*system == NULL || ((*system)->name = arena_intern(arena, name)) == NULL) {
+            *system = NULL;
+            return;
+        }
     }
+    else {
+        // Dynamically allocates memory for system
+        *system = (System *)malloc(sizeof(System));
+        // Checks if the pointer to system is null
+        if(*system == NULL){
+            return;
+        }
+        // Dynamically allocates memory for name
+        (*system)->name = (char *)malloc(strlen(name) + 1);
+        // Checks if name is null
+        if((*system)->name == NULL){
+            // Frees the pointer to system
+            free(*system);
+            // sets the pointer to system to null
+            *system = NULL;
+            return;
+        }
 
-    // Copies the string
-    strcpy((*system)->name, name);
+        // Copies the string
+        strcpy((*system)->name, name);
+    }
     
     // Initializes the data 
+    (*system)->id = -1;
     (*system)->consumed = consumed;
     (*system)->produced = produced;
+    (*system)->recipe = NULL;
     (*system)->processing_time = processing_time;
     // This is set to standard
-    (*system)->status = STANDARD; 
+    system_set_control(*system, STANDARD, 0);
     (*system)->event_queue = event_queue;
 
     (*system)->amount_stored = 0;
+    (*system)->phase = SYSTEM_PHASE_CONVERT;
+    (*system)->timer_due = 0;
+    (*system)->timer_pending = 0;
+    (*system)->timer_next = NULL;
+    (*system)->lateness.total_ns = 0;
+    (*system)->lateness.max_ns = 0;
+    (*system)->lateness.count = 0;
+#ifdef P2_STATS
+    memset(&(*system)->stats, 0, sizeof((*system)->stats));
+#endif
 }
 
 /**
@@ -71,166 +115,428 @@ void system_destroy(System *system) {
      // Frees name and system
      if(system != NULL){
         free(system->name);
+        free(system->recipe);
         free(system);
     }
 }
 
 
+/**
+ * Gives a `System` several inputs and outputs.
+ *
+ * Each step then consumes every input or none of them (see `resource_try_consume_all`) and
+ * produces every output, each stored as far as it fits. `consumed` and `produced` become the
+ * first input and output, as listed, and stand for the recipe where a single resource is
+ * expected. Inputs naming the same resource are merged, as are outputs, and entries without a
+ * resource are dropped. With at most one of each no recipe is kept, so the system stays on the
+ * single-resource path. Resources a recipe consumes together are made transactional, so call
+ * this before any system runs, on a system that holds no output, once the resources have been
+ * added to the `ResourceArray`: their ids give the order they are locked in.
+ *
+ * @param[in,out] system        Pointer to the `System`.
+ * @param[in]     inputs        Resources consumed by each step.
+ * @param[in]     input_count   Number of inputs.
+ * @param[in]     outputs       Resources produced by each step.
+ * @param[in]     output_count  Number of outputs.
+ * @return                      Non-zero on success; zero if memory ran out (the system is unchanged).
+ */
+int system_set_recipe(System *system, const ResourceAmount *inputs, int input_count, const ResourceAmount *outputs, int output_count) {
+    return system_set_recipe_arena(system, inputs, input_count, outputs, output_count, NULL);
+}
+
+/**
+ * Gives a `System` several inputs and outputs, see `system_set_recipe`, taking the recipe from an `Arena`.
+ *
+ * Use this for systems created with `system_create_arena`, with the same arena. The system
+ * must not have a recipe yet. Without an arena this is `system_set_recipe`.
+ *
+ * @param[in,out] system        Pointer to the `System`.
+ * @param[in]     inputs        Resources consumed by each step.
+ * @param[in]     input_count   Number of inputs.
+ * @param[in]     outputs       Resources produced by each step.
+ * @param[in]     output_count  Number of outputs.
+ * @param[in,out] arena         Pointer to the `Arena` to allocate from, or NULL to use malloc.
+ * @return                      Non-zero on success; zero if memory ran out (the system is unchanged).
+ */
+int system_set_recipe_arena(System *system, const ResourceAmount *inputs, int input_count, const ResourceAmount *outputs, int output_count, Arena *arena) {
+    size_t size = sizeof(Recipe) + (size_t)(input_count + output_count) * sizeof(ResourceAmount) + (size_t)output_count * sizeof(int);
+    Recipe *recipe = NULL;
+    ResourceAmount none;
+
+    resource_amount_init(&none, NULL, 0);
+    if (input_count > 1 || output_count > 1) {
+        // The recipe and its arrays are one allocation, freed by system_destroy or with the arena
+        recipe = (arena != NULL) ? (Recipe *)arena_alloc(arena, size, _Alignof(Recipe)) : (Recipe *)malloc(size);
+        if (recipe == NULL) {
+            return 0;
+        }
+        recipe->inputs = (ResourceAmount *)(recipe + 1);
+        recipe->outputs = recipe->inputs + input_count;
+        recipe->stored = (int *)(recipe->outputs + output_count);
+        recipe->input_count = system_recipe_items(recipe->inputs, inputs, input_count);
+        recipe->output_count = system_recipe_items(recipe->outputs, outputs, output_count);
+        memset(recipe->stored, 0, (size_t)output_count * sizeof(int));
+        for (int i = 0; recipe->input_count > 1 && i < recipe->input_count; i++) {
+            recipe->inputs[i].resource->transactional = 1;
+        }
+    }
+
+    if (arena == NULL) {
+        free(system->recipe);
+    }
+    system->recipe = recipe;
+    system->consumed = (input_count > 0) ? inputs[0] : none;
+    system->produced = (output_count > 0) ? outputs[0] : none;
+    return 1;
+}
+
+/**
+ * Copies the entries of a recipe that name a resource, merging repeats, ordered by resource id.
+ *
+ * Resources with the same id are ordered by address, so two recipes over the same resources
+ * agree on the order.
+ *
+ * @param[out] items   Array of at least `count` entries to fill.
+ * @param[in]  source  Entries as given to `system_set_recipe`.
+ * @param[in]  count   Number of entries in `source`.
+ * @return             Number of entries filled.
+ */
+static int system_recipe_items(ResourceAmount *items, const ResourceAmount *source, int count) {
+    int filled = 0;
+
+    for (int i = 0; i < count; i++) {
+        Resource *resource = source[i].resource;
+        int at = 0;
+
+        if (resource == NULL) {
+            continue;
+        }
+        // Insertion sort, recipes are short
+        while (at < filled && (items[at].resource->id < resource->id
+                               || (items[at].resource->id == resource->id && items[at].resource < resource))) {
+            at++;
+        }
+        if (at < filled && items[at].resource == resource) {
+            items[at].amount += source[i].amount;
+            continue;
+        }
+        memmove(&items[at + 1], &items[at], (size_t)(filled - at) * sizeof(ResourceAmount));
+        items[at] = source[i];
+        filled++;
+    }
+    return filled;
+}
+
 /**
  * Runs the main loop for a `System`.
  *
  * This function manages the lifecycle of a system, including resource conversion,
- * processing time simulation, and resource storage. It generates events based on
- * the success or failure of these operations.
+ * processing time simulation, and resource storage. It takes one step and then
+ * sleeps until the step's wait is over, so a thread can be dedicated to the system.
+ * Sleeps are to an absolute deadline, so oversleeping does not add up over many steps.
  *
  * @param[in,out] system  Pointer to the `System` to run.
  */
 void system_run(System *system) {
+    long long now = monotonic_now_ns();
+    struct timespec deadline;
+    int delay;
+
+    if (system->timer_pending) {
+        lateness_record(&system->lateness, now - system->timer_due);
+        system->timer_pending = 0;
+    }
+
+    delay = system_step(system);
+
+    if (delay > 0) {
+        system->timer_due = system_next_due(system, delay, now);
+        system->timer_pending = 1;
+        resource_flush_due(now, system->timer_due - now);
+        deadline.tv_sec = system->timer_due / 1000000000LL;
+        deadline.tv_nsec = system->timer_due % 1000000000LL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) != 0) {
+            // Interrupted by a signal, keep sleeping
+        }
+    }
+    else {
+        resource_flush_due(now, 0);
+    }
+}
+
+/**
+ * Computes when a wait of `delay` milliseconds that starts now should end.
+ *
+ * The wait is measured from when the previous wait was due rather than from `now`, so a step
+ * that starts late is made up for by the next one and production rates do not drift. The
+ * catch-up is limited to one wait: the result is never earlier than `now`.
+ *
+ * @param[in] system  Pointer to the `System` about to wait.
+ * @param[in] delay   Length of the wait in milliseconds.
+ * @param[in] now     Current monotonic time in nanoseconds.
+ * @return            Monotonic time in nanoseconds the wait ends at.
+ */
+long long system_next_due(System *system, int delay, long long now) {
+    long long base = (system->timer_due != 0) ? system->timer_due : now;
+    long long due = base + (long long)delay * 1000000LL;
+
+    return (due < now) ? now : due;
+}
+
+/**
+ * Advances a `System` by one step without blocking.
+ *
+ * A system alternates between converting (consuming its input and starting processing)
+ * and storing (handing over its output once processing is done). Each call does the work
+ * for the current phase and returns how long to wait before calling again, so the wait
+ * can be a sleep, a timer or a jump of a virtual clock. Events are generated based on
+ * the success or failure of these operations.
+ *
+ * @param[in,out] system  Pointer to the `System` to step.
+ * @return                Milliseconds until the next step should run, zero to run it immediately.
+ */
+int system_step(System *system) {
+#ifdef P2_STATS
+    long long start = monotonic_now_ns();
+    int delay = system_advance(system);
+    long long busy = monotonic_now_ns() - start;
+
+    // A step that leaves the system processing waits for its output, any other wait is a back-off
+    system->stats.steps++;
+    system->stats.busy_ns += busy;
+    if (system->phase == SYSTEM_PHASE_PROCESS) {
+        system->stats.process_ms += delay;
+    }
+    else {
+        system->stats.backoff_ms += delay;
+    }
+    stats_record(STATS_STEP_BUSY, busy);
+    return delay;
+#else
+    return system_advance(system);
+#endif
+}
+
+/**
+ * Does the work of `system_step` for the current phase.
+ *
+ * @param[in,out] system  Pointer to the `System` to step.
+ * @return                Milliseconds until the next step should run, zero to run it immediately.
+ */
+static int system_advance(System *system) {
     Event event;
+    Resource *resource = NULL;
     int result_status;
-    
-    if (system->amount_stored == 0) {
-        // Need to convert resources (consume and process)
-        result_status = system_convert(system);
 
-        if (result_status != STATUS_OK) {
-            // Report that resources were out / insufficient
-            event_init(&event, system, system->consumed.resource, result_status, PRIORITY_HIGH, system->consumed.resource->amount);
-            event_queue_push(system->event_queue, &event);    
-            // Sleep to prevent looping too frequently and spamming with events
-            usleep(SYSTEM_WAIT_TIME * 1000);          
+    if (system->phase == SYSTEM_PHASE_CONVERT) {
+        if (system->amount_stored > 0) {
+            // Output from an earlier conversion still has to be stored
+            system->phase = SYSTEM_PHASE_STORE;
+        }
+        else {
+            // Need to convert resources (consume and process)
+            result_status = system_convert(system, &resource);
+
+            if (result_status != STATUS_OK) {
+                // Report that resources were out / insufficient
+                event_init(&event, system, resource, result_status, PRIORITY_HIGH, resource_get_amount(resource));
+                event_queue_push(system->event_queue, &event);    
+                // Wait to prevent looping too frequently and spamming with events
+                return SYSTEM_WAIT_TIME;
+            }
+
+            system->phase = SYSTEM_PHASE_PROCESS;
+            return system_adjusted_processing_time(system);
         }
     }
 
-    if (system->amount_stored  > 0) {
+    if (system->phase == SYSTEM_PHASE_PROCESS) {
+        // Processing is done, the output is ready to store
+        if (system->recipe != NULL) {
+            for (int i = 0; i < system->recipe->output_count; i++) {
+                system->recipe->stored[i] += system->recipe->outputs[i].amount;
+                system->amount_stored += system->recipe->outputs[i].amount;
+            }
+        }
+        else if (system->produced.resource != NULL) {
+            system->amount_stored += system->produced.amount;
+        }
+        else {
+            system->amount_stored = 0;
+        }
+        system->phase = SYSTEM_PHASE_STORE;
+    }
+
+    if (system->amount_stored > 0) {
         // Attempt to store the produced resources
-        result_status = system_store_resources(system);
+        result_status = system_store_resources(system, &resource);
 
         if (result_status != STATUS_OK) {
-            event_init(&event, system, system->produced.resource, result_status, PRIORITY_LOW, system->produced.resource->amount);
+            event_init(&event, system, resource, result_status, PRIORITY_LOW, resource_get_amount(resource));
             event_queue_push(system->event_queue, &event);
-            // Sleep to prevent looping too frequently and spamming with events
-            usleep(SYSTEM_WAIT_TIME * 1000);
+            // Wait to prevent looping too frequently and spamming with events
+            return SYSTEM_WAIT_TIME;
         }
     }
+
+    system->phase = SYSTEM_PHASE_CONVERT;
+    return 0;
 }
 
 /**
- * Converts resources in a `System`.
+ * Consumes the input of a `System`.
  *
- * Handles the consumption of required resources and simulates processing time.
- * Updates the amount of produced resources based on the system's configuration.
+ * The consumed resource is taken with a lock-free compare-and-swap, the inputs of a recipe
+ * all at once. Processing is left to the caller, so systems sharing an input can run in parallel.
  *
- * @param[in,out] system           Pointer to the `System` performing the conversion.
- * @param[out]    amount_produced  Pointer to the integer tracking the amount of produced resources.
- * @return                         `STATUS_OK` if successful, or an error status code.
+ * @param[in,out] system    Pointer to the `System` performing the conversion.
+ * @param[out]    shortage  Set to the resource that was short when the conversion fails.
+ * @return                  `STATUS_OK` if successful, or an error status code.
  */
-static int system_convert(System *system) {
-    int status;
+static int system_convert(System *system, Resource **shortage) {
     Resource *consumed_resource = system->consumed.resource;
-    int amount_consumed = system->consumed.amount;
+    int failed = 0, result;
 
-    sem_wait(&consumed_resource->resource_mutex);
-    // We can always convert without consuming anything
-    if (consumed_resource == NULL) {
-        status = STATUS_OK;
-    } else {
-        // Attempt to consume the required resources
-        if (consumed_resource->amount >= amount_consumed) {
-            consumed_resource->amount -= amount_consumed;
-            status = STATUS_OK;
-        } else {
-            status = (consumed_resource->amount == 0) ? STATUS_EMPTY : STATUS_INSUFFICIENT;
+    if (system->recipe != NULL) {
+        if (system->recipe->input_count == 0) {
+            return STATUS_OK;
+        }
+        result = resource_try_consume_all(system->recipe->inputs, system->recipe->input_count, &failed);
+        *shortage = system->recipe->inputs[failed].resource;
+        for (int i = 0; result == STATUS_OK && i < system->recipe->input_count; i++) {
+            system_report_level(system, system->recipe->inputs[i].resource, -system->recipe->inputs[i].amount);
         }
+        return result;
     }
 
-    if (status == STATUS_OK) {
-        system_simulate_process_time(system);
-
-        if (system->produced.resource != NULL) {
-            system->amount_stored += system->produced.amount;
-        }
-        else {
-            system->amount_stored = 0;
-        }
+    // We can always convert without consuming anything
+    *shortage = consumed_resource;
+    if (consumed_resource == NULL) {
+        return STATUS_OK;
     }
 
-    sem_post(&consumed_resource->resource_mutex);
-    return status;
+    // Attempt to consume the required resources
+    result = resource_try_consume(consumed_resource, system->consumed.amount);
+    if (result == STATUS_OK) {
+        system_report_level(system, consumed_resource, -system->consumed.amount);
+    }
+    return result;
 }
 
 /**
- * Simulates the processing time for a `System`.
+ * Computes the processing time for a `System`.
  *
- * Adjusts the processing time based on the system's current status (e.g., SLOW, FAST)
- * and sleeps for the adjusted time to simulate processing.
+ * Adjusts the processing time based on the system's current status (e.g., SLOW, FAST), or on
+ * the pace a controller gave it.
  *
  * @param[in] system  Pointer to the `System` whose processing time is being simulated.
+ * @return            The adjusted processing time in milliseconds.
  */
-static void system_simulate_process_time(System *system) {
-    int adjusted_processing_time;
+static int system_adjusted_processing_time(System *system) {
+    int status, pace;
 
+    system_get_control(system, &status, &pace);
+    if (pace > 0) {
+        return (int)((long long)system->processing_time * 100 / pace);
+    }
     // Adjust based on the current system status modifier
-    switch (system->status) {
+    switch (status) {
         case SLOW:
-            adjusted_processing_time = system->processing_time * 2;
-            break;
+            return system->processing_time * 2;
         case FAST:
-            adjusted_processing_time = system->processing_time / 2;
-            break;
+            return system->processing_time / 2;
         default:
-            adjusted_processing_time = system->processing_time;
+            return system->processing_time;
     }
-
-    // Sleep for the required time
-    usleep(adjusted_processing_time * 1000);
 }
 
 /**
  * Stores produced resources in a `System`.
  *
  * Attempts to add the produced resources to the corresponding resource's amount,
- * considering the maximum capacity. Updates the `produced_resource_count` to reflect
- * any leftover resources that couldn't be stored.
+ * considering the maximum capacity. Updates the system's `amount_stored` to reflect
+ * any leftover resources that couldn't be stored. Each output of a recipe is stored on its own.
  *
- * @param[in,out] system                   Pointer to the `System` storing resources.
- * @param[in,out] produced_resource_count  Pointer to the integer value of how many resources need to be stored, updated with the amount that could not be stored.
- * @return                                 `STATUS_OK` if all resources were stored, or `STATUS_CAPACITY` if not all could be stored.
+ * @param[in,out] system  Pointer to the `System` storing resources.
+ * @param[out]    full    Set to the first resource that had no room for everything.
+ * @return                `STATUS_OK` if all resources were stored, or `STATUS_CAPACITY` if not all could be stored.
  */
-static int system_store_resources(System *system) {
+static int system_store_resources(System *system, Resource **full) {
     Resource *produced_resource = system->produced.resource;
-    int available_space, amount_to_store;
+    int stored = 0;
+
+    *full = produced_resource;
+    if (system->recipe != NULL) {
+        Recipe *recipe = system->recipe;
+
+        *full = NULL;
+        for (int i = 0; i < recipe->output_count; i++) {
+            if (recipe->stored[i] == 0) {
+                continue;
+            }
+            resource_try_store(recipe->outputs[i].resource, recipe->stored[i], &stored);
+            system_report_level(system, recipe->outputs[i].resource, stored);
+            recipe->stored[i] -= stored;
+            system->amount_stored -= stored;
+            if (recipe->stored[i] != 0 && *full == NULL) {
+                *full = recipe->outputs[i].resource;
+            }
+        }
+        return (system->amount_stored != 0) ? STATUS_CAPACITY : STATUS_OK;
+    }
 
-    sem_wait(&produced_resource->resource_mutex);
     // We can always proceed if there's nothing to store
     if (produced_resource == NULL || system->amount_stored == 0) {
         system->amount_stored = 0;
         return STATUS_OK;
     }
 
-    amount_to_store = system->amount_stored;
-
-    // Calculate available space
-    available_space = produced_resource->max_capacity - produced_resource->amount;
-
-    if (available_space >= amount_to_store) {
-        // Store all produced resources
-        produced_resource->amount += amount_to_store;
-        system->amount_stored = 0;
-    } else if (available_space > 0) {
-        // Store as much as possible
-        produced_resource->amount += available_space;
-        system->amount_stored = amount_to_store - available_space;
-    }
+    // Store as much as possible, whatever does not fit stays in the system
+    resource_try_store(produced_resource, system->amount_stored, &stored);
+    system_report_level(system, produced_resource, stored);
+    system->amount_stored -= stored;
 
     if (system->amount_stored != 0) {
         return STATUS_CAPACITY;
     }
 
-    sem_post(&produced_resource->resource_mutex);
     return STATUS_OK;
 }
 
+/**
+ * Reports a change that took a resource across one of its watermarks.
+ *
+ * A consumption that takes the amount below `low_mark` pushes `STATUS_LOW`, a store that takes
+ * it above `high_mark` pushes `STATUS_HIGH`, so a controller hears about a resource running low
+ * or filling up before anyone runs into it. The amount is read after the change, so with other
+ * threads changing the resource at the same time a crossing can go unreported; the controller's
+ * periodic pass catches up with those.
+ *
+ * @param[in,out] system    Pointer to the `System` that changed the resource.
+ * @param[in]     resource  Pointer to the changed `Resource`.
+ * @param[in]     change    Units added, negative for units consumed.
+ */
+static void system_report_level(System *system, Resource *resource, int change) {
+    Event event;
+    int amount, status;
+
+    if (resource == NULL || change == 0 || (resource->low_mark == 0 && resource->high_mark == 0)) {
+        return;
+    }
+    amount = resource_get_amount(resource);
+    if (change < 0 && amount < resource->low_mark && amount - change >= resource->low_mark) {
+        status = STATUS_LOW;
+    }
+    else if (change > 0 && resource->high_mark > 0 && amount > resource->high_mark && amount - change <= resource->high_mark) {
+        status = STATUS_HIGH;
+    }
+    else {
+        return;
+    }
+    event_init(&event, system, resource, status, PRIORITY_MED, amount);
+    event_queue_push(system->event_queue, &event);
+}
+
 
 /**
  * Initializes the `SystemArray`.
@@ -240,14 +546,28 @@ static int system_store_resources(System *system) {
  * @param[out] array  Pointer to the `SystemArray` to initialize.
  */
 void system_array_init(SystemArray *array) {
+    system_array_init_arena(array, NULL);
+}
+
+/**
+ * Initializes a `SystemArray` whose storage comes from an `Arena`.
+ *
+ * Such an array holds systems created in the same arena: cleaning it destroys none of them,
+ * they are released with the arena. Without an arena this is `system_array_init`.
+ *
+ * @param[out]    array  Pointer to the `SystemArray` to initialize.
+ * @param[in,out] arena  Pointer to the `Arena`, or NULL to use malloc.
+ */
+void system_array_init_arena(SystemArray *array, Arena *arena) {
      // Initializes the array 
      if(array != NULL){
         // Sets the size to 0
         array->size = 0;
         // Sets the capacity to 1
         array->capacity = 1;
-        // Dynamically allocates memory for systems
-        array->systems = (System **)calloc(array->capacity, sizeof(System *));
+        array->arena = arena;
+        // Dynamically allocates memory for systems, an arena's array allocates on the first add instead
+        array->systems = (arena == NULL) ? (System **)calloc(array->capacity, sizeof(System *)) : NULL;
 
         // If it is null sets capacity to 0
         if(array->systems == NULL){
@@ -260,6 +580,8 @@ void system_array_init(SystemArray *array) {
  * Cleans up the `SystemArray` by destroying all systems and freeing memory.
  *
  * Iterates through the array, cleaning any memory for each System pointed to by the array.
+ * An array with an arena only forgets its systems, releasing the arena frees them and the
+ * storage at once.
  *
  * @param[in,out] array  Pointer to the `SystemArray` to clean.
  */
@@ -268,6 +590,13 @@ void system_array_clean(SystemArray *array) {
      if(array == NULL || array->systems == NULL){
         return;
     }
+    // Storage and systems go with the arena
+    if (array->arena != NULL) {
+        array->systems = NULL;
+        array->size = 0;
+        array->capacity = 0;
+        return;
+    }
     // Iterates through the array and destroys systems at index i
     for(int i = 0; i < array->size; i++){
         if(array->systems[i] != NULL){
@@ -301,7 +630,8 @@ void system_array_add(SystemArray *array, System *system) {
         // Doubles the size of the array
         size_t new_capacity = (array->capacity == 0) ? 1 : array->capacity * 2; 
         // Dynamically allocates memory for the new system
-        System **new_system = (System **)malloc(new_capacity * sizeof(System *));
+        System **new_system = (array->arena != NULL) ? (System **)arena_alloc(array->arena, new_capacity * sizeof(System *), _Alignof(System *))
+                                                     : (System **)malloc(new_capacity * sizeof(System *));
         // Checks if new system is null
         if(new_system == NULL){
             return;
@@ -310,20 +640,164 @@ void system_array_add(SystemArray *array, System *system) {
         for(int i = 0; i < array->size; i++){
             new_system[i] = array->systems[i];
         }
-        // Frees the systems
-        free(array->systems);
+        // Frees the systems, the old storage of an arena's array is left behind
+        if (array->arena == NULL) {
+            free(array->systems);
+        }
 
         array->systems = new_system;
         array->capacity = new_capacity;
     }
+    system->id = array->size;
     array->systems[array->size++] = system;
 }
 
+/**
+ * Prints how late each system's steps started compared to when they were due.
+ *
+ * @param[in] array  Pointer to the `SystemArray` to report on.
+ */
+void system_array_print_lateness(SystemArray *array) {
+    printf("%-20s %10s %12s %12s\n", "System", "Steps", "Mean (us)", "Max (us)");
+    for (int i = 0; i < array->size; i++) {
+        System *system = array->systems[i];
+        LatenessStats *stats = &system->lateness;
+        printf("%-20s %10ld %12.1f %12.1f\n",
+               system->name,
+               stats->count,
+               stats->count > 0 ? (double)stats->total_ns / stats->count / 1000.0 : 0.0,
+               (double)stats->max_ns / 1000.0);
+    }
+}
+
 // Creates the thread for the system
 void *system_thread(void *args){
     System *system = (System *)args;
-    while(system->status != TERMINATE){
+    while(system_status(system) != TERMINATE){
         system_run(system);
     }
+    // Units held back from relaxed resources must not be lost
+    resource_flush_thread();
     return NULL;
-}
\ No newline at end of file
+}
+/**
+ * Builds the `SystemTable` of a `SystemArray`.
+ *
+ * Copies the fields the manager scans into one column per field, with resources referred to
+ * by their id, so a pass over every system reads contiguous integers. All columns share a
+ * single allocation. The table describes the systems in the array when it is built; systems
+ * added afterwards are not in it.
+ *
+ * @param[out] table  Pointer to the `SystemTable` to build.
+ * @param[in]  array  Pointer to the `SystemArray` to describe.
+ * @return            Non-zero on success; zero if memory ran out (the table is then empty).
+ */
+int system_table_build(SystemTable *table, SystemArray *array) {
+    int size = array->size;
+    int *columns = (int *)malloc((size_t)size * 6 * sizeof(int) + 1);
+    System **systems = (System **)malloc((size_t)size * sizeof(System *) + 1);
+
+    table->size = 0;
+    table->status = table->pace = table->processing_time = table->consumed = table->produced = table->outputs = NULL;
+    table->systems = NULL;
+    if (columns == NULL || systems == NULL) {
+        free(columns);
+        free(systems);
+        return 0;
+    }
+
+    table->status = columns;
+    table->processing_time = columns + size;
+    table->consumed = columns + 2 * size;
+    table->produced = columns + 3 * size;
+    table->pace = columns + 4 * size;
+    table->outputs = columns + 5 * size;
+    table->systems = systems;
+
+    for (int i = 0; i < size; i++) {
+        System *system = array->systems[i];
+        system_get_control(system, &table->status[i], &table->pace[i]);
+        table->processing_time[i] = system->processing_time;
+        table->consumed[i] = (system->consumed.resource != NULL) ? system->consumed.resource->id : -1;
+        table->produced[i] = (system->produced.resource != NULL) ? system->produced.resource->id : -1;
+        table->outputs[i] = (system->recipe != NULL) ? system->recipe->output_count : 0;
+        table->systems[i] = system;
+    }
+    table->size = size;
+    return 1;
+}
+
+/**
+ * Frees the columns of a `SystemTable`, the systems themselves are untouched.
+ *
+ * @param[in,out] table  Pointer to the `SystemTable` to clean.
+ */
+void system_table_clean(SystemTable *table) {
+    // The status column is the start of the allocation holding every column
+    free(table->status);
+    free(table->systems);
+    table->size = 0;
+    table->status = table->pace = table->processing_time = table->consumed = table->produced = table->outputs = NULL;
+    table->systems = NULL;
+}
+
+/**
+ * Maps a system status code to a human-readable string.
+ *
+ * @param[in] status  One of TERMINATE, DISABLED, SLOW, STANDARD or FAST.
+ * @return            Name of the status, "UNKNOWN" for anything else.
+ */
+const char *system_status_name(int status) {
+    switch (status) {
+        case TERMINATE:
+            return "TERMINATE";
+        case DISABLED:
+            return "DISABLED";
+        case SLOW:
+            return "SLOW";
+        case STANDARD:
+            return "STANDARD";
+        case FAST:
+            return "FAST";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+/**
+ * Gives a `System` a status and a pace in a single store.
+ *
+ * Both live in one atomic word, so a thread stepping the system never pairs a new status
+ * with the pace of an earlier change.
+ *
+ * @param[in,out] system  Pointer to the `System`.
+ * @param[in]     status  One of TERMINATE, DISABLED, SLOW, STANDARD or FAST.
+ * @param[in]     pace    Percent of the standard rate set by a controller, zero to follow the status.
+ */
+void system_set_control(System *system, int status, int pace) {
+    atomic_store_explicit(&system->control, (pace << SYSTEM_STATUS_BITS) | status, memory_order_release);
+}
+
+/**
+ * Reads the status of a `System`.
+ *
+ * @param[in] system  Pointer to the `System`.
+ * @return            The status last given by `system_set_control`.
+ */
+int system_status(const System *system) {
+    return atomic_load_explicit(&system->control, memory_order_acquire) & ((1 << SYSTEM_STATUS_BITS) - 1);
+}
+
+/**
+ * Reads the status and pace of a `System`, both from the same `system_set_control`.
+ *
+ * @param[in]  system  Pointer to the `System`.
+ * @param[out] status  Set to the status.
+ * @param[out] pace    Set to the pace, zero when the system follows its status.
+ */
+void system_get_control(const System *system, int *status, int *pace) {
+    int control = atomic_load_explicit(&system->control, memory_order_acquire);
+
+    *status = control & ((1 << SYSTEM_STATUS_BITS) - 1);
+    *pace = control >> SYSTEM_STATUS_BITS;
+}
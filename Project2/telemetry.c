@@ -0,0 +1,246 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Helpers just used by the telemetry writer, static so they can't get linked into other files
+
+static void telemetry_flush(Telemetry *telemetry);
+static unsigned char *telemetry_reserve(Telemetry *telemetry, size_t size);
+
+/**
+ * Creates a telemetry file for a loaded Manager and writes its header.
+ *
+ * The header lists the names of every resource and system, so the Manager must be fully
+ * loaded. Records are collected in a buffer of at least `TELEMETRY_BUFFER` bytes and written
+ * out when it fills up, so the cost per record is a copy.
+ *
+ * @param[out] telemetry      Pointer to the `Telemetry` to initialize.
+ * @param[in]  manager        Pointer to the loaded `Manager`.
+ * @param[in]  path           Path of the file to create, truncated if it exists.
+ * @param[in]  interval_ms    Milliseconds between snapshots.
+ * @param[in]  virtual_clock  Non-zero to stamp records with the manager's virtual time.
+ * @return                    Non-zero on success; zero otherwise (an error has been printed).
+ */
+int telemetry_open(Telemetry *telemetry, Manager *manager, const char *path, int interval_ms, int virtual_clock) {
+    TelemetryHeader header;
+    unsigned char *names;
+    size_t length;
+
+    memset(telemetry, 0, sizeof(*telemetry));
+    telemetry->manager = manager;
+    telemetry->virtual_clock = virtual_clock;
+    telemetry->start_ns = monotonic_now_ns();
+    telemetry->interval_ns = (long long)(interval_ms > 0 ? interval_ms : TELEMETRY_INTERVAL) * 1000000LL;
+    telemetry->next_snapshot_ns = 0;
+    // Amounts and statuses follow the fixed part, padded so every record stays 8-byte aligned
+    telemetry->snapshot_size = (sizeof(TelemetrySnapshot) + manager->resource_array.size * sizeof(int32_t)
+                                + manager->system_array.size + 7) & ~(size_t)7;
+
+    telemetry->buffer_size = TELEMETRY_BUFFER;
+    while (telemetry->buffer_size < 2 * telemetry->snapshot_size) {
+        telemetry->buffer_size *= 2;
+    }
+    telemetry->buffer = (unsigned char *)malloc(telemetry->buffer_size);
+    if (telemetry->buffer == NULL) {
+        perror("Failed to allocate memory for telemetry");
+        return 0;
+    }
+    telemetry->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (telemetry->fd < 0) {
+        perror(path);
+        free(telemetry->buffer);
+        telemetry->buffer = NULL;
+        return 0;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TELEMETRY_MAGIC, sizeof(header.magic));
+    header.version = TELEMETRY_VERSION;
+    header.resource_count = manager->resource_array.size;
+    header.system_count = manager->system_array.size;
+    for (int i = 0; i < manager->resource_array.size; i++) {
+        header.names_size += strlen(manager->resource_array.resources[i]->name) + 1;
+    }
+    for (int i = 0; i < manager->system_array.size; i++) {
+        header.names_size += strlen(manager->system_array.systems[i]->name) + 1;
+    }
+
+    memcpy(telemetry_reserve(telemetry, sizeof(header)), &header, sizeof(header));
+    for (int i = 0; i < manager->resource_array.size + manager->system_array.size; i++) {
+        const char *name = (i < manager->resource_array.size) ? manager->resource_array.resources[i]->name
+                                                              : manager->system_array.systems[i - manager->resource_array.size]->name;
+        length = strlen(name) + 1;
+        names = telemetry_reserve(telemetry, length);
+        if (names != NULL) {
+            memcpy(names, name, length);
+        }
+    }
+    return 1;
+}
+
+/**
+ * Writes out the remaining records and closes the telemetry file.
+ *
+ * @param[in,out] telemetry  Pointer to the open `Telemetry`.
+ */
+void telemetry_close(Telemetry *telemetry) {
+    if (telemetry->buffer == NULL) {
+        return;
+    }
+    telemetry_flush(telemetry);
+    if (close(telemetry->fd) != 0 || telemetry->failed) {
+        fprintf(stderr, "Telemetry output is incomplete\n");
+    }
+    free(telemetry->buffer);
+    telemetry->buffer = NULL;
+}
+
+/**
+ * Reads the clock records are stamped with.
+ *
+ * @param[in] telemetry  Pointer to the `Telemetry`.
+ * @return               Nanoseconds since the start of the run, virtual or real.
+ */
+long long telemetry_now(Telemetry *telemetry) {
+    return telemetry->virtual_clock ? telemetry->manager->virtual_time : monotonic_now_ns() - telemetry->start_ns;
+}
+
+/**
+ * Records an event handled by the manager.
+ *
+ * @param[in,out] telemetry  Pointer to the `Telemetry`.
+ * @param[in]     event      Pointer to the `Event`.
+ */
+void telemetry_event(Telemetry *telemetry, const Event *event) {
+    TelemetryEvent *record = (TelemetryEvent *)telemetry_reserve(telemetry, sizeof(TelemetryEvent));
+
+    if (record == NULL) {
+        return;
+    }
+    record->record.type = TELEMETRY_EVENT;
+    record->record.size = sizeof(TelemetryEvent);
+    record->record.time_ns = telemetry_now(telemetry);
+    record->system = (event->system != NULL) ? event->system->id : -1;
+    record->resource = (event->resource != NULL) ? event->resource->id : -1;
+    record->status = event->status;
+    record->priority = event->priority;
+    record->amount = event->amount;
+    record->count = event->count;
+}
+
+/**
+ * Records the amount of every resource, the status of every system and the queue depth.
+ *
+ * @param[in,out] telemetry  Pointer to the `Telemetry`.
+ * @param[in]     time_ns    Time to stamp the snapshot with, on the records' clock.
+ */
+void telemetry_snapshot(Telemetry *telemetry, long long time_ns) {
+    Manager *manager = telemetry->manager;
+    unsigned char *record = telemetry_reserve(telemetry, telemetry->snapshot_size);
+    TelemetrySnapshot *snapshot = (TelemetrySnapshot *)record;
+    int32_t *amounts;
+    uint8_t *statuses;
+    Resource **resources;
+    int resource_count, system_count;
+
+    if (record == NULL) {
+        return;
+    }
+    snapshot->record.type = TELEMETRY_SNAPSHOT;
+    snapshot->record.size = (uint32_t)telemetry->snapshot_size;
+    snapshot->record.time_ns = time_ns;
+    snapshot->queue_depth = event_queue_size(&manager->event_queue);
+    snapshot->reserved = 0;
+
+    // Plain loops over local pointers, this runs up to a thousand times per simulated second
+    amounts = (int32_t *)(record + sizeof(TelemetrySnapshot));
+    resource_count = manager->resource_array.size;
+    resources = manager->resource_array.resources;
+    for (int i = 0; i < resource_count; i++) {
+        amounts[i] = atomic_load_explicit(&resources[i]->amount, memory_order_relaxed);
+    }
+    statuses = (uint8_t *)(amounts + resource_count);
+    system_count = manager->system_array.size;
+    if (manager->system_table.size == system_count) {
+        // The status column holds the same values without a pointer per system
+        const int *column = manager->system_table.status;
+        for (int i = 0; i < system_count; i++) {
+            statuses[i] = (uint8_t)column[i];
+        }
+    }
+    else {
+        System **systems = manager->system_array.systems;
+        for (int i = 0; i < system_count; i++) {
+            statuses[i] = (uint8_t)system_status(systems[i]);
+        }
+    }
+    // Zero the padding so files are reproducible
+    memset(statuses + system_count, 0, telemetry->snapshot_size - (size_t)(statuses + system_count - record));
+}
+
+/**
+ * Takes a snapshot if one has come due on the records' clock.
+ *
+ * Used by real-time runs. When the caller polls late, one snapshot stamped with the current time
+ * stands in for the intervals that were missed, since the state they would have shown is gone.
+ *
+ * @param[in,out] telemetry  Pointer to the `Telemetry`.
+ */
+void telemetry_poll(Telemetry *telemetry) {
+    long long now = telemetry_now(telemetry);
+
+    if (telemetry->next_snapshot_ns > now) {
+        return;
+    }
+    telemetry_snapshot(telemetry, now);
+    while (telemetry->next_snapshot_ns <= now) {
+        telemetry->next_snapshot_ns += telemetry->interval_ns;
+    }
+}
+
+/**
+ * Returns space for a record in the buffer, writing the buffer out first if it is too full.
+ *
+ * @param[in,out] telemetry  Pointer to the `Telemetry`.
+ * @param[in]     size       Bytes needed, at most `buffer_size`.
+ * @return                   Pointer to the space, or NULL if the record cannot be kept.
+ */
+static unsigned char *telemetry_reserve(Telemetry *telemetry, size_t size) {
+    unsigned char *space;
+
+    if (telemetry->used + size > telemetry->buffer_size) {
+        telemetry_flush(telemetry);
+    }
+    if (telemetry->failed || size > telemetry->buffer_size) {
+        return NULL;
+    }
+    space = telemetry->buffer + telemetry->used;
+    telemetry->used += size;
+    return space;
+}
+
+/**
+ * Writes the buffered records to the file.
+ *
+ * @param[in,out] telemetry  Pointer to the `Telemetry`.
+ */
+static void telemetry_flush(Telemetry *telemetry) {
+    size_t written = 0;
+
+    while (written < telemetry->used && !telemetry->failed) {
+        ssize_t result = write(telemetry->fd, telemetry->buffer + written, telemetry->used - written);
+        if (result < 0) {
+            if (errno != EINTR) {
+                perror("Failed to write telemetry");
+                telemetry->failed = 1;
+            }
+            continue;
+        }
+        written += (size_t)result;
+    }
+    telemetry->used = 0;
+}
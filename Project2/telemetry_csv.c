@@ -0,0 +1,165 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Converts a telemetry file written by `p2 --telemetry` to CSV.
+//
+//     p2csv telemetry.bin events      one row per handled event
+//     p2csv telemetry.bin snapshots   one row per snapshot, one column per resource and system
+
+static const char *csv_system_status(int status);
+static void csv_print_name(const char *name);
+
+int main(int argc, char *argv[]) {
+    TelemetryHeader header;
+    TelemetryRecord record;
+    unsigned char *body;
+    char *names;
+    const char **resource_names, **system_names;
+    size_t body_capacity = 0;
+    int events;
+    FILE *file;
+
+    if (argc != 3 || (strcmp(argv[2], "events") != 0 && strcmp(argv[2], "snapshots") != 0)) {
+        fprintf(stderr, "Usage: %s telemetry.bin events|snapshots\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    events = (strcmp(argv[2], "events") == 0);
+
+    file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TELEMETRY_MAGIC, sizeof(header.magic)) != 0
+        || header.version != TELEMETRY_VERSION) {
+        fprintf(stderr, "%s: not a telemetry file of this version\n", argv[1]);
+        fclose(file);
+        return EXIT_FAILURE;
+    }
+
+    // Names of every resource, then every system, each NUL-terminated
+    names = (char *)malloc(header.names_size + 1);
+    resource_names = (const char **)malloc((header.resource_count + 1) * sizeof(char *));
+    system_names = (const char **)malloc((header.system_count + 1) * sizeof(char *));
+    if (names == NULL || resource_names == NULL || system_names == NULL
+        || fread(names, 1, header.names_size, file) != header.names_size) {
+        fprintf(stderr, "%s: truncated header\n", argv[1]);
+        fclose(file);
+        return EXIT_FAILURE;
+    }
+    names[header.names_size] = '\0';
+    for (uint32_t i = 0, offset = 0; i < header.resource_count + header.system_count; i++) {
+        const char *name = (offset < header.names_size) ? names + offset : "";
+        if (i < header.resource_count) {
+            resource_names[i] = name;
+        }
+        else {
+            system_names[i - header.resource_count] = name;
+        }
+        offset += strlen(name) + 1;
+    }
+
+    if (events) {
+        printf("time_ms,system,resource,status,priority,amount,count\n");
+    }
+    else {
+        printf("time_ms,queue_depth");
+        for (uint32_t i = 0; i < header.resource_count; i++) {
+            printf(",");
+            csv_print_name(resource_names[i]);
+        }
+        for (uint32_t i = 0; i < header.system_count; i++) {
+            printf(",");
+            csv_print_name(system_names[i]);
+        }
+        printf("\n");
+    }
+
+    body = NULL;
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+        size_t size = (record.size >= sizeof(record)) ? record.size - sizeof(record) : 0;
+
+        if (size > body_capacity) {
+            free(body);
+            body_capacity = size;
+            body = (unsigned char *)malloc(body_capacity);
+            if (body == NULL) {
+                perror("Failed to allocate memory for a record");
+                fclose(file);
+                return EXIT_FAILURE;
+            }
+        }
+        if (size > 0 && fread(body, 1, size, file) != size) {
+            fprintf(stderr, "%s: truncated record\n", argv[1]);
+            break;
+        }
+
+        if (events && record.type == TELEMETRY_EVENT && size + sizeof(record) >= sizeof(TelemetryEvent)) {
+            TelemetryEvent event;
+            memcpy((unsigned char *)&event + sizeof(record), body, sizeof(event) - sizeof(record));
+            printf("%.6f,", record.time_ns / 1e6);
+            csv_print_name(event.system >= 0 && (uint32_t)event.system < header.system_count ? system_names[event.system] : "");
+            printf(",");
+            csv_print_name(event.resource >= 0 && (uint32_t)event.resource < header.resource_count ? resource_names[event.resource] : "");
+            printf(",%d,%d,%d,%d\n", event.status, event.priority, event.amount, event.count);
+        }
+        else if (!events && record.type == TELEMETRY_SNAPSHOT
+                 && size + sizeof(record) >= sizeof(TelemetrySnapshot) + header.resource_count * sizeof(int32_t) + header.system_count) {
+            TelemetrySnapshot snapshot;
+            const unsigned char *amounts = body + sizeof(snapshot) - sizeof(record);
+            const uint8_t *statuses = amounts + header.resource_count * sizeof(int32_t);
+
+            memcpy((unsigned char *)&snapshot + sizeof(record), body, sizeof(snapshot) - sizeof(record));
+            printf("%.6f,%d", record.time_ns / 1e6, snapshot.queue_depth);
+            for (uint32_t i = 0; i < header.resource_count; i++) {
+                int32_t amount;
+                memcpy(&amount, amounts + i * sizeof(int32_t), sizeof(amount));
+                printf(",%d", amount);
+            }
+            for (uint32_t i = 0; i < header.system_count; i++) {
+                printf(",%s", csv_system_status(statuses[i]));
+            }
+            printf("\n");
+        }
+    }
+
+    free(body);
+    free(names);
+    free(resource_names);
+    free(system_names);
+    fclose(file);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Maps a system status code to the name the simulator displays.
+ *
+ * @param[in] status  System status code.
+ * @return            Name of the status.
+ */
+static const char *csv_system_status(int status) {
+    static const char *names[] = {"TERMINATE", "DISABLED", "SLOW", "STANDARD", "FAST"};
+    return (status >= TERMINATE && status <= FAST) ? names[status] : "UNKNOWN";
+}
+
+/**
+ * Prints a name as a CSV field, quoting it when it contains a comma or a quote.
+ *
+ * @param[in] name  Name to print.
+ */
+static void csv_print_name(const char *name) {
+    if (strpbrk(name, ",\"\n") == NULL) {
+        fputs(name, stdout);
+        return;
+    }
+    putchar('"');
+    for (; *name != '\0'; name++) {
+        if (*name == '"') {
+            putchar('"');
+        }
+        putchar(*name);
+    }
+    putchar('"');
+}
@@ -0,0 +1,698 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+#define TICK_NEVER INT_MAX  // Due millisecond of a terminated member, which never steps again
+
+// Key and row of one system, sorted to lay the groups out
+typedef struct TickMember {
+    int consumed, consume_amount;
+    int produced, produce_amount;
+    int processing_time;
+    int recipe;         // Non-zero for a system with a recipe, which is a group of its own
+    int row;
+} TickMember;
+
+// Helpers just used by the tick engine, static so they can't get linked into other files
+
+static int tick_member_compare(const void *a, const void *b);
+static int tick_same_group(const TickMember *a, const TickMember *b);
+static int tick_group_compare(const void *a, const void *b);
+static long tick_group_step(Manager *manager, TickGroup *group, int now, int bound);
+static int tick_quiet_span(Manager *manager, TickGroup *group, int now, int bound);
+static long tick_member_step(Manager *manager, TickGroup *group, int member, int now);
+static int tick_member_advance(Manager *manager, TickGroup *group, int member, System *system);
+static int tick_wait(int base, int status, int pace);
+static void tick_report(System *system, Resource *resource, int status, int priority);
+static void tick_report_level(System *system, Resource *resource, int change);
+static void tick_drain(Manager *manager);
+static int tick_next_due(const TickGroup *group, int from, int now);
+static int tick_heap_before(const TickEngine *engine, int a, int b);
+static void tick_heap_push(TickEngine *engine, int group);
+static int tick_heap_pop(TickEngine *engine);
+
+/**
+ * Groups the systems of a loaded Manager for `tick_engine_run`.
+ *
+ * Systems consuming and producing the same amounts of the same resources with the same
+ * processing time form a group, and each group keeps its members' state in columns. A system
+ * with a recipe is a group of its own and steps with `system_step`. The
+ * Manager's `SystemTable` is built if it was not, since the engine reads statuses from it.
+ *
+ * @param[out]    engine   Pointer to the `TickEngine` to build.
+ * @param[in,out] manager  Pointer to the loaded `Manager`.
+ * @return                 Non-zero on success; zero if memory ran out.
+ */
+int tick_engine_build(TickEngine *engine, Manager *manager) {
+    int size = manager->system_array.size;
+    TickMember *members;
+
+    memset(engine, 0, sizeof(*engine));
+    if (manager->system_table.size != size && !manager_build_tables(manager)) {
+        return 0;
+    }
+
+    members = (TickMember *)malloc((size_t)size * sizeof(TickMember) + 1);
+    if (members == NULL) {
+        return 0;
+    }
+    for (int i = 0; i < size; i++) {
+        System *system = manager->system_array.systems[i];
+        members[i].consumed = manager->system_table.consumed[i];
+        members[i].consume_amount = (system->consumed.resource != NULL) ? system->consumed.amount : 0;
+        members[i].produced = manager->system_table.produced[i];
+        members[i].produce_amount = (system->produced.resource != NULL) ? system->produced.amount : 0;
+        members[i].processing_time = system->processing_time;
+        members[i].recipe = (system->recipe != NULL);
+        members[i].row = i;
+    }
+    // Members of a group end up next to each other, in SystemArray order
+    qsort(members, size, sizeof(TickMember), tick_member_compare);
+
+    for (int i = 0; i < size; i++) {
+        engine->group_count += (i == 0 || !tick_same_group(&members[i - 1], &members[i]));
+    }
+    engine->groups = (TickGroup *)calloc(engine->group_count + 1, sizeof(TickGroup));
+    engine->columns = (int *)malloc((size_t)size * 4 * sizeof(int) + 1);
+    engine->heap = (int *)malloc((size_t)engine->group_count * sizeof(int) + 1);
+    if (engine->groups == NULL || engine->columns == NULL || engine->heap == NULL) {
+        free(members);
+        tick_engine_clean(engine);
+        return 0;
+    }
+
+    for (int i = 0, group = -1; i < size; i++) {
+        TickGroup *current;
+        System *system = manager->system_array.systems[members[i].row];
+
+        if (i == 0 || !tick_same_group(&members[i - 1], &members[i])) {
+            current = &engine->groups[++group];
+            current->consumed = members[i].consumed;
+            current->consume_amount = members[i].consume_amount;
+            current->produced = members[i].produced;
+            current->produce_amount = members[i].produce_amount;
+            current->processing_time = members[i].processing_time;
+            current->system = members[i].recipe ? system : NULL;
+            current->rows = engine->columns + i;
+            current->due = engine->columns + size + i;
+            current->phase = engine->columns + 2 * size + i;
+            current->stored = engine->columns + 3 * size + i;
+        }
+        current = &engine->groups[group];
+        current->rows[current->size] = members[i].row;
+        current->due[current->size] = 0;
+        current->phase[current->size] = system->phase;
+        current->stored[current->size] = system->amount_stored;
+        current->size++;
+    }
+    free(members);
+
+    // Groups step in the order of their first member, so a scenario of one-member groups runs step for step like manager_run_virtual
+    qsort(engine->groups, engine->group_count, sizeof(TickGroup), tick_group_compare);
+    return 1;
+}
+
+/**
+ * Runs the simulation on the virtual clock, stepping runs of due members of a group in one pass.
+ *
+ * The clock jumps from one due millisecond to the next like `manager_run_virtual`, and the run
+ * has the same outcome, event for event: within a millisecond the due systems step in
+ * `SystemArray` order whichever group they are in, each with the result `system_step` would
+ * give, and the manager handles every event before the next step. A step that pushes no event
+ * leaves the manager nothing to react to, so a run of a group's members whose steps all go
+ * through without an event is settled in a single pass over its columns. The member whose step
+ * would push an event (a shortage, a full output, a watermark crossing) ends the run: it steps
+ * on its own, reporting exactly what `system_step` would, the manager drains its events, and
+ * the next run starts with the statuses and paces the manager left.
+ *
+ * Each pass reads and writes contiguous columns only, with the per-member decisions made
+ * without branches, so the compiler turns the passes into vector instructions. Scenarios made
+ * of a few kinds of systems repeated many times, laid out group by group, gain the most; systems
+ * of different groups interleaved in the `SystemArray`, or steps that keep pushing events, are
+ * stepped one system at a time and gain little over `manager_run_virtual`.
+ *
+ * @param[in,out] engine    Pointer to the `TickEngine` built for the Manager.
+ * @param[in,out] manager   Pointer to the `Manager`, its systems must not have threads.
+ * @param[in]     limit_ns  Virtual time in nanoseconds to stop at if nothing terminates the simulation.
+ * @return                  Number of system steps taken.
+ */
+long long tick_engine_run(TickEngine *engine, Manager *manager, long long limit_ns) {
+    long long start_ns = manager->virtual_time;
+    long long steps = 0;
+    long long span_ms = (limit_ns - start_ns) / 1000000LL;
+    int limit_ms = (span_ms < INT_MAX / 2) ? (int)span_ms : INT_MAX / 2;
+
+    // Every system not waiting from an earlier run is due at the current virtual time
+    for (int g = 0; g < engine->group_count; g++) {
+        TickGroup *group = &engine->groups[g];
+        group->next_due = INT_MAX;
+        for (int i = 0; i < group->size; i++) {
+            System *system = manager->system_array.systems[group->rows[i]];
+            long long wait_ms = (system->timer_due - start_ns) / 1000000LL;
+
+            group->due[i] = (wait_ms > 0) ? (int)((wait_ms < INT_MAX / 2) ? wait_ms : INT_MAX / 2) : 0;
+            group->phase[i] = system->phase;
+            group->stored[i] = system->amount_stored;
+            group->next_due = (group->due[i] < group->next_due) ? group->due[i] : group->next_due;
+        }
+    }
+
+    while (atomic_load(&manager->simulation_running) != 0 && engine->group_count > 0) {
+        int now = INT_MAX;
+
+        for (int g = 0; g < engine->group_count; g++) {
+            now = (engine->groups[g].next_due < now) ? engine->groups[g].next_due : now;
+        }
+        if (now > limit_ms) {
+            break;
+        }
+        manager->virtual_time = start_ns + (long long)now * 1000000LL;
+
+        // Snapshots due by this millisecond show the state before it, and before the controller's pass
+        if (manager->telemetry != NULL) {
+            while (manager->telemetry->next_snapshot_ns <= manager->virtual_time) {
+                telemetry_snapshot(manager->telemetry, manager->telemetry->next_snapshot_ns);
+                manager->telemetry->next_snapshot_ns += manager->telemetry->interval_ns;
+            }
+        }
+        controller_update(manager, manager->virtual_time);
+
+        // The groups due now take turns, the one with the earliest due member first
+        engine->heap_count = 0;
+        for (int g = 0; g < engine->group_count; g++) {
+            TickGroup *group = &engine->groups[g];
+            if (group->next_due == now) {
+                group->cursor = tick_next_due(group, 0, now);
+                tick_heap_push(engine, g);
+            }
+        }
+        while (engine->heap_count > 0 && atomic_load(&manager->simulation_running) != 0) {
+            TickGroup *group = &engine->groups[tick_heap_pop(engine)];
+            int bound = INT_MAX;
+
+            // The group steps its members up to the next one of another group that is due
+            if (engine->heap_count > 0) {
+                TickGroup *next = &engine->groups[engine->heap[0]];
+                bound = next->rows[next->cursor];
+            }
+            steps += tick_group_step(manager, group, now, bound);
+            if (group->cursor < group->size) {
+                tick_heap_push(engine, (int)(group - engine->groups));
+            }
+        }
+
+        for (int g = 0; g < engine->group_count; g++) {
+            TickGroup *group = &engine->groups[g];
+            int next = INT_MAX;
+
+            if (group->next_due != now) {
+                continue;
+            }
+            for (int i = 0; i < group->size; i++) {
+                next = (group->due[i] < next) ? group->due[i] : next;
+            }
+            group->next_due = next;
+        }
+    }
+
+    if (atomic_load(&manager->simulation_running) != 0 && manager->virtual_time < limit_ns) {
+        manager->virtual_time = limit_ns;
+    }
+
+    // Hand the state back so the systems can carry on with system_step
+    for (int g = 0; g < engine->group_count; g++) {
+        TickGroup *group = &engine->groups[g];
+        for (int i = 0; i < group->size; i++) {
+            System *system = manager->system_array.systems[group->rows[i]];
+            system->phase = group->phase[i];
+            system->amount_stored = group->stored[i];
+            // A terminated system keeps the due time it was dropped at
+            if (group->due[i] != TICK_NEVER) {
+                system->timer_due = start_ns + (long long)group->due[i] * 1000000LL;
+            }
+        }
+    }
+    return steps;
+}
+
+/**
+ * Frees everything held by a `TickEngine`.
+ *
+ * @param[in,out] engine  Pointer to the `TickEngine` to clean.
+ */
+void tick_engine_clean(TickEngine *engine) {
+    free(engine->groups);
+    free(engine->columns);
+    free(engine->heap);
+    engine->groups = NULL;
+    engine->columns = NULL;
+    engine->heap = NULL;
+    engine->group_count = 0;
+    engine->heap_count = 0;
+}
+
+/**
+ * Steps the members of a group that are due at `now`, from its cursor up to row `bound`.
+ *
+ * Runs of members found by `tick_quiet_span` are settled in one pass over the columns: each
+ * stores what it holds, consumes its input and starts processing with the wait
+ * `system_adjusted_processing_time` gives its status and pace. The member that ends a run
+ * steps on its own with `tick_member_step`. The cursor is left on the first due member at or
+ * after `bound`, or past the last member.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @param[in,out] group    Pointer to the `TickGroup` to step.
+ * @param[in]     now      Current millisecond of the run.
+ * @param[in]     bound    Row of the next system of another group due now, INT_MAX if there is none.
+ * @return                 Number of system steps taken, a store followed by a conversion counts as two.
+ */
+static long tick_group_step(Manager *manager, TickGroup *group, int now, int bound) {
+    const int *restrict rows = group->rows;
+    const int *restrict status = manager->system_table.status;
+    const int *restrict pace = manager->system_table.pace;
+    int *restrict due = group->due;
+    int *restrict phase = group->phase;
+    int *restrict stored = group->stored;
+    const int base = group->processing_time;
+    long steps = 0;
+
+    if (group->system != NULL) {
+        steps = tick_member_step(manager, group, 0, now);
+        group->cursor = group->size;
+        return steps;
+    }
+
+    while (group->cursor < group->size && rows[group->cursor] < bound && atomic_load(&manager->simulation_running) != 0) {
+        int from = group->cursor;
+        int end = tick_quiet_span(manager, group, now, bound);
+
+        // Every due member of the run stores, converts and starts processing
+        for (int i = from; i < end; i++) {
+            int go = (due[i] == now);
+            int current = status[rows[i]];
+            int paced = pace[rows[i]];
+            int scaled = (int)((long long)base * 100 / (paced > 0 ? paced : 100));
+            int wait = (paced > 0) ? scaled : ((current == SLOW) ? base * 2 : ((current == FAST) ? base / 2 : base));
+
+            steps += go + (go & ((phase[i] != SYSTEM_PHASE_CONVERT) | (stored[i] > 0)));
+            stored[i] = go ? 0 : stored[i];
+            phase[i] = go ? SYSTEM_PHASE_PROCESS : phase[i];
+            due[i] = go ? now + wait : due[i];
+        }
+
+        // The member that ended the run steps on its own, with the manager reacting to it
+        if (end < group->size && rows[end] < bound) {
+            steps += tick_member_step(manager, group, end, now);
+            end++;
+        }
+        group->cursor = tick_next_due(group, end, now);
+    }
+    return steps;
+}
+
+/**
+ * Finds how far a group's due members can step at `now` without pushing an event.
+ *
+ * Starting at the cursor, the members' steps are played out on the amounts of the consumed
+ * and produced resources, in order. The run ends before the first member that would find its
+ * output does not fit, find too little input, take a resource across a watermark, start a
+ * processing time of zero (it steps again at once), or has been terminated, and before row
+ * `bound`. The resources are left with the amounts the run's members leave them at. Nothing
+ * can end early if events are pending, since the manager handles them after the next step.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @param[in]     group    Pointer to the `TickGroup`.
+ * @param[in]     now      Current millisecond of the run.
+ * @param[in]     bound    Row the run must stop before.
+ * @return                 Index of the member that ends the run, or of the first member at or after `bound`.
+ */
+static int tick_quiet_span(Manager *manager, TickGroup *group, int now, int bound) {
+    Resource *consumed = (group->consumed >= 0) ? manager->resource_array.resources[group->consumed] : NULL;
+    Resource *produced = (group->produced >= 0) ? manager->resource_array.resources[group->produced] : NULL;
+    const int *status = manager->system_table.status;
+    const int *pace = manager->system_table.pace;
+    int same = (consumed != NULL && consumed == produced);
+    int held_amount = (produced != NULL) ? resource_get_amount(produced) : 0;
+    int input_amount = (consumed != NULL) ? resource_get_amount(consumed) : 0;
+    int need = group->consume_amount;
+    int i = group->cursor;
+
+    if (event_queue_size(&manager->event_queue) > 0) {
+        return i;
+    }
+
+    for (; i < group->size && group->rows[i] < bound; i++) {
+        int row = group->rows[i];
+        int held = group->stored[i];
+        int after_store = held_amount, after_convert = input_amount;
+
+        if (group->due[i] != now) {
+            continue;
+        }
+        if (status[row] == TERMINATE || tick_wait(group->processing_time, status[row], pace[row]) == 0) {
+            break;
+        }
+        if (group->phase[i] == SYSTEM_PHASE_PROCESS) {
+            held = (produced != NULL) ? held + group->produce_amount : 0;
+        }
+        if (produced != NULL && held > 0) {
+            if (held > produced->max_capacity - held_amount) {
+                break;
+            }
+            after_store = held_amount + held;
+            if (produced->high_mark > 0 && after_store > produced->high_mark && held_amount <= produced->high_mark) {
+                break;
+            }
+            after_convert = same ? after_store : after_convert;
+        }
+        if (consumed != NULL) {
+            if (after_convert < need) {
+                break;
+            }
+            if (need > 0 && after_convert - need < consumed->low_mark && after_convert >= consumed->low_mark) {
+                break;
+            }
+            after_convert -= need;
+            after_store = same ? after_convert : after_store;
+        }
+        held_amount = after_store;
+        input_amount = after_convert;
+    }
+
+    if (produced != NULL) {
+        atomic_store_explicit(&produced->amount, held_amount, memory_order_relaxed);
+    }
+    if (consumed != NULL && !same) {
+        atomic_store_explicit(&consumed->amount, input_amount, memory_order_relaxed);
+    }
+    return i;
+}
+
+/**
+ * Steps one member at `now` the way `manager_run_virtual` would step its system.
+ *
+ * The member steps again at once while its step asks for no wait, and the manager handles the
+ * events of every step before the next one. A step that starts processing waits at least
+ * `VIRTUAL_MIN_PROCESS`, as in `manager_run_virtual`. A terminated member is not stepped and
+ * never steps again.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @param[in,out] group    Pointer to the `TickGroup`.
+ * @param[in]     member   Index of the member in the group.
+ * @param[in]     now      Current millisecond of the run.
+ * @return                 Number of system steps taken.
+ */
+static long tick_member_step(Manager *manager, TickGroup *group, int member, int now) {
+    System *system = manager->system_array.systems[group->rows[member]];
+    long steps = 0;
+    int delay = 0;
+
+    do {
+        if (system_status(system) == TERMINATE) {
+            system->timer_due = manager->virtual_time;
+            group->due[member] = TICK_NEVER;
+            return steps;
+        }
+        if (group->system != NULL) {
+            delay = system_step(system);
+            group->phase[member] = system->phase;
+            group->stored[member] = system->amount_stored;
+        }
+        else {
+            delay = tick_member_advance(manager, group, member, system);
+        }
+        steps++;
+        tick_drain(manager);
+        if (delay < VIRTUAL_MIN_PROCESS && group->phase[member] == SYSTEM_PHASE_PROCESS) {
+            delay = VIRTUAL_MIN_PROCESS;
+        }
+    } while (delay == 0 && atomic_load(&manager->simulation_running) != 0);
+
+    group->due[member] = now + delay;
+    return steps;
+}
+
+/**
+ * Does what `system_step` does for the current phase of a member, on the group's columns.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @param[in,out] group    Pointer to the `TickGroup`.
+ * @param[in]     member   Index of the member in the group.
+ * @param[in]     system   Pointer to the member's `System`, which events are reported for.
+ * @return                 Milliseconds until the member steps again, zero to step it immediately.
+ */
+static int tick_member_advance(Manager *manager, TickGroup *group, int member, System *system) {
+    Resource *consumed = (group->consumed >= 0) ? manager->resource_array.resources[group->consumed] : NULL;
+    Resource *produced = (group->produced >= 0) ? manager->resource_array.resources[group->produced] : NULL;
+    int *phase = &group->phase[member];
+    int *stored = &group->stored[member];
+    int row = group->rows[member];
+
+    if (*phase == SYSTEM_PHASE_CONVERT) {
+        if (*stored > 0) {
+            // Output from an earlier conversion still has to be stored
+            *phase = SYSTEM_PHASE_STORE;
+        }
+        else {
+            if (consumed != NULL) {
+                int amount = resource_get_amount(consumed);
+
+                if (amount < group->consume_amount) {
+                    tick_report(system, consumed, (amount == 0) ? STATUS_EMPTY : STATUS_INSUFFICIENT, PRIORITY_HIGH);
+                    return SYSTEM_WAIT_TIME;
+                }
+                atomic_store_explicit(&consumed->amount, amount - group->consume_amount, memory_order_relaxed);
+                tick_report_level(system, consumed, -group->consume_amount);
+            }
+            *phase = SYSTEM_PHASE_PROCESS;
+            return tick_wait(group->processing_time, manager->system_table.status[row], manager->system_table.pace[row]);
+        }
+    }
+
+    if (*phase == SYSTEM_PHASE_PROCESS) {
+        // Processing is done, the output is ready to store
+        *stored = (produced != NULL) ? *stored + group->produce_amount : 0;
+        *phase = SYSTEM_PHASE_STORE;
+    }
+
+    if (*stored > 0) {
+        // Store as much as fits, like resource_try_store
+        int amount = resource_get_amount(produced);
+        int space = produced->max_capacity - amount;
+        int add = (space >= *stored) ? *stored : ((space > 0) ? space : 0);
+
+        atomic_store_explicit(&produced->amount, amount + add, memory_order_relaxed);
+        tick_report_level(system, produced, add);
+        *stored -= add;
+        if (*stored != 0) {
+            tick_report(system, produced, STATUS_CAPACITY, PRIORITY_LOW);
+            return SYSTEM_WAIT_TIME;
+        }
+    }
+
+    *phase = SYSTEM_PHASE_CONVERT;
+    return 0;
+}
+
+/**
+ * Computes a processing time the way `system_adjusted_processing_time` does.
+ *
+ * @param[in] base    Processing time of the group in milliseconds.
+ * @param[in] status  Status of the member.
+ * @param[in] pace    Pace of the member, zero to follow the status.
+ * @return            Milliseconds the member processes for.
+ */
+static int tick_wait(int base, int status, int pace) {
+    if (pace > 0) {
+        return (int)((long long)base * 100 / pace);
+    }
+    return (status == SLOW) ? base * 2 : ((status == FAST) ? base / 2 : base);
+}
+
+/**
+ * Pushes the event `system_step` pushes when a step fails.
+ *
+ * @param[in] system    Pointer to the `System` the event is reported for.
+ * @param[in] resource  Pointer to the `Resource` in question.
+ * @param[in] status    `STATUS_*` of the failure.
+ * @param[in] priority  Priority of the event.
+ */
+static void tick_report(System *system, Resource *resource, int status, int priority) {
+    Event event;
+
+    event_init(&event, system, resource, status, priority, resource_get_amount(resource));
+    event_queue_push(system->event_queue, &event);
+}
+
+/**
+ * Reports a member's change to a resource that took it across one of its watermarks, like `system_report_level`.
+ *
+ * @param[in] system    Pointer to the `System` that changed the resource.
+ * @param[in] resource  Pointer to the changed `Resource`.
+ * @param[in] change    Units added, negative for units consumed.
+ */
+static void tick_report_level(System *system, Resource *resource, int change) {
+    int amount;
+
+    if (change == 0 || (resource->low_mark == 0 && resource->high_mark == 0)) {
+        return;
+    }
+    amount = resource_get_amount(resource);
+    if (change < 0 && amount < resource->low_mark && amount - change >= resource->low_mark) {
+        tick_report(system, resource, STATUS_LOW, PRIORITY_MED);
+    }
+    else if (change > 0 && resource->high_mark > 0 && amount > resource->high_mark && amount - change <= resource->high_mark) {
+        tick_report(system, resource, STATUS_HIGH, PRIORITY_MED);
+    }
+}
+
+/**
+ * Lets the manager handle every pending event.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ */
+static void tick_drain(Manager *manager) {
+    Event batch[MANAGER_BATCH_SIZE];
+    int events;
+
+    while ((events = event_queue_drain(&manager->event_queue, batch, MANAGER_BATCH_SIZE)) > 0) {
+        for (int i = 0; i < events; i++) {
+            manager_handle_event(manager, &batch[i]);
+        }
+    }
+}
+
+/**
+ * Finds the next member of a group that is due at `now`.
+ *
+ * @param[in] group  Pointer to the `TickGroup`.
+ * @param[in] from   Index of the first member to look at.
+ * @param[in] now    Current millisecond of the run.
+ * @return           Index of the member, `group->size` if there is none.
+ */
+static int tick_next_due(const TickGroup *group, int from, int now) {
+    while (from < group->size && group->due[from] != now) {
+        from++;
+    }
+    return from;
+}
+
+/**
+ * Orders two groups in the engine's heap by the row of the member at their cursor.
+ *
+ * @param[in] engine  Pointer to the `TickEngine`.
+ * @param[in] a       Index of the first group.
+ * @param[in] b       Index of the second group.
+ * @return            Non-zero if `a` steps before `b`.
+ */
+static int tick_heap_before(const TickEngine *engine, int a, int b) {
+    const TickGroup *x = &engine->groups[a];
+    const TickGroup *y = &engine->groups[b];
+
+    return x->rows[x->cursor] < y->rows[y->cursor];
+}
+
+/**
+ * Adds a group to the engine's heap.
+ *
+ * @param[in,out] engine  Pointer to the `TickEngine`.
+ * @param[in]     group   Index of the group to add.
+ */
+static void tick_heap_push(TickEngine *engine, int group) {
+    int i = engine->heap_count++;
+
+    // Sift the new entry up towards the root
+    while (i > 0 && tick_heap_before(engine, group, engine->heap[(i - 1) / 2])) {
+        engine->heap[i] = engine->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    engine->heap[i] = group;
+}
+
+/**
+ * Removes the group whose cursor member steps first from the engine's heap.
+ *
+ * @param[in,out] engine  Pointer to the `TickEngine`, its heap must not be empty.
+ * @return                Index of the group.
+ */
+static int tick_heap_pop(TickEngine *engine) {
+    int first = engine->heap[0];
+    int last = engine->heap[--engine->heap_count];
+    int i = 0, child;
+
+    // Sift the last entry down from the root
+    while ((child = 2 * i + 1) < engine->heap_count) {
+        if (child + 1 < engine->heap_count && tick_heap_before(engine, engine->heap[child + 1], engine->heap[child])) {
+            child++;
+        }
+        if (!tick_heap_before(engine, engine->heap[child], last)) {
+            break;
+        }
+        engine->heap[i] = engine->heap[child];
+        i = child;
+    }
+    if (engine->heap_count > 0) {
+        engine->heap[i] = last;
+    }
+    return first;
+}
+
+/**
+ * Orders members by group key, then by their place in the SystemArray.
+ *
+ * @param[in] a  Pointer to the first `TickMember`.
+ * @param[in] b  Pointer to the second `TickMember`.
+ * @return       Negative, zero or positive as for `qsort`.
+ */
+static int tick_member_compare(const void *a, const void *b) {
+    const TickMember *x = (const TickMember *)a;
+    const TickMember *y = (const TickMember *)b;
+
+    if (x->consumed != y->consumed) {
+        return (x->consumed < y->consumed) ? -1 : 1;
+    }
+    if (x->consume_amount != y->consume_amount) {
+        return (x->consume_amount < y->consume_amount) ? -1 : 1;
+    }
+    if (x->produced != y->produced) {
+        return (x->produced < y->produced) ? -1 : 1;
+    }
+    if (x->produce_amount != y->produce_amount) {
+        return (x->produce_amount < y->produce_amount) ? -1 : 1;
+    }
+    if (x->processing_time != y->processing_time) {
+        return (x->processing_time < y->processing_time) ? -1 : 1;
+    }
+    if (x->recipe != y->recipe) {
+        return x->recipe - y->recipe;
+    }
+    return (x->row < y->row) ? -1 : (x->row > y->row);
+}
+
+/**
+ * Tells whether two sorted members belong to the same group.
+ *
+ * @param[in] a  Pointer to the first `TickMember`.
+ * @param[in] b  Pointer to the second `TickMember`.
+ * @return       Non-zero if every field of their keys is equal.
+ */
+static int tick_same_group(const TickMember *a, const TickMember *b) {
+    return !a->recipe && !b->recipe && a->consumed == b->consumed && a->consume_amount == b->consume_amount && a->produced == b->produced
+           && a->produce_amount == b->produce_amount && a->processing_time == b->processing_time;
+}
+
+/**
+ * Orders groups by the SystemArray index of their first member.
+ *
+ * @param[in] a  Pointer to the first `TickGroup`.
+ * @param[in] b  Pointer to the second `TickGroup`.
+ * @return       Negative, zero or positive as for `qsort`.
+ */
+static int tick_group_compare(const void *a, const void *b) {
+    const TickGroup *x = (const TickGroup *)a;
+    const TickGroup *y = (const TickGroup *)b;
+
+    return (x->rows[0] < y->rows[0]) ? -1 : (x->rows[0] > y->rows[0]);
+}
@@ -0,0 +1,562 @@
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Helpers just used by the trace, static so they can't get linked into other files
+
+static long long trace_now(Trace *trace);
+static void trace_append(Trace *trace, const TraceRecord *record);
+static void trace_keep(Trace *trace, const TraceRecord *record);
+static void trace_flush(Trace *trace);
+static void trace_write(Trace *trace, const void *data, size_t size);
+static const TraceRecord *trace_check(Manager *manager, const char *path, const char *map, size_t size, long long *count);
+static void trace_compare(Trace *trace, const TraceRecord *records, long long count, long long *next, TraceReplay *result);
+
+/**
+ * Creates a trace of a loaded Manager and writes its header.
+ *
+ * A trace holds every call of `event_queue_push`, every status or pace the manager gives a
+ * system and the amounts its controller passes read, in the order they were made. Recording
+ * never allocates and never waits: records are claimed in a ring of `TRACE_RING` slots from
+ * any thread, the way an `EventRing` is, and the manager moves them to the file on its passes. Records that find the ring full are dropped
+ * and their number is recorded in their place. To record, point both `manager->trace` and
+ * `manager->event_queue.trace` at the trace.
+ *
+ * @param[out] trace          Pointer to the `Trace` to initialize.
+ * @param[in]  manager        Pointer to the loaded `Manager`.
+ * @param[in]  path           Path of the file to create, truncated if it exists; NULL to only take records with `trace_take`.
+ * @param[in]  virtual_clock  Non-zero to stamp records with the manager's virtual time, for single-threaded runs.
+ * @return                    Non-zero on success; zero otherwise (an error has been printed).
+ */
+int trace_open(Trace *trace, Manager *manager, const char *path, int virtual_clock) {
+    static const char padding[8] = {0};
+    TraceHeader header;
+    size_t names_size = 0;
+
+    memset(trace, 0, sizeof(*trace));
+    trace->manager = manager;
+    trace->fd = -1;
+    trace->virtual_clock = virtual_clock;
+    trace->start_ns = monotonic_now_ns();
+    atomic_init(&trace->enqueue_pos, 0);
+    atomic_init(&trace->dequeue_pos, 0);
+    atomic_init(&trace->lost, 0);
+
+    trace->cells = (TraceCell *)malloc(TRACE_RING * sizeof(TraceCell));
+    trace->buffer = (TraceRecord *)malloc(TRACE_BUFFER * sizeof(TraceRecord));
+    if (trace->cells == NULL || trace->buffer == NULL) {
+        perror("Failed to allocate memory for the trace");
+        free(trace->cells);
+        free(trace->buffer);
+        trace->cells = NULL;
+        trace->buffer = NULL;
+        return 0;
+    }
+    // A slot is free for the producer whose position equals its sequence
+    for (size_t i = 0; i < TRACE_RING; i++) {
+        atomic_init(&trace->cells[i].sequence, i);
+    }
+    if (path == NULL) {
+        return 1;
+    }
+
+    trace->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (trace->fd < 0) {
+        perror(path);
+        free(trace->cells);
+        free(trace->buffer);
+        trace->cells = NULL;
+        trace->buffer = NULL;
+        return 0;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.resource_count = manager->resource_array.size;
+    header.system_count = manager->system_array.size;
+    for (int i = 0; i < manager->resource_array.size; i++) {
+        names_size += strlen(manager->resource_array.resources[i]->name) + 1;
+    }
+    for (int i = 0; i < manager->system_array.size; i++) {
+        names_size += strlen(manager->system_array.systems[i]->name) + 1;
+    }
+    // Padded so the records stay 8-byte aligned when the file is mapped
+    header.names_size = (uint32_t)((names_size + 7) & ~(size_t)7);
+
+    trace_write(trace, &header, sizeof(header));
+    for (int i = 0; i < manager->resource_array.size; i++) {
+        trace_write(trace, manager->resource_array.resources[i]->name, strlen(manager->resource_array.resources[i]->name) + 1);
+    }
+    for (int i = 0; i < manager->system_array.size; i++) {
+        trace_write(trace, manager->system_array.systems[i]->name, strlen(manager->system_array.systems[i]->name) + 1);
+    }
+    trace_write(trace, padding, header.names_size - names_size);
+    return 1;
+}
+
+/**
+ * Writes out the remaining records and closes the trace.
+ *
+ * Nothing may record into the trace any more.
+ *
+ * @param[in,out] trace  Pointer to the open `Trace`.
+ */
+void trace_close(Trace *trace) {
+    if (trace->cells == NULL) {
+        return;
+    }
+    if (trace->fd >= 0) {
+        trace_poll(trace);
+        trace_flush(trace);
+        if (close(trace->fd) != 0 || trace->failed) {
+            fprintf(stderr, "Trace output is incomplete\n");
+        }
+        else if (trace->dropped > 0) {
+            fprintf(stderr, "Trace dropped %lld records, the manager fell behind\n", trace->dropped);
+        }
+    }
+    free(trace->cells);
+    free(trace->buffer);
+    trace->cells = NULL;
+    trace->buffer = NULL;
+    trace->fd = -1;
+}
+
+/**
+ * Records a call of `event_queue_push`, from any thread.
+ *
+ * @param[in,out] trace  Pointer to the `Trace`.
+ * @param[in]     event  Pointer to the `Event` being pushed.
+ */
+void trace_push(Trace *trace, const Event *event) {
+    TraceRecord record;
+
+    record.time_ns = trace_now(trace);
+    record.system = (event->system != NULL) ? event->system->id : -1;
+    record.resource = (event->resource != NULL) ? event->resource->id : -1;
+    record.amount = event->amount;
+    record.type = TRACE_PUSH;
+    record.status = (int8_t)event->status;
+    record.priority = (int8_t)event->priority;
+    record.reserved = 0;
+    trace_append(trace, &record);
+}
+
+/**
+ * Records a system being given a different status or pace by its manager.
+ *
+ * @param[in,out] trace   Pointer to the `Trace`.
+ * @param[in]     system  Pointer to the changed `System`.
+ * @param[in]     status  New status of the system.
+ * @param[in]     pace    New pace of the system.
+ */
+void trace_status(Trace *trace, const System *system, int status, int pace) {
+    TraceRecord record;
+
+    record.time_ns = trace_now(trace);
+    record.system = system->id;
+    record.resource = -1;
+    record.amount = pace;
+    record.type = TRACE_STATUS;
+    record.status = (int8_t)status;
+    record.priority = 0;
+    record.reserved = 0;
+    trace_append(trace, &record);
+}
+
+/**
+ * Records the amount of a resource as a controller pass reads it.
+ *
+ * @param[in,out] trace     Pointer to the `Trace`.
+ * @param[in]     resource  Pointer to the `Resource` read.
+ */
+void trace_level(Trace *trace, Resource *resource) {
+    TraceRecord record;
+
+    record.time_ns = trace_now(trace);
+    record.system = -1;
+    record.resource = resource->id;
+    record.amount = resource_get_amount(resource);
+    record.type = TRACE_LEVEL;
+    record.status = 0;
+    record.priority = 0;
+    record.reserved = 0;
+    trace_append(trace, &record);
+}
+
+/**
+ * Takes the oldest record from the ring, must only be called by the thread writing the trace.
+ *
+ * @param[in,out] trace   Pointer to the `Trace`.
+ * @param[out]    record  Pointer to the `TraceRecord` to fill.
+ * @return                Non-zero if a record was taken; zero if no published record is waiting.
+ */
+int trace_take(Trace *trace, TraceRecord *record) {
+    size_t pos = atomic_load_explicit(&trace->dequeue_pos, memory_order_relaxed);
+    TraceCell *cell = &trace->cells[pos & (TRACE_RING - 1)];
+
+    if (atomic_load_explicit(&cell->sequence, memory_order_acquire) != pos + 1) {
+        return 0;
+    }
+    *record = cell->record;
+    // Free the slot for the producer that wraps around to it
+    atomic_store_explicit(&cell->sequence, pos + TRACE_RING, memory_order_release);
+    atomic_store_explicit(&trace->dequeue_pos, pos + 1, memory_order_relaxed);
+    return 1;
+}
+
+/**
+ * Moves the waiting records to the file, writing when `TRACE_BUFFER` of them are collected.
+ *
+ * Called by the manager on every pass, and by a single-threaded run whenever the ring fills.
+ *
+ * @param[in,out] trace  Pointer to the `Trace`.
+ */
+void trace_poll(Trace *trace) {
+    TraceRecord record;
+    long lost;
+
+    if (trace->fd < 0) {
+        return;
+    }
+    if (atomic_load_explicit(&trace->lost, memory_order_relaxed) != 0) {
+        lost = atomic_exchange(&trace->lost, 0);
+        memset(&record, 0, sizeof(record));
+        record.time_ns = trace_now(trace);
+        record.system = record.resource = -1;
+        record.amount = (int32_t)lost;
+        record.type = TRACE_LOST;
+        trace->dropped += lost;
+        trace_keep(trace, &record);
+    }
+    while (trace_take(trace, &record)) {
+        trace_keep(trace, &record);
+    }
+}
+
+/**
+ * Replays a trace into a loaded Manager at full speed, without any system threads.
+ *
+ * Every recorded push is pushed again and handled at once, the way a virtual run handles the
+ * events of a step: the virtual clock is set to the time of the push and the reported resource
+ * takes the reported amount, since it is all the manager can know of it. A recorded controller
+ * pass is made again at its time on the amounts it read; one that comes due between them, as
+ * when the trace was recorded with another policy, is made at the next push. Replaying stops
+ * when the manager terminates the simulation. The status changes the replay makes are
+ * compared, in order, with the recorded ones. A trace of a virtual run replayed with the policy
+ * it was recorded with makes the same changes. One of a real-time run may not: its queue merges
+ * and reorders events, its manager reads amounts that changed after they were reported, and
+ * partitions make passes of their own.
+ *
+ * The Manager must hold the scenario the trace was recorded from and be configured like the
+ * recording run. Its virtual clock and statuses are changed.
+ *
+ * @param[in,out] manager  Pointer to the loaded `Manager`.
+ * @param[in]     path     Path of the trace.
+ * @param[in,out] record   Pointer to a `Trace` opened on the virtual clock to record the replay into, or NULL.
+ * @param[out]    result   Pointer to the `TraceReplay` to fill.
+ * @return                 Non-zero if the trace was replayed; zero if it could not be read (an error has been printed).
+ */
+int trace_replay(Manager *manager, const char *path, Trace *record, TraceReplay *result) {
+    Event batch[MANAGER_BATCH_SIZE];
+    Trace local;
+    Trace *changes = record;
+    Trace *saved_trace = manager->trace, *saved_queue_trace = manager->event_queue.trace;
+    const TraceRecord *records;
+    struct stat info;
+    long long count, next = 0, pass_end = 0, start;
+    char *map;
+    int fd, events;
+
+    memset(result, 0, sizeof(*result));
+    result->difference = -1;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 0;
+    }
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(TraceHeader)) {
+        fprintf(stderr, "%s: truncated trace\n", path);
+        close(fd);
+        return 0;
+    }
+    map = (char *)mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Failed to map the trace");
+        return 0;
+    }
+    records = trace_check(manager, path, map, (size_t)info.st_size, &count);
+    if (records == NULL || (changes == NULL && !trace_open(&local, manager, NULL, 1))) {
+        munmap(map, (size_t)info.st_size);
+        return 0;
+    }
+    if (changes == NULL) {
+        changes = &local;
+    }
+    for (long long i = 0; i < count; i++) {
+        result->recorded_changes += (records[i].type == TRACE_STATUS);
+        result->lost += (records[i].type == TRACE_LOST) ? records[i].amount : 0;
+    }
+
+    // The replay's own status changes go to the ring to be compared, and its pushes only when recorded
+    manager->trace = changes;
+    manager->event_queue.trace = record;
+    start = monotonic_now_ns();
+    for (long long i = 0; i < count && atomic_load(&manager->simulation_running) != 0; i++) {
+        const TraceRecord *entry = &records[i];
+        Resource *resource;
+        System *system;
+        Event event;
+
+        if (entry->type == TRACE_LEVEL && i >= pass_end) {
+            // A pass's reads are mixed with the changes it made, every amount is restored before it is made again
+            for (pass_end = i; pass_end < count && records[pass_end].time_ns == entry->time_ns
+                               && (records[pass_end].type == TRACE_LEVEL || records[pass_end].type == TRACE_STATUS); pass_end++) {
+                const TraceRecord *level = &records[pass_end];
+                if (level->type == TRACE_LEVEL && level->resource >= 0 && level->resource < manager->resource_array.size) {
+                    atomic_store_explicit(&manager->resource_array.resources[level->resource]->amount, level->amount, memory_order_relaxed);
+                }
+            }
+            manager->virtual_time = entry->time_ns;
+            controller_update(manager, manager->virtual_time);
+            trace_compare(changes, records, count, &next, result);
+            continue;
+        }
+        if (entry->type != TRACE_PUSH) {
+            continue;
+        }
+        if (entry->system < 0 || entry->system >= manager->system_array.size
+            || entry->resource < 0 || entry->resource >= manager->resource_array.size) {
+            result->skipped++;
+            continue;
+        }
+        system = manager->system_array.systems[entry->system];
+        resource = manager->resource_array.resources[entry->resource];
+
+        manager->virtual_time = entry->time_ns;
+        controller_update(manager, manager->virtual_time);
+        atomic_store_explicit(&resource->amount, entry->amount, memory_order_relaxed);
+        event_init(&event, system, resource, entry->status, entry->priority, entry->amount);
+        event_queue_push(&manager->event_queue, &event);
+        while ((events = event_queue_drain(&manager->event_queue, batch, MANAGER_BATCH_SIZE)) > 0) {
+            for (int j = 0; j < events; j++) {
+                manager_handle_event(manager, &batch[j]);
+            }
+        }
+        result->events++;
+        trace_compare(changes, records, count, &next, result);
+    }
+    result->wall_ns = monotonic_now_ns() - start;
+
+    // A recorded change the replay never made is the first difference
+    if (result->difference < 0 && result->replayed_changes < result->recorded_changes) {
+        while (records[next].type != TRACE_STATUS) {
+            next++;
+        }
+        result->difference = result->replayed_changes;
+        result->recorded = records[next];
+    }
+
+    manager->trace = saved_trace;
+    manager->event_queue.trace = saved_queue_trace;
+    if (changes == &local) {
+        trace_close(&local);
+    }
+    munmap(map, (size_t)info.st_size);
+    return 1;
+}
+
+/**
+ * Reads the clock records are stamped with.
+ *
+ * @param[in] trace  Pointer to the `Trace`.
+ * @return           Nanoseconds since the start of the run, virtual or real.
+ */
+static long long trace_now(Trace *trace) {
+    return trace->virtual_clock ? trace->manager->virtual_time : monotonic_now_ns() - trace->start_ns;
+}
+
+/**
+ * Adds a record to the ring without taking a lock.
+ *
+ * Producers claim a position with compare-and-swap, write the slot, then publish it by
+ * advancing the slot's sequence, as in `event_ring_push`. In a multi-threaded run a record that
+ * finds the ring full is counted as lost; a single-threaded run writes the ring out first, as
+ * nobody else would.
+ *
+ * @param[in,out] trace   Pointer to the `Trace`.
+ * @param[in]     record  Pointer to the `TraceRecord` to add.
+ */
+static void trace_append(Trace *trace, const TraceRecord *record) {
+    TraceCell *cell;
+    size_t pos, sequence;
+    ptrdiff_t diff;
+
+    pos = atomic_load_explicit(&trace->enqueue_pos, memory_order_relaxed);
+    for (;;) {
+        cell = &trace->cells[pos & (TRACE_RING - 1)];
+        sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        diff = (ptrdiff_t)sequence - (ptrdiff_t)pos;
+
+        if (diff == 0) {
+            // The slot is free, try to claim this position
+            if (atomic_compare_exchange_weak_explicit(&trace->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (diff < 0 && trace->virtual_clock && trace->fd >= 0) {
+            trace_poll(trace);
+        }
+        else if (diff < 0) {
+            // The writer has not taken this slot yet, the ring is full
+            atomic_fetch_add(&trace->lost, 1);
+            return;
+        }
+        else {
+            // Another producer claimed the position first
+            pos = atomic_load_explicit(&trace->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    cell->record = *record;
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+}
+
+/**
+ * Adds a record taken from the ring to the buffer, writing the buffer out when it is full.
+ *
+ * @param[in,out] trace   Pointer to the `Trace`.
+ * @param[in]     record  Pointer to the `TraceRecord`.
+ */
+static void trace_keep(Trace *trace, const TraceRecord *record) {
+    if (trace->used == TRACE_BUFFER) {
+        trace_flush(trace);
+    }
+    trace->buffer[trace->used++] = *record;
+}
+
+/**
+ * Writes the buffered records to the file.
+ *
+ * @param[in,out] trace  Pointer to the `Trace`.
+ */
+static void trace_flush(Trace *trace) {
+    trace_write(trace, trace->buffer, (size_t)trace->used * sizeof(TraceRecord));
+    trace->used = 0;
+}
+
+/**
+ * Writes bytes to the trace file, giving up on the file once a write fails.
+ *
+ * @param[in,out] trace  Pointer to the `Trace`.
+ * @param[in]     data   Bytes to write.
+ * @param[in]     size   Number of bytes.
+ */
+static void trace_write(Trace *trace, const void *data, size_t size) {
+    size_t written = 0;
+
+    while (written < size && !trace->failed) {
+        ssize_t result = write(trace->fd, (const char *)data + written, size - written);
+        if (result < 0) {
+            if (errno != EINTR) {
+                perror("Failed to write the trace");
+                trace->failed = 1;
+            }
+            continue;
+        }
+        written += (size_t)result;
+    }
+}
+
+/**
+ * Checks that a mapped trace is whole and was recorded from the Manager's scenario.
+ *
+ * @param[in]  manager  Pointer to the loaded `Manager`.
+ * @param[in]  path     Path of the trace, for the errors.
+ * @param[in]  map      The mapped trace.
+ * @param[in]  size     Bytes in the trace.
+ * @param[out] count    Number of records.
+ * @return              The first record, or NULL if the trace cannot be replayed (an error has been printed).
+ */
+static const TraceRecord *trace_check(Manager *manager, const char *path, const char *map, size_t size, long long *count) {
+    const TraceHeader *header = (const TraceHeader *)map;
+    const char *name = map + sizeof(TraceHeader);
+    size_t names_end;
+
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0 || header->version != TRACE_VERSION) {
+        fprintf(stderr, "%s: not a trace of this version of the simulator\n", path);
+        return NULL;
+    }
+    names_end = sizeof(TraceHeader) + header->names_size;
+    if (names_end > size || header->names_size % 8 != 0 || (header->names_size > 0 && map[names_end - 1] != '\0')) {
+        fprintf(stderr, "%s: corrupt trace\n", path);
+        return NULL;
+    }
+    if (header->resource_count != (uint32_t)manager->resource_array.size || header->system_count != (uint32_t)manager->system_array.size) {
+        fprintf(stderr, "%s: recorded with %u resources and %u systems, the scenario has %d and %d\n",
+                path, header->resource_count, header->system_count, manager->resource_array.size, manager->system_array.size);
+        return NULL;
+    }
+    for (int i = 0; i < manager->resource_array.size + manager->system_array.size; i++) {
+        const char *expected = (i < manager->resource_array.size) ? manager->resource_array.resources[i]->name
+                                                                  : manager->system_array.systems[i - manager->resource_array.size]->name;
+        if ((size_t)(name - map) >= names_end || strcmp(name, expected) != 0) {
+            fprintf(stderr, "%s: recorded from a different scenario (%s where it has %s)\n",
+                    path, ((size_t)(name - map) < names_end) ? name : "nothing", expected);
+            return NULL;
+        }
+        name += strlen(name) + 1;
+    }
+    if ((size - names_end) % sizeof(TraceRecord) != 0) {
+        fprintf(stderr, "%s: trace ends in the middle of a record, replaying the whole ones\n", path);
+    }
+    *count = (long long)((size - names_end) / sizeof(TraceRecord));
+    return (const TraceRecord *)(map + names_end);
+}
+
+/**
+ * Compares the status changes a replay has just made with the recorded ones, in order.
+ *
+ * Takes every record of the replay from the ring, passing it on to the replay's file if it has one.
+ *
+ * @param[in,out] trace    Pointer to the `Trace` the replay records into.
+ * @param[in]     records  The recorded trace.
+ * @param[in]     count    Number of records in the trace.
+ * @param[in,out] next     Index of the first record after the last recorded change compared.
+ * @param[in,out] result   Pointer to the `TraceReplay` being filled.
+ */
+static void trace_compare(Trace *trace, const TraceRecord *records, long long count, long long *next, TraceReplay *result) {
+    TraceRecord record;
+
+    while (trace_take(trace, &record)) {
+        if (trace->fd >= 0) {
+            trace_keep(trace, &record);
+        }
+        if (record.type != TRACE_STATUS) {
+            continue;
+        }
+        while (*next < count && records[*next].type != TRACE_STATUS) {
+            (*next)++;
+        }
+        if (result->difference < 0 && (*next == count || records[*next].system != record.system
+                                       || records[*next].status != record.status || records[*next].amount != record.amount)) {
+            result->difference = result->replayed_changes;
+            result->replayed = record;
+            if (*next < count) {
+                result->recorded = records[*next];
+            }
+        }
+        *next += (*next < count);
+        result->replayed_changes++;
+    }
+}